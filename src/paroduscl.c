@@ -16,6 +16,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -23,9 +24,25 @@
 #include <string.h>
 #include <strings.h>
 #include <semaphore.h>
-#include <nanomsg/nn.h>
-#include <nanomsg/pipeline.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "paroduscl.h"
+#include "paroduscl_msgpack.h"
+#include "paroduscl_queue.h"
+#include "paroduscl_dispatch.h"
+#include "paroduscl_request.h"
+#include "paroduscl_route.h"
+#include "paroduscl_loop.h"
+#include "paroduscl_stats.h"
+#include "paroduscl_transport.h"
+#include "paroduscl_arena.h"
+#include "paroduscl_cache.h"
+#include "paroduscl_capture.h"
+#include "paroduscl_trace.h"
 #ifdef USE_RDKX_LOGGER
 #include "rdkx_logger.h"
 #else
@@ -33,47 +50,258 @@
 #endif
 
 #define PCL_SERVICE_NAME_LEN_MAX (64)
+#define PCL_SERVICE_HASH_SIZE    (2 * PCL_SERVICE_QTY_MAX) // power of two
 #define PCL_URL_LEN_MAX          (256)
 
 #define PCL_SERVICE_NAME_DEFAULT "iot"
 #define PCL_URL_CLIENT_DEFAULT   "tcp://127.0.0.1:6667"
 #define PCL_RECV_TIMEOUT_DEFAULT (2)
 #define PCL_SEND_TIMEOUT_DEFAULT (2)
+#define PCL_RECV_BATCH_MAX       (64)
+#define PCL_DISPATCH_SHARDS_PER_WORKER (4)
+#define PCL_ARENA_IDLE_MAX       (8)
+#define PCL_SEND_LANE_WEIGHT_DEFAULT { 8, 4, 1 }
+#define PCL_IDEMPOTENCY_ENTRIES_DEFAULT (1024)
+#define PCL_IDEMPOTENCY_MEM_DEFAULT     (1024 * 1024)
+#define PCL_RETRIEVE_CACHE_ENTRIES      (256)
+#define PCL_RETRIEVE_CACHE_MEM_DEFAULT  (256 * 1024)
+#define PCL_RETRIEVE_PENDING_MEM        (64 * 1024)
+#define PCL_STREAM_CHUNK_SIZE_DEFAULT   (64 * 1024)
+#define PCL_STREAM_TIMEOUT_DEFAULT      (30000)
+#define PCL_STREAM_QTY_MAX              (64)       // received streams in progress at once
+#define PCL_STREAM_MEM_MAX              (64 * 1024)
+#define PCL_STREAM_HEADER_LEN_MAX       (64)
+#define PCL_TRACE_SAMPLE_DEFAULT        (100)
+#define PCL_REGISTER_BACKOFF_MIN_MS (50)
+#define PCL_REGISTER_BACKOFF_MAX_MS (5000)
+#define PCL_REGISTER_AUTH_WAIT_MS   (2000) // registration is sent again when no AUTH 200 arrives in time
 
-#define PCL_MUTEX_LOCK()   sem_wait(&obj->semaphore)
-#define PCL_MUTEX_UNLOCK() sem_post(&obj->semaphore)
+#define PCL_RECV_LOCK()    sem_wait(&obj->recv_lock)
+#define PCL_RECV_UNLOCK()  sem_post(&obj->recv_lock)
 
 typedef struct {
-   int sock;
-   int fd;
-   int timeout;
-} pcl_sock_t;
+   char     name[PCL_SERVICE_NAME_LEN_MAX];
+   uint32_t name_len;
+   uint32_t hash;
+   bool     authorized;
+   int      auth_status;
+   pcl_msg_handler_req_t   handler_request;
+   pcl_msg_handler_event_t handler_event;
+   pcl_msg_handler_crud_t  handler_create;
+   pcl_msg_handler_crud_t  handler_retrieve;
+   pcl_msg_handler_crud_t  handler_update;
+   pcl_msg_handler_crud_t  handler_delete;
+   pcl_msg_handler_view_t  handler_view;
+   pcl_route_table_t *     routes;
+} pcl_service_t;
+
+// Calls using one side of the object.  active starts with a reference held by the object itself, which pcl_term drops when it
+// closes the side, so the call that brings it to zero is the only one to post quiesce and nothing touches the side afterwards.
+typedef struct {
+   atomic_uint active;
+   atomic_bool closing;
+   sem_t       quiesce;
+} pcl_side_t;
 
 typedef struct {
-   sem_t semaphore;
-   bool  authorized;
+   sem_t recv_lock;  // keeps receiving threads from interleaving messages, sending does not lock
+   atomic_bool authorized; // written under service_lock, read by senders without locking
+   bool  send_zero_copy;
+   bool  view_mode;
    int   auth_status;
-   int   service_name_len;
-   char  service_name[PCL_SERVICE_NAME_LEN_MAX];
    char  url_parodus[PCL_URL_LEN_MAX];
    char  url_client[PCL_URL_LEN_MAX];
    
    pcl_sock_t        recv;
    pcl_sock_t        send;
-   pcl_msg_handler_req_t   handler_request;
-   pcl_msg_handler_event_t handler_event;
-   pcl_msg_handler_crud_t  handler_create;
-   pcl_msg_handler_crud_t  handler_retrieve;
-   pcl_msg_handler_crud_t  handler_update;
-   pcl_msg_handler_crud_t  handler_delete;
    pcl_msg_handler_alive_t handler_alive;
+
+   pcl_service_t             services[PCL_SERVICE_QTY_MAX];    // services[0] is named in pcl_params_t
+   uint32_t                  service_qty;
+   _Atomic(pcl_service_t *)  service_hash[PCL_SERVICE_HASH_SIZE]; // open addressing on the service name hash, read without locking
+   sem_t                     service_lock;                      // serializes adding services, creating the loop and auth accounting
+   uint32_t                  auth_pending[PCL_SERVICE_QTY_MAX]; // services waiting for an AUTH, in registration order
+   uint32_t                  auth_pending_qty;
+
+   sem_t                   send_flush;         // held by the thread writing the send queue to the socket
+   pcl_queue_t             send_queue[PCL_SEND_LANE_QTY]; // all created when asynchronous send is enabled
+   uint32_t                send_lane_weight[PCL_SEND_LANE_QTY];
+   uint32_t                send_lane;          // lane being drained by pcl_send_flush
+   uint32_t                send_lane_credit;   // messages it may still write this round
+   pcl_send_overflow_t     send_overflow;
+   pcl_send_complete_t     send_complete;
+   pcl_queue_item_t        send_pending;       // popped message waiting for the socket to become writable
+   bool                    send_pending_valid;
+
+   pcl_dispatch_t *        dispatch;           // worker pool running handlers, NULL to run them on the receive thread
+   atomic_uint             dispatch_pending;   // messages pushed to the workers whose dispatch has not returned
+   pcl_request_table_t *   requests;           // outstanding pcl_send_request_async requests
+   pcl_arena_pool_t *      arena_pool;         // arenas for decoded messages, NULL to decode with wrp_to_struct
+   pcl_cache_t *           idempotency;        // recently received request uuids and the responses sent to them, NULL when disabled
+   uint32_t                idempotency_window_ms;
+   pcl_cache_t *           retrieve_cache;     // RETRIEVE responses keyed by service name and dest path, NULL when disabled
+   pcl_cache_t *           retrieve_pending;   // transaction_uuid of each RETRIEVE being handled to the generation and key it was received with
+   uint32_t                retrieve_ttl_ms;
+   atomic_uint             retrieve_generation; // advanced by every invalidation so responses built before it are not cached
+   uint32_t                stream_chunk_size;
+   atomic_uint             stream_next;        // id of the next stream sent
+   pcl_stream_handler_t    handler_stream;
+   pcl_cache_t *           streams;            // received streams keyed by source and stream id, NULL without handler_stream
+   uint32_t                stream_timeout_ms;
+
+   // Admission control for received messages
+   atomic_uint             recv_backlog;       // decoded or queued and not yet dispatched
+   bool                    shed_deadline;      // any deadline set, messages are then timestamped and decoded at dispatch
+   uint64_t                shed_deadline_ns[PCL_BATCH_MSG_TYPE_MAX];
+   uint32_t                shed_backlog_max;
+   bool                    shed_reject;
+   pcl_shed_handler_t      handler_shed;
+   atomic_bool             shedding;
+   pcl_capture_t *         capture;            // raw frames are logged here, NULL when not capturing
+   pcl_trace_t *           trace;              // spans of sampled messages are recorded here, NULL when not tracing
+
+   _Atomic(pcl_loop_t *)   loop;               // created by the first pcl_run_once, pcl_fd_add or pcl_timer_add
+   int                     loop_wake_fd;       // eventfd interrupting the loop wait
+   atomic_bool             loop_wake_pending;
+   atomic_bool             loop_stop;
+   bool                    loop_recv_ready;    // fd_recv signalled and not yet drained
+   bool                    loop_send_ready;    // fd_send signalled or messages queued since the last flush
+
+   pcl_stats_live_t        stats;
+   uint64_t                init_ns;            // pcl_init start time
+   atomic_uint_fast64_t    authorized_ns;      // time of the first AUTH 200 for the primary service, 0 until then
+   pcl_ready_handler_t     handler_ready;
+
+   // Background registration for init_async and supervision of the connection to parodus
+   pthread_t               supervise_thread;
+   bool                    supervise_thread_valid;
+   bool                    supervise_stop;
+   bool                    supervise_wake;
+   pthread_mutex_t         supervise_lock;
+   pthread_cond_t          supervise_cond;     // signalled by pcl_supervise_wake and pcl_term
+   uint32_t                alive_timeout_ms;   // 0 when not supervising
+   atomic_uint_fast64_t    alive_ns;           // last SVC_ALIVE, or the last authorization
+   atomic_uint_fast64_t    register_ns;        // last registration sent
+   pcl_queue_t             replay;             // pcl_send messages held while parodus is lost
+
+   // pcl_term closes one side at a time and waits for the calls already using it to return
+   pcl_side_t              recv_side;
+   pcl_side_t              send_side;
 } pcl_obj_t;
 
+typedef struct {
+   pcl_obj_t *       obj;
+   enum wrp_msg_type msg_type;
+   size_t            head_len;
+   uint8_t           head[];   // msgpack encoding of the invariant fields
+} pcl_template_obj_t;
+
+typedef struct {
+   char *       buf;    // raw message, only kept when dispatching zero-copy views
+   int          len;
+   wrp_msg_t *  wrp;    // decoded message
+   pcl_arena_t *arena;  // holds wrp when it was decoded into an arena
+   uint64_t     recv_ns; // drained from the socket, 0 when no shed deadline is set
+   pcl_trace_ctx_t trace;
+} pcl_recv_msg_t;
+
+typedef struct {
+   pcl_dispatch_node_t node; // must be first
+   pcl_recv_msg_t      msg;
+} pcl_dispatch_msg_t;
+
+typedef struct {
+   uint32_t seq;     // next chunk expected
+   uint64_t offset;  // payload bytes received so far
+} pcl_stream_state_t;
+
+typedef struct {
+   atomic_uint refs;
+} pcl_view_ref_t;
+
+typedef struct {
+   void *                 msg_buf;
+   const pcl_transport_t *transport; // frees msg_buf
+   pcl_view_ref_t *       ref;       // allocated on first retain
+} pcl_view_owner_t;
+
+typedef struct {
+   pcl_msg_view_t   view;    // must be first
+   pcl_view_owner_t owner;
+} pcl_view_retained_t;
+
 
 static void         pcl_obj_destroy(pcl_obj_t **obj, int *errsv);
-static pcl_result_t pcl_register(pcl_obj_t *obj, int *errsv);
-static pcl_result_t pcl_sock_send_wrp(pcl_obj_t *obj, wrp_msg_t *msg, int *errsv);
-static bool         pcl_service_name_match(pcl_obj_t *obj, const char *dest);
+static void         pcl_side_init(pcl_side_t *side);
+static bool         pcl_side_enter(pcl_side_t *side);
+static void         pcl_side_leave(pcl_side_t *side);
+static void         pcl_side_close(pcl_obj_t *obj, pcl_side_t *side, pcl_sock_t *sock);
+static pcl_result_t pcl_register(pcl_obj_t *obj, pcl_service_t *service, int flags, int *errsv);
+static pcl_result_t pcl_register_all(pcl_obj_t *obj, int *errsv);
+static uint32_t     pcl_register_backoff(uint32_t *backoff_ms, unsigned int *seed);
+static void *       pcl_supervise_thread(void *data);
+static void         pcl_supervise_lost(pcl_obj_t *obj, const char *reason);
+static void         pcl_supervise_wake(pcl_obj_t *obj);
+static pcl_result_t pcl_replay_push(pcl_obj_t *obj, wrp_msg_t *msg, int *errsv);
+static void         pcl_replay_flush(pcl_obj_t *obj);
+static pcl_service_t *pcl_service_insert(pcl_obj_t *obj, const char *name, pcl_result_t *result);
+static pcl_service_t *pcl_service_lookup(pcl_obj_t *obj, const char *name, size_t name_len);
+static void         pcl_service_publish(pcl_obj_t *obj, pcl_service_t *service);
+static pcl_service_t *pcl_service_find(pcl_obj_t *obj, const char *dest, size_t dest_len, const char **path);
+static void         pcl_auth_pending_remove(pcl_obj_t *obj, uint32_t index);
+static pcl_result_t pcl_sock_send_wrp(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv);
+static pcl_result_t pcl_sock_send_wrp_copy(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv);
+static pcl_result_t pcl_sock_send_wrp_zero_copy(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv);
+static pcl_result_t pcl_send_result(pcl_obj_t *obj, int msg_type, int ret, size_t msg_len, uint64_t start, int errsv);
+static pcl_result_t pcl_wrp_encode_msg(pcl_obj_t *obj, wrp_msg_t *msg, void **msg_bytes, size_t *msg_len, int *errsv);
+static pcl_result_t pcl_send_queue_push(pcl_obj_t *obj, wrp_msg_t *msg, uint32_t lane, void *ctx, int *errsv);
+static bool         pcl_send_queue_pop(pcl_obj_t *obj, pcl_queue_item_t *item);
+static uint32_t     pcl_send_lane_default(int msg_type);
+static void         pcl_send_complete(pcl_obj_t *obj, pcl_queue_item_t *item, pcl_result_t result);
+static void         pcl_send_queue_abort(pcl_obj_t *obj);
+static bool         pcl_route_dispatch(pcl_service_t *service, enum wrp_msg_type msg_type, const char *path, size_t path_len, wrp_msg_t *msg, const pcl_msg_view_t *view, pcl_result_t *result);
+static pcl_result_t pcl_recv_msg(pcl_obj_t *obj, int *errsv);
+static pcl_result_t pcl_recv_frame(pcl_obj_t *obj, char *msg_buf, int msg_len, pcl_trace_ctx_t *trace);
+static void         pcl_recv_trace(pcl_obj_t *obj, const char *msg_buf, int msg_len, uint64_t start, pcl_trace_ctx_t *trace);
+static pcl_result_t pcl_recv_decode(pcl_obj_t *obj, char *msg_buf, int msg_len, const pcl_trace_ctx_t *trace, pcl_recv_msg_t *msg, pcl_arena_t **arena);
+static pcl_result_t pcl_recv_decode_wrp(pcl_obj_t *obj, char *msg_buf, int msg_len, pcl_recv_msg_t *msg, pcl_arena_t **arena);
+static bool         pcl_recv_expired(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type, pcl_result_t *result);
+static void         pcl_recv_shed(pcl_obj_t *obj, const pcl_wrp_peek_t *peek, uint64_t age_ns);
+static void         pcl_recv_forget(pcl_obj_t *obj, const char *uuid, size_t uuid_len);
+static void         pcl_shed_state(pcl_obj_t *obj, bool shedding, uint64_t age_ns);
+static size_t       pcl_shed_reply(const pcl_wrp_peek_t *peek, void *buf, size_t size);
+static void         pcl_send_reply(pcl_obj_t *obj, int msg_type, void *msg_bytes, size_t msg_len);
+static void         pcl_recv_msg_free(pcl_recv_msg_t *msg);
+static pcl_result_t pcl_recv_dispatch(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type);
+static pcl_result_t pcl_recv_dispatch_inline(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type);
+static bool         pcl_recv_filter(pcl_obj_t *obj, char *msg_buf, int msg_len, enum wrp_msg_type *msg_type, pcl_result_t *result);
+static bool         pcl_service_handler_default(pcl_obj_t *obj, pcl_service_t *service, enum wrp_msg_type msg_type);
+static bool         pcl_recv_duplicate(pcl_obj_t *obj, const pcl_wrp_peek_t *peek);
+static bool         pcl_recv_cached(pcl_obj_t *obj, const pcl_wrp_peek_t *peek, bool chunk);
+static bool         pcl_retrieve_cache_key(pcl_obj_t *obj, const char *dest, size_t dest_len, const char **key, size_t *key_len);
+static size_t       pcl_retrieve_cache_reply(const pcl_wrp_peek_t *peek, const uint8_t *value, size_t value_len, void *buf, size_t size);
+static void         pcl_retrieve_cache_record(pcl_obj_t *obj, const wrp_msg_t *msg, const void *msg_bytes, size_t msg_len);
+static ssize_t      pcl_stream_fill(pcl_stream_reader_t reader, void *ctx, uint8_t *buf, size_t len, size_t size);
+static bool         pcl_stream_dispatch(pcl_obj_t *obj, wrp_msg_t *msg, const pcl_msg_view_t *view, pcl_result_t *result);
+static bool         pcl_stream_header_parse(const char *header, size_t header_len, pcl_stream_chunk_t *chunk);
+static bool         pcl_stream_msg_is_chunk(const wrp_msg_t *msg);
+static void         pcl_idempotency_record(pcl_obj_t *obj, int msg_type, const char *uuid, const void *msg_bytes, size_t msg_len);
+static const char * pcl_wrp_msg_uuid(const wrp_msg_t *msg);
+static bool         pcl_recv_msg_key(pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type, const char **key, size_t *key_len);
+static void         pcl_dispatch_run(void *ctx, pcl_dispatch_node_t *node);
+static pcl_result_t pcl_msg_dispatch(pcl_obj_t *obj, wrp_msg_t *msg_wrp, pcl_trace_ctx_t *trace);
+static pcl_result_t pcl_msg_dispatch_view(pcl_obj_t *obj, const pcl_msg_view_t *view, pcl_trace_ctx_t *trace);
+static void         pcl_view_unref(pcl_view_owner_t *owner);
+static bool         pcl_response_match(pcl_obj_t *obj, const char *uuid, size_t uuid_len, wrp_msg_t *msg, const pcl_msg_view_t *view);
+static pcl_result_t pcl_recv_drain(pcl_obj_t *obj, uint32_t max_msgs, uint32_t budget_us, pcl_batch_result_t *batch, uint32_t *drained, int *errsv);
+static pcl_result_t pcl_run_step(pcl_obj_t *obj, int timeout_ms, int *errsv);
+static pcl_loop_t * pcl_loop_get(pcl_obj_t *obj, pcl_result_t *result, int *errsv);
+static void         pcl_loop_notify(pcl_obj_t *obj);
+static void         pcl_loop_recv_ready(void *ctx, int fd, uint32_t events);
+static void         pcl_loop_send_ready(void *ctx, int fd, uint32_t events);
+static void         pcl_loop_wake(void *ctx, int fd, uint32_t events);
+static uint64_t     pcl_time_us(void);
+static int          pcl_timeout_ms(const int *timeout_ms, const int *timeout_sec, int timeout_default);
 static pcl_result_t pcl_msg_handler_auth(pcl_obj_t *obj, struct wrp_auth_msg *msg);
 static pcl_result_t pcl_msg_handler_request(struct wrp_req_msg *msg);
 static pcl_result_t pcl_msg_handler_event(struct wrp_event_msg *msg);
@@ -83,6 +311,7 @@ static pcl_result_t pcl_msg_handler_update(struct wrp_crud_msg *msg);
 static pcl_result_t pcl_msg_handler_delete(struct wrp_crud_msg *msg);
 static pcl_result_t pcl_msg_handler_register(pcl_obj_t *obj, struct wrp_svc_registration_msg *msg);
 static pcl_result_t pcl_msg_handler_alive(void);
+static pcl_result_t pcl_msg_handler_view(const pcl_msg_view_t *msg);
 
 pcl_result_t pcl_init(pcl_object_t *object, int *fd_recv, int *fd_send, int *errsv, pcl_params_t *params) {
    if(object == NULL) {
@@ -101,98 +330,195 @@ pcl_result_t pcl_init(pcl_object_t *object, int *fd_recv, int *fd_send, int *err
    }
    bzero(obj, sizeof(*obj));
 
-   sem_init(&obj->semaphore, 0, 1);
+   sem_init(&obj->recv_lock, 0, 1);
+   pcl_side_init(&obj->recv_side);
+   pcl_side_init(&obj->send_side);
+   sem_init(&obj->send_flush, 0, 1);
+   sem_init(&obj->service_lock, 0, 1);
+   pthread_condattr_t condattr;
+   pthread_condattr_init(&condattr);
+   pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+   pthread_mutex_init(&obj->supervise_lock, NULL);
+   pthread_cond_init(&obj->supervise_cond, &condattr);
+   pthread_condattr_destroy(&condattr);
+   obj->init_ns     = pcl_stats_time_ns();
    obj->authorized  = false;
    obj->auth_status = -1;
    obj->recv.sock   = -1;
    obj->send.sock   = -1;
    obj->recv.fd     = -1;
    obj->send.fd     = -1;
+   obj->loop_wake_fd = -1;
+   obj->stream_chunk_size = PCL_STREAM_CHUNK_SIZE_DEFAULT;
+   atomic_init(&obj->stream_next, (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16)); // ids differ between runs of the sender
+
+   obj->requests = pcl_request_table_create();
+   if(obj->requests == NULL) {
+      pcl_obj_destroy(&obj, NULL);
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   pcl_result_t   result;
+   pcl_service_t *service = pcl_service_insert(obj, (params && params->service_name) ? params->service_name : PCL_SERVICE_NAME_DEFAULT, &result);
+   if(service == NULL) {
+      pcl_obj_destroy(&obj, NULL);
+      return(result);
+   }
    if(params == NULL) { // use defaults
-      snprintf(obj->service_name, PCL_SERVICE_NAME_LEN_MAX, "%s", PCL_SERVICE_NAME_DEFAULT);
       snprintf(obj->url_parodus,  PCL_URL_LEN_MAX,          "%s", PCL_URL_PARODUS_DEFAULT);
       snprintf(obj->url_client,   PCL_URL_LEN_MAX,          "%s", PCL_URL_CLIENT_DEFAULT);
-      obj->recv.timeout     = PCL_RECV_TIMEOUT_DEFAULT;
-      obj->send.timeout     = PCL_SEND_TIMEOUT_DEFAULT;
-      obj->handler_request  = pcl_msg_handler_request;
-      obj->handler_event    = pcl_msg_handler_event;
-      obj->handler_create   = pcl_msg_handler_create;
-      obj->handler_retrieve = pcl_msg_handler_retrieve;
-      obj->handler_update   = pcl_msg_handler_update;
-      obj->handler_delete   = pcl_msg_handler_delete;
+      obj->recv.timeout     = pcl_timeout_ms(NULL, NULL, PCL_RECV_TIMEOUT_DEFAULT);
+      obj->send.timeout     = pcl_timeout_ms(NULL, NULL, PCL_SEND_TIMEOUT_DEFAULT);
       obj->handler_alive    = pcl_msg_handler_alive;
    } else {
-      snprintf(obj->service_name, PCL_SERVICE_NAME_LEN_MAX, "%s", params->service_name ? params->service_name : PCL_SERVICE_NAME_DEFAULT);
       snprintf(obj->url_parodus,  PCL_URL_LEN_MAX,          "%s", params->url_parodus  ? params->url_parodus  : PCL_URL_PARODUS_DEFAULT);
       snprintf(obj->url_client,   PCL_URL_LEN_MAX,          "%s", params->url_client   ? params->url_client   : PCL_URL_CLIENT_DEFAULT);
-      obj->recv.timeout     = params->timeout_recv     ? *(params->timeout_recv)  : PCL_RECV_TIMEOUT_DEFAULT;
-      obj->send.timeout     = params->timeout_send     ? *(params->timeout_send)  : PCL_SEND_TIMEOUT_DEFAULT;
-      obj->handler_request  = params->handler_request  ? params->handler_request  : pcl_msg_handler_request;
-      obj->handler_event    = params->handler_event    ? params->handler_event    : pcl_msg_handler_event;
-      obj->handler_create   = params->handler_create   ? params->handler_create   : pcl_msg_handler_create;
-      obj->handler_retrieve = params->handler_retrieve ? params->handler_retrieve : pcl_msg_handler_retrieve;
-      obj->handler_update   = params->handler_update   ? params->handler_update   : pcl_msg_handler_update;
-      obj->handler_delete   = params->handler_delete   ? params->handler_delete   : pcl_msg_handler_delete;
+      obj->recv.timeout     = pcl_timeout_ms(params->timeout_recv_ms, params->timeout_recv, PCL_RECV_TIMEOUT_DEFAULT);
+      obj->send.timeout     = pcl_timeout_ms(params->timeout_send_ms, params->timeout_send, PCL_SEND_TIMEOUT_DEFAULT);
+      obj->send_zero_copy   = params->send_zero_copy   ? *(params->send_zero_copy) : false;
+      obj->send_overflow    = params->send_queue_overflow ? *(params->send_queue_overflow) : PCL_SEND_OVERFLOW_FAIL_FAST;
+      obj->send_complete    = params->send_complete;
+      obj->handler_ready    = params->handler_ready;
+      obj->alive_timeout_ms = (params->alive_timeout_ms && *(params->alive_timeout_ms) > 0) ? *(params->alive_timeout_ms) : 0;
       obj->handler_alive    = params->handler_alive    ? params->handler_alive    : pcl_msg_handler_alive;
+      obj->view_mode        = (params->handler_view != NULL);
+      obj->handler_stream   = params->handler_stream;
+      obj->shed_backlog_max = (params->shed_backlog_max && *(params->shed_backlog_max) > 0) ? *(params->shed_backlog_max) : 0;
+      obj->shed_reject      = params->shed_reject ? *(params->shed_reject) : false;
+      obj->handler_shed     = params->handler_shed;
+      for(uint32_t index = WRP_MSG_TYPE__REQ; params->shed_deadline_ms != NULL && index <= WRP_MSG_TYPE__DELETE; index++) {
+         if(params->shed_deadline_ms[index] > 0) { // control messages are never shed
+            obj->shed_deadline_ns[index] = (uint64_t)params->shed_deadline_ms[index] * 1000000;
+            obj->shed_deadline           = true;
+         }
+      }
+      if(params->stream_chunk_size != NULL && *(params->stream_chunk_size) > 0) {
+         obj->stream_chunk_size = *(params->stream_chunk_size);
+      }
+      service->handler_request  = params->handler_request;
+      service->handler_event    = params->handler_event;
+      service->handler_create   = params->handler_create;
+      service->handler_retrieve = params->handler_retrieve;
+      service->handler_update   = params->handler_update;
+      service->handler_delete   = params->handler_delete;
+      service->handler_view     = params->handler_view;
    }
-   obj->service_name_len = strlen(obj->service_name);
-   
-   XLOGD_INFO("service name <%s> parodus <%s> client <%s>", obj->service_name, obj->url_parodus, obj->url_client);
-   
-   obj->recv.sock = nn_socket(AF_SP, NN_PULL);
-   if(obj->recv.sock < 0) {
-      *errsv = errno;
-      pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_RECV_CREATE);
+   if(service->handler_request  == NULL) { service->handler_request  = pcl_msg_handler_request;  }
+   if(service->handler_event    == NULL) { service->handler_event    = pcl_msg_handler_event;    }
+   if(service->handler_create   == NULL) { service->handler_create   = pcl_msg_handler_create;   }
+   if(service->handler_retrieve == NULL) { service->handler_retrieve = pcl_msg_handler_retrieve; }
+   if(service->handler_update   == NULL) { service->handler_update   = pcl_msg_handler_update;   }
+   if(service->handler_delete   == NULL) { service->handler_delete   = pcl_msg_handler_delete;   }
+   if(service->handler_view     == NULL) { service->handler_view     = pcl_msg_handler_view;     }
+   pcl_service_publish(obj, service);
+   if(params != NULL && params->dispatch_workers != NULL && *(params->dispatch_workers) > 0) {
+      uint32_t workers = *(params->dispatch_workers);
+      obj->dispatch = pcl_dispatch_create(workers, workers * PCL_DISPATCH_SHARDS_PER_WORKER, pcl_dispatch_run, obj);
+      if(obj->dispatch == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
    }
-   if(obj->recv.timeout > 0) {
-      obj->recv.timeout *= 1000;
-      if(nn_setsockopt(obj->recv.sock, NN_SOL_SOCKET, NN_RCVTIMEO, &obj->recv.timeout, sizeof(obj->recv.timeout)) < 0) {
-         *errsv = errno;
+   if(params != NULL && params->decode_arena != NULL && *(params->decode_arena) && !obj->view_mode) {
+      obj->arena_pool = pcl_arena_pool_create(PCL_ARENA_IDLE_MAX, &obj->stats.arena_alloc);
+      if(obj->arena_pool == NULL) {
          pcl_obj_destroy(&obj, NULL);
-         return(PCL_RESULT_ERROR_SOCK_RECV_SETOPT);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
       }
    }
-   
-   if(nn_bind(obj->recv.sock, obj->url_client) < 0) {
-      *errsv = errno;
-      pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_RECV_BIND);
+   if(params != NULL && params->idempotency_window_ms != NULL && *(params->idempotency_window_ms) > 0) {
+      uint32_t entries = (params->idempotency_entries && *(params->idempotency_entries) > 0) ? *(params->idempotency_entries) : PCL_IDEMPOTENCY_ENTRIES_DEFAULT;
+      size_t   mem_max = (params->idempotency_mem_max && *(params->idempotency_mem_max) > 0) ? *(params->idempotency_mem_max) : PCL_IDEMPOTENCY_MEM_DEFAULT;
+      obj->idempotency_window_ms = *(params->idempotency_window_ms);
+      obj->idempotency = pcl_cache_create(entries, mem_max, &obj->stats.idempotency_evicted);
+      if(obj->idempotency == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
    }
-   size_t optvallen = sizeof(obj->recv.fd);
-   if(nn_getsockopt(obj->recv.sock, NN_SOL_SOCKET, NN_RCVFD, &obj->recv.fd, &optvallen) < 0) {
-      *errsv = errno;
-      pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_RECV_GETOPT);
+   if(params != NULL && params->retrieve_cache_ttl_ms != NULL && *(params->retrieve_cache_ttl_ms) > 0) {
+      size_t mem_max = (params->retrieve_cache_mem_max && *(params->retrieve_cache_mem_max) > 0) ? *(params->retrieve_cache_mem_max) : PCL_RETRIEVE_CACHE_MEM_DEFAULT;
+      obj->retrieve_ttl_ms  = *(params->retrieve_cache_ttl_ms);
+      obj->retrieve_cache   = pcl_cache_create(PCL_RETRIEVE_CACHE_ENTRIES, mem_max, &obj->stats.retrieve_cache_evicted);
+      obj->retrieve_pending = pcl_cache_create(PCL_RETRIEVE_CACHE_ENTRIES, PCL_RETRIEVE_PENDING_MEM, NULL);
+      if(obj->retrieve_cache == NULL || obj->retrieve_pending == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
+   }
+   if(obj->handler_stream != NULL) {
+      obj->stream_timeout_ms = (params->stream_timeout_ms && *(params->stream_timeout_ms) > 0) ? *(params->stream_timeout_ms) : PCL_STREAM_TIMEOUT_DEFAULT;
+      obj->streams = pcl_cache_create(PCL_STREAM_QTY_MAX, PCL_STREAM_MEM_MAX, NULL);
+      if(obj->streams == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
+   }
+   if(params != NULL && params->send_queue_depth != NULL && *(params->send_queue_depth) > 0) {
+      const uint32_t weight_default[PCL_SEND_LANE_QTY] = PCL_SEND_LANE_WEIGHT_DEFAULT;
+      for(uint32_t lane = 0; lane < PCL_SEND_LANE_QTY; lane++) {
+         int depth = (params->send_lane_depth != NULL && params->send_lane_depth[lane] > 0) ? params->send_lane_depth[lane] : *(params->send_queue_depth);
+         if(!pcl_queue_create(&obj->send_queue[lane], depth)) {
+            pcl_obj_destroy(&obj, NULL);
+            return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+         }
+         obj->send_lane_weight[lane] = (params->send_lane_weight != NULL && params->send_lane_weight[lane] > 0) ? params->send_lane_weight[lane] : weight_default[lane];
+      }
+      obj->send_lane = PCL_SEND_LANE_QTY - 1; // the first round starts with the control lane
    }
    
-   obj->send.sock = nn_socket(AF_SP, NN_PUSH);
-   if(obj->send.sock < 0) {
-      *errsv = errno;
-      pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_SEND_CREATE);
+   if(obj->alive_timeout_ms > 0 && params->replay_depth != NULL && *(params->replay_depth) > 0) {
+      if(!pcl_queue_create(&obj->replay, *(params->replay_depth))) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
    }
-   if(nn_setsockopt(obj->send.sock, NN_SOL_SOCKET, NN_SNDTIMEO, &obj->send.timeout, sizeof(obj->send.timeout)) < 0 || optvallen != sizeof(obj->recv.fd)) {
-      *errsv = errno;
-      pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_SEND_SETOPT);
+   
+   if(params != NULL && params->capture_path != NULL) {
+      obj->capture = pcl_capture_open(params->capture_path, errsv);
+      if(obj->capture == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_PARAMS);
+      }
    }
-   if(nn_connect(obj->send.sock, obj->url_parodus) < 0) {
-      *errsv = errno;
+   if(params != NULL && params->trace_name != NULL) {
+      uint32_t sample    = (params->trace_sample != NULL && *(params->trace_sample) >= 0) ? (uint32_t)*(params->trace_sample) : PCL_TRACE_SAMPLE_DEFAULT;
+      uint32_t ring_size = (params->trace_ring_size != NULL && *(params->trace_ring_size) > 0) ? *(params->trace_ring_size) : 0;
+      obj->trace = pcl_trace_open(params->trace_name, sample, ring_size, errsv);
+      if(obj->trace == NULL) {
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_PARAMS);
+      }
+   }
+   
+   XLOGD_INFO("service name <%s> parodus <%s> client <%s>", service->name, obj->url_parodus, obj->url_client);
+   
+   result = pcl_sock_open(&obj->recv, obj->url_client, true, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
       pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_SEND_CONNECT);
+      return(result);
    }
-   optvallen = sizeof(obj->send.fd);
-   if(nn_getsockopt(obj->send.sock, NN_SOL_SOCKET, NN_SNDFD, &obj->send.fd, &optvallen) < 0 || optvallen != sizeof(obj->send.fd)) {
-      *errsv = errno;
+   result = pcl_sock_open(&obj->send, obj->url_parodus, false, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
       pcl_obj_destroy(&obj, NULL);
-      return(PCL_RESULT_ERROR_SOCK_SEND_GETOPT);
+      return(result);
    }
 
-   if(PCL_RESULT_SUCCESS != pcl_register(obj, errsv)) {
+   // With init_async registration is retried until parodus authorizes the service, pcl_send fails with
+   // PCL_RESULT_ERROR_SOCK_SEND_AUTH until then
+   bool init_async = (params != NULL && params->init_async != NULL && *(params->init_async));
+   if(!init_async && PCL_RESULT_SUCCESS != pcl_register(obj, service, 0, errsv)) {
       pcl_obj_destroy(&obj, NULL);
       return(PCL_RESULT_ERROR_REGISTER);
    }
+   if(init_async || obj->alive_timeout_ms > 0) {
+      int rc = pthread_create(&obj->supervise_thread, NULL, pcl_supervise_thread, obj);
+      if(rc != 0) {
+         *errsv = rc;
+         pcl_obj_destroy(&obj, NULL);
+         return(PCL_RESULT_ERROR_INTERNAL);
+      }
+      obj->supervise_thread_valid = true;
+   }
    
    if(fd_recv != NULL) {
       *fd_recv = obj->recv.fd;
@@ -214,18 +540,88 @@ void pcl_obj_destroy(pcl_obj_t **obj, int *errsv) {
    if(obj == NULL || *obj == NULL) {
       return;
    }
-   errno = 0;
-   if((*obj)->recv.sock >= 0) {
-      nn_shutdown((*obj)->recv.sock, 0);
-      nn_close((*obj)->recv.sock);
-      (*obj)->recv.sock = -1;
+   if((*obj)->supervise_thread_valid) {
+      pthread_mutex_lock(&(*obj)->supervise_lock);
+      (*obj)->supervise_stop = true;
+      pthread_cond_signal(&(*obj)->supervise_cond);
+      pthread_mutex_unlock(&(*obj)->supervise_lock);
+      pthread_join((*obj)->supervise_thread, NULL);
+      (*obj)->supervise_thread_valid = false;
+   }
+   if((*obj)->dispatch != NULL) { // handlers may still send, so finish them before closing the sockets
+      pcl_dispatch_destroy((*obj)->dispatch);
+      (*obj)->dispatch = NULL;
+   }
+   if((*obj)->arena_pool != NULL) {
+      pcl_arena_pool_destroy((*obj)->arena_pool);
+      (*obj)->arena_pool = NULL;
+   }
+   if((*obj)->loop != NULL) {
+      pcl_loop_destroy((*obj)->loop);
+      (*obj)->loop = NULL;
+   }
+   if((*obj)->loop_wake_fd >= 0) {
+      close((*obj)->loop_wake_fd);
+      (*obj)->loop_wake_fd = -1;
+   }
+   if((*obj)->requests != NULL) {
+      pcl_request_table_destroy((*obj)->requests);
+      (*obj)->requests = NULL;
+   }
+   if((*obj)->idempotency != NULL) {
+      pcl_cache_destroy((*obj)->idempotency);
+      (*obj)->idempotency = NULL;
+   }
+   if((*obj)->retrieve_cache != NULL) {
+      pcl_cache_destroy((*obj)->retrieve_cache);
+      (*obj)->retrieve_cache = NULL;
+   }
+   if((*obj)->retrieve_pending != NULL) {
+      pcl_cache_destroy((*obj)->retrieve_pending);
+      (*obj)->retrieve_pending = NULL;
+   }
+   if((*obj)->streams != NULL) {
+      pcl_cache_destroy((*obj)->streams);
+      (*obj)->streams = NULL;
    }
-   if((*obj)->send.sock >= 0) {
-      nn_shutdown((*obj)->send.sock, 0);
-      nn_close((*obj)->send.sock);
-      (*obj)->send.sock = -1;
+   if((*obj)->capture != NULL) {
+      pcl_capture_close((*obj)->capture);
+      (*obj)->capture = NULL;
    }
-   sem_destroy(&(*obj)->semaphore);
+   if((*obj)->trace != NULL) {
+      pcl_trace_close((*obj)->trace);
+      (*obj)->trace = NULL;
+   }
+   for(uint32_t index = 0; index < (*obj)->service_qty; index++) {
+      pcl_route_table_destroy((*obj)->services[index].routes);
+   }
+   (*obj)->service_qty = 0;
+   // Queued messages are freed by the send transport, abort them before closing it
+   if((*obj)->send_queue[0].cells != NULL) {
+      pcl_send_queue_abort(*obj);
+   }
+   for(uint32_t lane = 0; lane < PCL_SEND_LANE_QTY; lane++) {
+      if((*obj)->send_queue[lane].cells != NULL) {
+         pcl_queue_destroy(&(*obj)->send_queue[lane]);
+      }
+   }
+   if((*obj)->replay.cells != NULL) {
+      pcl_queue_item_t item;
+      while(pcl_queue_pop(&(*obj)->replay, &item)) {
+         (*obj)->send.transport->msg_free(item.msg_bytes);
+      }
+      pcl_queue_destroy(&(*obj)->replay);
+   }
+   errno = 0;
+   pcl_sock_close(&(*obj)->recv);
+   pcl_sock_close(&(*obj)->send);
+   sem_destroy(&(*obj)->send_flush);
+   sem_destroy(&(*obj)->service_lock);
+   sem_destroy(&(*obj)->recv_side.quiesce);
+   sem_destroy(&(*obj)->send_side.quiesce);
+   sem_destroy(&(*obj)->recv_lock);
+   pthread_cond_destroy(&(*obj)->supervise_cond);
+   pthread_mutex_destroy(&(*obj)->supervise_lock);
    *errsv = errno;
    free(*obj);
    *obj = NULL;
@@ -240,7 +636,21 @@ pcl_result_t pcl_term(pcl_object_t object, int *errsv) {
    }
    *errsv = 0;
 
-   PCL_MUTEX_LOCK();
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+
+   // Stop receiving first so no more messages reach the dispatch workers
+   atomic_store(&obj->loop_stop, true);
+   pcl_side_close(obj, &obj->recv_side, &obj->recv);
+
+   // Handlers still queued on the workers run to completion and can send their responses
+   if(obj->dispatch != NULL) {
+      pcl_dispatch_destroy(obj->dispatch);
+      obj->dispatch = NULL;
+   }
+   pcl_side_close(obj, &obj->send_side, &obj->send);
+
    pcl_obj_destroy(&obj, errsv);
    if(*errsv) {
       return(PCL_RESULT_ERROR_INTERNAL);
@@ -248,6 +658,39 @@ pcl_result_t pcl_term(pcl_object_t object, int *errsv) {
    return(PCL_RESULT_SUCCESS);
 }
 
+void pcl_side_init(pcl_side_t *side) {
+   atomic_init(&side->active, 1);
+   atomic_init(&side->closing, false);
+   sem_init(&side->quiesce, 0, 0);
+}
+
+bool pcl_side_enter(pcl_side_t *side) {
+   atomic_fetch_add(&side->active, 1);
+   if(atomic_load(&side->closing)) {
+      pcl_side_leave(side);
+      return(false);
+   }
+   return(true);
+}
+
+void pcl_side_leave(pcl_side_t *side) {
+   // Only reaches zero once pcl_side_close has dropped the object's reference
+   if(atomic_fetch_sub(&side->active, 1) == 1) {
+      sem_post(&side->quiesce);
+   }
+}
+
+void pcl_side_close(pcl_obj_t *obj, pcl_side_t *side, pcl_sock_t *sock) {
+   atomic_store(&side->closing, true);
+   pcl_loop_notify(obj);
+
+   // Shutting the socket down makes calls blocked in recv or send return
+   pcl_sock_shutdown(sock);
+   if(atomic_fetch_sub(&side->active, 1) != 1) {
+      sem_wait(&side->quiesce);
+   }
+}
+
 pcl_result_t pcl_recv(pcl_object_t object, int *errsv) {
    pcl_obj_t *obj = (pcl_obj_t *)object;
    int errsink;
@@ -258,195 +701,2451 @@ pcl_result_t pcl_recv(pcl_object_t object, int *errsv) {
    if(obj == NULL) {
       return(PCL_RESULT_ERROR_PARAMS);
    }
+   if(!pcl_side_enter(&obj->recv_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   pcl_result_t result = pcl_recv_msg(obj, errsv);
+   pcl_side_leave(&obj->recv_side);
+   return(result);
+}
+
+pcl_result_t pcl_recv_msg(pcl_obj_t *obj, int *errsv) {
+   pcl_request_table_expire(obj->requests, NULL);
    
-   PCL_MUTEX_LOCK();
+   PCL_RECV_LOCK();
    
    // Receive from socket
-   char *     msg_buf = NULL;
-   wrp_msg_t *msg_wrp = NULL;
-   int msg_len = nn_recv(obj->recv.sock, &msg_buf, NN_MSG, 0);
+   pcl_trace_ctx_t trace       = { .sampled = pcl_trace_sample(obj->trace) };
+   uint64_t        trace_start = pcl_trace_begin(&trace);
+   char *msg_buf = NULL;
+   int   msg_len = obj->recv.transport->recv(&obj->recv, (void **)&msg_buf, 0);
 
    if(msg_len < 0 || msg_buf == NULL) {
       *errsv = errno;
       if(errno == ETIMEDOUT) {
-         PCL_MUTEX_UNLOCK();
+         PCL_RECV_UNLOCK();
+         pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SOCK_RECV_TIMEOUT);
          return(PCL_RESULT_ERROR_SOCK_RECV_TIMEOUT);
       }
-      PCL_MUTEX_UNLOCK();
+      PCL_RECV_UNLOCK();
+      pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SOCK_RECV_READ);
       return(PCL_RESULT_ERROR_SOCK_RECV_READ);
    }
+   pcl_capture_frame(obj->capture, PCL_CAPTURE_IN, msg_buf, msg_len);
+   pcl_recv_trace(obj, msg_buf, msg_len, trace_start, &trace);
+   return(pcl_recv_frame(obj, msg_buf, msg_len, &trace));
+}
+
+pcl_result_t pcl_recv_frame(pcl_obj_t *obj, char *msg_buf, int msg_len, pcl_trace_ctx_t *trace) {
+   // Called with the receive lock held, it is released before dispatching
+   pcl_recv_msg_t    msg;
+   enum wrp_msg_type msg_type;
+   pcl_result_t      result;
+
+   // Drop messages nobody handles before decoding them
+   uint64_t trace_start = pcl_trace_begin(trace);
+   bool     filtered    = pcl_recv_filter(obj, msg_buf, msg_len, &msg_type, &result);
+   pcl_trace_span(obj->trace, trace, PCL_TRACE_FILTER, trace_start);
+   if(filtered) {
+      PCL_RECV_UNLOCK();
+      return(result);
+   }
 
    // Convert bytes to wrp
-   msg_len = (int) wrp_to_struct(msg_buf, msg_len, WRP_BYTES, &msg_wrp);
-   nn_freemsg(msg_buf);
-   msg_buf = NULL;
-   
-   if(msg_len < 1 || msg_wrp == NULL) {
-      PCL_MUTEX_UNLOCK();
-      return(PCL_RESULT_ERROR_SOCK_RECV_WRP);
+   pcl_arena_t *arena = NULL;
+   result = pcl_recv_decode(obj, msg_buf, msg_len, trace, &msg, &arena);
+   PCL_RECV_UNLOCK();
+   if(arena != NULL) { // the message holds its own reference
+      pcl_arena_release(arena);
    }
-   PCL_MUTEX_UNLOCK();
 
-   pcl_result_t result = PCL_RESULT_ERROR_INTERNAL;
-   
-   // Call handler based on message type
-   switch(msg_wrp->msg_type) {
-      case WRP_MSG_TYPE__AUTH: {
-         result = pcl_msg_handler_auth(obj, &msg_wrp->u.auth);
-         break;
-      }
-      case WRP_MSG_TYPE__SVC_REGISTRATION: {
-         result = pcl_msg_handler_register(obj, &msg_wrp->u.reg);
-         break;
-      }
-      case WRP_MSG_TYPE__SVC_ALIVE: {
-         result = (*obj->handler_alive)();
-         break;
-      }
-      case WRP_MSG_TYPE__REQ: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.req.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_request)(&msg_wrp->u.req);
+   if(result != PCL_RESULT_SUCCESS) {
+      return(result);
+   }
+   return(pcl_recv_dispatch(obj, &msg, NULL));
+}
+
+void pcl_recv_trace(pcl_obj_t *obj, const char *msg_buf, int msg_len, uint64_t start, pcl_trace_ctx_t *trace) {
+   // Only sampled messages are peeked for their uuid here, the receive filter peeks them again
+   pcl_wrp_peek_t peek;
+   if(!trace->sampled) {
+      return;
+   }
+   trace->len = msg_len;
+   if(pcl_wrp_peek(msg_buf, msg_len, &peek)) {
+      trace->msg_type = peek.msg_type;
+      trace->hash     = (peek.transaction_uuid.len > 0) ? pcl_trace_hash(peek.transaction_uuid.str, peek.transaction_uuid.len) : 0;
+   }
+   pcl_trace_span(obj->trace, trace, PCL_TRACE_RECV, start);
+}
+
+pcl_result_t pcl_recv_batch(pcl_object_t object, uint32_t max_msgs, uint32_t budget_us, pcl_batch_result_t *batch, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || max_msgs == 0) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(batch != NULL) {
+      bzero(batch, sizeof(*batch));
+   }
+   if(max_msgs > PCL_RECV_BATCH_MAX) {
+      max_msgs = PCL_RECV_BATCH_MAX;
+   }
+   if(!pcl_side_enter(&obj->recv_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   pcl_request_table_expire(obj->requests, NULL);
+
+   pcl_result_t result = pcl_recv_drain(obj, max_msgs, budget_us, batch, NULL, errsv);
+   pcl_side_leave(&obj->recv_side);
+   return(result);
+}
+
+pcl_result_t pcl_recv_drain(pcl_obj_t *obj, uint32_t max_msgs, uint32_t budget_us, pcl_batch_result_t *batch, uint32_t *drained, int *errsv) {
+   pcl_recv_msg_t msgs[PCL_RECV_BATCH_MAX];
+   uint32_t       msg_qty  = 0;
+   uint32_t       read_qty = 0;
+   pcl_result_t   result   = PCL_RESULT_SUCCESS;
+   uint64_t       deadline = (budget_us > 0) ? pcl_time_us() + budget_us : 0;
+   pcl_arena_t *  arena    = NULL; // shared by the batch, released when the last message has been handled
+
+   PCL_RECV_LOCK();
+
+   // Drain the socket without blocking until it is empty, the batch is full or the budget is spent
+   while(read_qty < max_msgs) {
+      pcl_trace_ctx_t trace       = { .sampled = pcl_trace_sample(obj->trace) };
+      uint64_t        trace_start = pcl_trace_begin(&trace);
+      char *msg_buf = NULL;
+      int   msg_len = obj->recv.transport->recv(&obj->recv, (void **)&msg_buf, PCL_SOCK_DONTWAIT);
+
+      if(msg_len < 0 || msg_buf == NULL) {
+         if(errno != EAGAIN) {
+            *errsv = errno;
+            result = PCL_RESULT_ERROR_SOCK_RECV_READ;
+            pcl_stats_result(&obj->stats, result);
          }
          break;
       }
-      case WRP_MSG_TYPE__EVENT: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.event.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_event)(&msg_wrp->u.event);
+
+      read_qty++;
+      pcl_capture_frame(obj->capture, PCL_CAPTURE_IN, msg_buf, msg_len);
+      pcl_recv_trace(obj, msg_buf, msg_len, trace_start, &trace);
+      enum wrp_msg_type msg_type;
+      pcl_result_t      msg_result;
+      trace_start   = pcl_trace_begin(&trace);
+      bool filtered = pcl_recv_filter(obj, msg_buf, msg_len, &msg_type, &msg_result);
+      pcl_trace_span(obj->trace, &trace, PCL_TRACE_FILTER, trace_start);
+      if(filtered) {
+         if(batch != NULL) { // counted as a result but not as dispatched
+            batch->result[msg_result]++;
          }
-         break;
-      }
-      case WRP_MSG_TYPE__CREATE: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.crud.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_create)(&msg_wrp->u.crud);
+      } else if(PCL_RESULT_SUCCESS != pcl_recv_decode(obj, msg_buf, msg_len, &trace, &msgs[msg_qty], &arena)) {
+         if(batch != NULL) {
+            batch->result[PCL_RESULT_ERROR_SOCK_RECV_WRP]++;
          }
-         break;
+      } else {
+         msg_qty++;
       }
-      case WRP_MSG_TYPE__RETREIVE: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.crud.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_retrieve)(&msg_wrp->u.crud);
-         }
+      if(deadline && pcl_time_us() >= deadline) {
          break;
       }
-      case WRP_MSG_TYPE__UPDATE: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.crud.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_update)(&msg_wrp->u.crud);
+   }
+   PCL_RECV_UNLOCK();
+   if(arena != NULL) {
+      pcl_arena_release(arena);
+   }
+
+   for(uint32_t index = 0; index < msg_qty; index++) {
+      enum wrp_msg_type msg_type   = WRP_MSG_TYPE__UNKNOWN;
+      pcl_result_t      msg_result = pcl_recv_dispatch(obj, &msgs[index], &msg_type);
+
+      if(batch != NULL) {
+         uint32_t type_index = (msg_type < PCL_BATCH_MSG_TYPE_MAX) ? msg_type : 0;
+         batch->dispatched++;
+         batch->msg_type[type_index]++;
+         if(msg_result != PCL_RESULT_SUCCESS) {
+            batch->msg_type_fail[type_index]++;
          }
-         break;
+         batch->result[(msg_result < PCL_RESULT_INVALID) ? msg_result : PCL_RESULT_INVALID]++;
       }
+   }
+
+   if(drained != NULL) {
+      *drained = read_qty;
+   }
+   // Only report a read error when nothing could be drained
+   if(result != PCL_RESULT_SUCCESS && msg_qty > 0) {
+      result = PCL_RESULT_SUCCESS;
+   }
+   return(result);
+}
+
+bool pcl_recv_filter(pcl_obj_t *obj, char *msg_buf, int msg_len, enum wrp_msg_type *msg_type, pcl_result_t *result) {
+   pcl_wrp_peek_t peek;
+
+   // Anything that cannot be peeked is left for the decode to report
+   if(!pcl_wrp_peek(msg_buf, msg_len, &peek)) {
+      return(false);
+   }
+   bool answered = false;
+   bool chunk    = false;
+   switch(peek.msg_type) {
+      case WRP_MSG_TYPE__REQ:
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
       case WRP_MSG_TYPE__DELETE: {
-         if(!pcl_service_name_match(obj, msg_wrp->u.crud.dest)) {
-            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
-         } else {
-            result = (*obj->handler_delete)(&msg_wrp->u.crud);
+         if(peek.transaction_uuid.len > 0) {
+            // May be the response to an outstanding request
+            if(pcl_request_table_count(obj->requests) > 0 && pcl_request_table_contains(obj->requests, peek.transaction_uuid.str, peek.transaction_uuid.len)) {
+               return(false);
+            }
+            // Every chunk of a stream carries the caller's transaction_uuid, so chunks are neither retries nor answered from the cache
+            chunk = (obj->idempotency != NULL || obj->retrieve_cache != NULL) && pcl_wrp_peek_header(msg_buf, msg_len, PCL_STREAM_HEADER);
+            if(!chunk) {
+               answered = pcl_recv_duplicate(obj, &peek);
+            }
+         }
+         if(!answered) {
+            answered = pcl_recv_cached(obj, &peek, chunk);
          }
          break;
       }
-      case WRP_MSG_TYPE__UNKNOWN:
-      default: {
-         result = PCL_RESULT_ERROR_SOCK_RECV_MSGTYPE;
+      case WRP_MSG_TYPE__EVENT: {
          break;
       }
+      default: {
+         return(false);
+      }
    }
-   wrp_free_struct(msg_wrp);
-   
-   return(result);
-}
 
-bool pcl_service_name_match(pcl_obj_t *obj, const char *dest) {
-   if(strncmp("mac:", dest, 4) == 0) {
-      const char *service = strchr(dest, '/');
-      if(service == NULL) {
+   const char *   path    = NULL;
+   pcl_service_t *service = NULL;
+   if(answered) {
+      *result = PCL_RESULT_SUCCESS;
+   } else if(obj->shed_backlog_max > 0 && atomic_load(&obj->recv_backlog) >= obj->shed_backlog_max) {
+      pcl_recv_shed(obj, &peek, 0);
+      *result = PCL_RESULT_ERROR_SHED;
+   } else if((service = pcl_service_find(obj, peek.dest.str, peek.dest.len, &path)) == NULL) {
+      pcl_recv_forget(obj, peek.transaction_uuid.str, peek.transaction_uuid.len);
+      *result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
+   } else {
+      pcl_route_match_t   match;
+      pcl_route_handler_t handler;
+      void *              ctx;
+
+      if(!pcl_route_table_empty(service->routes) && pcl_route_table_lookup(service->routes, peek.msg_type, path, peek.dest.len - (path - peek.dest.str), &match, &handler, &ctx)) {
          return(false);
       }
-      service++;
-
-      //const char *mac = dest + 4;
-      //printf("%s: mac <%.12s> service <%s>\n", __FUNCTION__, mac, service);
+      if(obj->handler_stream != NULL || !pcl_service_handler_default(obj, service, peek.msg_type)) { // chunks are only known after decode
+         return(false);
+      }
+      *result = PCL_RESULT_SUCCESS; // what the default handler returns
+   }
+   *msg_type = peek.msg_type;
+   pcl_stats_add(&obj->stats.recv_msgs[pcl_stats_type_index(peek.msg_type)], 1);
+   pcl_stats_add(&obj->stats.recv_bytes[pcl_stats_type_index(peek.msg_type)], msg_len);
+   pcl_stats_add(&obj->stats.recv_filtered[pcl_stats_type_index(peek.msg_type)], 1);
+   pcl_stats_result(&obj->stats, *result);
+   obj->recv.transport->msg_free(msg_buf);
+   return(true);
+}
 
-      // TODO check mac address
-      
-      if(strncmp(service, obj->service_name, obj->service_name_len) == 0) {
-         // Make sure service name ends in /, ?, # or null termination
-         if(service[obj->service_name_len] == '/' || service[obj->service_name_len] == '?' || service[obj->service_name_len] == '#' || service[obj->service_name_len] == '\0') {
-            return(true);
+bool pcl_recv_duplicate(pcl_obj_t *obj, const pcl_wrp_peek_t *peek) {
+   if(obj->idempotency == NULL || peek->msg_type == WRP_MSG_TYPE__RETREIVE) {
+      return(false);
+   }
+   void * response     = NULL;
+   size_t response_len = 0;
+   switch(pcl_cache_lookup(obj->idempotency, peek->transaction_uuid.str, peek->transaction_uuid.len, obj->idempotency_window_ms, &response, &response_len)) {
+      case PCL_CACHE_MISS: {
+         pcl_stats_add(&obj->stats.idempotency_new, 1);
+         return(false);
+      }
+      case PCL_CACHE_PENDING: { // still being handled, or handled without a response
+         pcl_stats_add(&obj->stats.idempotency_suppressed, 1);
+         return(true);
+      }
+      case PCL_CACHE_HIT:
+      default: {
+         // Answer the retry with the response to the first request without blocking the receive thread
+         pcl_stats_add(&obj->stats.idempotency_replayed, 1);
+         if(pcl_side_enter(&obj->send_side)) {
+            pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, response, response_len);
+            uint64_t start = pcl_stats_time_ns();
+            int      ret   = obj->send.transport->send(&obj->send, response, response_len, PCL_SOCK_DONTWAIT);
+            pcl_send_result(obj, peek->msg_type, ret, response_len, start, (ret < 0) ? errno : 0);
+            pcl_side_leave(&obj->send_side);
          }
+         free(response);
+         return(true);
       }
    }
-   return(false);
 }
 
-pcl_result_t pcl_send(pcl_object_t object, wrp_msg_t *msg, int *errsv) {
-   pcl_obj_t *obj = (pcl_obj_t *)object;
-   int errsink;
-   if(errsv == NULL) {
-      errsv = &errsink;
+bool pcl_recv_cached(pcl_obj_t *obj, const pcl_wrp_peek_t *peek, bool chunk) {
+   const char *key;
+   size_t      key_len;
+   if(obj->retrieve_cache == NULL || !pcl_retrieve_cache_key(obj, peek->dest.str, peek->dest.len, &key, &key_len)) {
+      return(false);
    }
-   *errsv = 0;
-   if(obj == NULL || msg == NULL) {
-      return(PCL_RESULT_ERROR_PARAMS);
+   if(peek->msg_type == WRP_MSG_TYPE__CREATE || peek->msg_type == WRP_MSG_TYPE__UPDATE || peek->msg_type == WRP_MSG_TYPE__DELETE) {
+      // A write passing through makes the cached responses for its path stale, along with those for the paths below it and the
+      // paths above it, whose responses may include it
+      atomic_fetch_add(&obj->retrieve_generation, 1);
+      pcl_stats_add(&obj->stats.retrieve_cache_invalidated, pcl_cache_remove_path(obj->retrieve_cache, key, key_len));
+      return(false);
    }
-   if(!obj->authorized) {
-      return(PCL_RESULT_ERROR_SOCK_SEND_AUTH);
+   if(peek->msg_type != WRP_MSG_TYPE__RETREIVE || peek->transaction_uuid.len == 0 || peek->source.str == NULL || chunk) {
+      return(false);
+   }
+   void * value     = NULL;
+   size_t value_len = 0;
+   if(pcl_cache_lookup(obj->retrieve_cache, key, key_len, 0, &value, &value_len) != PCL_CACHE_HIT) {
+      // Remember the path and generation for the response, which only carries the transaction_uuid
+      uint8_t  pending[sizeof(uint32_t) + PCL_URL_LEN_MAX];
+      uint32_t generation = atomic_load(&obj->retrieve_generation);
+      pcl_stats_add(&obj->stats.retrieve_cache_misses, 1);
+      if(key_len <= PCL_URL_LEN_MAX) {
+         memcpy(pending, &generation, sizeof(generation));
+         memcpy(&pending[sizeof(generation)], key, key_len);
+         pcl_cache_store(obj->retrieve_pending, peek->transaction_uuid.str, peek->transaction_uuid.len, pending, sizeof(generation) + key_len, obj->retrieve_ttl_ms, false);
+      }
+      return(false);
    }
-   return(pcl_sock_send_wrp(obj, msg, errsv));
-}
 
-pcl_result_t pcl_register(pcl_obj_t *obj, int *errsv) {
-   wrp_msg_t reg_msg;
-   reg_msg.msg_type           = WRP_MSG_TYPE__SVC_REGISTRATION;
-   reg_msg.u.reg.service_name = obj->service_name;
-   reg_msg.u.reg.url          = obj->url_client;
-   return(pcl_sock_send_wrp(obj, &reg_msg, errsv));
+   // Address the cached response to this requester and transaction, written without blocking the receive thread
+   pcl_stats_add(&obj->stats.retrieve_cache_hits, 1);
+   size_t msg_len   = pcl_retrieve_cache_reply(peek, value, value_len, NULL, 0);
+   void * msg_bytes = obj->send.transport->msg_alloc(msg_len);
+   if(msg_bytes != NULL) {
+      pcl_retrieve_cache_reply(peek, value, value_len, msg_bytes, msg_len);
+      pcl_send_reply(obj, WRP_MSG_TYPE__RETREIVE, msg_bytes, msg_len);
+   }
+   free(value);
+   return(true);
 }
 
-pcl_result_t pcl_sock_send_wrp(pcl_obj_t *obj, wrp_msg_t *msg, int *errsv) {
-   void *msg_bytes = NULL;
+bool pcl_retrieve_cache_key(pcl_obj_t *obj, const char *dest, size_t dest_len, const char **key, size_t *key_len) {
+   // The key is the dest from the service name on, so every mac prefix and a trailing '/' map to the same entry
+   const char *   path    = NULL;
+   pcl_service_t *service = pcl_service_find(obj, dest, dest_len, &path);
+   if(service == NULL) {
+      return(false);
+   }
+   *key     = path - service->name_len;
+   *key_len = dest_len - (*key - dest);
+   if(*key_len > service->name_len && (*key)[*key_len - 1] == '/') {
+      (*key_len)--;
+   }
+   return(true);
+}
+
+size_t pcl_retrieve_cache_reply(const pcl_wrp_peek_t *peek, const uint8_t *value, size_t value_len, void *buf, size_t size) {
+   // value holds the field count followed by every field of the first response except dest and transaction_uuid
+   uint32_t        count;
+   pcl_mp_writer_t writer;
+   memcpy(&count, value, sizeof(count));
+   pcl_mp_writer_init(&writer, buf, size);
+   pcl_mp_write_map(&writer, count + 2);
+   pcl_mp_write_str(&writer, "dest", 4);
+   pcl_mp_write_str(&writer, peek->source.str, peek->source.len);
+   pcl_mp_write_str(&writer, "transaction_uuid", 16);
+   pcl_mp_write_str(&writer, peek->transaction_uuid.str, peek->transaction_uuid.len);
+   pcl_mp_write_raw(&writer, &value[sizeof(count)], value_len - sizeof(count));
+   return(writer.len);
+}
+
+void pcl_retrieve_cache_record(pcl_obj_t *obj, const wrp_msg_t *msg, const void *msg_bytes, size_t msg_len) {
+   if(obj->retrieve_cache == NULL || msg->msg_type != WRP_MSG_TYPE__RETREIVE || msg->u.crud.transaction_uuid == NULL) {
+      return;
+   }
+   const char *uuid        = msg->u.crud.transaction_uuid;
+   void *      pending     = NULL;
+   size_t      pending_len = 0;
+   if(pcl_cache_lookup(obj->retrieve_pending, uuid, strlen(uuid), 0, &pending, &pending_len) != PCL_CACHE_HIT) {
+      return;
+   }
+   pcl_cache_remove(obj->retrieve_pending, uuid, strlen(uuid));
+
+   // Only successful responses built after the last invalidation are cached
+   uint32_t generation;
+   memcpy(&generation, pending, sizeof(generation));
+   if(msg->u.crud.status == 200 && generation == atomic_load(&obj->retrieve_generation)) {
+      uint32_t count;
+      ssize_t  fields_len = pcl_wrp_strip_addressing(msg_bytes, msg_len, NULL, 0, &count);
+      uint8_t *value      = (fields_len >= 0) ? (uint8_t *)malloc(sizeof(count) + fields_len) : NULL;
+      if(value != NULL) {
+         pcl_wrp_strip_addressing(msg_bytes, msg_len, &value[sizeof(count)], fields_len, &count);
+         memcpy(value, &count, sizeof(count));
+         pcl_cache_store(obj->retrieve_cache, (const char *)pending + sizeof(generation), pending_len - sizeof(generation), value, sizeof(count) + fields_len, obj->retrieve_ttl_ms, false);
+         free(value);
+      }
+   }
+   free(pending);
+}
+
+void pcl_idempotency_record(pcl_obj_t *obj, int msg_type, const char *uuid, const void *msg_bytes, size_t msg_len) {
+   // A response carries the transaction_uuid of its request, keep it for retries of the request
+   if(obj->idempotency == NULL || uuid == NULL || msg_type == WRP_MSG_TYPE__RETREIVE) {
+      return;
+   }
+   pcl_cache_store(obj->idempotency, uuid, strlen(uuid), msg_bytes, msg_len, obj->idempotency_window_ms, true);
+}
+
+const char *pcl_wrp_msg_uuid(const wrp_msg_t *msg) {
+   if(msg->msg_type == WRP_MSG_TYPE__REQ) {
+      return(msg->u.req.transaction_uuid);
+   } else if(msg->msg_type >= WRP_MSG_TYPE__CREATE && msg->msg_type <= WRP_MSG_TYPE__DELETE) {
+      return(msg->u.crud.transaction_uuid);
+   }
+   return(NULL);
+}
+
+bool pcl_service_handler_default(pcl_obj_t *obj, pcl_service_t *service, enum wrp_msg_type msg_type) {
+   if(obj->view_mode) {
+      return(service->handler_view == pcl_msg_handler_view);
+   }
+   switch(msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         return(service->handler_request == pcl_msg_handler_request);
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         return(service->handler_event == pcl_msg_handler_event);
+      }
+      case WRP_MSG_TYPE__CREATE: {
+         return(service->handler_create == pcl_msg_handler_create);
+      }
+      case WRP_MSG_TYPE__RETREIVE: {
+         return(service->handler_retrieve == pcl_msg_handler_retrieve);
+      }
+      case WRP_MSG_TYPE__UPDATE: {
+         return(service->handler_update == pcl_msg_handler_update);
+      }
+      case WRP_MSG_TYPE__DELETE: {
+         return(service->handler_delete == pcl_msg_handler_delete);
+      }
+      default: {
+         return(false);
+      }
+   }
+}
+
+// arena is the caller's reference to the arena being filled, taken from the pool on first use
+pcl_result_t pcl_recv_decode(pcl_obj_t *obj, char *msg_buf, int msg_len, const pcl_trace_ctx_t *trace, pcl_recv_msg_t *msg, pcl_arena_t **arena) {
+   bzero(msg, sizeof(*msg));
+   msg->trace = *trace;
+
+   // Keep the buffer when views are parsed in place at dispatch, or when its age is checked there before decoding
+   if(obj->view_mode || obj->shed_deadline) {
+      msg->buf     = msg_buf;
+      msg->len     = msg_len;
+      msg->recv_ns = obj->shed_deadline ? pcl_stats_time_ns() : 0;
+      atomic_fetch_add(&obj->recv_backlog, 1);
+      msg->trace.mark = pcl_trace_begin(&msg->trace);
+      return(PCL_RESULT_SUCCESS);
+   }
+   pcl_result_t result = pcl_recv_decode_wrp(obj, msg_buf, msg_len, msg, arena);
+   if(result == PCL_RESULT_SUCCESS) {
+      atomic_fetch_add(&obj->recv_backlog, 1);
+   }
+   return(result);
+}
+
+pcl_result_t pcl_recv_decode_wrp(pcl_obj_t *obj, char *msg_buf, int msg_len, pcl_recv_msg_t *msg, pcl_arena_t **arena) {
+   uint64_t trace_start = pcl_trace_begin(&msg->trace);
+   uint64_t start       = pcl_stats_time_ns();
+   msg->buf = NULL;
+   msg->len = msg_len;
+   if(obj->arena_pool != NULL && *arena == NULL) {
+      *arena = pcl_arena_get(obj->arena_pool);
+   }
+   if(*arena != NULL) {
+      if(pcl_wrp_decode_arena(msg_buf, msg_len, *arena, &msg->wrp)) {
+         pcl_arena_retain(*arena);
+         msg->arena = *arena;
+      } else {
+         msg_len = 0;
+      }
+   } else {
+      msg_len = (int) wrp_to_struct(msg_buf, msg_len, WRP_BYTES, &msg->wrp);
+   }
+   obj->recv.transport->msg_free(msg_buf);
+   pcl_stats_hist_record(&obj->stats.decode, start);
+   msg->trace.mark = pcl_trace_span(obj->trace, &msg->trace, PCL_TRACE_DECODE, trace_start);
+
+   if(msg_len < 1 || msg->wrp == NULL) {
+      pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SOCK_RECV_WRP);
+      return(PCL_RESULT_ERROR_SOCK_RECV_WRP);
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_recv_dispatch(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type) {
+   if(obj->dispatch == NULL) {
+      return(pcl_recv_dispatch_inline(obj, msg, msg_type));
+   }
+   enum wrp_msg_type type    = WRP_MSG_TYPE__UNKNOWN;
+   const char *      key     = NULL;
+   size_t            key_len = 0;
+
+   // Control messages and anything that cannot be keyed are handled on the receive thread
+   if(!pcl_recv_msg_key(msg, &type, &key, &key_len)) {
+      return(pcl_recv_dispatch_inline(obj, msg, msg_type));
+   }
+   pcl_dispatch_msg_t *item = (pcl_dispatch_msg_t *)malloc(sizeof(pcl_dispatch_msg_t));
+   if(item == NULL) {
+      return(pcl_recv_dispatch_inline(obj, msg, msg_type));
+   }
+   if(msg_type != NULL) {
+      *msg_type = type;
+   }
+   item->msg  = *msg;
+   msg->buf   = NULL;
+   msg->wrp   = NULL;
+   msg->arena = NULL;
+   atomic_fetch_add(&obj->dispatch_pending, 1);
+   pcl_dispatch_push(obj->dispatch, pcl_dispatch_hash(key, key_len), &item->node);
+   return(PCL_RESULT_SUCCESS);
+}
+
+bool pcl_recv_msg_key(pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type, const char **key, size_t *key_len) {
+   const char *uuid = NULL;
+   const char *dest = NULL;
+
+   if(msg->wrp != NULL) {
+      *msg_type = msg->wrp->msg_type;
+      switch(msg->wrp->msg_type) {
+         case WRP_MSG_TYPE__REQ:
+            uuid = msg->wrp->u.req.transaction_uuid;
+            dest = msg->wrp->u.req.dest;
+            break;
+         case WRP_MSG_TYPE__EVENT:
+            dest = msg->wrp->u.event.dest;
+            break;
+         case WRP_MSG_TYPE__CREATE:
+         case WRP_MSG_TYPE__RETREIVE:
+         case WRP_MSG_TYPE__UPDATE:
+         case WRP_MSG_TYPE__DELETE:
+            uuid = msg->wrp->u.crud.transaction_uuid;
+            dest = msg->wrp->u.crud.dest;
+            break;
+         default:
+            return(false);
+      }
+      *key     = (uuid != NULL) ? uuid : dest;
+      *key_len = (*key != NULL) ? strlen(*key) : 0;
+      return(*key != NULL);
+   }
+
+   pcl_msg_view_t view;
+   if(!pcl_wrp_view_parse(msg->buf, msg->len, &view)) {
+      return(false);
+   }
+   *msg_type = view.msg_type;
+   switch(view.msg_type) {
+      case WRP_MSG_TYPE__REQ:
+      case WRP_MSG_TYPE__EVENT:
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE:
+         break;
+      default:
+         return(false);
+   }
+   // key points into msg->buf which moves to the worker with the message
+   *key     = (view.transaction_uuid.len > 0) ? view.transaction_uuid.str : view.dest.str;
+   *key_len = (view.transaction_uuid.len > 0) ? view.transaction_uuid.len : view.dest.len;
+   return(true);
+}
+
+void pcl_dispatch_run(void *ctx, pcl_dispatch_node_t *node) {
+   pcl_dispatch_msg_t *item = (pcl_dispatch_msg_t *)node;
+   pcl_obj_t *obj = (pcl_obj_t *)ctx;
+   pcl_recv_dispatch_inline(obj, &item->msg, NULL);
+   free(item);
+   atomic_fetch_sub(&obj->dispatch_pending, 1);
+}
+
+pcl_result_t pcl_recv_dispatch_inline(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type) {
+   pcl_result_t result;
+   uint64_t     start;
+
+   atomic_fetch_sub(&obj->recv_backlog, 1);
+   pcl_trace_span(obj->trace, &msg->trace, PCL_TRACE_QUEUE, msg->trace.mark);
+   if(msg->recv_ns != 0) {
+      if(pcl_recv_expired(obj, msg, msg_type, &result)) {
+         return(result);
+      }
+      if(!obj->view_mode) { // decoding was left until the age was checked
+         pcl_arena_t *arena = NULL;
+         if(obj->arena_pool != NULL) {
+            arena = pcl_arena_get(obj->arena_pool);
+         }
+         result = pcl_recv_decode_wrp(obj, msg->buf, msg->len, msg, &arena);
+         if(arena != NULL) { // the message holds its own reference
+            pcl_arena_release(arena);
+         }
+         if(result != PCL_RESULT_SUCCESS) {
+            return(result);
+         }
+      }
+   }
+
+   if(msg->wrp != NULL) {
+      if(msg_type != NULL) {
+         *msg_type = msg->wrp->msg_type;
+      }
+      pcl_stats_add(&obj->stats.recv_msgs[pcl_stats_type_index(msg->wrp->msg_type)], 1);
+      pcl_stats_add(&obj->stats.recv_bytes[pcl_stats_type_index(msg->wrp->msg_type)], msg->len);
+      const pcl_trace_ctx_t *trace_prev = (obj->trace != NULL) ? pcl_trace_enter(obj->trace, &msg->trace) : NULL;
+      msg->trace.mark = pcl_trace_begin(&msg->trace);
+      start  = pcl_stats_time_ns();
+      result = pcl_msg_dispatch(obj, msg->wrp, &msg->trace);
+      pcl_stats_hist_record(&obj->stats.handler, start);
+      pcl_trace_span(obj->trace, &msg->trace, PCL_TRACE_HANDLER, msg->trace.mark);
+      if(obj->trace != NULL) {
+         pcl_trace_leave(obj->trace, trace_prev);
+      }
+      pcl_stats_result(&obj->stats, result);
+      pcl_recv_msg_free(msg);
+      return(result);
+   }
+
+   pcl_msg_view_t   view;
+   pcl_view_owner_t owner = { .msg_buf = msg->buf, .transport = obj->recv.transport, .ref = NULL };
+
+   uint64_t trace_start = pcl_trace_begin(&msg->trace);
+   start = pcl_stats_time_ns();
+   if(!pcl_wrp_view_parse(msg->buf, msg->len, &view)) {
+      pcl_stats_hist_record(&obj->stats.decode, start);
+      result = PCL_RESULT_ERROR_SOCK_RECV_WRP;
+   } else {
+      pcl_stats_hist_record(&obj->stats.decode, start);
+      msg->trace.mark = pcl_trace_span(obj->trace, &msg->trace, PCL_TRACE_DECODE, trace_start);
+      if(msg_type != NULL) {
+         *msg_type = view.msg_type;
+      }
+      pcl_stats_add(&obj->stats.recv_msgs[pcl_stats_type_index(view.msg_type)], 1);
+      pcl_stats_add(&obj->stats.recv_bytes[pcl_stats_type_index(view.msg_type)], msg->len);
+      const pcl_trace_ctx_t *trace_prev = (obj->trace != NULL) ? pcl_trace_enter(obj->trace, &msg->trace) : NULL;
+      view.priv = &owner;
+      start     = pcl_stats_time_ns();
+      result    = pcl_msg_dispatch_view(obj, &view, &msg->trace);
+      pcl_stats_hist_record(&obj->stats.handler, start);
+      pcl_trace_span(obj->trace, &msg->trace, PCL_TRACE_HANDLER, msg->trace.mark);
+      if(obj->trace != NULL) {
+         pcl_trace_leave(obj->trace, trace_prev);
+      }
+   }
+   pcl_stats_result(&obj->stats, result);
+   pcl_view_unref(&owner);
+   msg->buf = NULL;
+   return(result);
+}
+
+bool pcl_recv_expired(pcl_obj_t *obj, pcl_recv_msg_t *msg, enum wrp_msg_type *msg_type, pcl_result_t *result) {
+   pcl_wrp_peek_t peek;
+   uint64_t       age_ns = pcl_stats_time_ns() - msg->recv_ns;
+
+   pcl_stats_hist_record(&obj->stats.queue_age, msg->recv_ns);
+   if(!pcl_wrp_peek(msg->buf, msg->len, &peek) || peek.msg_type >= PCL_BATCH_MSG_TYPE_MAX) { // left for the decode to report
+      return(false);
+   }
+   uint64_t deadline_ns = obj->shed_deadline_ns[peek.msg_type];
+   if(deadline_ns == 0 || age_ns <= deadline_ns) {
+      // Stop shedding once messages are dispatched well within their deadline and the backlog has halved
+      if(atomic_load_explicit(&obj->shedding, memory_order_relaxed) && (deadline_ns == 0 || age_ns <= deadline_ns / 2) &&
+         (obj->shed_backlog_max == 0 || atomic_load(&obj->recv_backlog) <= obj->shed_backlog_max / 2)) {
+         pcl_shed_state(obj, false, age_ns);
+      }
+      return(false);
+   }
+   if(msg_type != NULL) {
+      *msg_type = peek.msg_type;
+   }
+   pcl_recv_shed(obj, &peek, age_ns);
+   pcl_stats_add(&obj->stats.recv_msgs[pcl_stats_type_index(peek.msg_type)], 1);
+   pcl_stats_add(&obj->stats.recv_bytes[pcl_stats_type_index(peek.msg_type)], msg->len);
+   pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SHED);
+   obj->recv.transport->msg_free(msg->buf);
+   msg->buf = NULL;
+   *result  = PCL_RESULT_ERROR_SHED;
+   return(true);
+}
+
+void pcl_recv_shed(pcl_obj_t *obj, const pcl_wrp_peek_t *peek, uint64_t age_ns) {
+   pcl_stats_add((age_ns > 0) ? &obj->stats.shed_expired : &obj->stats.shed_backlog, 1);
+   pcl_recv_forget(obj, peek->transaction_uuid.str, peek->transaction_uuid.len);
+
+   // Crud messages can be answered so the requester does not wait for its own timeout
+   bool crud = (peek->msg_type >= WRP_MSG_TYPE__CREATE && peek->msg_type <= WRP_MSG_TYPE__DELETE);
+   if(obj->shed_reject && crud && peek->transaction_uuid.len > 0 && peek->source.str != NULL) {
+      size_t msg_len   = pcl_shed_reply(peek, NULL, 0);
+      void * msg_bytes = obj->send.transport->msg_alloc(msg_len);
+      if(msg_bytes != NULL) {
+         pcl_shed_reply(peek, msg_bytes, msg_len);
+         pcl_send_reply(obj, peek->msg_type, msg_bytes, msg_len);
+         pcl_stats_add(&obj->stats.shed_rejected, 1);
+      }
+   }
+   if(!atomic_load_explicit(&obj->shedding, memory_order_relaxed)) {
+      pcl_shed_state(obj, true, age_ns);
+   }
+}
+
+void pcl_recv_forget(pcl_obj_t *obj, const char *uuid, size_t uuid_len) {
+   // The message never reached a handler, so a retry is dispatched instead of suppressed and the 503 or missing response is not cached
+   if(uuid == NULL || uuid_len == 0) {
+      return;
+   }
+   if(obj->idempotency != NULL) {
+      pcl_cache_remove(obj->idempotency, uuid, uuid_len);
+   }
+   if(obj->retrieve_pending != NULL) {
+      pcl_cache_remove(obj->retrieve_pending, uuid, uuid_len);
+   }
+}
+
+void pcl_shed_state(pcl_obj_t *obj, bool shedding, uint64_t age_ns) {
+   // Only the thread making the change reports it
+   if(atomic_exchange(&obj->shedding, shedding) != shedding && obj->handler_shed != NULL) {
+      (*obj->handler_shed)(shedding, atomic_load(&obj->recv_backlog), age_ns / 1000000);
+   }
+}
+
+size_t pcl_shed_reply(const pcl_wrp_peek_t *peek, void *buf, size_t size) {
+   pcl_mp_writer_t writer;
+   pcl_mp_writer_init(&writer, buf, size);
+   pcl_mp_write_map(&writer, 5);
+   pcl_mp_write_str(&writer, "msg_type", 8);
+   pcl_mp_write_int(&writer, peek->msg_type);
+   pcl_mp_write_str(&writer, "source", 6);
+   pcl_mp_write_str(&writer, peek->dest.str, peek->dest.len);
+   pcl_mp_write_str(&writer, "dest", 4);
+   pcl_mp_write_str(&writer, peek->source.str, peek->source.len);
+   pcl_mp_write_str(&writer, "transaction_uuid", 16);
+   pcl_mp_write_str(&writer, peek->transaction_uuid.str, peek->transaction_uuid.len);
+   pcl_mp_write_str(&writer, "status", 6);
+   pcl_mp_write_int(&writer, 503);
+   return(writer.len);
+}
+
+void pcl_recv_msg_free(pcl_recv_msg_t *msg) {
+   if(msg->arena != NULL) { // freed with the rest of the arena
+      pcl_arena_release(msg->arena);
+      msg->arena = NULL;
+   } else {
+      wrp_free_struct(msg->wrp);
+   }
+   msg->wrp = NULL;
+}
+
+pcl_result_t pcl_msg_dispatch(pcl_obj_t *obj, wrp_msg_t *msg_wrp, pcl_trace_ctx_t *trace) {
+   pcl_result_t result = PCL_RESULT_ERROR_INTERNAL;
+   const char * uuid   = NULL;
+   const char * dest   = NULL;
+
+   switch(msg_wrp->msg_type) {
+      case WRP_MSG_TYPE__AUTH: {
+         return(pcl_msg_handler_auth(obj, &msg_wrp->u.auth));
+      }
+      case WRP_MSG_TYPE__SVC_REGISTRATION: {
+         return(pcl_msg_handler_register(obj, &msg_wrp->u.reg));
+      }
+      case WRP_MSG_TYPE__SVC_ALIVE: {
+         atomic_store_explicit(&obj->alive_ns, pcl_stats_time_ns(), memory_order_relaxed);
+         return((*obj->handler_alive)());
+      }
+      case WRP_MSG_TYPE__REQ: {
+         uuid = msg_wrp->u.req.transaction_uuid;
+         dest = msg_wrp->u.req.dest;
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         dest = msg_wrp->u.event.dest;
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         uuid = msg_wrp->u.crud.transaction_uuid;
+         dest = msg_wrp->u.crud.dest;
+         break;
+      }
+      case WRP_MSG_TYPE__UNKNOWN:
+      default: {
+         return(PCL_RESULT_ERROR_SOCK_RECV_MSGTYPE);
+      }
+   }
+
+   // Responses to outstanding requests go to the request's callback
+   if(uuid != NULL && pcl_response_match(obj, uuid, strlen(uuid), msg_wrp, NULL)) {
+      return(PCL_RESULT_SUCCESS);
+   }
+
+   // The handler span starts once the service is matched
+   const char *   path     = NULL;
+   size_t         dest_len = (dest != NULL) ? strlen(dest) : 0;
+   pcl_service_t *service  = pcl_service_find(obj, dest, dest_len, &path);
+   trace->mark = pcl_trace_span(obj->trace, trace, PCL_TRACE_MATCH, trace->mark);
+   if(service == NULL) {
+      pcl_recv_forget(obj, uuid, (uuid != NULL) ? strlen(uuid) : 0);
+      return(PCL_RESULT_ERROR_SOCK_RECV_SVCNAME);
+   }
+
+   // Chunks go to the stream handler, then registered routes take priority over the per type handler
+   if(obj->handler_stream != NULL && pcl_stream_dispatch(obj, msg_wrp, NULL, &result)) {
+      return(result);
+   }
+   if(pcl_route_dispatch(service, msg_wrp->msg_type, path, dest_len - (path - dest), msg_wrp, NULL, &result)) {
+      return(result);
+   }
+
+   // Call handler based on message type
+   switch(msg_wrp->msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         result = (*service->handler_request)(&msg_wrp->u.req);
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         result = (*service->handler_event)(&msg_wrp->u.event);
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE: {
+         result = (*service->handler_create)(&msg_wrp->u.crud);
+         break;
+      }
+      case WRP_MSG_TYPE__RETREIVE: {
+         result = (*service->handler_retrieve)(&msg_wrp->u.crud);
+         break;
+      }
+      case WRP_MSG_TYPE__UPDATE: {
+         result = (*service->handler_update)(&msg_wrp->u.crud);
+         break;
+      }
+      case WRP_MSG_TYPE__DELETE: {
+         result = (*service->handler_delete)(&msg_wrp->u.crud);
+         break;
+      }
+      default: {
+         result = PCL_RESULT_ERROR_SOCK_RECV_MSGTYPE;
+         break;
+      }
+   }
+   return(result);
+}
+
+pcl_result_t pcl_msg_dispatch_view(pcl_obj_t *obj, const pcl_msg_view_t *view, pcl_trace_ctx_t *trace) {
+   pcl_result_t result = PCL_RESULT_ERROR_INTERNAL;
+
+   if(view->msg_type >= WRP_MSG_TYPE__REQ && view->msg_type <= WRP_MSG_TYPE__DELETE && view->msg_type != WRP_MSG_TYPE__EVENT && view->transaction_uuid.len > 0) {
+      if(pcl_response_match(obj, view->transaction_uuid.str, view->transaction_uuid.len, NULL, view)) {
+         return(PCL_RESULT_SUCCESS);
+      }
+   }
+
+   switch(view->msg_type) {
+      case WRP_MSG_TYPE__AUTH: {
+         struct wrp_auth_msg auth = { .status = view->status };
+         result = pcl_msg_handler_auth(obj, &auth);
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_REGISTRATION: {
+         result = PCL_RESULT_SUCCESS;
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_ALIVE: {
+         atomic_store_explicit(&obj->alive_ns, pcl_stats_time_ns(), memory_order_relaxed);
+         result = (*obj->handler_alive)();
+         break;
+      }
+      case WRP_MSG_TYPE__REQ:
+      case WRP_MSG_TYPE__EVENT:
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         const char *   path    = NULL;
+         pcl_service_t *service = pcl_service_find(obj, view->dest.str, view->dest.len, &path);
+         trace->mark = pcl_trace_span(obj->trace, trace, PCL_TRACE_MATCH, trace->mark);
+         if(service == NULL) {
+            pcl_recv_forget(obj, view->transaction_uuid.str, view->transaction_uuid.len);
+            result = PCL_RESULT_ERROR_SOCK_RECV_SVCNAME;
+         } else if(obj->handler_stream != NULL && pcl_stream_dispatch(obj, NULL, view, &result)) {
+            break;
+         } else if(!pcl_route_dispatch(service, view->msg_type, path, view->dest.len - (path - view->dest.str), NULL, view, &result)) {
+            result = (*service->handler_view)(view);
+         }
+         break;
+      }
+      case WRP_MSG_TYPE__UNKNOWN:
+      default: {
+         result = PCL_RESULT_ERROR_SOCK_RECV_MSGTYPE;
+         break;
+      }
+   }
+   return(result);
+}
+
+bool pcl_route_dispatch(pcl_service_t *service, enum wrp_msg_type msg_type, const char *path, size_t path_len, wrp_msg_t *msg, const pcl_msg_view_t *view, pcl_result_t *result) {
+   pcl_route_match_t   match;
+   pcl_route_handler_t handler;
+   void *              ctx;
+
+   if(pcl_route_table_empty(service->routes) || !pcl_route_table_lookup(service->routes, msg_type, path, path_len, &match, &handler, &ctx)) {
+      return(false);
+   }
+   *result = (*handler)(ctx, msg, view, &match);
+   return(true);
+}
+
+bool pcl_stream_dispatch(pcl_obj_t *obj, wrp_msg_t *msg, const pcl_msg_view_t *view, pcl_result_t *result) {
+   pcl_stream_chunk_t chunk;
+   pcl_str_view_t     source       = { NULL, 0 };
+   size_t             payload_size = 0;
+   bool               found        = false;
+
+   if(msg != NULL) {
+      headers_t *headers = NULL;
+      switch(msg->msg_type) {
+         case WRP_MSG_TYPE__REQ: {
+            headers      = msg->u.req.headers;
+            source.str   = msg->u.req.source;
+            payload_size = msg->u.req.payload_size;
+            break;
+         }
+         case WRP_MSG_TYPE__EVENT: {
+            headers      = msg->u.event.headers;
+            source.str   = msg->u.event.source;
+            payload_size = msg->u.event.payload_size;
+            break;
+         }
+         default: {
+            headers      = msg->u.crud.headers;
+            source.str   = msg->u.crud.source;
+            payload_size = msg->u.crud.payload_size;
+            break;
+         }
+      }
+      for(size_t index = 0; headers != NULL && index < headers->count && !found; index++) {
+         found = (headers->headers[index] != NULL && pcl_stream_header_parse(headers->headers[index], strlen(headers->headers[index]), &chunk));
+      }
+      source.len = (source.str != NULL) ? strlen(source.str) : 0;
+   } else {
+      pcl_str_view_t header;
+      for(uint32_t index = 0; index < view->header_count && !found; index++) {
+         found = (pcl_msg_view_header(view, index, &header) && pcl_stream_header_parse(header.str, header.len, &chunk));
+      }
+      source       = view->source;
+      payload_size = view->payload_size;
+   }
+   if(!found) {
+      return(false);
+   }
+
+   // Each stream is tracked by its source and id until the last chunk, a chunk out of sequence drops the rest of the stream
+   char    key[PCL_URL_LEN_MAX + sizeof(uint32_t)];
+   size_t  key_len = (source.len < PCL_URL_LEN_MAX) ? source.len : PCL_URL_LEN_MAX;
+   memcpy(key, &chunk.stream_id, sizeof(uint32_t));
+   memcpy(&key[sizeof(uint32_t)], source.str, key_len);
+   key_len += sizeof(uint32_t);
+
+   pcl_stream_state_t state = { 0, 0 };
+   void *             value = NULL;
+   size_t             value_len;
+   if(chunk.seq > 0 && pcl_cache_lookup(obj->streams, key, key_len, 0, &value, &value_len) == PCL_CACHE_HIT) {
+      memcpy(&state, value, sizeof(state));
+      free(value);
+   }
+   if(state.seq != chunk.seq) {
+      pcl_cache_remove(obj->streams, key, key_len);
+      pcl_stats_add(&obj->stats.stream_chunks_dropped, 1);
+      *result = PCL_RESULT_ERROR_SOCK_RECV_PAYLOAD;
+      return(true);
+   }
+   chunk.offset  = state.offset;
+   state.seq++;
+   state.offset += payload_size;
+   if(chunk.last) {
+      pcl_cache_remove(obj->streams, key, key_len);
+   } else {
+      pcl_cache_store(obj->streams, key, key_len, &state, sizeof(state), obj->stream_timeout_ms, false);
+   }
+   pcl_stats_add(&obj->stats.stream_chunks_recv, 1);
+   *result = (*obj->handler_stream)(&chunk, msg, view);
+   return(true);
+}
+
+bool pcl_stream_header_parse(const char *header, size_t header_len, pcl_stream_chunk_t *chunk) {
+   const size_t name_len = sizeof(PCL_STREAM_HEADER) - 1;
+   if(header_len <= name_len || header_len >= PCL_STREAM_HEADER_LEN_MAX || strncasecmp(header, PCL_STREAM_HEADER, name_len) != 0 || header[name_len] != ':') {
+      return(false);
+   }
+   char     value[PCL_STREAM_HEADER_LEN_MAX]; // view headers are not null terminated
+   unsigned last;
+   memcpy(value, &header[name_len + 1], header_len - name_len - 1);
+   value[header_len - name_len - 1] = '\0';
+   if(sscanf(value, "%x %u %u", &chunk->stream_id, &chunk->seq, &last) != 3) {
+      return(false);
+   }
+   chunk->offset = 0;
+   chunk->last   = (last != 0);
+   return(true);
+}
+
+bool pcl_stream_msg_is_chunk(const wrp_msg_t *msg) {
+   // A chunk of a stream shares the transaction_uuid of the whole stream, it is not the response to a request
+   headers_t *headers;
+   switch(msg->msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         headers = msg->u.req.headers;
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         headers = msg->u.crud.headers;
+         break;
+      }
+      default: {
+         return(false);
+      }
+   }
+   const size_t name_len = sizeof(PCL_STREAM_HEADER) - 1;
+   for(size_t index = 0; headers != NULL && index < headers->count; index++) {
+      const char *header = headers->headers[index];
+      if(header != NULL && strncasecmp(header, PCL_STREAM_HEADER, name_len) == 0 && header[name_len] == ':') {
+         return(true);
+      }
+   }
+   return(false);
+}
+
+bool pcl_response_match(pcl_obj_t *obj, const char *uuid, size_t uuid_len, wrp_msg_t *msg, const pcl_msg_view_t *view) {
+   pcl_response_handler_t callback;
+   void *                 ctx;
+
+   if(!pcl_request_table_remove(obj->requests, uuid, uuid_len, &callback, &ctx)) {
+      return(false);
+   }
+   (*callback)(ctx, PCL_RESULT_SUCCESS, msg, view);
+   return(true);
+}
+
+pcl_msg_view_t *pcl_msg_view_retain(const pcl_msg_view_t *view) {
+   if(view == NULL || view->priv == NULL) {
+      return(NULL);
+   }
+   pcl_view_owner_t *owner = (pcl_view_owner_t *)view->priv;
+
+   if(owner->ref == NULL) { // first retain, share the buffer between the dispatcher and the retained copy
+      owner->ref = (pcl_view_ref_t *)malloc(sizeof(pcl_view_ref_t));
+      if(owner->ref == NULL) {
+         return(NULL);
+      }
+      atomic_init(&owner->ref->refs, 1);
+   }
+   pcl_view_retained_t *retained = (pcl_view_retained_t *)malloc(sizeof(pcl_view_retained_t));
+   if(retained == NULL) {
+      return(NULL);
+   }
+   atomic_fetch_add(&owner->ref->refs, 1);
+   retained->view       = *view;
+   retained->owner      = *owner;
+   retained->view.priv  = &retained->owner;
+   return(&retained->view);
+}
+
+void pcl_msg_view_release(pcl_msg_view_t *view) {
+   if(view == NULL || view->priv == NULL) {
+      return;
+   }
+   pcl_view_unref((pcl_view_owner_t *)view->priv);
+   free((pcl_view_retained_t *)view);
+}
+
+void pcl_view_unref(pcl_view_owner_t *owner) {
+   if(owner->ref == NULL) {
+      owner->transport->msg_free(owner->msg_buf);
+   } else if(atomic_fetch_sub(&owner->ref->refs, 1) == 1) {
+      owner->transport->msg_free(owner->msg_buf);
+      free(owner->ref);
+   }
+   owner->msg_buf = NULL;
+   owner->ref     = NULL;
+}
+
+pcl_service_t *pcl_service_find(pcl_obj_t *obj, const char *dest, size_t dest_len, const char **path) {
+   if(dest != NULL && dest_len >= 4 && strncmp("mac:", dest, 4) == 0) {
+      const char *service = memchr(dest, '/', dest_len);
+      if(service == NULL) {
+         return(NULL);
+      }
+      service++;
+
+      //const char *mac = dest + 4;
+      //printf("%s: mac <%.12s> service <%s>\n", __FUNCTION__, mac, service);
+
+      // TODO check mac address
+      
+      // Service name ends in /, ?, # or null termination
+      size_t remaining = dest_len - (service - dest);
+      size_t name_len  = 0;
+      while(name_len < remaining && service[name_len] != '/' && service[name_len] != '?' && service[name_len] != '#' && service[name_len] != '\0') {
+         name_len++;
+      }
+      pcl_service_t *entry = pcl_service_lookup(obj, service, name_len);
+      if(entry != NULL && path != NULL) {
+         *path = service + name_len;
+      }
+      return(entry);
+   }
+   return(NULL);
+}
+
+pcl_service_t *pcl_service_lookup(pcl_obj_t *obj, const char *name, size_t name_len) {
+   uint32_t hash = pcl_dispatch_hash(name, name_len);
+
+   for(uint32_t probe = 0; probe < PCL_SERVICE_HASH_SIZE; probe++) {
+      pcl_service_t *entry = atomic_load_explicit(&obj->service_hash[(hash + probe) & (PCL_SERVICE_HASH_SIZE - 1)], memory_order_acquire);
+      if(entry == NULL) {
+         break;
+      }
+      if(entry->hash == hash && entry->name_len == name_len && memcmp(entry->name, name, name_len) == 0) {
+         return(entry);
+      }
+   }
+   return(NULL);
+}
+
+pcl_service_t *pcl_service_insert(pcl_obj_t *obj, const char *name, pcl_result_t *result) {
+   size_t name_len = strlen(name);
+   if(name_len == 0 || name_len >= PCL_SERVICE_NAME_LEN_MAX || strpbrk(name, "/?#") != NULL) {
+      *result = PCL_RESULT_ERROR_PARAMS;
+      return(NULL);
+   }
+   if(pcl_service_lookup(obj, name, name_len) != NULL) {
+      *result = PCL_RESULT_ERROR_PARAMS;
+      return(NULL);
+   }
+   if(obj->service_qty >= PCL_SERVICE_QTY_MAX) {
+      *result = PCL_RESULT_ERROR_SERVICE_LIMIT;
+      return(NULL);
+   }
+   pcl_service_t *service = &obj->services[obj->service_qty];
+   bzero(service, sizeof(*service));
+   service->routes = pcl_route_table_create();
+   if(service->routes == NULL) {
+      *result = PCL_RESULT_ERROR_OUT_OF_MEMORY;
+      return(NULL);
+   }
+   memcpy(service->name, name, name_len + 1);
+   service->name_len    = name_len;
+   service->hash        = pcl_dispatch_hash(name, name_len);
+   service->authorized  = false;
+   service->auth_status = -1;
+   obj->service_qty++;
+   *result = PCL_RESULT_SUCCESS;
+   return(service);
+}
+
+void pcl_service_publish(pcl_obj_t *obj, pcl_service_t *service) {
+   // The table holds at most half as many services as slots so a free slot always exists
+   for(uint32_t probe = 0; probe < PCL_SERVICE_HASH_SIZE; probe++) {
+      uint32_t slot = (service->hash + probe) & (PCL_SERVICE_HASH_SIZE - 1);
+      if(atomic_load_explicit(&obj->service_hash[slot], memory_order_relaxed) == NULL) {
+         atomic_store_explicit(&obj->service_hash[slot], service, memory_order_release);
+         return;
+      }
+   }
+}
+
+pcl_result_t pcl_service_add(pcl_object_t object, const pcl_service_params_t *params, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || params == NULL || params->service_name == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+
+   pcl_result_t result;
+   sem_wait(&obj->service_lock);
+   pcl_service_t *service = pcl_service_insert(obj, params->service_name, &result);
+   if(service == NULL) {
+      sem_post(&obj->service_lock);
+      return(result);
+   }
+   service->handler_request  = params->handler_request  ? params->handler_request  : pcl_msg_handler_request;
+   service->handler_event    = params->handler_event    ? params->handler_event    : pcl_msg_handler_event;
+   service->handler_create   = params->handler_create   ? params->handler_create   : pcl_msg_handler_create;
+   service->handler_retrieve = params->handler_retrieve ? params->handler_retrieve : pcl_msg_handler_retrieve;
+   service->handler_update   = params->handler_update   ? params->handler_update   : pcl_msg_handler_update;
+   service->handler_delete   = params->handler_delete   ? params->handler_delete   : pcl_msg_handler_delete;
+   service->handler_view     = params->handler_view     ? params->handler_view     : pcl_msg_handler_view;
+   pcl_service_publish(obj, service);
+   sem_post(&obj->service_lock);
+
+   XLOGD_INFO("service name <%s>", service->name);
+
+   // The service stays routable if registration fails so it can be registered again later
+   if(PCL_RESULT_SUCCESS != pcl_register(obj, service, 0, errsv)) {
+      return(PCL_RESULT_ERROR_REGISTER);
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_service_route_add(pcl_object_t object, const char *service_name, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || service_name == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_service_t *service = pcl_service_lookup(obj, service_name, strlen(service_name));
+   if(service == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   return(pcl_route_table_add(service->routes, msg_type, pattern, handler, ctx));
+}
+
+bool pcl_service_authorized(pcl_object_t object, const char *service_name, int *auth_status) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || service_name == NULL) {
+      return(false);
+   }
+   pcl_service_t *service = pcl_service_lookup(obj, service_name, strlen(service_name));
+   if(service == NULL) {
+      return(false);
+   }
+   sem_wait(&obj->service_lock); // AUTH messages and the supervisor update the state
+   bool authorized = service->authorized;
+   if(auth_status != NULL) {
+      *auth_status = service->auth_status;
+   }
+   sem_post(&obj->service_lock);
+   return(authorized);
+}
+
+pcl_result_t pcl_send(pcl_object_t object, wrp_msg_t *msg, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || msg == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   // Once parodus has been lost, messages are held until the service is authorized again
+   bool replay = (obj->replay.cells != NULL && atomic_load(&obj->authorized_ns) != 0);
+   if(!obj->authorized) {
+      if(replay) {
+         return(pcl_replay_push(obj, msg, errsv));
+      }
+      return(PCL_RESULT_ERROR_SOCK_SEND_AUTH);
+   }
+   pcl_result_t result = pcl_sock_send_wrp(obj, msg, 0, errsv);
+   if(result == PCL_RESULT_ERROR_SOCK_SEND_WRITE && replay && !obj->authorized) { // this failure was taken as losing parodus
+      result = pcl_replay_push(obj, msg, errsv);
+   }
+   return(result);
+}
+
+pcl_result_t pcl_send_stream(pcl_object_t object, wrp_msg_t *msg, pcl_stream_reader_t reader, void *ctx, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || msg == NULL || reader == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   // Held for the whole stream so pcl_term cannot free the object between chunks
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   wrp_msg_t   chunk = *msg;
+   headers_t **headers;
+   void **     payload;
+   size_t *    payload_size;
+   switch(chunk.msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         headers      = &chunk.u.req.headers;
+         payload      = &chunk.u.req.payload;
+         payload_size = &chunk.u.req.payload_size;
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         headers      = &chunk.u.event.headers;
+         payload      = &chunk.u.event.payload;
+         payload_size = &chunk.u.event.payload_size;
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         headers      = &chunk.u.crud.headers;
+         payload      = &chunk.u.crud.payload;
+         payload_size = &chunk.u.crud.payload_size;
+         break;
+      }
+      default: {
+         pcl_side_leave(&obj->send_side);
+         return(PCL_RESULT_ERROR_PARAMS);
+      }
+   }
+
+   // Each chunk carries the caller's headers followed by the chunk header.  One byte is read past each chunk to tell whether
+   // it is the last, and carried over to the start of the next.
+   size_t     header_qty = (*headers != NULL) ? (*headers)->count : 0;
+   headers_t *chunk_headers = (headers_t *)malloc(sizeof(headers_t) + (header_qty + 1) * sizeof(char *));
+   uint8_t *  buf           = (uint8_t *)malloc(obj->stream_chunk_size + 1);
+   char       header[PCL_STREAM_HEADER_LEN_MAX];
+   if(chunk_headers == NULL || buf == NULL) {
+      free(chunk_headers);
+      free(buf);
+      pcl_side_leave(&obj->send_side);
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   if(header_qty > 0) {
+      memcpy(chunk_headers->headers, (*headers)->headers, header_qty * sizeof(char *));
+   }
+   chunk_headers->count = header_qty + 1;
+   chunk_headers->headers[header_qty] = header;
+   *headers = chunk_headers;
+   *payload = buf;
+
+   uint32_t     stream_id = atomic_fetch_add(&obj->stream_next, 1);
+   size_t       carry     = 0;
+   pcl_result_t result    = PCL_RESULT_SUCCESS;
+   for(uint32_t seq = 0; result == PCL_RESULT_SUCCESS; seq++) {
+      ssize_t len = pcl_stream_fill(reader, ctx, buf, carry, obj->stream_chunk_size + 1);
+      if(len < 0) {
+         *errsv = errno;
+         result = PCL_RESULT_ERROR_SEND_ABORTED;
+         break;
+      }
+      bool last = ((size_t)len <= obj->stream_chunk_size);
+      *payload_size = last ? (size_t)len : obj->stream_chunk_size;
+      snprintf(header, sizeof(header), "%s: %08x %u %u", PCL_STREAM_HEADER, stream_id, seq, last);
+      result = pcl_send(obj, &chunk, errsv);
+      if(result == PCL_RESULT_SUCCESS) {
+         pcl_stats_add(&obj->stats.stream_chunks_sent, 1);
+      }
+      if(last) {
+         break;
+      }
+      buf[0] = buf[obj->stream_chunk_size];
+      carry  = 1;
+   }
+   free(chunk_headers);
+   free(buf);
+   pcl_side_leave(&obj->send_side);
+   return(result);
+}
+
+ssize_t pcl_stream_fill(pcl_stream_reader_t reader, void *ctx, uint8_t *buf, size_t len, size_t size) {
+   // Readers may return less than asked for before the end of the payload
+   while(len < size) {
+      ssize_t ret = (*reader)(ctx, &buf[len], size - len);
+      if(ret < 0) {
+         return(-1);
+      }
+      if(ret == 0) {
+         break;
+      }
+      len += ret;
+   }
+   return(len);
+}
+
+ssize_t pcl_stream_read_fd(void *ctx, void *buf, size_t size) {
+   ssize_t ret;
+   do {
+      ret = read(*(int *)ctx, buf, size);
+   } while(ret < 0 && errno == EINTR);
+   return(ret);
+}
+
+pcl_result_t pcl_send_request_async(pcl_object_t object, wrp_msg_t *msg, uint32_t deadline_ms, pcl_response_handler_t callback, void *ctx, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || msg == NULL || callback == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   const char *uuid = pcl_wrp_msg_uuid(msg);
+   if(uuid == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(!obj->authorized) {
+      return(PCL_RESULT_ERROR_SOCK_SEND_AUTH);
+   }
+
+   // Register before sending so a fast response cannot be missed
+   pcl_result_t result = pcl_request_table_add(obj->requests, uuid, deadline_ms, callback, ctx);
+   if(result != PCL_RESULT_SUCCESS) {
+      return(result);
+   }
+   result = pcl_sock_send_wrp(obj, msg, 0, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      pcl_request_table_remove(obj->requests, uuid, strlen(uuid), &callback, &ctx);
+   } else {
+      pcl_loop_notify(obj); // the loop may need to wake up earlier for the new deadline
+   }
+   return(result);
+}
+
+pcl_result_t pcl_template_create(pcl_object_t object, const wrp_msg_t *proto, pcl_template_t *tmpl) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || proto == NULL || tmpl == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   ssize_t head_len = pcl_wrp_encode_head(proto, NULL, 0);
+   if(head_len < 1) {
+      return(PCL_RESULT_ERROR_SOCK_SEND_WRP);
+   }
+   pcl_template_obj_t *template = (pcl_template_obj_t *)malloc(sizeof(pcl_template_obj_t) + head_len);
+   if(template == NULL) {
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   template->obj      = obj;
+   template->msg_type = proto->msg_type;
+   template->head_len = pcl_wrp_encode_head(proto, template->head, head_len);
+   *tmpl = template;
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_template_send(pcl_template_t tmpl, const void *payload, size_t payload_len, const char *transaction_uuid, int *errsv) {
+   pcl_template_obj_t *template = (pcl_template_obj_t *)tmpl;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(template == NULL || (transaction_uuid == NULL && template->msg_type != WRP_MSG_TYPE__EVENT)) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_obj_t *obj = template->obj;
+   if(!obj->authorized) {
+      return(PCL_RESULT_ERROR_SOCK_SEND_AUTH);
+   }
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+
+   // Copy the invariant fields and append the variable ones straight into a buffer owned by the transport
+   size_t   msg_len   = template->head_len + pcl_wrp_encode_tail(template->msg_type, transaction_uuid, payload, payload_len, NULL, 0);
+   uint8_t *msg_bytes = (uint8_t *)obj->send.transport->msg_alloc(msg_len);
+   if(msg_bytes == NULL) {
+      *errsv = errno;
+      pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      pcl_side_leave(&obj->send_side);
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   memcpy(msg_bytes, template->head, template->head_len);
+   pcl_wrp_encode_tail(template->msg_type, transaction_uuid, payload, payload_len, &msg_bytes[template->head_len], msg_len - template->head_len);
+   if(template->msg_type != WRP_MSG_TYPE__EVENT) {
+      pcl_idempotency_record(obj, template->msg_type, transaction_uuid, msg_bytes, msg_len);
+   }
+
+   pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, msg_bytes, msg_len);
+   uint64_t start = pcl_stats_time_ns();
+   int      ret   = obj->send.transport->send_msg(&obj->send, msg_bytes, msg_len, 0);
+   if(ret < 0) { // buffer is still owned by the caller on failure
+      *errsv = errno;
+      obj->send.transport->msg_free(msg_bytes);
+   }
+   pcl_result_t result = pcl_send_result(obj, template->msg_type, ret, msg_len, start, *errsv);
+   pcl_side_leave(&obj->send_side);
+   return(result);
+}
+
+void pcl_template_destroy(pcl_template_t tmpl) {
+   free(tmpl);
+}
+
+pcl_result_t pcl_route_add(pcl_object_t object, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   return(pcl_route_table_add(obj->services[0].routes, msg_type, pattern, handler, ctx));
+}
+
+pcl_result_t pcl_retrieve_cache_invalidate(pcl_object_t object, const char *path) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || obj->retrieve_cache == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   atomic_fetch_add(&obj->retrieve_generation, 1);
+   if(path == NULL) {
+      pcl_cache_clear(obj->retrieve_cache);
+      return(PCL_RESULT_SUCCESS);
+   }
+   size_t path_len = strlen(path);
+   if(path_len > 1 && path[path_len - 1] == '/') {
+      path_len--;
+   }
+   pcl_stats_add(&obj->stats.retrieve_cache_invalidated, pcl_cache_remove_path(obj->retrieve_cache, path, path_len));
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_replay(pcl_object_t object, const char *path, double speed, pcl_replay_result_t *result, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   pcl_replay_result_t result_sink;
+   if(result == NULL) {
+      result = &result_sink;
+   }
+   bzero(result, sizeof(*result));
+   if(obj == NULL || path == NULL || speed < 0) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_capture_log_t log;
+   if(!pcl_capture_log_open(&log, path, errsv)) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(!pcl_side_enter(&obj->recv_side)) {
+      pcl_capture_log_close(&log);
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+
+   // Each session is timed from its first received frame, so the gap before it and between sessions is not replayed
+   const pcl_capture_record_t *record;
+   const void *                frame;
+   pcl_result_t                ret         = PCL_RESULT_SUCCESS;
+   uint64_t                    start       = pcl_stats_time_ns();
+   uint64_t                    session_ns  = 0;
+   uint64_t                    base_ns     = 0;
+   bool                        session_fed = false;
+   while(pcl_capture_log_next(&log, &record, &frame)) {
+      if(record->dir == PCL_CAPTURE_START) {
+         session_fed = false;
+         continue;
+      }
+      if(record->dir != PCL_CAPTURE_IN || record->len == 0) {
+         continue;
+      }
+      uint64_t now = pcl_stats_time_ns();
+      if(!session_fed) {
+         session_ns  = record->time_ns;
+         base_ns     = now;
+         session_fed = true;
+      } else if(speed > 0) {
+         uint64_t due = base_ns + (uint64_t)((record->time_ns - session_ns) / speed);
+         if(due > now) {
+            struct timespec ts = { .tv_sec = due / 1000000000, .tv_nsec = due % 1000000000 };
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+            }
+         } else if(now - due > result->lag_max_ns) {
+            result->lag_max_ns = now - due;
+         }
+      }
+
+      // Frames are copied into transport buffers because the receive path frees them
+      char *msg_buf = (char *)obj->recv.transport->msg_alloc(record->len);
+      if(msg_buf == NULL) {
+         *errsv = errno;
+         ret    = PCL_RESULT_ERROR_OUT_OF_MEMORY;
+         break;
+      }
+      memcpy(msg_buf, frame, record->len);
+      pcl_trace_ctx_t trace = { .sampled = pcl_trace_sample(obj->trace) };
+      pcl_recv_trace(obj, msg_buf, record->len, pcl_trace_begin(&trace), &trace);
+      PCL_RECV_LOCK();
+      pcl_recv_frame(obj, msg_buf, record->len, &trace);
+      result->frames++;
+      result->bytes += record->len;
+   }
+
+   // Frames pushed to the dispatch workers are timed until their handlers return
+   while(atomic_load(&obj->dispatch_pending) > 0) {
+      struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000 };
+      nanosleep(&ts, NULL);
+   }
+   result->elapsed_ns = pcl_stats_time_ns() - start;
+   pcl_side_leave(&obj->recv_side);
+   pcl_capture_log_close(&log);
+   return(ret);
+}
+
+pcl_result_t pcl_request_expire(pcl_object_t object, uint32_t *next_ms) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_request_table_expire(obj->requests, next_ms);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_register(pcl_obj_t *obj, pcl_service_t *service, int flags, int *errsv) {
+   wrp_msg_t reg_msg;
+   reg_msg.msg_type           = WRP_MSG_TYPE__SVC_REGISTRATION;
+   reg_msg.u.reg.service_name = service->name;
+   reg_msg.u.reg.url          = obj->url_client;
+
+   // Parodus answers each registration with an AUTH, queue the service before sending so the reply cannot be missed
+   uint32_t index = service - obj->services;
+   sem_wait(&obj->service_lock);
+   if(obj->auth_pending_qty < PCL_SERVICE_QTY_MAX) {
+      obj->auth_pending[obj->auth_pending_qty++] = index;
+   }
+   sem_post(&obj->service_lock);
+
+   pcl_result_t result = pcl_sock_send_wrp(obj, &reg_msg, flags, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      pcl_auth_pending_remove(obj, index);
+   } else {
+      atomic_store(&obj->register_ns, pcl_stats_time_ns());
+   }
+   return(result);
+}
+
+void pcl_auth_pending_remove(pcl_obj_t *obj, uint32_t index) {
+   sem_wait(&obj->service_lock);
+   for(uint32_t pos = obj->auth_pending_qty; pos > 0; pos--) { // newest entry for the service
+      if(obj->auth_pending[pos - 1] == index) {
+         memmove(&obj->auth_pending[pos - 1], &obj->auth_pending[pos], (obj->auth_pending_qty - pos) * sizeof(obj->auth_pending[0]));
+         obj->auth_pending_qty--;
+         break;
+      }
+   }
+   sem_post(&obj->service_lock);
+}
+
+pcl_result_t pcl_register_all(pcl_obj_t *obj, int *errsv) {
+   sem_wait(&obj->service_lock);
+   uint32_t service_qty = obj->service_qty;
+   sem_post(&obj->service_lock);
+
+   for(uint32_t index = 0; index < service_qty; index++) {
+      // Drop the entry left by a registration that was never answered so the next AUTH is attributed to this one
+      pcl_auth_pending_remove(obj, index);
+      pcl_result_t result = pcl_register(obj, &obj->services[index], PCL_SOCK_DONTWAIT, errsv);
+      if(result != PCL_RESULT_SUCCESS) {
+         return(result);
+      }
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+uint32_t pcl_register_backoff(uint32_t *backoff_ms, unsigned int *seed) {
+   // Wait between half and all of the current backoff so clients restarted together do not retry in step
+   uint32_t wait_ms = (*backoff_ms / 2) + (rand_r(seed) % (*backoff_ms / 2 + 1));
+   *backoff_ms = (*backoff_ms >= PCL_REGISTER_BACKOFF_MAX_MS / 2) ? PCL_REGISTER_BACKOFF_MAX_MS : *backoff_ms * 2;
+   return(wait_ms);
+}
+
+void *pcl_supervise_thread(void *data) {
+   pcl_obj_t *  obj        = (pcl_obj_t *)data;
+   uint32_t     backoff_ms = PCL_REGISTER_BACKOFF_MIN_MS;
+   unsigned int seed       = (unsigned int)obj->init_ns;
+
+   pthread_mutex_lock(&obj->supervise_lock);
+   while(!obj->supervise_stop) {
+      obj->supervise_wake = false;
+      pthread_mutex_unlock(&obj->supervise_lock);
+
+      uint32_t wait_ms;
+      bool     authorized   = atomic_load(&obj->authorized);
+      uint64_t register_ns  = atomic_load(&obj->register_ns);
+      uint64_t auth_wait_ns = (uint64_t)PCL_REGISTER_AUTH_WAIT_MS * 1000000;
+      uint64_t since_ns     = pcl_stats_time_ns() - register_ns;
+      if(!authorized && register_ns != 0 && since_ns < auth_wait_ns) { // the AUTH for the last registration may still arrive
+         wait_ms = (auth_wait_ns - since_ns) / 1000000 + 1;
+      } else if(!authorized) {
+         int          errsv  = 0;
+         pcl_result_t result = pcl_register_all(obj, &errsv);
+         if(result == PCL_RESULT_SUCCESS) {
+            wait_ms    = PCL_REGISTER_AUTH_WAIT_MS;
+            backoff_ms = PCL_REGISTER_BACKOFF_MIN_MS;
+         } else {
+            wait_ms    = pcl_register_backoff(&backoff_ms, &seed);
+            XLOGD_INFO("register failed <%s> errno <%d> retry in %u ms", pcl_result_str(result), errsv, wait_ms);
+         }
+      } else if(obj->alive_timeout_ms == 0) { // only registering for init_async
+         pthread_mutex_lock(&obj->supervise_lock);
+         break;
+      } else {
+         pcl_replay_flush(obj);
+         uint64_t timeout_ns = (uint64_t)obj->alive_timeout_ms * 1000000;
+         uint64_t elapsed_ns = pcl_stats_time_ns() - atomic_load(&obj->alive_ns);
+         if(elapsed_ns >= timeout_ns) {
+            pcl_supervise_lost(obj, "no SVC_ALIVE");
+            wait_ms = 0;
+         } else {
+            wait_ms = (timeout_ns - elapsed_ns) / 1000000 + 1;
+         }
+      }
+
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec  += wait_ms / 1000;
+      deadline.tv_nsec += (wait_ms % 1000) * 1000000;
+      if(deadline.tv_nsec >= 1000000000) {
+         deadline.tv_sec++;
+         deadline.tv_nsec -= 1000000000;
+      }
+      pthread_mutex_lock(&obj->supervise_lock);
+      while(!obj->supervise_stop && !obj->supervise_wake) {
+         if(pthread_cond_timedwait(&obj->supervise_cond, &obj->supervise_lock, &deadline) == ETIMEDOUT) {
+            break;
+         }
+      }
+   }
+   pthread_mutex_unlock(&obj->supervise_lock);
+   return(NULL);
+}
+
+void pcl_supervise_lost(pcl_obj_t *obj, const char *reason) {
+   // Parodus forgets its registrations when it restarts, so every service has to register and be authorized again
+   sem_wait(&obj->service_lock);
+   bool lost = obj->authorized;
+   if(lost) {
+      for(uint32_t index = 0; index < obj->service_qty; index++) {
+         obj->services[index].authorized = false;
+      }
+      obj->authorized       = false;
+      obj->auth_pending_qty = 0;
+      atomic_store(&obj->register_ns, 0); // register at once rather than waiting for an AUTH to the old registration
+   }
+   sem_post(&obj->service_lock);
+
+   if(lost) {
+      XLOGD_INFO("parodus lost <%s>, registering again", reason);
+      pcl_stats_add(&obj->stats.reconnects, 1);
+      pcl_supervise_wake(obj);
+   }
+}
+
+void pcl_supervise_wake(pcl_obj_t *obj) {
+   pthread_mutex_lock(&obj->supervise_lock);
+   obj->supervise_wake = true;
+   pthread_cond_signal(&obj->supervise_cond);
+   pthread_mutex_unlock(&obj->supervise_lock);
+}
+
+pcl_result_t pcl_replay_push(pcl_obj_t *obj, wrp_msg_t *msg, int *errsv) {
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   pcl_queue_item_t item   = { .ctx = NULL, .msg_type = msg->msg_type };
+   pcl_result_t     result = pcl_wrp_encode_msg(obj, msg, &item.msg_bytes, &item.msg_len, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      pcl_stats_result(&obj->stats, result);
+      pcl_side_leave(&obj->send_side);
+      return(result);
+   }
+   while(!pcl_queue_push(&obj->replay, &item)) { // keep the newest messages
+      pcl_queue_item_t oldest;
+      if(pcl_queue_pop(&obj->replay, &oldest)) {
+         obj->send.transport->msg_free(oldest.msg_bytes);
+         pcl_stats_add(&obj->stats.replay_dropped, 1);
+      }
+   }
+   pcl_stats_add(&obj->stats.replay_held, 1);
+   pcl_side_leave(&obj->send_side);
+
+   // The supervisor may have flushed the buffer between the authorization check and the push
+   if(atomic_load(&obj->authorized)) {
+      pcl_supervise_wake(obj);
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+void pcl_replay_flush(pcl_obj_t *obj) {
+   if(obj->replay.cells == NULL || !pcl_side_enter(&obj->send_side)) {
+      return;
+   }
+   pcl_queue_item_t item;
+   while(pcl_queue_pop(&obj->replay, &item)) {
+      pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, item.msg_bytes, item.msg_len);
+      uint64_t start = pcl_stats_time_ns();
+      int      ret   = obj->send.transport->send_msg(&obj->send, item.msg_bytes, item.msg_len, 0);
+      int      errsv = 0;
+      if(ret < 0) {
+         errsv = errno;
+         obj->send.transport->msg_free(item.msg_bytes);
+         pcl_stats_add(&obj->stats.replay_dropped, 1);
+      }
+      if(PCL_RESULT_SUCCESS != pcl_send_result(obj, item.msg_type, ret, item.msg_len, start, errsv) && ret < 0) {
+         break; // the rest is kept for the next authorization
+      }
+   }
+   pcl_side_leave(&obj->send_side);
+}
+
+pcl_result_t pcl_sock_send_wrp(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv) {
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+
+   // nanomsg sockets are thread safe and each message is encoded into its own buffer, so senders run concurrently without locking
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   // Sends made by a handler follow the sampling of the message it handles
+   const pcl_trace_ctx_t *current     = pcl_trace_current(obj->trace);
+   pcl_trace_ctx_t        trace       = { .sampled = (current != NULL) ? current->sampled : pcl_trace_sample(obj->trace), .msg_type = msg->msg_type };
+   uint64_t               trace_start = pcl_trace_begin(&trace);
+   pcl_result_t result;
+   if(obj->send_zero_copy) {
+      result = pcl_sock_send_wrp_zero_copy(obj, msg, flags, errsv);
+   } else {
+      result = pcl_sock_send_wrp_copy(obj, msg, flags, errsv);
+   }
+   if(trace.sampled) {
+      const char *uuid = pcl_wrp_msg_uuid(msg);
+      trace.hash = (uuid != NULL) ? pcl_trace_hash(uuid, strlen(uuid)) : ((current != NULL) ? current->hash : 0);
+      pcl_trace_span(obj->trace, &trace, PCL_TRACE_SEND, trace_start);
+   }
+   pcl_side_leave(&obj->send_side);
+   return(result);
+}
+
+pcl_result_t pcl_sock_send_wrp_copy(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv) {
+   void *  msg_bytes = NULL;
+   ssize_t msg_len   = wrp_struct_to(msg, WRP_BYTES, &msg_bytes);
+   if(msg_len < 1 || msg_bytes == NULL) {
+      pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SOCK_SEND_WRP);
+      return(PCL_RESULT_ERROR_SOCK_SEND_WRP);
+   }
+   if(!pcl_stream_msg_is_chunk(msg)) {
+      pcl_idempotency_record(obj, msg->msg_type, pcl_wrp_msg_uuid(msg), msg_bytes, msg_len);
+      pcl_retrieve_cache_record(obj, msg, msg_bytes, msg_len);
+   }
+
+   pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, msg_bytes, msg_len);
+   uint64_t start = pcl_stats_time_ns();
+   int      ret   = obj->send.transport->send(&obj->send, msg_bytes, msg_len, flags);
+   if(ret < 0) {
+      *errsv = errno;
+   }
+   free(msg_bytes);
+   return(pcl_send_result(obj, msg->msg_type, ret, msg_len, start, *errsv));
+}
+
+pcl_result_t pcl_sock_send_wrp_zero_copy(pcl_obj_t *obj, wrp_msg_t *msg, int flags, int *errsv) {
+   void *       msg_bytes = NULL;
+   size_t       msg_len   = 0;
+   pcl_result_t result    = pcl_wrp_encode_msg(obj, msg, &msg_bytes, &msg_len, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      pcl_stats_result(&obj->stats, result);
+      return(result);
+   }
+
+   pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, msg_bytes, msg_len);
+   uint64_t start = pcl_stats_time_ns();
+   int      ret   = obj->send.transport->send_msg(&obj->send, msg_bytes, msg_len, flags);
+
+   if(ret < 0) { // buffer is still owned by the caller on failure
+      *errsv = errno;
+      obj->send.transport->msg_free(msg_bytes);
+   }
+   return(pcl_send_result(obj, msg->msg_type, ret, msg_len, start, *errsv));
+}
+
+void pcl_send_reply(pcl_obj_t *obj, int msg_type, void *msg_bytes, size_t msg_len) {
+   // Replies made on the receive thread are written without blocking, msg_bytes is from the transport's msg_alloc
+   if(!pcl_side_enter(&obj->send_side)) {
+      obj->send.transport->msg_free(msg_bytes);
+      return;
+   }
+   pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, msg_bytes, msg_len);
+   uint64_t start = pcl_stats_time_ns();
+   int      ret   = obj->send.transport->send_msg(&obj->send, msg_bytes, msg_len, PCL_SOCK_DONTWAIT);
+   int      errsv = 0;
+   if(ret < 0) { // buffer is still owned by the caller on failure
+      errsv = errno;
+      obj->send.transport->msg_free(msg_bytes);
+   }
+   pcl_send_result(obj, msg_type, ret, msg_len, start, errsv);
+   pcl_side_leave(&obj->send_side);
+}
+
+pcl_result_t pcl_send_result(pcl_obj_t *obj, int msg_type, int ret, size_t msg_len, uint64_t start, int errsv) {
+   pcl_result_t result = PCL_RESULT_SUCCESS;
+
+   pcl_stats_hist_record(&obj->stats.send, start);
+   if(ret < 0) {
+      result = PCL_RESULT_ERROR_SOCK_SEND_WRITE;
+      if(errsv == ETIMEDOUT) {
+         pcl_stats_add(&obj->stats.send_timeout, 1);
+      }
+      if(obj->alive_timeout_ms > 0 && errsv != EAGAIN && !atomic_load(&obj->send_side.closing)) {
+         pcl_supervise_lost(obj, "send failed");
+      }
+   } else {
+      pcl_stats_add(&obj->stats.send_msgs[pcl_stats_type_index(msg_type)], 1);
+      pcl_stats_add(&obj->stats.send_bytes[pcl_stats_type_index(msg_type)], ret);
+      if(ret != msg_len) {
+         result = PCL_RESULT_ERROR_SOCK_SEND_PARTIAL;
+      }
+   }
+   pcl_stats_result(&obj->stats, result);
+   return(result);
+}
+
+pcl_result_t pcl_wrp_encode_msg(pcl_obj_t *obj, wrp_msg_t *msg, void **msg_bytes, size_t *msg_len, int *errsv) {
+   // Size the message, then encode straight into a transport buffer whose ownership can be passed to send_msg
+   ssize_t len = pcl_wrp_encode(msg, NULL, 0);
+   if(len < 1) {
+      return(PCL_RESULT_ERROR_SOCK_SEND_WRP);
+   }
+   void *bytes = obj->send.transport->msg_alloc(len);
+   if(bytes == NULL) {
+      *errsv = errno;
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   if(pcl_wrp_encode(msg, bytes, len) != len) {
+      obj->send.transport->msg_free(bytes);
+      return(PCL_RESULT_ERROR_SOCK_SEND_WRP);
+   }
+   if(!pcl_stream_msg_is_chunk(msg)) {
+      pcl_idempotency_record(obj, msg->msg_type, pcl_wrp_msg_uuid(msg), bytes, len);
+      pcl_retrieve_cache_record(obj, msg, bytes, len);
+   }
+   *msg_bytes = bytes;
+   *msg_len   = len;
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_send_async(pcl_object_t object, wrp_msg_t *msg, void *ctx, int *errsv) {
+   return(pcl_send_async_lane(object, msg, PCL_SEND_LANE_AUTO, ctx, errsv));
+}
+
+pcl_result_t pcl_send_async_lane(pcl_object_t object, wrp_msg_t *msg, pcl_send_lane_t lane, void *ctx, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
    int errsink;
    if(errsv == NULL) {
       errsv = &errsink;
    }
    *errsv = 0;
+   if(obj == NULL || msg == NULL || obj->send_queue[0].cells == NULL || lane < PCL_SEND_LANE_AUTO || lane >= PCL_SEND_LANE_QTY) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(!obj->authorized) {
+      return(PCL_RESULT_ERROR_SOCK_SEND_AUTH);
+   }
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   pcl_result_t result = pcl_send_queue_push(obj, msg, (lane == PCL_SEND_LANE_AUTO) ? pcl_send_lane_default(msg->msg_type) : (uint32_t)lane, ctx, errsv);
+   pcl_side_leave(&obj->send_side);
+   return(result);
+}
 
-   PCL_MUTEX_LOCK();
-   ssize_t msg_len = wrp_struct_to(msg, WRP_BYTES, &msg_bytes);
-   if(msg_len < 1 || msg_bytes == NULL) {
-      PCL_MUTEX_UNLOCK();
-      return(PCL_RESULT_ERROR_SOCK_SEND_WRP);
+uint32_t pcl_send_lane_default(int msg_type) {
+   switch(msg_type) {
+      case WRP_MSG_TYPE__AUTH:
+      case WRP_MSG_TYPE__SVC_REGISTRATION:
+      case WRP_MSG_TYPE__SVC_ALIVE: {
+         return(PCL_SEND_LANE_CONTROL);
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         return(PCL_SEND_LANE_BULK);
+      }
+      default: {
+         return(PCL_SEND_LANE_RESPONSE);
+      }
    }
+}
 
-   int ret = nn_send(obj->send.sock, (const char *)msg_bytes, msg_len, 0);
-   
-   PCL_MUTEX_UNLOCK();
-   if(ret < 0) {
+pcl_result_t pcl_send_queue_push(pcl_obj_t *obj, wrp_msg_t *msg, uint32_t lane, void *ctx, int *errsv) {
+   pcl_queue_item_t item = { .ctx = ctx, .msg_type = msg->msg_type, .lane = lane };
+   pcl_queue_t *    queue = &obj->send_queue[lane];
+   pcl_result_t     result = pcl_wrp_encode_msg(obj, msg, &item.msg_bytes, &item.msg_len, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      pcl_stats_result(&obj->stats, result);
+      return(result);
+   }
+
+   while(!pcl_queue_push(queue, &item)) {
+      pcl_queue_item_t oldest;
+      pcl_stats_add(&obj->stats.send_lane_dropped[lane], 1);
+      switch(obj->send_overflow) {
+         case PCL_SEND_OVERFLOW_DROP_OLDEST: {
+            if(pcl_queue_pop(queue, &oldest)) {
+               pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+               pcl_send_complete(obj, &oldest, PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+            }
+            break;
+         }
+         case PCL_SEND_OVERFLOW_DROP_NEWEST: {
+            pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+            pcl_send_complete(obj, &item, PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+            return(PCL_RESULT_SUCCESS);
+         }
+         case PCL_SEND_OVERFLOW_FAIL_FAST:
+         default: {
+            pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+            obj->send.transport->msg_free(item.msg_bytes);
+            return(PCL_RESULT_ERROR_SEND_QUEUE_FULL);
+         }
+      }
+   }
+   pcl_loop_notify(obj);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_send_flush(pcl_object_t object, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL || obj->send_queue[0].cells == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(!pcl_side_enter(&obj->send_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   if(sem_trywait(&obj->send_flush) != 0) { // another thread is already flushing
+      pcl_side_leave(&obj->send_side);
+      return(PCL_RESULT_SUCCESS);
+   }
+
+   pcl_result_t result = PCL_RESULT_SUCCESS;
+   for(;;) {
+      if(!obj->send_pending_valid) {
+         if(!pcl_send_queue_pop(obj, &obj->send_pending)) {
+            break;
+         }
+         obj->send_pending_valid = true;
+         pcl_capture_frame(obj->capture, PCL_CAPTURE_OUT, obj->send_pending.msg_bytes, obj->send_pending.msg_len); // once, not per retry
+      }
+      uint64_t start = pcl_stats_time_ns();
+      int      ret   = obj->send.transport->send_msg(&obj->send, obj->send_pending.msg_bytes, obj->send_pending.msg_len, PCL_SOCK_DONTWAIT);
+      if(ret < 0) {
+         if(errno == EAGAIN) { // socket is full, keep the message until fd_send is signalled again
+            break;
+         }
+         *errsv = errno;
+         result = pcl_send_result(obj, obj->send_pending.msg_type, ret, obj->send_pending.msg_len, start, *errsv);
+         obj->send_pending_valid = false;
+         pcl_send_complete(obj, &obj->send_pending, result);
+         continue;
+      }
+      obj->send_pending_valid = false;
+      obj->send_pending.msg_bytes = NULL; // owned by the transport now
+      pcl_stats_add(&obj->stats.send_lane_sent[obj->send_pending.lane], 1);
+      pcl_send_complete(obj, &obj->send_pending, pcl_send_result(obj, obj->send_pending.msg_type, ret, obj->send_pending.msg_len, start, 0));
+   }
+   sem_post(&obj->send_flush);
+   pcl_side_leave(&obj->send_side);
+   return(result);
+}
+
+bool pcl_send_queue_pop(pcl_obj_t *obj, pcl_queue_item_t *item) {
+   // Weighted round robin, called by the flushing thread only.  An empty lane gives up the rest of its turn.
+   for(uint32_t tries = 0; tries <= PCL_SEND_LANE_QTY; tries++) {
+      if(obj->send_lane_credit == 0) {
+         obj->send_lane        = (obj->send_lane + 1) % PCL_SEND_LANE_QTY;
+         obj->send_lane_credit = obj->send_lane_weight[obj->send_lane];
+      }
+      if(pcl_queue_pop(&obj->send_queue[obj->send_lane], item)) {
+         obj->send_lane_credit--;
+         return(true);
+      }
+      obj->send_lane_credit = 0;
+   }
+   return(false);
+}
+
+uint32_t pcl_send_queue_len(pcl_object_t object) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || obj->send_queue[0].cells == NULL) {
+      return(0);
+   }
+   uint32_t len = (obj->send_pending_valid ? 1 : 0);
+   for(uint32_t lane = 0; lane < PCL_SEND_LANE_QTY; lane++) {
+      len += pcl_queue_len(&obj->send_queue[lane]);
+   }
+   return(len);
+}
+
+uint32_t pcl_recv_backlog(pcl_object_t object) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(0);
+   }
+   return(atomic_load(&obj->recv_backlog));
+}
+
+pcl_result_t pcl_trace_sample_set(pcl_object_t object, uint32_t sample) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || obj->trace == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_trace_sample_rate(obj->trace, sample);
+   return(PCL_RESULT_SUCCESS);
+}
+
+uint32_t pcl_send_lane_len(pcl_object_t object, pcl_send_lane_t lane) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || obj->send_queue[0].cells == NULL || lane < 0 || lane >= PCL_SEND_LANE_QTY) {
+      return(0);
+   }
+   return(pcl_queue_len(&obj->send_queue[lane]));
+}
+
+void pcl_send_complete(pcl_obj_t *obj, pcl_queue_item_t *item, pcl_result_t result) {
+   if(item->msg_bytes != NULL) {
+      obj->send.transport->msg_free(item->msg_bytes);
+      item->msg_bytes = NULL;
+   }
+   if(obj->send_complete != NULL) {
+      (*obj->send_complete)(item->ctx, result);
+   }
+}
+
+void pcl_send_queue_abort(pcl_obj_t *obj) {
+   pcl_queue_item_t item;
+   if(obj->send_pending_valid) {
+      obj->send_pending_valid = false;
+      pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SEND_ABORTED);
+      pcl_send_complete(obj, &obj->send_pending, PCL_RESULT_ERROR_SEND_ABORTED);
+   }
+   for(uint32_t lane = 0; lane < PCL_SEND_LANE_QTY; lane++) {
+      while(pcl_queue_pop(&obj->send_queue[lane], &item)) {
+         pcl_stats_result(&obj->stats, PCL_RESULT_ERROR_SEND_ABORTED);
+         pcl_send_complete(obj, &item, PCL_RESULT_ERROR_SEND_ABORTED);
+      }
+   }
+}
+
+pcl_result_t pcl_stats_get(pcl_object_t object, pcl_stats_t *stats) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || stats == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_stats_snapshot(&obj->stats, stats);
+   uint64_t authorized_ns = atomic_load(&obj->authorized_ns);
+   stats->time_to_authorized_us = (authorized_ns != 0) ? (authorized_ns - obj->init_ns) / 1000 : 0;
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_stats_reset(pcl_object_t object) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_stats_clear(&obj->stats);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_run_once(pcl_object_t object, int timeout_ms, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   if(!pcl_side_enter(&obj->recv_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   pcl_result_t result = pcl_run_step(obj, timeout_ms, errsv);
+   pcl_side_leave(&obj->recv_side);
+   return(result);
+}
+
+pcl_result_t pcl_run_step(pcl_obj_t *obj, int timeout_ms, int *errsv) {
+   pcl_result_t result;
+   pcl_loop_t * loop = pcl_loop_get(obj, &result, errsv);
+   if(loop == NULL) {
+      return(result);
+   }
+
+   // Wake up in time for the next request deadline
+   uint32_t next_ms = UINT32_MAX;
+   pcl_request_table_expire(obj->requests, &next_ms);
+   if(next_ms != UINT32_MAX && (timeout_ms < 0 || next_ms < (uint32_t)timeout_ms)) {
+      timeout_ms = next_ms;
+   }
+   // Messages left over from the last call are handled without waiting
+   if(obj->loop_recv_ready) {
+      timeout_ms = 0;
+   }
+
+   if(pcl_loop_wait(loop, timeout_ms) < 0) {
       *errsv = errno;
-      free(msg_bytes);
-      return(PCL_RESULT_ERROR_SOCK_SEND_WRITE);
+      return(PCL_RESULT_ERROR_INTERNAL);
    }
-   free(msg_bytes);
-   if(ret != msg_len) {
-      return(PCL_RESULT_ERROR_SOCK_SEND_PARTIAL);
+
+   // fd_recv is edge-triggered.  Drain one batch per call so timers and other fds are not starved, anything left is read on the next call.
+   result = PCL_RESULT_SUCCESS;
+   if(obj->loop_recv_ready) {
+      uint32_t drained = 0;
+      result = pcl_recv_drain(obj, PCL_RECV_BATCH_MAX, 0, NULL, &drained, errsv);
+      obj->loop_recv_ready = (drained == PCL_RECV_BATCH_MAX);
+   }
+   // Handlers may have queued responses, flush them in the same call
+   if(obj->send_queue[0].cells != NULL && (obj->loop_send_ready || pcl_send_queue_len(obj) > 0)) {
+      obj->loop_send_ready = false;
+      pcl_result_t result_send = pcl_send_flush(obj, errsv);
+      if(result == PCL_RESULT_SUCCESS) {
+         result = result_send;
+      }
+   }
+   return(result);
+}
+
+pcl_result_t pcl_run(pcl_object_t object, int *errsv) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   *errsv = 0;
+
+   // The whole run counts as one receiving call, so pcl_term waits for the loop to see it closing rather than freeing the object
+   // between iterations
+   if(!pcl_side_enter(&obj->recv_side)) {
+      return(PCL_RESULT_ERROR_CLOSED);
+   }
+   // Created before closing is checked so pcl_term always has a loop to wake
+   pcl_result_t result = PCL_RESULT_SUCCESS;
+   if(pcl_loop_get(obj, &result, errsv) == NULL) {
+      pcl_side_leave(&obj->recv_side);
+      return(result);
+   }
+   atomic_store(&obj->loop_stop, false);
+   while(true) {
+      // pcl_term also sets loop_stop, closing takes precedence
+      if(atomic_load(&obj->recv_side.closing)) {
+         result = PCL_RESULT_ERROR_CLOSED;
+         break;
+      }
+      if(atomic_load(&obj->loop_stop)) {
+         break;
+      }
+      // Message errors are reported to the handlers, only a failing loop ends the run
+      if(pcl_run_step(obj, -1, errsv) == PCL_RESULT_ERROR_INTERNAL) {
+         result = PCL_RESULT_ERROR_INTERNAL;
+         break;
+      }
+   }
+   pcl_side_leave(&obj->recv_side);
+   return(result);
+}
+
+pcl_result_t pcl_run_stop(pcl_object_t object) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
    }
+   atomic_store(&obj->loop_stop, true);
+   pcl_loop_notify(obj);
    return(PCL_RESULT_SUCCESS);
 }
 
+pcl_result_t pcl_fd_add(pcl_object_t object, int fd, uint32_t events, pcl_fd_handler_t handler, void *ctx) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_result_t result;
+   pcl_loop_t * loop = pcl_loop_get(obj, &result, NULL);
+   if(loop == NULL) {
+      return(result);
+   }
+   return(pcl_loop_fd_add(loop, fd, events, handler, ctx));
+}
+
+pcl_result_t pcl_fd_remove(pcl_object_t object, int fd) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL || fd == obj->recv.fd || fd == obj->send.fd || fd == obj->loop_wake_fd) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_loop_t *loop = atomic_load(&obj->loop);
+   if(loop == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   return(pcl_loop_fd_remove(loop, fd));
+}
+
+pcl_result_t pcl_timer_add(pcl_object_t object, uint32_t period_ms, pcl_timer_handler_t handler, void *ctx, int *timer_id) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_result_t result;
+   pcl_loop_t * loop = pcl_loop_get(obj, &result, NULL);
+   if(loop == NULL) {
+      return(result);
+   }
+   return(pcl_loop_timer_add(loop, period_ms, handler, ctx, timer_id));
+}
+
+pcl_result_t pcl_timer_remove(pcl_object_t object, int timer_id) {
+   pcl_obj_t *obj = (pcl_obj_t *)object;
+   if(obj == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_loop_t *loop = atomic_load(&obj->loop);
+   if(loop == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   return(pcl_loop_timer_remove(loop, timer_id));
+}
+
+pcl_loop_t *pcl_loop_get(pcl_obj_t *obj, pcl_result_t *result, int *errsv) {
+   int errsink;
+   if(errsv == NULL) {
+      errsv = &errsink;
+   }
+   pcl_loop_t *loop = atomic_load(&obj->loop);
+   if(loop != NULL) {
+      return(loop);
+   }
+
+   sem_wait(&obj->service_lock);
+   loop = atomic_load(&obj->loop);
+   if(loop != NULL) { // created by another thread
+      sem_post(&obj->service_lock);
+      return(loop);
+   }
+   loop = pcl_loop_create();
+   if(loop == NULL) {
+      *errsv  = errno;
+      *result = PCL_RESULT_ERROR_INTERNAL;
+      sem_post(&obj->service_lock);
+      return(NULL);
+   }
+   obj->loop_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if(obj->loop_wake_fd < 0) {
+      *errsv  = errno;
+      *result = PCL_RESULT_ERROR_INTERNAL;
+      pcl_loop_destroy(loop);
+      sem_post(&obj->service_lock);
+      return(NULL);
+   }
+   // nanomsg signals both fds as readable
+   *result = pcl_loop_fd_add(loop, obj->recv.fd, PCL_FD_READ, pcl_loop_recv_ready, obj);
+   if(*result == PCL_RESULT_SUCCESS && obj->send_queue[0].cells != NULL) {
+      *result = pcl_loop_fd_add(loop, obj->send.fd, PCL_FD_READ, pcl_loop_send_ready, obj);
+   }
+   if(*result == PCL_RESULT_SUCCESS) {
+      *result = pcl_loop_fd_add(loop, obj->loop_wake_fd, PCL_FD_READ, pcl_loop_wake, obj);
+   }
+   if(*result != PCL_RESULT_SUCCESS) {
+      pcl_loop_destroy(loop);
+      close(obj->loop_wake_fd);
+      obj->loop_wake_fd = -1;
+      sem_post(&obj->service_lock);
+      return(NULL);
+   }
+   // Anything already queued on the sockets produced its edge before the fds were added
+   obj->loop_recv_ready = true;
+   obj->loop_send_ready = true;
+   atomic_store(&obj->loop, loop);
+   sem_post(&obj->service_lock);
+   return(loop);
+}
+
+void pcl_loop_notify(pcl_obj_t *obj) {
+   if(atomic_load(&obj->loop) == NULL) {
+      return;
+   }
+   // One write per wakeup, cleared by pcl_loop_wake before the queue is flushed
+   if(!atomic_exchange(&obj->loop_wake_pending, true)) {
+      uint64_t value = 1;
+      if(write(obj->loop_wake_fd, &value, sizeof(value)) < 0) {
+         atomic_store(&obj->loop_wake_pending, false);
+      }
+   }
+}
+
+void pcl_loop_recv_ready(void *ctx, int fd, uint32_t events) {
+   ((pcl_obj_t *)ctx)->loop_recv_ready = true;
+}
+
+void pcl_loop_send_ready(void *ctx, int fd, uint32_t events) {
+   ((pcl_obj_t *)ctx)->loop_send_ready = true;
+}
+
+void pcl_loop_wake(void *ctx, int fd, uint32_t events) {
+   pcl_obj_t *obj = (pcl_obj_t *)ctx;
+   uint64_t   value;
+   while(read(fd, &value, sizeof(value)) > 0) {
+   }
+   atomic_store(&obj->loop_wake_pending, false);
+   obj->loop_send_ready = true;
+}
+
+int pcl_timeout_ms(const int *timeout_ms, const int *timeout_sec, int timeout_default) {
+   if(timeout_ms != NULL) {
+      return(*timeout_ms);
+   }
+   int timeout = (timeout_sec != NULL) ? *timeout_sec : timeout_default;
+   return((timeout > 0) ? timeout * 1000 : timeout);
+}
+
+uint64_t pcl_time_us(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
 pcl_result_t pcl_msg_handler_auth(pcl_obj_t *obj, struct wrp_auth_msg *msg) {
    //printf("%s: status <%d>\n", __FUNCTION__, msg->status);
-   if(msg->status == 200) {
-      obj->authorized = true;
-   } else {
-      obj->authorized = false;
+   // The AUTH carries no service name.  Attribute it to the oldest registration still waiting, or to every service when none is.
+   sem_wait(&obj->service_lock);
+   uint32_t first = 0;
+   uint32_t last  = obj->service_qty;
+   if(obj->auth_pending_qty > 0) {
+      first = obj->auth_pending[0];
+      last  = first + 1;
+      obj->auth_pending_qty--;
+      memmove(&obj->auth_pending[0], &obj->auth_pending[1], obj->auth_pending_qty * sizeof(obj->auth_pending[0]));
+   }
+   for(uint32_t index = first; index < last; index++) {
+      obj->services[index].authorized  = (msg->status == 200);
+      obj->services[index].auth_status = msg->status;
+   }
+   // Sending is authorized by the primary service
+   bool ready = !obj->authorized && obj->services[0].authorized;
+   obj->authorized  = obj->services[0].authorized;
+   obj->auth_status = obj->services[0].auth_status;
+   sem_post(&obj->service_lock);
+
+   if(ready) {
+      uint_fast64_t authorized_ns = 0;
+      atomic_compare_exchange_strong(&obj->authorized_ns, &authorized_ns, pcl_stats_time_ns());
+      atomic_store(&obj->alive_ns, pcl_stats_time_ns());
+      pcl_supervise_wake(obj);
+      if(obj->handler_ready != NULL) {
+         obj->handler_ready(msg->status, (atomic_load(&obj->authorized_ns) - obj->init_ns) / 1000000);
+      }
    }
-   obj->auth_status = msg->status;
    return(PCL_RESULT_SUCCESS);
 }
 
@@ -460,6 +3159,11 @@ pcl_result_t pcl_msg_handler_alive(void) {
    return(PCL_RESULT_SUCCESS);
 }
 
+pcl_result_t pcl_msg_handler_view(const pcl_msg_view_t *msg) {
+   //printf("%s: \n", __FUNCTION__);
+   return(PCL_RESULT_SUCCESS);
+}
+
 pcl_result_t pcl_msg_handler_request(struct wrp_req_msg *msg) {
    //printf("%s: \n", __FUNCTION__);
    return(PCL_RESULT_SUCCESS);
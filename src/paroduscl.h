@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include <wrp-c/wrp-c.h>
 
 #define PCL_URL_PARODUS_DEFAULT  "tcp://127.0.0.1:6666"
@@ -50,13 +51,107 @@ typedef enum {
    PCL_RESULT_ERROR_SOCK_SEND_AUTH    = 21,
    PCL_RESULT_ERROR_REGISTER          = 22,
    PCL_RESULT_ERROR_INTERNAL          = 23,
-   PCL_RESULT_INVALID                 = 24,
+   PCL_RESULT_ERROR_SEND_QUEUE_FULL   = 24,
+   PCL_RESULT_ERROR_SEND_ABORTED      = 25,
+   PCL_RESULT_ERROR_REQUEST_TIMEOUT   = 26,
+   PCL_RESULT_ERROR_SERVICE_LIMIT     = 27,
+   PCL_RESULT_ERROR_CLOSED            = 28,
+   PCL_RESULT_ERROR_SHED              = 29,
+   PCL_RESULT_INVALID                 = 30,
 } pcl_result_t;
 
+// Read-only string view into a received message.  Not null terminated.
+typedef struct {
+   const char *str;
+   uint32_t    len;
+} pcl_str_view_t;
+
+// Read-only message view whose fields point directly into the received buffer.  A view (and every pointer in it) is valid
+// until the view handler returns.  Call pcl_msg_view_retain to keep it longer and pcl_msg_view_release when done.
+typedef struct {
+   enum wrp_msg_type msg_type;
+   pcl_str_view_t    transaction_uuid;
+   pcl_str_view_t    content_type;
+   pcl_str_view_t    source;
+   pcl_str_view_t    dest;
+   pcl_str_view_t    path;
+   int               status;
+   int               rdr;
+   uint32_t          header_count;  // use pcl_msg_view_header to access each header
+   const void *      payload;
+   uint32_t          payload_size;
+   const void *      headers;       // library use only
+   const void *      headers_end;   // library use only
+   void *            priv;          // library use only
+} pcl_msg_view_t;
+
+#define PCL_ROUTE_PARAMS_MAX (8)
+
+// Result of matching a message's dest against a route.  All views point into dest.
+typedef struct {
+   pcl_str_view_t path;         // dest following the service name, without query or fragment
+   pcl_str_view_t query;        // text following '?', without fragment
+   pcl_str_view_t fragment;     // text following '#'
+   uint32_t       param_count;
+   pcl_str_view_t params[PCL_ROUTE_PARAMS_MAX]; // segments matched by each '*' followed by the remainder matched by '**'
+} pcl_route_match_t;
+
 typedef pcl_result_t (*pcl_msg_handler_req_t)(struct wrp_req_msg *msg);
 typedef pcl_result_t (*pcl_msg_handler_event_t)(struct wrp_event_msg *msg);
 typedef pcl_result_t (*pcl_msg_handler_crud_t)(struct wrp_crud_msg *msg);
 typedef pcl_result_t (*pcl_msg_handler_alive_t)(void);
+typedef pcl_result_t (*pcl_msg_handler_view_t)(const pcl_msg_view_t *msg);
+typedef void         (*pcl_send_complete_t)(void *ctx, pcl_result_t result);
+// Called each time the primary service becomes authorized, with the time since pcl_init to its first authorization
+typedef void         (*pcl_ready_handler_t)(int auth_status, uint32_t time_to_authorized_ms);
+// Called once per pcl_send_request_async.  On success the response is in msg (or view when handler_view is set), valid until the
+// callback returns.  Both are NULL when the request timed out (PCL_RESULT_ERROR_REQUEST_TIMEOUT) or was aborted by pcl_term.
+typedef void         (*pcl_response_handler_t)(void *ctx, pcl_result_t result, wrp_msg_t *msg, const pcl_msg_view_t *view);
+// Called for a message matching a route.  msg is set in the default decode mode, view when handler_view is set.
+typedef pcl_result_t (*pcl_route_handler_t)(void *ctx, wrp_msg_t *msg, const pcl_msg_view_t *view, const pcl_route_match_t *match);
+
+// Header added to each message sent by pcl_send_stream, followed by ": <stream id in hex> <seq> <last>"
+#define PCL_STREAM_HEADER "X-Pcl-Chunk"
+
+// Position of a received chunk in its stream
+typedef struct {
+   uint32_t stream_id;  // chosen by the sender, unique per source
+   uint32_t seq;        // 0 for the first chunk
+   uint64_t offset;     // payload bytes of the stream preceding this chunk
+   bool     last;
+} pcl_stream_chunk_t;
+
+// Called with each chunk of a stream in order.  msg is set in the default decode mode, view when handler_view is set.
+typedef pcl_result_t (*pcl_stream_handler_t)(const pcl_stream_chunk_t *chunk, wrp_msg_t *msg, const pcl_msg_view_t *view);
+// Called when received messages start being shed and when shedding stops, with the messages waiting for dispatch and the time the
+// message that caused the change waited
+typedef void         (*pcl_shed_handler_t)(bool shedding, uint32_t backlog, uint32_t queue_age_ms);
+// Fills buf with up to size bytes of a streamed payload.  Returns the length read, 0 at the end of the payload or -1 on error.
+typedef ssize_t      (*pcl_stream_reader_t)(void *ctx, void *buf, size_t size);
+
+#define PCL_FD_READ  (0x01)
+#define PCL_FD_WRITE (0x02)
+#define PCL_FD_ERROR (0x04)
+
+// Called from pcl_run when fd is ready.  The fd is watched edge-triggered, so it should be read or written until EAGAIN.
+typedef void         (*pcl_fd_handler_t)(void *ctx, int fd, uint32_t events);
+typedef void         (*pcl_timer_handler_t)(void *ctx, int timer_id);
+
+typedef enum {
+   PCL_SEND_OVERFLOW_FAIL_FAST   = 0, // pcl_send_async returns PCL_RESULT_ERROR_SEND_QUEUE_FULL
+   PCL_SEND_OVERFLOW_DROP_NEWEST = 1, // the new message is discarded
+   PCL_SEND_OVERFLOW_DROP_OLDEST = 2, // the oldest queued message is discarded to make room
+} pcl_send_overflow_t;
+
+// Queues drained by pcl_send_flush.  Each round writes up to the lane's weight of messages from every lane, control first.
+typedef enum {
+   PCL_SEND_LANE_AUTO     = -1, // chosen by msg_type
+   PCL_SEND_LANE_CONTROL  = 0,  // registration, auth and alive messages
+   PCL_SEND_LANE_RESPONSE = 1,  // requests and crud messages
+   PCL_SEND_LANE_BULK     = 2,  // events
+} pcl_send_lane_t;
+
+#define PCL_SEND_LANE_QTY (3)
 
 typedef struct {
    const char *service_name;  // NULL to use default value
@@ -71,18 +166,196 @@ typedef struct {
    pcl_msg_handler_crud_t  handler_update;
    pcl_msg_handler_crud_t  handler_delete;
    pcl_msg_handler_alive_t handler_alive;
+   pcl_msg_handler_view_t  handler_view;  // NULL to decode into wrp structs.  When set, request, event and crud messages are passed as zero-copy views.
+   const bool *send_zero_copy;            // encode directly into a nanomsg buffer and transfer ownership on send.  NULL to use default value (false)
+   const int  *send_queue_depth;          // messages held for pcl_send_async.  NULL or 0 to disable asynchronous send
+   const pcl_send_overflow_t *send_queue_overflow; // NULL to use default value (fail fast)
+   pcl_send_complete_t        send_complete;       // called once for each pcl_send_async message when sent or dropped.  NULL for none
+   const int  *dispatch_workers;          // threads running request, event and crud handlers.  NULL or 0 to run handlers in pcl_recv.
+                                          // Messages with the same transaction_uuid (or dest when there is none) are handled in order.
+   const int  *timeout_recv_ms;           // in milliseconds, used instead of timeout_recv.  NULL to use timeout_recv
+   const int  *timeout_send_ms;           // in milliseconds, used instead of timeout_send.  NULL to use timeout_send
+   const bool *decode_arena;              // decode into pooled arenas freed in one step after the handlers return.  NULL to use default value (false)
+   const bool *init_async;                // return from pcl_init without waiting to register, retrying in the background.  NULL to use default value (false)
+   pcl_ready_handler_t handler_ready;     // called from pcl_recv when parodus authorizes the service.  NULL for none
+   const int  *alive_timeout_ms;          // register again when no SVC_ALIVE arrives for this long or a send fails.  NULL or 0 to disable
+   const int  *replay_depth;              // messages pcl_send holds while parodus is lost (needs alive_timeout_ms).  NULL or 0 for none
+   const int  *send_lane_depth;           // PCL_SEND_LANE_QTY queue depths, indexed by lane.  NULL to use send_queue_depth for every lane
+   const int  *send_lane_weight;          // PCL_SEND_LANE_QTY messages written from each lane per round.  NULL to use default value (8, 4, 1)
+   const int  *idempotency_window_ms;     // remember received REQ, CREATE, UPDATE and DELETE transaction_uuids this long so retries are not
+                                          // dispatched again.  NULL or 0 to disable
+   const int  *idempotency_entries;       // transaction_uuids remembered at most.  NULL to use default value (1024)
+   const int  *idempotency_mem_max;       // bytes used for remembered uuids and their responses at most.  NULL to use default value (1 MiB)
+   const int  *retrieve_cache_ttl_ms;     // answer RETRIEVEs for a dest path with the last response to it for this long.  NULL or 0 to disable
+   const int  *retrieve_cache_mem_max;    // bytes used for cached responses at most.  NULL to use default value (256 KiB)
+   const int  *stream_chunk_size;         // payload bytes per message sent by pcl_send_stream.  NULL to use default value (64 KiB)
+   pcl_stream_handler_t handler_stream;   // receives the chunks of streamed messages in order.  NULL to dispatch them like other messages
+   const int  *stream_timeout_ms;         // received streams with no chunk for this long are dropped.  NULL to use default value (30000)
+   const int  *shed_deadline_ms;          // PCL_BATCH_MSG_TYPE_MAX ages, indexed by wrp msg type, past which received requests, events and
+                                          // crud messages are shed instead of decoded.  NULL to disable, 0 entries for no deadline
+   const int  *shed_backlog_max;          // received messages waiting for dispatch above which new ones are shed.  NULL or 0 for no limit
+   const bool *shed_reject;               // answer shed crud messages with status 503.  NULL to use default value (false, dropped silently)
+   pcl_shed_handler_t handler_shed;       // called when shedding starts and stops.  NULL for none
+   const char *capture_path;              // append every raw frame received and sent to this capture log for pcl_replay.  NULL to disable
+   const char *trace_name;                // shared memory object (shm_open name) per message spans are traced to.  NULL to disable
+   const int  *trace_sample;              // 1 in trace_sample messages are traced, 0 to start paused.  NULL to use default value (100)
+   const int  *trace_ring_size;           // spans kept per thread, rounded up to a power of two.  NULL to use default value (4096)
 } pcl_params_t;
 
+#define PCL_SERVICE_QTY_MAX (32) // services per object, including the one named in pcl_params_t
+
+// Additional service sharing the object's sockets.  Handlers left NULL ignore the message.
+typedef struct {
+   const char *service_name;
+   pcl_msg_handler_req_t   handler_request;
+   pcl_msg_handler_event_t handler_event;
+   pcl_msg_handler_crud_t  handler_create;
+   pcl_msg_handler_crud_t  handler_retrieve;
+   pcl_msg_handler_crud_t  handler_update;
+   pcl_msg_handler_crud_t  handler_delete;
+   pcl_msg_handler_view_t  handler_view;   // used instead of the handlers above when the object was created with handler_view
+} pcl_service_params_t;
+
 typedef void *pcl_object_t;
+typedef void *pcl_template_t;
+
+#define PCL_BATCH_MSG_TYPE_MAX (WRP_MSG_TYPE__SVC_ALIVE + 1)
+
+typedef struct {
+   uint32_t dispatched;                             // number of messages dispatched to handlers
+   uint32_t msg_type[PCL_BATCH_MSG_TYPE_MAX];       // messages dispatched, indexed by wrp msg type (unknown types in index 0)
+   uint32_t msg_type_fail[PCL_BATCH_MSG_TYPE_MAX];  // messages whose handler did not return success, indexed by wrp msg type
+   uint32_t result[PCL_RESULT_INVALID + 1];         // number of occurrences of each result (including decode failures)
+} pcl_batch_result_t;
+
+typedef struct {
+   uint64_t frames;      // received frames fed through the receive path
+   uint64_t bytes;
+   uint64_t elapsed_ns;  // from the start of the replay to the return of the last dispatch, on the dispatch_workers too
+   uint64_t lag_max_ns;  // furthest a frame was fed behind its scaled capture time
+} pcl_replay_result_t;
+
+#define PCL_STATS_HIST_BUCKETS (32)
+
+typedef struct {
+   uint64_t count;
+   uint64_t sum_ns;
+   uint64_t bucket[PCL_STATS_HIST_BUCKETS]; // bucket n counts durations from 2^n to 2^(n+1) - 1 ns, the last bucket also counts longer ones
+} pcl_stats_hist_t;
+
+typedef struct {
+   uint64_t         recv_msgs[PCL_BATCH_MSG_TYPE_MAX];  // indexed by wrp msg type (unknown types in index 0)
+   uint64_t         recv_bytes[PCL_BATCH_MSG_TYPE_MAX];
+   uint64_t         send_msgs[PCL_BATCH_MSG_TYPE_MAX];
+   uint64_t         send_bytes[PCL_BATCH_MSG_TYPE_MAX];
+   uint64_t         result[PCL_RESULT_INVALID + 1];     // results of each receive, dispatch and send, including decode failures
+                                                        // (ERROR_SOCK_RECV_WRP), service name mismatches (ERROR_SOCK_RECV_SVCNAME)
+                                                        // and partial sends (ERROR_SOCK_SEND_PARTIAL)
+   uint64_t         send_timeout;                       // sends failing because the send timeout expired
+   pcl_stats_hist_t decode;                             // time to decode a received message
+   pcl_stats_hist_t handler;                            // time spent dispatching a message to its handler
+   pcl_stats_hist_t send;                               // time spent in nn_send
+   uint64_t         recv_filtered[PCL_BATCH_MSG_TYPE_MAX]; // dropped before decode (no matching service, no handler set or shed)
+   uint64_t         arena_alloc;                        // heap allocations made for decode arenas, stops growing once the pool is warm
+   uint64_t         time_to_authorized_us;              // from pcl_init to the first AUTH 200 for the primary service, 0 until then.
+                                                        // Not cleared by pcl_stats_reset.
+   uint64_t         reconnects;                         // times parodus was taken as lost and the services registered again
+   uint64_t         replay_held;                        // messages pcl_send held while parodus was lost
+   uint64_t         replay_dropped;                     // held messages discarded because the buffer was full or sending them failed
+   uint64_t         send_lane_sent[PCL_SEND_LANE_QTY];  // queued messages written to the socket, indexed by lane
+   uint64_t         send_lane_dropped[PCL_SEND_LANE_QTY]; // queued messages dropped or refused because the lane was full
+   uint64_t         idempotency_new;                    // requests seen for the first time and dispatched
+   uint64_t         idempotency_replayed;               // retries answered with the response sent to the first request
+   uint64_t         idempotency_suppressed;             // retries dropped because the first request has no response yet
+   uint64_t         idempotency_evicted;                // remembered requests dropped to stay within the limits before their window ended
+   uint64_t         retrieve_cache_hits;                // RETRIEVEs answered from the cache
+   uint64_t         retrieve_cache_misses;              // RETRIEVEs passed to the handlers
+   uint64_t         retrieve_cache_invalidated;         // cached responses dropped by a CREATE, UPDATE or DELETE for a related path
+   uint64_t         retrieve_cache_evicted;             // cached responses dropped to stay within the limits before their ttl ended
+   uint64_t         stream_chunks_sent;                 // chunks written by pcl_send_stream
+   uint64_t         stream_chunks_recv;                 // chunks passed to handler_stream
+   uint64_t         stream_chunks_dropped;              // chunks received out of sequence or for an unknown or expired stream
+   uint64_t         shed_expired;                       // received messages dropped for waiting past their shed_deadline_ms
+   uint64_t         shed_backlog;                       // received messages dropped because shed_backlog_max were waiting
+   uint64_t         shed_rejected;                      // shed messages answered with status 503
+   pcl_stats_hist_t queue_age;                          // time from draining a message from the socket to dispatching it, recorded
+                                                        // when shed_deadline_ms is set
+} pcl_stats_t;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 pcl_result_t pcl_init(pcl_object_t *object, int *fd_recv, int *fd_send, int *errsv, pcl_params_t *params);
+// Closes the receive side, waits for calls receiving on other threads to return, lets queued dispatch workers finish, then does
+// the same for the send side.  Calls made while closing return PCL_RESULT_ERROR_CLOSED.  Must not be called from a handler.
 pcl_result_t pcl_term(pcl_object_t object, int *errsv);
 pcl_result_t pcl_recv(pcl_object_t object, int *errsv);
+// Drains up to max_msgs (at most 64) without blocking, stopping early when the socket is empty or budget_us (0 for no limit) has elapsed
+pcl_result_t pcl_recv_batch(pcl_object_t object, uint32_t max_msgs, uint32_t budget_us, pcl_batch_result_t *batch, int *errsv);
 pcl_result_t pcl_send(pcl_object_t object, wrp_msg_t *msg, int *errsv);
+// Encodes msg and queues it without blocking.  Call pcl_send_flush when fd_send is ready to write the queue to the socket.
+pcl_result_t pcl_send_async(pcl_object_t object, wrp_msg_t *msg, void *ctx, int *errsv);
+// Like pcl_send_async, on the given lane instead of the one chosen by msg_type
+pcl_result_t pcl_send_async_lane(pcl_object_t object, wrp_msg_t *msg, pcl_send_lane_t lane, void *ctx, int *errsv);
+pcl_result_t pcl_send_flush(pcl_object_t object, int *errsv);
+uint32_t     pcl_send_queue_len(pcl_object_t object);
+uint32_t     pcl_send_lane_len(pcl_object_t object, pcl_send_lane_t lane);
+// Returns the number of received messages decoded or queued for dispatch and not yet dispatched
+uint32_t     pcl_recv_backlog(pcl_object_t object);
+// Traces 1 in sample messages from now on, 0 pauses tracing.  Fails unless the object was created with trace_name.
+pcl_result_t pcl_trace_sample_set(pcl_object_t object, uint32_t sample);
+// Sends msg (a REQ, event or crud message) with its payload read from reader instead of msg, split into messages of at most
+// stream_chunk_size payload bytes.  Each is a copy of msg with a PCL_STREAM_HEADER header added.  Blocks until every chunk is sent,
+// so the payload is never held in memory as a whole.
+pcl_result_t pcl_send_stream(pcl_object_t object, wrp_msg_t *msg, pcl_stream_reader_t reader, void *ctx, int *errsv);
+// Reader for pcl_send_stream reading from the file descriptor pointed to by ctx
+ssize_t      pcl_stream_read_fd(void *ctx, void *buf, size_t size);
+// Sends a REQ or crud message and routes the response with the same transaction_uuid to callback instead of the message handlers
+pcl_result_t pcl_send_request_async(pcl_object_t object, wrp_msg_t *msg, uint32_t deadline_ms, pcl_response_handler_t callback, void *ctx, int *errsv);
+// Encodes every field of proto (a REQ, event or crud message) except transaction_uuid and payload once.  pcl_template_send then only
+// appends the uuid (ignored for events) and payload.  Templates must be destroyed before the object is terminated.
+pcl_result_t pcl_template_create(pcl_object_t object, const wrp_msg_t *proto, pcl_template_t *tmpl);
+pcl_result_t pcl_template_send(pcl_template_t tmpl, const void *payload, size_t payload_len, const char *transaction_uuid, int *errsv);
+void         pcl_template_destroy(pcl_template_t tmpl);
+// Routes request, event or crud messages of msg_type whose dest path (after the service name) matches pattern to handler instead
+// of the per type handler.  Pattern segments are separated by '/'; '*' matches any one segment and a final '**' matches the rest.
+pcl_result_t pcl_route_add(pcl_object_t object, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx);
+// Registers another service name on the object's sockets.  Messages whose dest names the service go to its handlers and routes.
+pcl_result_t pcl_service_add(pcl_object_t object, const pcl_service_params_t *params, int *errsv);
+pcl_result_t pcl_service_route_add(pcl_object_t object, const char *service_name, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx);
+// Returns true when parodus authorized the service.  auth_status (optional) is set to the last status received for it (-1 for none).
+bool         pcl_service_authorized(pcl_object_t object, const char *service_name, int *auth_status);
+// Drops the cached RETRIEVE responses for path, the dest without its mac prefix (service name and path, "iot/config" for
+// "mac:112233445566/iot/config"), and for the paths above and below it.  NULL drops every cached response.
+pcl_result_t pcl_retrieve_cache_invalidate(pcl_object_t object, const char *path);
+// Feeds the received frames of a capture log (see capture_path) through the object's receive filter, decode and dispatch as if they
+// were read from fd_recv.  speed scales the recorded gaps between frames (1.0 for the original timing, 2.0 for twice as fast), 0
+// feeds them as fast as possible.  Sent frames in the log are skipped.  result (optional) is filled in when the log has been read.
+pcl_result_t pcl_replay(pcl_object_t object, const char *path, double speed, pcl_replay_result_t *result, int *errsv);
+// Expires requests past their deadline.  Called by pcl_recv, call it directly when pcl_recv is not called often enough.
+// next_ms (optional) is set to the time until the next expiry check is needed.
+pcl_result_t pcl_request_expire(pcl_object_t object, uint32_t *next_ms);
+
+// Built-in event loop.  pcl_run_once waits up to timeout_ms (-1 for no limit) for fd_recv, fd_send, application fds and timers,
+// then receives and dispatches pending messages, flushes the send queue and runs the handlers of ready fds and timers.
+// pcl_run repeats it until pcl_run_stop is called, or returns PCL_RESULT_ERROR_CLOSED once pcl_term is called from another thread.
+pcl_result_t pcl_run_once(pcl_object_t object, int timeout_ms, int *errsv);
+pcl_result_t pcl_run(pcl_object_t object, int *errsv);
+pcl_result_t pcl_run_stop(pcl_object_t object);
+pcl_result_t pcl_fd_add(pcl_object_t object, int fd, uint32_t events, pcl_fd_handler_t handler, void *ctx);
+pcl_result_t pcl_fd_remove(pcl_object_t object, int fd);
+// Calls handler every period_ms from pcl_run.  timer_id (optional) is set to the id used to remove the timer.
+pcl_result_t pcl_timer_add(pcl_object_t object, uint32_t period_ms, pcl_timer_handler_t handler, void *ctx, int *timer_id);
+pcl_result_t pcl_timer_remove(pcl_object_t object, int timer_id);
+
+// Copies the object's counters.  Counters are updated without locking so the copy is not an atomic snapshot.
+pcl_result_t pcl_stats_get(pcl_object_t object, pcl_stats_t *stats);
+pcl_result_t pcl_stats_reset(pcl_object_t object);
+
+pcl_msg_view_t *pcl_msg_view_retain(const pcl_msg_view_t *view);
+void            pcl_msg_view_release(pcl_msg_view_t *view);
+bool            pcl_msg_view_header(const pcl_msg_view_t *view, uint32_t index, pcl_str_view_t *header);
 
 const char *pcl_result_str(pcl_result_t result);
 
@@ -0,0 +1,202 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "paroduscl_arena.h"
+
+#define PCL_ARENA_CHUNK_SIZE  (16 * 1024)
+#define PCL_ARENA_RETAIN_MAX  (256 * 1024) // chunk bytes kept by an idle arena
+#define PCL_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+typedef struct pcl_arena_chunk {
+   struct pcl_arena_chunk *next;
+   size_t                  size;
+   size_t                  used;
+   uint8_t                 data[] __attribute__((aligned(8)));
+} pcl_arena_chunk_t;
+
+struct pcl_arena {
+   pcl_arena_pool_t * pool;
+   struct pcl_arena * next;     // idle list
+   atomic_uint        refs;
+   pcl_arena_chunk_t *first;
+   pcl_arena_chunk_t *current;
+};
+
+struct pcl_arena_pool {
+   pthread_mutex_t       lock;
+   pcl_arena_t *         idle;
+   uint32_t              idle_qty;
+   uint32_t              idle_max;
+   atomic_uint_fast64_t *heap_allocs;
+};
+
+static pcl_arena_chunk_t *pcl_arena_chunk_create(pcl_arena_t *arena, size_t size);
+static void               pcl_arena_reset(pcl_arena_t *arena);
+static void               pcl_arena_destroy(pcl_arena_t *arena);
+static void               pcl_arena_count(pcl_arena_pool_t *pool);
+
+pcl_arena_pool_t *pcl_arena_pool_create(uint32_t idle_max, atomic_uint_fast64_t *heap_allocs) {
+   pcl_arena_pool_t *pool = (pcl_arena_pool_t *)calloc(1, sizeof(pcl_arena_pool_t));
+   if(pool == NULL) {
+      return(NULL);
+   }
+   pthread_mutex_init(&pool->lock, NULL);
+   pool->idle_max    = idle_max;
+   pool->heap_allocs = heap_allocs;
+   return(pool);
+}
+
+void pcl_arena_pool_destroy(pcl_arena_pool_t *pool) {
+   while(pool->idle != NULL) {
+      pcl_arena_t *arena = pool->idle;
+      pool->idle = arena->next;
+      pcl_arena_destroy(arena);
+   }
+   pthread_mutex_destroy(&pool->lock);
+   free(pool);
+}
+
+pcl_arena_t *pcl_arena_get(pcl_arena_pool_t *pool) {
+   pthread_mutex_lock(&pool->lock);
+   pcl_arena_t *arena = pool->idle;
+   if(arena != NULL) {
+      pool->idle = arena->next;
+      pool->idle_qty--;
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   if(arena == NULL) {
+      arena = (pcl_arena_t *)calloc(1, sizeof(pcl_arena_t));
+      if(arena == NULL) {
+         return(NULL);
+      }
+      pcl_arena_count(pool);
+      arena->pool = pool;
+   }
+   arena->next = NULL;
+   atomic_init(&arena->refs, 1);
+   return(arena);
+}
+
+void pcl_arena_retain(pcl_arena_t *arena) {
+   atomic_fetch_add_explicit(&arena->refs, 1, memory_order_relaxed);
+}
+
+void pcl_arena_release(pcl_arena_t *arena) {
+   if(atomic_fetch_sub_explicit(&arena->refs, 1, memory_order_acq_rel) != 1) {
+      return;
+   }
+   pcl_arena_pool_t *pool = arena->pool;
+   pcl_arena_reset(arena);
+
+   pthread_mutex_lock(&pool->lock);
+   if(pool->idle_qty < pool->idle_max) {
+      arena->next = pool->idle;
+      pool->idle  = arena;
+      pool->idle_qty++;
+      arena = NULL;
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   if(arena != NULL) {
+      pcl_arena_destroy(arena);
+   }
+}
+
+void *pcl_arena_alloc(pcl_arena_t *arena, size_t size) {
+   size = PCL_ARENA_ALIGN(size);
+
+   // Chunks kept from earlier use are reused in order before a new one is added
+   pcl_arena_chunk_t *chunk = arena->current;
+   while(chunk != NULL && chunk->size - chunk->used < size) {
+      chunk = chunk->next;
+   }
+   if(chunk == NULL) {
+      chunk = pcl_arena_chunk_create(arena, size);
+      if(chunk == NULL) {
+         return(NULL);
+      }
+   }
+   arena->current = chunk;
+
+   void *ptr = &chunk->data[chunk->used];
+   chunk->used += size;
+   return(ptr);
+}
+
+pcl_arena_chunk_t *pcl_arena_chunk_create(pcl_arena_t *arena, size_t size) {
+   if(size < PCL_ARENA_CHUNK_SIZE) {
+      size = PCL_ARENA_CHUNK_SIZE;
+   }
+   pcl_arena_chunk_t *chunk = (pcl_arena_chunk_t *)malloc(sizeof(pcl_arena_chunk_t) + size);
+   if(chunk == NULL) {
+      return(NULL);
+   }
+   pcl_arena_count(arena->pool);
+   chunk->size = size;
+   chunk->used = 0;
+
+   // Insert after the current chunk so the chunks being skipped stay available after a reset
+   if(arena->current == NULL) {
+      chunk->next  = arena->first;
+      arena->first = chunk;
+   } else {
+      chunk->next = arena->current->next;
+      arena->current->next = chunk;
+   }
+   return(chunk);
+}
+
+void pcl_arena_reset(pcl_arena_t *arena) {
+   size_t              retained = 0;
+   pcl_arena_chunk_t **link     = &arena->first;
+
+   // Keep chunks up to the retention limit, free the rest
+   while(*link != NULL) {
+      pcl_arena_chunk_t *chunk = *link;
+      if(retained + chunk->size > PCL_ARENA_RETAIN_MAX) {
+         *link = chunk->next;
+         free(chunk);
+         continue;
+      }
+      retained   += chunk->size;
+      chunk->used = 0;
+      link        = &chunk->next;
+   }
+   arena->current = arena->first;
+}
+
+void pcl_arena_destroy(pcl_arena_t *arena) {
+   while(arena->first != NULL) {
+      pcl_arena_chunk_t *chunk = arena->first;
+      arena->first = chunk->next;
+      free(chunk);
+   }
+   free(arena);
+}
+
+void pcl_arena_count(pcl_arena_pool_t *pool) {
+   if(pool->heap_allocs != NULL) {
+      atomic_fetch_add_explicit(pool->heap_allocs, 1, memory_order_relaxed);
+   }
+}
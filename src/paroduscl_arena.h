@@ -0,0 +1,40 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_ARENA__
+#define __PARODUS_CLIENT_LIB_ARENA__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Bump allocator for decoded messages.  Everything allocated from an arena is released at once when its last reference is dropped,
+// which resets the arena and returns it to its pool.  Allocation is not thread safe, references are.
+typedef struct pcl_arena      pcl_arena_t;
+typedef struct pcl_arena_pool pcl_arena_pool_t;
+
+// heap_allocs (optional) counts every malloc made for arenas and their chunks
+pcl_arena_pool_t *pcl_arena_pool_create(uint32_t idle_max, atomic_uint_fast64_t *heap_allocs);
+void              pcl_arena_pool_destroy(pcl_arena_pool_t *pool); // every arena must have been released
+pcl_arena_t *     pcl_arena_get(pcl_arena_pool_t *pool);           // returned with one reference
+void              pcl_arena_retain(pcl_arena_t *arena);
+void              pcl_arena_release(pcl_arena_t *arena);
+void *            pcl_arena_alloc(pcl_arena_t *arena, size_t size); // 8 byte aligned, NULL when out of memory
+
+#endif
@@ -0,0 +1,301 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "paroduscl_cache.h"
+#include "paroduscl_dispatch.h"
+
+typedef struct pcl_cache_entry {
+   struct pcl_cache_entry *hash_next;
+   struct pcl_cache_entry *lru_prev;   // more recently used
+   struct pcl_cache_entry *lru_next;   // less recently used
+   uint32_t                hash;
+   uint64_t                expires_ms;
+   void *                  value;      // NULL while pending
+   size_t                  value_len;
+   size_t                  key_len;
+   char                    key[];
+} pcl_cache_entry_t;
+
+struct pcl_cache {
+   pthread_mutex_t       lock;
+   uint32_t              count;
+   uint32_t              entries_max;
+   size_t                mem;          // entries and values
+   size_t                mem_max;
+   uint32_t              bucket_qty;
+   pcl_cache_entry_t **  buckets;
+   pcl_cache_entry_t *   lru_head;
+   pcl_cache_entry_t *   lru_tail;
+   atomic_uint_fast64_t *evicted;
+};
+
+static uint64_t           pcl_cache_now_ms(void);
+static pcl_cache_entry_t *pcl_cache_find(pcl_cache_t *cache, const char *key, size_t key_len, uint32_t hash, uint64_t now);
+static void               pcl_cache_unlink(pcl_cache_t *cache, pcl_cache_entry_t *entry);
+static void               pcl_cache_push_head(pcl_cache_t *cache, pcl_cache_entry_t *entry);
+static void               pcl_cache_free(pcl_cache_t *cache, pcl_cache_entry_t *entry);
+static bool               pcl_cache_reserve(pcl_cache_t *cache, size_t size, uint64_t now);
+static bool               pcl_cache_path_related(const char *key, size_t key_len, const char *path, size_t path_len);
+
+pcl_cache_t *pcl_cache_create(uint32_t entries_max, size_t mem_max, atomic_uint_fast64_t *evicted) {
+   if(entries_max == 0) {
+      return(NULL);
+   }
+   pcl_cache_t *cache = (pcl_cache_t *)calloc(1, sizeof(pcl_cache_t));
+   if(cache == NULL) {
+      return(NULL);
+   }
+   // Sized for the entry limit so chains stay short without growing
+   cache->bucket_qty = 16;
+   while(cache->bucket_qty < entries_max) {
+      cache->bucket_qty *= 2;
+   }
+   cache->buckets = (pcl_cache_entry_t **)calloc(cache->bucket_qty, sizeof(pcl_cache_entry_t *));
+   if(cache->buckets == NULL) {
+      free(cache);
+      return(NULL);
+   }
+   cache->entries_max = entries_max;
+   cache->mem_max     = mem_max;
+   cache->evicted     = evicted;
+   pthread_mutex_init(&cache->lock, NULL);
+   return(cache);
+}
+
+void pcl_cache_destroy(pcl_cache_t *cache) {
+   if(cache == NULL) {
+      return;
+   }
+   pcl_cache_clear(cache);
+   pthread_mutex_destroy(&cache->lock);
+   free(cache->buckets);
+   free(cache);
+}
+
+pcl_cache_result_t pcl_cache_lookup(pcl_cache_t *cache, const char *key, size_t key_len, uint32_t ttl_ms, void **value, size_t *value_len) {
+   uint32_t hash = pcl_dispatch_hash(key, key_len);
+   uint64_t now  = pcl_cache_now_ms();
+
+   pthread_mutex_lock(&cache->lock);
+   pcl_cache_entry_t *entry = pcl_cache_find(cache, key, key_len, hash, now);
+   if(entry != NULL) {
+      pcl_cache_unlink(cache, entry);
+      pcl_cache_push_head(cache, entry);
+      if(entry->value == NULL) {
+         pthread_mutex_unlock(&cache->lock);
+         return(PCL_CACHE_PENDING);
+      }
+      // Copied so the entry can be evicted while the caller uses the value
+      *value = malloc(entry->value_len);
+      if(*value == NULL) {
+         pthread_mutex_unlock(&cache->lock);
+         return(PCL_CACHE_PENDING);
+      }
+      memcpy(*value, entry->value, entry->value_len);
+      *value_len = entry->value_len;
+      pthread_mutex_unlock(&cache->lock);
+      return(PCL_CACHE_HIT);
+   }
+   if(ttl_ms > 0 && pcl_cache_reserve(cache, sizeof(pcl_cache_entry_t) + key_len, now)) {
+      entry = (pcl_cache_entry_t *)calloc(1, sizeof(pcl_cache_entry_t) + key_len);
+      if(entry != NULL) {
+         entry->hash       = hash;
+         entry->expires_ms = now + ttl_ms;
+         entry->key_len    = key_len;
+         memcpy(entry->key, key, key_len);
+         entry->hash_next  = cache->buckets[hash & (cache->bucket_qty - 1)];
+         cache->buckets[hash & (cache->bucket_qty - 1)] = entry;
+         pcl_cache_push_head(cache, entry);
+         cache->count++;
+         cache->mem += sizeof(pcl_cache_entry_t) + key_len;
+      }
+   }
+   pthread_mutex_unlock(&cache->lock);
+   return(PCL_CACHE_MISS);
+}
+
+bool pcl_cache_store(pcl_cache_t *cache, const char *key, size_t key_len, const void *value, size_t value_len, uint32_t ttl_ms, bool pending_only) {
+   uint32_t hash = pcl_dispatch_hash(key, key_len);
+   uint64_t now  = pcl_cache_now_ms();
+
+   pthread_mutex_lock(&cache->lock);
+   pcl_cache_entry_t *entry = pcl_cache_find(cache, key, key_len, hash, now);
+   if(pending_only && (entry == NULL || entry->value != NULL)) {
+      pthread_mutex_unlock(&cache->lock);
+      return(false);
+   }
+   if(entry != NULL) { // the new value replaces the old one
+      pcl_cache_free(cache, entry);
+      entry = NULL;
+   }
+   size_t size = sizeof(pcl_cache_entry_t) + key_len + value_len;
+   if(size > cache->mem_max || !pcl_cache_reserve(cache, size, now)) {
+      pthread_mutex_unlock(&cache->lock);
+      return(false);
+   }
+   entry = (pcl_cache_entry_t *)calloc(1, sizeof(pcl_cache_entry_t) + key_len);
+   void *copy = malloc(value_len > 0 ? value_len : 1);
+   if(entry == NULL || copy == NULL) {
+      pthread_mutex_unlock(&cache->lock);
+      free(entry);
+      free(copy);
+      return(false);
+   }
+   memcpy(copy, value, value_len);
+   entry->hash       = hash;
+   entry->expires_ms = now + ttl_ms;
+   entry->value      = copy;
+   entry->value_len  = value_len;
+   entry->key_len    = key_len;
+   memcpy(entry->key, key, key_len);
+   entry->hash_next  = cache->buckets[hash & (cache->bucket_qty - 1)];
+   cache->buckets[hash & (cache->bucket_qty - 1)] = entry;
+   pcl_cache_push_head(cache, entry);
+   cache->count++;
+   cache->mem += size;
+   pthread_mutex_unlock(&cache->lock);
+   return(true);
+}
+
+bool pcl_cache_remove(pcl_cache_t *cache, const char *key, size_t key_len) {
+   uint32_t hash = pcl_dispatch_hash(key, key_len);
+
+   pthread_mutex_lock(&cache->lock);
+   pcl_cache_entry_t *entry = pcl_cache_find(cache, key, key_len, hash, 0);
+   if(entry != NULL) {
+      pcl_cache_free(cache, entry);
+   }
+   pthread_mutex_unlock(&cache->lock);
+   return(entry != NULL);
+}
+
+uint32_t pcl_cache_remove_path(pcl_cache_t *cache, const char *path, size_t path_len) {
+   uint32_t removed = 0;
+   pthread_mutex_lock(&cache->lock);
+   pcl_cache_entry_t *entry = cache->lru_head;
+   while(entry != NULL) {
+      pcl_cache_entry_t *next = entry->lru_next;
+      if(pcl_cache_path_related(entry->key, entry->key_len, path, path_len)) {
+         pcl_cache_free(cache, entry);
+         removed++;
+      }
+      entry = next;
+   }
+   pthread_mutex_unlock(&cache->lock);
+   return(removed);
+}
+
+void pcl_cache_clear(pcl_cache_t *cache) {
+   pthread_mutex_lock(&cache->lock);
+   while(cache->lru_tail != NULL) {
+      pcl_cache_free(cache, cache->lru_tail);
+   }
+   pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t pcl_cache_now_ms(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+pcl_cache_entry_t *pcl_cache_find(pcl_cache_t *cache, const char *key, size_t key_len, uint32_t hash, uint64_t now) {
+   for(pcl_cache_entry_t *entry = cache->buckets[hash & (cache->bucket_qty - 1)]; entry != NULL; entry = entry->hash_next) {
+      if(entry->hash == hash && entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+         if(now != 0 && entry->expires_ms <= now) {
+            pcl_cache_free(cache, entry);
+            return(NULL);
+         }
+         return(entry);
+      }
+   }
+   return(NULL);
+}
+
+void pcl_cache_unlink(pcl_cache_t *cache, pcl_cache_entry_t *entry) {
+   if(entry->lru_prev != NULL) {
+      entry->lru_prev->lru_next = entry->lru_next;
+   } else {
+      cache->lru_head = entry->lru_next;
+   }
+   if(entry->lru_next != NULL) {
+      entry->lru_next->lru_prev = entry->lru_prev;
+   } else {
+      cache->lru_tail = entry->lru_prev;
+   }
+   entry->lru_prev = NULL;
+   entry->lru_next = NULL;
+}
+
+void pcl_cache_push_head(pcl_cache_t *cache, pcl_cache_entry_t *entry) {
+   entry->lru_prev = NULL;
+   entry->lru_next = cache->lru_head;
+   if(cache->lru_head != NULL) {
+      cache->lru_head->lru_prev = entry;
+   } else {
+      cache->lru_tail = entry;
+   }
+   cache->lru_head = entry;
+}
+
+void pcl_cache_free(pcl_cache_t *cache, pcl_cache_entry_t *entry) {
+   pcl_cache_entry_t **link = &cache->buckets[entry->hash & (cache->bucket_qty - 1)];
+   while(*link != entry) {
+      link = &(*link)->hash_next;
+   }
+   *link = entry->hash_next;
+   pcl_cache_unlink(cache, entry);
+   cache->count--;
+   cache->mem -= sizeof(pcl_cache_entry_t) + entry->key_len + entry->value_len;
+   free(entry->value);
+   free(entry);
+}
+
+bool pcl_cache_path_related(const char *key, size_t key_len, const char *path, size_t path_len) {
+   // One is the other or starts with it followed by a separator, so "iot/a" is related to "iot" and "iot/a/b" but not "iot/ab"
+   size_t len = (key_len < path_len) ? key_len : path_len;
+   if(memcmp(key, path, len) != 0) {
+      return(false);
+   }
+   if(key_len == path_len) {
+      return(true);
+   }
+   return(((key_len > path_len) ? key[len] : path[len]) == '/');
+}
+
+bool pcl_cache_reserve(pcl_cache_t *cache, size_t size, uint64_t now) {
+   // Expired entries go first, then the least recently used ones
+   while(cache->lru_tail != NULL && cache->lru_tail->expires_ms <= now) {
+      pcl_cache_free(cache, cache->lru_tail);
+   }
+   while(cache->count >= cache->entries_max || cache->mem + size > cache->mem_max) {
+      if(cache->lru_tail == NULL) {
+         return(false);
+      }
+      pcl_cache_free(cache, cache->lru_tail);
+      if(cache->evicted != NULL) {
+         atomic_fetch_add_explicit(cache->evicted, 1, memory_order_relaxed);
+      }
+   }
+   return(true);
+}
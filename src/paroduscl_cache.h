@@ -0,0 +1,49 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __PARODUS_CLIENT_LIB_CACHE__
+#define __PARODUS_CLIENT_LIB_CACHE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Bounded LRU of byte strings keyed by string.  Entries expire after their ttl and the least recently used ones are evicted to stay
+// within the entry and memory limits.  An entry may be added without a value to mark its key as pending.
+typedef struct pcl_cache pcl_cache_t;
+
+typedef enum {
+   PCL_CACHE_MISS    = 0,
+   PCL_CACHE_PENDING = 1, // key present without a value
+   PCL_CACHE_HIT     = 2,
+} pcl_cache_result_t;
+
+// evicted (optional) counts entries removed to make room before they expired
+pcl_cache_t *      pcl_cache_create(uint32_t entries_max, size_t mem_max, atomic_uint_fast64_t *evicted);
+void               pcl_cache_destroy(pcl_cache_t *cache);
+// On a hit value is set to a copy the caller frees.  On a miss with ttl_ms > 0 the key is added as pending for ttl_ms.
+pcl_cache_result_t pcl_cache_lookup(pcl_cache_t *cache, const char *key, size_t key_len, uint32_t ttl_ms, void **value, size_t *value_len);
+// Stores a copy of value under key, replacing any previous value.  With pending_only the value is only stored if the key is pending.
+bool               pcl_cache_store(pcl_cache_t *cache, const char *key, size_t key_len, const void *value, size_t value_len, uint32_t ttl_ms, bool pending_only);
+bool               pcl_cache_remove(pcl_cache_t *cache, const char *key, size_t key_len);
+// Removes the entry keyed by path and every entry whose key is a path above or below it, with '/' separating the components.
+// Walks every entry.  Returns the number removed.
+uint32_t           pcl_cache_remove_path(pcl_cache_t *cache, const char *path, size_t path_len);
+void               pcl_cache_clear(pcl_cache_t *cache);
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "paroduscl_capture.h"
+#include "paroduscl_stats.h"
+
+#define PCL_CAPTURE_BUF_SIZE (64 * 1024)
+#define PCL_CAPTURE_ALIGN(len) (((len) + 7) & ~(size_t)7)
+
+struct pcl_capture {
+   pthread_mutex_t lock;
+   int             fd;
+   uint64_t        start_ns;
+   size_t          buf_len;
+   uint8_t         buf[PCL_CAPTURE_BUF_SIZE]; // records are written out when full and when the capture is closed
+};
+
+static void pcl_capture_flush(pcl_capture_t *capture);
+static void pcl_capture_write(int fd, const struct iovec *iov, int iov_qty);
+
+pcl_capture_t *pcl_capture_open(const char *path, int *errsv) {
+   pcl_capture_t *capture = (pcl_capture_t *)malloc(sizeof(pcl_capture_t));
+   if(capture == NULL) {
+      *errsv = errno;
+      return(NULL);
+   }
+   capture->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+   if(capture->fd < 0) {
+      *errsv = errno;
+      free(capture);
+      return(NULL);
+   }
+   pthread_mutex_init(&capture->lock, NULL);
+   capture->start_ns = pcl_stats_time_ns();
+   capture->buf_len  = 0;
+
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   pcl_capture_record_t record = { .time_ns = ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec, .len = PCL_CAPTURE_MAGIC_LEN, .dir = PCL_CAPTURE_START };
+   memcpy(capture->buf, &record, sizeof(record));
+   memcpy(&capture->buf[sizeof(record)], PCL_CAPTURE_MAGIC, PCL_CAPTURE_MAGIC_LEN);
+   capture->buf_len = sizeof(record) + PCL_CAPTURE_MAGIC_LEN;
+   return(capture);
+}
+
+void pcl_capture_close(pcl_capture_t *capture) {
+   if(capture == NULL) {
+      return;
+   }
+   pcl_capture_flush(capture);
+   close(capture->fd);
+   pthread_mutex_destroy(&capture->lock);
+   free(capture);
+}
+
+void pcl_capture_frame(pcl_capture_t *capture, pcl_capture_dir_t dir, const void *frame, size_t len) {
+   if(capture == NULL || len > UINT32_MAX) {
+      return;
+   }
+   static const uint8_t pad[8] = { 0 };
+   pcl_capture_record_t record = { .time_ns = pcl_stats_time_ns() - capture->start_ns, .len = (uint32_t)len, .dir = dir };
+   size_t               size   = sizeof(record) + PCL_CAPTURE_ALIGN(len);
+
+   pthread_mutex_lock(&capture->lock);
+   if(capture->buf_len + size > PCL_CAPTURE_BUF_SIZE) {
+      pcl_capture_flush(capture);
+   }
+   if(size > PCL_CAPTURE_BUF_SIZE) { // written straight from the caller's buffer
+      struct iovec iov[3] = { { &record, sizeof(record) }, { (void *)frame, len }, { (void *)pad, PCL_CAPTURE_ALIGN(len) - len } };
+      pcl_capture_write(capture->fd, iov, 3);
+   } else {
+      uint8_t *pos = &capture->buf[capture->buf_len];
+      memcpy(pos, &record, sizeof(record));
+      memcpy(&pos[sizeof(record)], frame, len);
+      memset(&pos[sizeof(record) + len], 0, PCL_CAPTURE_ALIGN(len) - len);
+      capture->buf_len += size;
+   }
+   pthread_mutex_unlock(&capture->lock);
+}
+
+void pcl_capture_flush(pcl_capture_t *capture) {
+   if(capture->buf_len > 0) {
+      struct iovec iov = { capture->buf, capture->buf_len };
+      pcl_capture_write(capture->fd, &iov, 1);
+      capture->buf_len = 0;
+   }
+}
+
+void pcl_capture_write(int fd, const struct iovec *iov, int iov_qty) {
+   // Records are dropped on a write error rather than failing the message they describe
+   struct iovec remaining[3];
+   memcpy(remaining, iov, iov_qty * sizeof(struct iovec));
+   int index = 0;
+   while(index < iov_qty) {
+      ssize_t ret = writev(fd, &remaining[index], iov_qty - index);
+      if(ret < 0) {
+         if(errno == EINTR) {
+            continue;
+         }
+         return;
+      }
+      while(index < iov_qty && (size_t)ret >= remaining[index].iov_len) {
+         ret -= remaining[index].iov_len;
+         index++;
+      }
+      if(index < iov_qty) {
+         remaining[index].iov_base  = (uint8_t *)remaining[index].iov_base + ret;
+         remaining[index].iov_len  -= ret;
+      }
+   }
+}
+
+bool pcl_capture_log_open(pcl_capture_log_t *log, const char *path, int *errsv) {
+   struct stat st;
+   int         fd = open(path, O_RDONLY | O_CLOEXEC);
+   if(fd < 0 || fstat(fd, &st) < 0) {
+      *errsv = errno;
+      if(fd >= 0) {
+         close(fd);
+      }
+      return(false);
+   }
+   log->len  = st.st_size;
+   log->pos  = 0;
+   log->base = (log->len > 0) ? mmap(NULL, log->len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+   *errsv    = (log->base == MAP_FAILED) ? ((log->len > 0) ? errno : EINVAL) : 0;
+   close(fd);
+   if(log->base == MAP_FAILED) {
+      log->base = NULL;
+      return(false);
+   }
+   madvise((void *)log->base, log->len, MADV_SEQUENTIAL);
+
+   // The log must start with a session
+   const pcl_capture_record_t *record;
+   const void *                frame;
+   if(!pcl_capture_log_next(log, &record, &frame) || record->dir != PCL_CAPTURE_START || record->len != PCL_CAPTURE_MAGIC_LEN ||
+      memcmp(frame, PCL_CAPTURE_MAGIC, PCL_CAPTURE_MAGIC_LEN) != 0) {
+      pcl_capture_log_close(log);
+      *errsv = EINVAL;
+      return(false);
+   }
+   log->pos = 0;
+   return(true);
+}
+
+void pcl_capture_log_close(pcl_capture_log_t *log) {
+   if(log->base != NULL) {
+      munmap((void *)log->base, log->len);
+      log->base = NULL;
+   }
+}
+
+bool pcl_capture_log_next(pcl_capture_log_t *log, const pcl_capture_record_t **record, const void **frame) {
+   if(log->len - log->pos < sizeof(pcl_capture_record_t)) {
+      return(false);
+   }
+   const pcl_capture_record_t *next = (const pcl_capture_record_t *)&log->base[log->pos];
+   size_t                      size = sizeof(pcl_capture_record_t) + PCL_CAPTURE_ALIGN((size_t)next->len);
+   if(log->len - log->pos < size) { // truncated by a crash while capturing
+      return(false);
+   }
+   *record   = next;
+   *frame    = &log->base[log->pos + sizeof(pcl_capture_record_t)];
+   log->pos += size;
+   return(true);
+}
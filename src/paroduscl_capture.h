@@ -0,0 +1,63 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __PARODUS_CLIENT_LIB_CAPTURE__
+#define __PARODUS_CLIENT_LIB_CAPTURE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Append-only log of raw WRP frames.  A log is a sequence of records, each followed by its frame and padded to 8 bytes.  Every
+// capture session starts with a PCL_CAPTURE_START record whose frame is PCL_CAPTURE_MAGIC and whose time is the wall clock.  Later
+// records in the session are timed from the start of the session.
+#define PCL_CAPTURE_MAGIC     "PCLCAP01"
+#define PCL_CAPTURE_MAGIC_LEN (8)
+
+typedef enum {
+   PCL_CAPTURE_IN    = 0, // received from parodus
+   PCL_CAPTURE_OUT   = 1, // passed to the socket for parodus
+   PCL_CAPTURE_START = 2,
+} pcl_capture_dir_t;
+
+typedef struct {
+   uint64_t time_ns;      // since the session started (CLOCK_MONOTONIC), or CLOCK_REALTIME for PCL_CAPTURE_START
+   uint32_t len;          // frame bytes following the record
+   uint8_t  dir;          // pcl_capture_dir_t
+   uint8_t  reserved[3];
+} pcl_capture_record_t;
+
+typedef struct pcl_capture pcl_capture_t;
+
+pcl_capture_t *pcl_capture_open(const char *path, int *errsv);
+void           pcl_capture_close(pcl_capture_t *capture); // writes out buffered records
+// Appends a record for frame, does nothing when capture is NULL.  Safe to call from any thread.
+void           pcl_capture_frame(pcl_capture_t *capture, pcl_capture_dir_t dir, const void *frame, size_t len);
+
+// Capture log mapped for reading
+typedef struct {
+   const uint8_t *base;
+   size_t         len;
+   size_t         pos;
+} pcl_capture_log_t;
+
+bool pcl_capture_log_open(pcl_capture_log_t *log, const char *path, int *errsv); // false if the file is not a capture log
+void pcl_capture_log_close(pcl_capture_log_t *log);
+// Returns the next complete record and its frame, false at the end of the log
+bool pcl_capture_log_next(pcl_capture_log_t *log, const pcl_capture_record_t **record, const void **frame);
+
+#endif
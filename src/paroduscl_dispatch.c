@@ -0,0 +1,209 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <pthread.h>
+#include "paroduscl_dispatch.h"
+
+typedef struct {
+   pthread_mutex_t      lock;
+   pcl_dispatch_node_t *head;
+   pcl_dispatch_node_t *tail;
+   bool                 running; // a worker is executing this shard's items
+} pcl_dispatch_shard_t;
+
+typedef struct {
+   pcl_dispatch_t *dispatch;
+   uint32_t        home;   // first shard scanned by this worker
+   pthread_t       thread;
+   bool            started;
+} pcl_dispatch_worker_t;
+
+struct pcl_dispatch {
+   pcl_dispatch_func_t    func;
+   void *                 ctx;
+   pthread_mutex_t        lock;       // protects generation and stop
+   pthread_cond_t         cond;
+   uint64_t               generation; // incremented on every push so idle workers do not miss work
+   bool                   stop;
+   uint32_t               shard_qty;
+   pcl_dispatch_shard_t * shards;
+   uint32_t               worker_qty;
+   pcl_dispatch_worker_t *workers;
+};
+
+static void *pcl_dispatch_thread(void *arg);
+static bool  pcl_dispatch_shard_run(pcl_dispatch_t *dispatch, pcl_dispatch_shard_t *shard);
+
+pcl_dispatch_t *pcl_dispatch_create(uint32_t workers, uint32_t shards, pcl_dispatch_func_t func, void *ctx) {
+   if(workers == 0 || func == NULL) {
+      return(NULL);
+   }
+   if(shards < workers) {
+      shards = workers;
+   }
+   pcl_dispatch_t *dispatch = (pcl_dispatch_t *)calloc(1, sizeof(pcl_dispatch_t));
+   if(dispatch == NULL) {
+      return(NULL);
+   }
+   dispatch->func       = func;
+   dispatch->ctx        = ctx;
+   dispatch->shard_qty  = shards;
+   dispatch->worker_qty = workers;
+   dispatch->shards     = (pcl_dispatch_shard_t *)calloc(shards, sizeof(pcl_dispatch_shard_t));
+   dispatch->workers    = (pcl_dispatch_worker_t *)calloc(workers, sizeof(pcl_dispatch_worker_t));
+   if(dispatch->shards == NULL || dispatch->workers == NULL) {
+      free(dispatch->shards);
+      free(dispatch->workers);
+      free(dispatch);
+      return(NULL);
+   }
+   pthread_mutex_init(&dispatch->lock, NULL);
+   pthread_cond_init(&dispatch->cond, NULL);
+   for(uint32_t index = 0; index < shards; index++) {
+      pthread_mutex_init(&dispatch->shards[index].lock, NULL);
+   }
+   for(uint32_t index = 0; index < workers; index++) {
+      pcl_dispatch_worker_t *worker = &dispatch->workers[index];
+      worker->dispatch = dispatch;
+      worker->home     = (index * shards) / workers;
+      if(pthread_create(&worker->thread, NULL, pcl_dispatch_thread, worker) != 0) {
+         pcl_dispatch_destroy(dispatch);
+         return(NULL);
+      }
+      worker->started = true;
+   }
+   return(dispatch);
+}
+
+void pcl_dispatch_destroy(pcl_dispatch_t *dispatch) {
+   if(dispatch == NULL) {
+      return;
+   }
+   pthread_mutex_lock(&dispatch->lock);
+   dispatch->stop = true;
+   pthread_cond_broadcast(&dispatch->cond);
+   pthread_mutex_unlock(&dispatch->lock);
+
+   for(uint32_t index = 0; index < dispatch->worker_qty; index++) {
+      if(dispatch->workers[index].started) {
+         pthread_join(dispatch->workers[index].thread, NULL);
+      }
+   }
+   // Workers only exit once every shard is empty, unless none could be started
+   for(uint32_t index = 0; index < dispatch->shard_qty; index++) {
+      while(pcl_dispatch_shard_run(dispatch, &dispatch->shards[index]));
+      pthread_mutex_destroy(&dispatch->shards[index].lock);
+   }
+   pthread_cond_destroy(&dispatch->cond);
+   pthread_mutex_destroy(&dispatch->lock);
+   free(dispatch->shards);
+   free(dispatch->workers);
+   free(dispatch);
+}
+
+void pcl_dispatch_push(pcl_dispatch_t *dispatch, uint32_t key, pcl_dispatch_node_t *node) {
+   pcl_dispatch_shard_t *shard = &dispatch->shards[key % dispatch->shard_qty];
+
+   node->next = NULL;
+   pthread_mutex_lock(&shard->lock);
+   if(shard->tail == NULL) {
+      shard->head = node;
+   } else {
+      shard->tail->next = node;
+   }
+   shard->tail = node;
+   pthread_mutex_unlock(&shard->lock);
+
+   pthread_mutex_lock(&dispatch->lock);
+   dispatch->generation++;
+   pthread_cond_signal(&dispatch->cond);
+   pthread_mutex_unlock(&dispatch->lock);
+}
+
+bool pcl_dispatch_shard_run(pcl_dispatch_t *dispatch, pcl_dispatch_shard_t *shard) {
+   pthread_mutex_lock(&shard->lock);
+   if(shard->running || shard->head == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      return(false);
+   }
+   shard->running = true;
+
+   // Keep the shard until it is empty so its items never run on two workers at once
+   while(shard->head != NULL) {
+      pcl_dispatch_node_t *node = shard->head;
+      shard->head = NULL;
+      shard->tail = NULL;
+      pthread_mutex_unlock(&shard->lock);
+
+      while(node != NULL) {
+         pcl_dispatch_node_t *next = node->next;
+         (*dispatch->func)(dispatch->ctx, node);
+         node = next;
+      }
+      pthread_mutex_lock(&shard->lock);
+   }
+   shard->running = false;
+   pthread_mutex_unlock(&shard->lock);
+   return(true);
+}
+
+void *pcl_dispatch_thread(void *arg) {
+   pcl_dispatch_worker_t *worker   = (pcl_dispatch_worker_t *)arg;
+   pcl_dispatch_t *       dispatch = worker->dispatch;
+
+   for(;;) {
+      pthread_mutex_lock(&dispatch->lock);
+      uint64_t generation = dispatch->generation;
+      pthread_mutex_unlock(&dispatch->lock);
+
+      // Scan from the home shard so workers spread out, taking any shard that is not already running
+      bool found = false;
+      for(uint32_t index = 0; index < dispatch->shard_qty; index++) {
+         if(pcl_dispatch_shard_run(dispatch, &dispatch->shards[(worker->home + index) % dispatch->shard_qty])) {
+            found = true;
+         }
+      }
+      if(found) {
+         continue;
+      }
+
+      pthread_mutex_lock(&dispatch->lock);
+      while(generation == dispatch->generation && !dispatch->stop) {
+         pthread_cond_wait(&dispatch->cond, &dispatch->lock);
+      }
+      bool stop = dispatch->stop && generation == dispatch->generation;
+      pthread_mutex_unlock(&dispatch->lock);
+      if(stop) {
+         break;
+      }
+   }
+   return(NULL);
+}
+
+uint32_t pcl_dispatch_hash(const char *str, size_t len) {
+   uint32_t hash = 2166136261u; // FNV-1a
+   for(size_t index = 0; index < len; index++) {
+      hash ^= (uint8_t)str[index];
+      hash *= 16777619u;
+   }
+   return(hash);
+}
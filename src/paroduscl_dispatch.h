@@ -0,0 +1,40 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_DISPATCH__
+#define __PARODUS_CLIENT_LIB_DISPATCH__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Intrusive node, embed as the first member of the dispatched item
+typedef struct pcl_dispatch_node {
+   struct pcl_dispatch_node *next;
+} pcl_dispatch_node_t;
+
+typedef void (*pcl_dispatch_func_t)(void *ctx, pcl_dispatch_node_t *node);
+
+typedef struct pcl_dispatch pcl_dispatch_t;
+
+// Items pushed with the same key run in order on one worker at a time.  Idle workers steal shards that are not running.
+pcl_dispatch_t *pcl_dispatch_create(uint32_t workers, uint32_t shards, pcl_dispatch_func_t func, void *ctx);
+void            pcl_dispatch_push(pcl_dispatch_t *dispatch, uint32_t key, pcl_dispatch_node_t *node);
+void            pcl_dispatch_destroy(pcl_dispatch_t *dispatch); // runs all pushed items then joins the workers
+uint32_t        pcl_dispatch_hash(const char *str, size_t len);
+
+#endif
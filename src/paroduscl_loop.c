@@ -0,0 +1,258 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "paroduscl.h"
+#include "paroduscl_loop.h"
+
+#define PCL_LOOP_EVENTS_MAX (64)
+
+typedef struct pcl_loop_entry {
+   struct pcl_loop_entry *next;
+   int                    fd;
+   bool                   timer;
+   atomic_bool            removed;
+   pcl_fd_handler_t       handler_fd;
+   pcl_timer_handler_t    handler_timer;
+   void *                 ctx;
+} pcl_loop_entry_t;
+
+struct pcl_loop {
+   int               epoll_fd;
+   pthread_mutex_t   lock;
+   pcl_loop_entry_t *entries;
+   pcl_loop_entry_t *removed;  // freed once no wait can still hold a pointer to them
+   bool              waiting;
+};
+
+static pcl_result_t pcl_loop_entry_add(pcl_loop_t *loop, pcl_loop_entry_t *entry, uint32_t events);
+static pcl_result_t pcl_loop_entry_remove(pcl_loop_t *loop, int fd, bool timer);
+static void         pcl_loop_removed_free(pcl_loop_t *loop);
+
+pcl_loop_t *pcl_loop_create(void) {
+   pcl_loop_t *loop = (pcl_loop_t *)calloc(1, sizeof(pcl_loop_t));
+   if(loop == NULL) {
+      return(NULL);
+   }
+   loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if(loop->epoll_fd < 0) {
+      free(loop);
+      return(NULL);
+   }
+   pthread_mutex_init(&loop->lock, NULL);
+   return(loop);
+}
+
+void pcl_loop_destroy(pcl_loop_t *loop) {
+   if(loop == NULL) {
+      return;
+   }
+   while(loop->entries != NULL) {
+      pcl_loop_entry_t *entry = loop->entries;
+      loop->entries = entry->next;
+      if(entry->timer) {
+         close(entry->fd);
+      }
+      free(entry);
+   }
+   loop->waiting = false;
+   pcl_loop_removed_free(loop);
+   close(loop->epoll_fd);
+   pthread_mutex_destroy(&loop->lock);
+   free(loop);
+}
+
+pcl_result_t pcl_loop_fd_add(pcl_loop_t *loop, int fd, uint32_t events, pcl_fd_handler_t handler, void *ctx) {
+   if(fd < 0 || handler == NULL || (events & (PCL_FD_READ | PCL_FD_WRITE)) == 0) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_loop_entry_t *entry = (pcl_loop_entry_t *)calloc(1, sizeof(pcl_loop_entry_t));
+   if(entry == NULL) {
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   entry->fd         = fd;
+   entry->handler_fd = handler;
+   entry->ctx        = ctx;
+
+   uint32_t epoll_events = EPOLLET;
+   if(events & PCL_FD_READ) {
+      epoll_events |= EPOLLIN;
+   }
+   if(events & PCL_FD_WRITE) {
+      epoll_events |= EPOLLOUT;
+   }
+   return(pcl_loop_entry_add(loop, entry, epoll_events));
+}
+
+pcl_result_t pcl_loop_fd_remove(pcl_loop_t *loop, int fd) {
+   return(pcl_loop_entry_remove(loop, fd, false));
+}
+
+pcl_result_t pcl_loop_timer_add(pcl_loop_t *loop, uint32_t period_ms, pcl_timer_handler_t handler, void *ctx, int *timer_id) {
+   if(period_ms == 0 || handler == NULL) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_loop_entry_t *entry = (pcl_loop_entry_t *)calloc(1, sizeof(pcl_loop_entry_t));
+   if(entry == NULL) {
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   entry->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if(entry->fd < 0) {
+      free(entry);
+      return(PCL_RESULT_ERROR_INTERNAL);
+   }
+   struct itimerspec spec;
+   spec.it_interval.tv_sec  = period_ms / 1000;
+   spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000;
+   spec.it_value            = spec.it_interval;
+   if(timerfd_settime(entry->fd, 0, &spec, NULL) < 0) {
+      close(entry->fd);
+      free(entry);
+      return(PCL_RESULT_ERROR_INTERNAL);
+   }
+   entry->timer         = true;
+   entry->handler_timer = handler;
+   entry->ctx           = ctx;
+
+   int fd = entry->fd;
+   pcl_result_t result = pcl_loop_entry_add(loop, entry, EPOLLIN | EPOLLET);
+   if(result != PCL_RESULT_SUCCESS) {
+      close(fd);
+      return(result);
+   }
+   if(timer_id != NULL) {
+      *timer_id = fd;
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_loop_timer_remove(pcl_loop_t *loop, int timer_id) {
+   return(pcl_loop_entry_remove(loop, timer_id, true));
+}
+
+int pcl_loop_wait(pcl_loop_t *loop, int timeout_ms) {
+   struct epoll_event events[PCL_LOOP_EVENTS_MAX];
+
+   pthread_mutex_lock(&loop->lock);
+   loop->waiting = true;
+   pthread_mutex_unlock(&loop->lock);
+
+   int qty = epoll_wait(loop->epoll_fd, events, PCL_LOOP_EVENTS_MAX, timeout_ms);
+   int errsv = errno;
+
+   for(int index = 0; index < qty; index++) {
+      pcl_loop_entry_t *entry = (pcl_loop_entry_t *)events[index].data.ptr;
+      if(entry->removed) { // removed by an earlier handler in this batch
+         continue;
+      }
+      if(entry->timer) {
+         uint64_t expirations;
+         if(read(entry->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            (*entry->handler_timer)(entry->ctx, entry->fd);
+         }
+         continue;
+      }
+      uint32_t flags = 0;
+      if(events[index].events & EPOLLIN) {
+         flags |= PCL_FD_READ;
+      }
+      if(events[index].events & EPOLLOUT) {
+         flags |= PCL_FD_WRITE;
+      }
+      if(events[index].events & (EPOLLERR | EPOLLHUP)) {
+         flags |= PCL_FD_ERROR;
+      }
+      (*entry->handler_fd)(entry->ctx, entry->fd, flags);
+   }
+
+   pthread_mutex_lock(&loop->lock);
+   loop->waiting = false;
+   pcl_loop_removed_free(loop);
+   pthread_mutex_unlock(&loop->lock);
+
+   if(qty < 0) {
+      errno = errsv;
+      return((errsv == EINTR) ? 0 : -1);
+   }
+   return(qty);
+}
+
+pcl_result_t pcl_loop_entry_add(pcl_loop_t *loop, pcl_loop_entry_t *entry, uint32_t events) {
+   struct epoll_event event = { .events = events, .data.ptr = entry };
+
+   pthread_mutex_lock(&loop->lock);
+   for(pcl_loop_entry_t *it = loop->entries; it != NULL; it = it->next) {
+      if(it->fd == entry->fd) {
+         pthread_mutex_unlock(&loop->lock);
+         free(entry);
+         return(PCL_RESULT_ERROR_PARAMS);
+      }
+   }
+   if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, entry->fd, &event) < 0) {
+      pthread_mutex_unlock(&loop->lock);
+      free(entry);
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   entry->next   = loop->entries;
+   loop->entries = entry;
+   pthread_mutex_unlock(&loop->lock);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_loop_entry_remove(pcl_loop_t *loop, int fd, bool timer) {
+   pthread_mutex_lock(&loop->lock);
+   for(pcl_loop_entry_t **it = &loop->entries; *it != NULL; it = &(*it)->next) {
+      pcl_loop_entry_t *entry = *it;
+      if(entry->fd != fd || entry->timer != timer) {
+         continue;
+      }
+      *it = entry->next;
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      if(timer) {
+         close(fd);
+      }
+      // A wait in progress may still have the entry in its event list
+      entry->removed = true;
+      entry->next    = loop->removed;
+      loop->removed  = entry;
+      if(!loop->waiting) {
+         pcl_loop_removed_free(loop);
+      }
+      pthread_mutex_unlock(&loop->lock);
+      return(PCL_RESULT_SUCCESS);
+   }
+   pthread_mutex_unlock(&loop->lock);
+   return(PCL_RESULT_ERROR_PARAMS);
+}
+
+void pcl_loop_removed_free(pcl_loop_t *loop) {
+   while(loop->removed != NULL) {
+      pcl_loop_entry_t *entry = loop->removed;
+      loop->removed = entry->next;
+      free(entry);
+   }
+}
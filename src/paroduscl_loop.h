@@ -0,0 +1,39 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_LOOP__
+#define __PARODUS_CLIENT_LIB_LOOP__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "paroduscl.h"
+
+// Edge-triggered epoll set of application fds and timerfd driven periodic timers
+typedef struct pcl_loop pcl_loop_t;
+
+pcl_loop_t * pcl_loop_create(void);
+void         pcl_loop_destroy(pcl_loop_t *loop);  // closes the timer fds but not the watched fds
+pcl_result_t pcl_loop_fd_add(pcl_loop_t *loop, int fd, uint32_t events, pcl_fd_handler_t handler, void *ctx);
+pcl_result_t pcl_loop_fd_remove(pcl_loop_t *loop, int fd);
+pcl_result_t pcl_loop_timer_add(pcl_loop_t *loop, uint32_t period_ms, pcl_timer_handler_t handler, void *ctx, int *timer_id);
+pcl_result_t pcl_loop_timer_remove(pcl_loop_t *loop, int timer_id);
+// Waits up to timeout_ms (-1 for no limit) and calls the handler of each ready fd and expired timer.  Returns the number of
+// handlers called or -1 with errno set.  Must not be called from more than one thread at a time.
+int          pcl_loop_wait(pcl_loop_t *loop, int timeout_ms);
+
+#endif
@@ -0,0 +1,1036 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include "paroduscl.h"
+#include "paroduscl_msgpack.h"
+
+#define PCL_MP_NIL      (0xC0)
+#define PCL_MP_FALSE    (0xC2)
+#define PCL_MP_TRUE     (0xC3)
+#define PCL_MP_BIN8     (0xC4)
+#define PCL_MP_BIN16    (0xC5)
+#define PCL_MP_BIN32    (0xC6)
+#define PCL_MP_EXT8     (0xC7)
+#define PCL_MP_EXT16    (0xC8)
+#define PCL_MP_EXT32    (0xC9)
+#define PCL_MP_FLOAT32  (0xCA)
+#define PCL_MP_FLOAT64  (0xCB)
+#define PCL_MP_UINT8    (0xCC)
+#define PCL_MP_UINT16   (0xCD)
+#define PCL_MP_UINT32   (0xCE)
+#define PCL_MP_UINT64   (0xCF)
+#define PCL_MP_INT8     (0xD0)
+#define PCL_MP_INT16    (0xD1)
+#define PCL_MP_INT32    (0xD2)
+#define PCL_MP_INT64    (0xD3)
+#define PCL_MP_FIXEXT1  (0xD4)
+#define PCL_MP_FIXEXT16 (0xD8)
+#define PCL_MP_STR8     (0xD9)
+#define PCL_MP_STR16    (0xDA)
+#define PCL_MP_STR32    (0xDB)
+#define PCL_MP_ARRAY16  (0xDC)
+#define PCL_MP_ARRAY32  (0xDD)
+#define PCL_MP_MAP16    (0xDE)
+#define PCL_MP_MAP32    (0xDF)
+
+static bool     pcl_mp_need(pcl_mp_reader_t *reader, size_t len);
+static uint64_t pcl_mp_be(const uint8_t *pos, uint32_t len);
+static bool     pcl_mp_read_len(pcl_mp_reader_t *reader, uint32_t size_len, uint32_t *len);
+static bool     pcl_mp_view_str(pcl_mp_reader_t *reader, pcl_str_view_t *str);
+static void     pcl_mp_write_tag(pcl_mp_writer_t *writer, uint8_t tag, uint64_t value, uint32_t len);
+static void     pcl_mp_write_key_str(pcl_mp_writer_t *writer, const char *key, const char *str);
+static void     pcl_wrp_encode_common(pcl_mp_writer_t *writer, const char *content_type, headers_t *headers, data_t *metadata, partners_t *partner_ids);
+static uint32_t pcl_wrp_count_common(const char *content_type, headers_t *headers, data_t *metadata, partners_t *partner_ids);
+static void     pcl_wrp_encode_spans(pcl_mp_writer_t *writer, const money_trace_spans *spans);
+static bool     pcl_wrp_arena_str(pcl_arena_t *arena, const pcl_str_view_t *view, char **str);
+static bool     pcl_wrp_arena_strs(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, size_t items_offset, void **list);
+static bool     pcl_wrp_arena_metadata(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, data_t **metadata);
+static bool     pcl_wrp_arena_spans(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, money_trace_spans *spans);
+
+void pcl_mp_reader_init(pcl_mp_reader_t *reader, const void *buf, size_t len) {
+   reader->pos = (const uint8_t *)buf;
+   reader->end = reader->pos + len;
+}
+
+bool pcl_mp_need(pcl_mp_reader_t *reader, size_t len) {
+   return((size_t)(reader->end - reader->pos) >= len);
+}
+
+uint64_t pcl_mp_be(const uint8_t *pos, uint32_t len) {
+   uint64_t value = 0;
+   for(uint32_t index = 0; index < len; index++) {
+      value = (value << 8) | pos[index];
+   }
+   return(value);
+}
+
+bool pcl_mp_read_len(pcl_mp_reader_t *reader, uint32_t size_len, uint32_t *len) {
+   if(!pcl_mp_need(reader, size_len)) {
+      return(false);
+   }
+   *len = (uint32_t)pcl_mp_be(reader->pos, size_len);
+   reader->pos += size_len;
+   return(true);
+}
+
+bool pcl_mp_read_map(pcl_mp_reader_t *reader, uint32_t *count) {
+   if(!pcl_mp_need(reader, 1)) {
+      return(false);
+   }
+   uint8_t tag = *reader->pos++;
+   if((tag & 0xF0) == 0x80) {
+      *count = tag & 0x0F;
+      return(true);
+   }
+   if(tag == PCL_MP_MAP16) {
+      return(pcl_mp_read_len(reader, 2, count));
+   }
+   if(tag == PCL_MP_MAP32) {
+      return(pcl_mp_read_len(reader, 4, count));
+   }
+   return(false);
+}
+
+bool pcl_mp_read_array(pcl_mp_reader_t *reader, uint32_t *count) {
+   if(!pcl_mp_need(reader, 1)) {
+      return(false);
+   }
+   uint8_t tag = *reader->pos++;
+   if((tag & 0xF0) == 0x90) {
+      *count = tag & 0x0F;
+      return(true);
+   }
+   if(tag == PCL_MP_ARRAY16) {
+      return(pcl_mp_read_len(reader, 2, count));
+   }
+   if(tag == PCL_MP_ARRAY32) {
+      return(pcl_mp_read_len(reader, 4, count));
+   }
+   return(false);
+}
+
+bool pcl_mp_read_str(pcl_mp_reader_t *reader, const char **str, uint32_t *len) {
+   if(!pcl_mp_need(reader, 1)) {
+      return(false);
+   }
+   uint8_t tag = *reader->pos++;
+   bool    ok  = true;
+   if((tag & 0xE0) == 0xA0) {
+      *len = tag & 0x1F;
+   } else if(tag == PCL_MP_STR8 || tag == PCL_MP_BIN8) {
+      ok = pcl_mp_read_len(reader, 1, len);
+   } else if(tag == PCL_MP_STR16 || tag == PCL_MP_BIN16) {
+      ok = pcl_mp_read_len(reader, 2, len);
+   } else if(tag == PCL_MP_STR32 || tag == PCL_MP_BIN32) {
+      ok = pcl_mp_read_len(reader, 4, len);
+   } else {
+      return(false);
+   }
+   if(!ok || !pcl_mp_need(reader, *len)) {
+      return(false);
+   }
+   *str = (const char *)reader->pos;
+   reader->pos += *len;
+   return(true);
+}
+
+bool pcl_mp_read_int(pcl_mp_reader_t *reader, int64_t *value) {
+   if(!pcl_mp_need(reader, 1)) {
+      return(false);
+   }
+   uint8_t tag = *reader->pos++;
+   if(tag <= 0x7F) {
+      *value = tag;
+      return(true);
+   }
+   if(tag >= 0xE0) {
+      *value = (int8_t)tag;
+      return(true);
+   }
+   uint32_t len;
+   bool     sign;
+   switch(tag) {
+      case PCL_MP_UINT8:  len = 1; sign = false; break;
+      case PCL_MP_UINT16: len = 2; sign = false; break;
+      case PCL_MP_UINT32: len = 4; sign = false; break;
+      case PCL_MP_UINT64: len = 8; sign = false; break;
+      case PCL_MP_INT8:   len = 1; sign = true;  break;
+      case PCL_MP_INT16:  len = 2; sign = true;  break;
+      case PCL_MP_INT32:  len = 4; sign = true;  break;
+      case PCL_MP_INT64:  len = 8; sign = true;  break;
+      default: return(false);
+   }
+   if(!pcl_mp_need(reader, len)) {
+      return(false);
+   }
+   uint64_t raw = pcl_mp_be(reader->pos, len);
+   reader->pos += len;
+   if(sign && len < 8 && (raw & (1ULL << ((len * 8) - 1)))) { // sign extend
+      raw |= ~0ULL << (len * 8);
+   }
+   *value = (int64_t)raw;
+   return(true);
+}
+
+bool pcl_mp_skip(pcl_mp_reader_t *reader) {
+   uint64_t remaining = 1;
+
+   // Iterative so that deeply nested input cannot exhaust the stack
+   while(remaining > 0) {
+      remaining--;
+      if(!pcl_mp_need(reader, 1)) {
+         return(false);
+      }
+      uint8_t  tag = *reader->pos;
+      uint32_t len = 0;
+      if(tag <= 0x7F || tag >= 0xE0 || tag == PCL_MP_NIL || tag == PCL_MP_FALSE || tag == PCL_MP_TRUE) {
+         reader->pos++;
+      } else if((tag & 0xF0) == 0x80 || tag == PCL_MP_MAP16 || tag == PCL_MP_MAP32) {
+         if(!pcl_mp_read_map(reader, &len)) {
+            return(false);
+         }
+         remaining += 2 * (uint64_t)len;
+      } else if((tag & 0xF0) == 0x90 || tag == PCL_MP_ARRAY16 || tag == PCL_MP_ARRAY32) {
+         if(!pcl_mp_read_array(reader, &len)) {
+            return(false);
+         }
+         remaining += len;
+      } else if((tag & 0xE0) == 0xA0 || (tag >= PCL_MP_BIN8 && tag <= PCL_MP_BIN32) || (tag >= PCL_MP_STR8 && tag <= PCL_MP_STR32)) {
+         const char *str;
+         if(!pcl_mp_read_str(reader, &str, &len)) {
+            return(false);
+         }
+      } else if(tag >= PCL_MP_UINT8 && tag <= PCL_MP_INT64) {
+         int64_t value;
+         if(!pcl_mp_read_int(reader, &value)) {
+            return(false);
+         }
+      } else if(tag == PCL_MP_FLOAT32 || tag == PCL_MP_FLOAT64) {
+         len = (tag == PCL_MP_FLOAT32) ? 4 : 8;
+         if(!pcl_mp_need(reader, 1 + len)) {
+            return(false);
+         }
+         reader->pos += 1 + len;
+      } else if(tag >= PCL_MP_FIXEXT1 && tag <= PCL_MP_FIXEXT16) {
+         len = 1 << (tag - PCL_MP_FIXEXT1);
+         if(!pcl_mp_need(reader, 2 + len)) {
+            return(false);
+         }
+         reader->pos += 2 + len;
+      } else if(tag >= PCL_MP_EXT8 && tag <= PCL_MP_EXT32) {
+         reader->pos++;
+         if(!pcl_mp_read_len(reader, 1 << (tag - PCL_MP_EXT8), &len) || !pcl_mp_need(reader, 1 + (size_t)len)) {
+            return(false);
+         }
+         reader->pos += 1 + len;
+      } else {
+         return(false);
+      }
+   }
+   return(true);
+}
+
+bool pcl_mp_key_is(const char *key, uint32_t key_len, const char *name) {
+   return(strlen(name) == key_len && memcmp(key, name, key_len) == 0);
+}
+
+bool pcl_mp_view_str(pcl_mp_reader_t *reader, pcl_str_view_t *str) {
+   return(pcl_mp_read_str(reader, &str->str, &str->len));
+}
+
+bool pcl_wrp_peek(const void *buf, size_t len, pcl_wrp_peek_t *peek) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+   bool            have_type = false;
+
+   bzero(peek, sizeof(*peek));
+   peek->msg_type = WRP_MSG_TYPE__UNKNOWN;
+
+   pcl_mp_reader_init(&reader, buf, len);
+   if(!pcl_mp_read_map(&reader, &count)) {
+      return(false);
+   }
+   for(uint32_t index = 0; index < count; index++) {
+      const char *key;
+      uint32_t    key_len;
+      int64_t     value;
+      bool        ok;
+
+      if(!pcl_mp_read_str(&reader, &key, &key_len)) {
+         return(false);
+      }
+      if(pcl_mp_key_is(key, key_len, "msg_type")) {
+         ok = pcl_mp_read_int(&reader, &value);
+         peek->msg_type = (enum wrp_msg_type)value;
+         have_type = true;
+      } else if(pcl_mp_key_is(key, key_len, "source")) {
+         ok = pcl_mp_view_str(&reader, &peek->source);
+      } else if(pcl_mp_key_is(key, key_len, "dest")) {
+         ok = pcl_mp_view_str(&reader, &peek->dest);
+      } else if(pcl_mp_key_is(key, key_len, "transaction_uuid")) {
+         ok = pcl_mp_view_str(&reader, &peek->transaction_uuid);
+      } else {
+         ok = pcl_mp_skip(&reader); // payloads are skipped by length without being read
+      }
+      if(!ok) {
+         return(false);
+      }
+      if(have_type && peek->source.str != NULL && peek->dest.str != NULL && peek->transaction_uuid.str != NULL) {
+         break;
+      }
+   }
+   return(have_type);
+}
+
+bool pcl_wrp_peek_header(const void *buf, size_t len, const char *name) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+   size_t          name_len = strlen(name);
+
+   pcl_mp_reader_init(&reader, buf, len);
+   if(!pcl_mp_read_map(&reader, &count)) {
+      return(false);
+   }
+   for(uint32_t index = 0; index < count; index++) {
+      const char *key;
+      uint32_t    key_len;
+      uint32_t    header_qty;
+
+      if(!pcl_mp_read_str(&reader, &key, &key_len)) {
+         return(false);
+      }
+      if(!pcl_mp_key_is(key, key_len, "headers")) {
+         if(!pcl_mp_skip(&reader)) {
+            return(false);
+         }
+         continue;
+      }
+      if(!pcl_mp_read_array(&reader, &header_qty)) {
+         return(false);
+      }
+      for(uint32_t header = 0; header < header_qty; header++) {
+         const char *str;
+         uint32_t    str_len;
+         if(!pcl_mp_read_str(&reader, &str, &str_len)) {
+            return(false);
+         }
+         if(str_len > name_len && str[name_len] == ':' && strncasecmp(str, name, name_len) == 0) {
+            return(true);
+         }
+      }
+      return(false);
+   }
+   return(false);
+}
+
+ssize_t pcl_wrp_strip_addressing(const void *msg, size_t len, void *buf, size_t size, uint32_t *count) {
+   pcl_mp_reader_t reader;
+   pcl_mp_writer_t writer;
+   uint32_t        fields;
+
+   pcl_mp_reader_init(&reader, msg, len);
+   pcl_mp_writer_init(&writer, buf, size);
+   if(!pcl_mp_read_map(&reader, &fields)) {
+      return(-1);
+   }
+   *count = 0;
+   for(uint32_t index = 0; index < fields; index++) {
+      const uint8_t *field = reader.pos;
+      const char *   key;
+      uint32_t       key_len;
+
+      if(!pcl_mp_read_str(&reader, &key, &key_len) || !pcl_mp_skip(&reader)) {
+         return(-1);
+      }
+      if(!pcl_mp_key_is(key, key_len, "dest") && !pcl_mp_key_is(key, key_len, "transaction_uuid")) {
+         pcl_mp_write_raw(&writer, field, reader.pos - field);
+         (*count)++;
+      }
+   }
+   return((ssize_t)writer.len);
+}
+
+bool pcl_wrp_view_parse(const void *buf, size_t len, pcl_msg_view_t *view) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+   bool            have_type = false;
+
+   bzero(view, sizeof(*view));
+   view->msg_type = WRP_MSG_TYPE__UNKNOWN;
+
+   pcl_mp_reader_init(&reader, buf, len);
+   if(!pcl_mp_read_map(&reader, &count)) {
+      return(false);
+   }
+   for(uint32_t index = 0; index < count; index++) {
+      const char *key;
+      uint32_t    key_len;
+      int64_t     value;
+      bool        ok;
+
+      if(!pcl_mp_read_str(&reader, &key, &key_len)) {
+         return(false);
+      }
+      if(pcl_mp_key_is(key, key_len, "msg_type")) {
+         ok = pcl_mp_read_int(&reader, &value);
+         view->msg_type = (enum wrp_msg_type)value;
+         have_type = true;
+      } else if(pcl_mp_key_is(key, key_len, "dest")) {
+         ok = pcl_mp_view_str(&reader, &view->dest);
+      } else if(pcl_mp_key_is(key, key_len, "source")) {
+         ok = pcl_mp_view_str(&reader, &view->source);
+      } else if(pcl_mp_key_is(key, key_len, "transaction_uuid")) {
+         ok = pcl_mp_view_str(&reader, &view->transaction_uuid);
+      } else if(pcl_mp_key_is(key, key_len, "content_type")) {
+         ok = pcl_mp_view_str(&reader, &view->content_type);
+      } else if(pcl_mp_key_is(key, key_len, "path")) {
+         ok = pcl_mp_view_str(&reader, &view->path);
+      } else if(pcl_mp_key_is(key, key_len, "status")) {
+         ok = pcl_mp_read_int(&reader, &value);
+         view->status = (int)value;
+      } else if(pcl_mp_key_is(key, key_len, "rdr")) {
+         ok = pcl_mp_read_int(&reader, &value);
+         view->rdr = (int)value;
+      } else if(pcl_mp_key_is(key, key_len, "payload")) {
+         const char *payload;
+         ok = pcl_mp_read_str(&reader, &payload, &view->payload_size);
+         view->payload = payload;
+      } else if(pcl_mp_key_is(key, key_len, "headers")) {
+         view->headers = reader.pos;
+         ok = pcl_mp_read_array(&reader, &view->header_count);
+         for(uint32_t header = 0; ok && header < view->header_count; header++) {
+            const char *str;
+            uint32_t    str_len;
+            ok = pcl_mp_read_str(&reader, &str, &str_len);
+         }
+         view->headers_end = reader.pos;
+      } else {
+         ok = pcl_mp_skip(&reader);
+      }
+      if(!ok) {
+         return(false);
+      }
+   }
+   return(have_type);
+}
+
+bool pcl_wrp_decode_arena(const void *buf, size_t len, pcl_arena_t *arena, wrp_msg_t **msg) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+   bool            have_type = false;
+   int64_t         msg_type  = WRP_MSG_TYPE__UNKNOWN;
+   int64_t         status    = 0;
+   int64_t         rdr       = 0;
+   pcl_str_view_t  uuid = {0}, content_type = {0}, source = {0}, dest = {0}, path = {0}, service_name = {0}, url = {0}, payload = {0};
+   const uint8_t * headers = NULL, *partner_ids = NULL, *metadata = NULL, *spans = NULL; // start of the value, parsed once the type is known
+
+   // First pass records where each field is, the union member to fill depends on msg_type which may come in any position
+   pcl_mp_reader_init(&reader, buf, len);
+   if(!pcl_mp_read_map(&reader, &count)) {
+      return(false);
+   }
+   for(uint32_t index = 0; index < count; index++) {
+      const char *key;
+      uint32_t    key_len;
+      bool        ok;
+
+      if(!pcl_mp_read_str(&reader, &key, &key_len)) {
+         return(false);
+      }
+      if(pcl_mp_key_is(key, key_len, "msg_type")) {
+         ok = pcl_mp_read_int(&reader, &msg_type);
+         have_type = true;
+      } else if(pcl_mp_key_is(key, key_len, "status")) {
+         ok = pcl_mp_read_int(&reader, &status);
+      } else if(pcl_mp_key_is(key, key_len, "rdr")) {
+         ok = pcl_mp_read_int(&reader, &rdr);
+      } else if(pcl_mp_key_is(key, key_len, "transaction_uuid")) {
+         ok = pcl_mp_view_str(&reader, &uuid);
+      } else if(pcl_mp_key_is(key, key_len, "content_type")) {
+         ok = pcl_mp_view_str(&reader, &content_type);
+      } else if(pcl_mp_key_is(key, key_len, "source")) {
+         ok = pcl_mp_view_str(&reader, &source);
+      } else if(pcl_mp_key_is(key, key_len, "dest")) {
+         ok = pcl_mp_view_str(&reader, &dest);
+      } else if(pcl_mp_key_is(key, key_len, "path")) {
+         ok = pcl_mp_view_str(&reader, &path);
+      } else if(pcl_mp_key_is(key, key_len, "service_name")) {
+         ok = pcl_mp_view_str(&reader, &service_name);
+      } else if(pcl_mp_key_is(key, key_len, "url")) {
+         ok = pcl_mp_view_str(&reader, &url);
+      } else if(pcl_mp_key_is(key, key_len, "payload")) {
+         ok = pcl_mp_view_str(&reader, &payload);
+      } else {
+         const uint8_t **value = NULL;
+         if(pcl_mp_key_is(key, key_len, "headers")) {
+            value = &headers;
+         } else if(pcl_mp_key_is(key, key_len, "partner_ids")) {
+            value = &partner_ids;
+         } else if(pcl_mp_key_is(key, key_len, "metadata")) {
+            value = &metadata;
+         } else if(pcl_mp_key_is(key, key_len, "spans")) {
+            value = &spans;
+         }
+         if(value != NULL) {
+            *value = reader.pos;
+         }
+         ok = pcl_mp_skip(&reader);
+      }
+      if(!ok) {
+         return(false);
+      }
+   }
+   if(!have_type) {
+      return(false);
+   }
+
+   wrp_msg_t *wrp = (wrp_msg_t *)pcl_arena_alloc(arena, sizeof(wrp_msg_t));
+   if(wrp == NULL) {
+      return(false);
+   }
+   bzero(wrp, sizeof(*wrp));
+   wrp->msg_type = (enum wrp_msg_type)msg_type;
+
+   bool ok = true;
+   switch(wrp->msg_type) {
+      case WRP_MSG_TYPE__AUTH: {
+         wrp->u.auth.status = (int)status;
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_REGISTRATION: {
+         ok = pcl_wrp_arena_str(arena, &service_name, &wrp->u.reg.service_name) && pcl_wrp_arena_str(arena, &url, &wrp->u.reg.url);
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_ALIVE: {
+         break;
+      }
+      case WRP_MSG_TYPE__REQ: {
+         struct wrp_req_msg *req = &wrp->u.req;
+         ok = pcl_wrp_arena_str(arena, &uuid, &req->transaction_uuid) && pcl_wrp_arena_str(arena, &content_type, &req->content_type) &&
+              pcl_wrp_arena_str(arena, &source, &req->source) && pcl_wrp_arena_str(arena, &dest, &req->dest) &&
+              pcl_wrp_arena_strs(arena, partner_ids, reader.end, offsetof(partners_t, partner_ids), (void **)&req->partner_ids) &&
+              pcl_wrp_arena_strs(arena, headers, reader.end, offsetof(headers_t, headers), (void **)&req->headers) &&
+              pcl_wrp_arena_metadata(arena, metadata, reader.end, &req->metadata) &&
+              pcl_wrp_arena_spans(arena, spans, reader.end, &req->spans) &&
+              pcl_wrp_arena_str(arena, &payload, (char **)&req->payload);
+         req->include_spans = (req->spans.count > 0);
+         req->payload_size  = payload.len;
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         struct wrp_event_msg *event = &wrp->u.event;
+         ok = pcl_wrp_arena_str(arena, &content_type, &event->content_type) &&
+              pcl_wrp_arena_str(arena, &source, &event->source) && pcl_wrp_arena_str(arena, &dest, &event->dest) &&
+              pcl_wrp_arena_strs(arena, partner_ids, reader.end, offsetof(partners_t, partner_ids), (void **)&event->partner_ids) &&
+              pcl_wrp_arena_strs(arena, headers, reader.end, offsetof(headers_t, headers), (void **)&event->headers) &&
+              pcl_wrp_arena_metadata(arena, metadata, reader.end, &event->metadata) &&
+              pcl_wrp_arena_str(arena, &payload, (char **)&event->payload);
+         event->payload_size = payload.len;
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         struct wrp_crud_msg *crud = &wrp->u.crud;
+         ok = pcl_wrp_arena_str(arena, &uuid, &crud->transaction_uuid) && pcl_wrp_arena_str(arena, &content_type, &crud->content_type) &&
+              pcl_wrp_arena_str(arena, &source, &crud->source) && pcl_wrp_arena_str(arena, &dest, &crud->dest) &&
+              pcl_wrp_arena_strs(arena, partner_ids, reader.end, offsetof(partners_t, partner_ids), (void **)&crud->partner_ids) &&
+              pcl_wrp_arena_strs(arena, headers, reader.end, offsetof(headers_t, headers), (void **)&crud->headers) &&
+              pcl_wrp_arena_metadata(arena, metadata, reader.end, &crud->metadata) &&
+              pcl_wrp_arena_spans(arena, spans, reader.end, &crud->spans) &&
+              pcl_wrp_arena_str(arena, &path, &crud->path) &&
+              pcl_wrp_arena_str(arena, &payload, (char **)&crud->payload);
+         crud->include_spans = (crud->spans.count > 0);
+         crud->status        = (int)status;
+         crud->rdr           = (int)rdr;
+         crud->payload_size  = payload.len;
+         break;
+      }
+      default: {
+         return(false);
+      }
+   }
+   if(!ok) {
+      return(false);
+   }
+   *msg = wrp;
+   return(true);
+}
+
+bool pcl_wrp_arena_str(pcl_arena_t *arena, const pcl_str_view_t *view, char **str) {
+   if(view->str == NULL) { // field not present
+      *str = NULL;
+      return(true);
+   }
+   *str = (char *)pcl_arena_alloc(arena, view->len + 1);
+   if(*str == NULL) {
+      return(false);
+   }
+   memcpy(*str, view->str, view->len);
+   (*str)[view->len] = '\0';
+   return(true);
+}
+
+// Decodes an array of strings into a headers_t or partners_t, which both hold a size_t count followed by the pointers at items_offset
+bool pcl_wrp_arena_strs(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, size_t items_offset, void **list) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+
+   *list = NULL;
+   if(pos == NULL) {
+      return(true);
+   }
+   pcl_mp_reader_init(&reader, pos, end - pos);
+   if(!pcl_mp_read_array(&reader, &count) || count > (size_t)(end - reader.pos)) {
+      return(false);
+   }
+   uint8_t *block = (uint8_t *)pcl_arena_alloc(arena, items_offset + count * sizeof(char *));
+   if(block == NULL) {
+      return(false);
+   }
+   char **items = (char **)(block + items_offset);
+   for(uint32_t index = 0; index < count; index++) {
+      pcl_str_view_t view;
+      if(!pcl_mp_view_str(&reader, &view) || !pcl_wrp_arena_str(arena, &view, &items[index])) {
+         return(false);
+      }
+   }
+   *(size_t *)block = count;
+   *list = block;
+   return(true);
+}
+
+bool pcl_wrp_arena_metadata(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, data_t **metadata) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+
+   *metadata = NULL;
+   if(pos == NULL) {
+      return(true);
+   }
+   pcl_mp_reader_init(&reader, pos, end - pos);
+   if(!pcl_mp_read_map(&reader, &count) || count > (size_t)(end - reader.pos)) {
+      return(false);
+   }
+   data_t *data = (data_t *)pcl_arena_alloc(arena, sizeof(data_t) + count * sizeof(struct data));
+   if(data == NULL) {
+      return(false);
+   }
+   data->count      = count;
+   data->data_items = (struct data *)(data + 1);
+   for(uint32_t index = 0; index < count; index++) {
+      pcl_str_view_t name, value;
+      if(!pcl_mp_view_str(&reader, &name) || !pcl_mp_view_str(&reader, &value) ||
+         !pcl_wrp_arena_str(arena, &name, &data->data_items[index].name) || !pcl_wrp_arena_str(arena, &value, &data->data_items[index].value)) {
+         return(false);
+      }
+   }
+   *metadata = data;
+   return(true);
+}
+
+bool pcl_wrp_arena_spans(pcl_arena_t *arena, const uint8_t *pos, const uint8_t *end, money_trace_spans *spans) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+
+   if(pos == NULL) {
+      return(true);
+   }
+   pcl_mp_reader_init(&reader, pos, end - pos);
+   if(!pcl_mp_read_array(&reader, &count) || count > (size_t)(end - reader.pos)) {
+      return(false);
+   }
+   spans->spans = (struct money_trace_span *)pcl_arena_alloc(arena, count * sizeof(struct money_trace_span));
+   if(spans->spans == NULL && count > 0) {
+      return(false);
+   }
+   for(uint32_t index = 0; index < count; index++) {
+      pcl_str_view_t name;
+      uint32_t       fields;
+      int64_t        start, duration;
+      if(!pcl_mp_read_array(&reader, &fields) || fields != 3 || !pcl_mp_view_str(&reader, &name) || !pcl_mp_read_int(&reader, &start) ||
+         !pcl_mp_read_int(&reader, &duration) || !pcl_wrp_arena_str(arena, &name, &spans->spans[index].name)) {
+         return(false);
+      }
+      spans->spans[index].start    = (uint64_t)start;
+      spans->spans[index].duration = (uint32_t)duration;
+   }
+   spans->count = count;
+   return(true);
+}
+
+bool pcl_msg_view_header(const pcl_msg_view_t *view, uint32_t index, pcl_str_view_t *header) {
+   pcl_mp_reader_t reader;
+   uint32_t        count;
+
+   if(view == NULL || header == NULL || view->headers == NULL || index >= view->header_count) {
+      return(false);
+   }
+   pcl_mp_reader_init(&reader, view->headers, (const uint8_t *)view->headers_end - (const uint8_t *)view->headers);
+   if(!pcl_mp_read_array(&reader, &count)) {
+      return(false);
+   }
+   for(uint32_t header_index = 0; header_index < count; header_index++) {
+      if(!pcl_mp_view_str(&reader, header)) {
+         return(false);
+      }
+      if(header_index == index) {
+         return(true);
+      }
+   }
+   return(false);
+}
+
+void pcl_mp_writer_init(pcl_mp_writer_t *writer, void *buf, size_t size) {
+   writer->buf  = (uint8_t *)buf;
+   writer->size = size;
+   writer->len  = 0;
+}
+
+void pcl_mp_write_raw(pcl_mp_writer_t *writer, const void *raw, size_t len) {
+   if(writer->buf != NULL && writer->len + len <= writer->size && len > 0) {
+      memcpy(&writer->buf[writer->len], raw, len);
+   }
+   writer->len += len;
+}
+
+void pcl_mp_write_tag(pcl_mp_writer_t *writer, uint8_t tag, uint64_t value, uint32_t len) {
+   uint8_t bytes[9];
+   bytes[0] = tag;
+   for(uint32_t index = 0; index < len; index++) {
+      bytes[len - index] = (uint8_t)(value >> (8 * index));
+   }
+   pcl_mp_write_raw(writer, bytes, 1 + len);
+}
+
+void pcl_mp_write_map(pcl_mp_writer_t *writer, uint32_t count) {
+   if(count < 16) {
+      pcl_mp_write_tag(writer, 0x80 | count, 0, 0);
+   } else if(count <= UINT16_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_MAP16, count, 2);
+   } else {
+      pcl_mp_write_tag(writer, PCL_MP_MAP32, count, 4);
+   }
+}
+
+void pcl_mp_write_array(pcl_mp_writer_t *writer, uint32_t count) {
+   if(count < 16) {
+      pcl_mp_write_tag(writer, 0x90 | count, 0, 0);
+   } else if(count <= UINT16_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_ARRAY16, count, 2);
+   } else {
+      pcl_mp_write_tag(writer, PCL_MP_ARRAY32, count, 4);
+   }
+}
+
+void pcl_mp_write_str(pcl_mp_writer_t *writer, const char *str, size_t len) {
+   if(len < 32) {
+      pcl_mp_write_tag(writer, 0xA0 | len, 0, 0);
+   } else if(len <= UINT8_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_STR8, len, 1);
+   } else if(len <= UINT16_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_STR16, len, 2);
+   } else {
+      pcl_mp_write_tag(writer, PCL_MP_STR32, len, 4);
+   }
+   pcl_mp_write_raw(writer, str, len);
+}
+
+void pcl_mp_write_bin(pcl_mp_writer_t *writer, const void *bin, size_t len) {
+   if(len <= UINT8_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_BIN8, len, 1);
+   } else if(len <= UINT16_MAX) {
+      pcl_mp_write_tag(writer, PCL_MP_BIN16, len, 2);
+   } else {
+      pcl_mp_write_tag(writer, PCL_MP_BIN32, len, 4);
+   }
+   pcl_mp_write_raw(writer, bin, len);
+}
+
+void pcl_mp_write_int(pcl_mp_writer_t *writer, int64_t value) {
+   if(value >= 0) {
+      if(value <= 0x7F) {
+         pcl_mp_write_tag(writer, (uint8_t)value, 0, 0);
+      } else if(value <= UINT8_MAX) {
+         pcl_mp_write_tag(writer, PCL_MP_UINT8, value, 1);
+      } else if(value <= UINT16_MAX) {
+         pcl_mp_write_tag(writer, PCL_MP_UINT16, value, 2);
+      } else if(value <= UINT32_MAX) {
+         pcl_mp_write_tag(writer, PCL_MP_UINT32, value, 4);
+      } else {
+         pcl_mp_write_tag(writer, PCL_MP_UINT64, value, 8);
+      }
+   } else {
+      if(value >= -32) {
+         pcl_mp_write_tag(writer, (uint8_t)value, 0, 0);
+      } else if(value >= INT8_MIN) {
+         pcl_mp_write_tag(writer, PCL_MP_INT8, (uint64_t)value, 1);
+      } else if(value >= INT16_MIN) {
+         pcl_mp_write_tag(writer, PCL_MP_INT16, (uint64_t)value, 2);
+      } else if(value >= INT32_MIN) {
+         pcl_mp_write_tag(writer, PCL_MP_INT32, (uint64_t)value, 4);
+      } else {
+         pcl_mp_write_tag(writer, PCL_MP_INT64, (uint64_t)value, 8);
+      }
+   }
+}
+
+void pcl_mp_write_bool(pcl_mp_writer_t *writer, bool value) {
+   pcl_mp_write_tag(writer, value ? PCL_MP_TRUE : PCL_MP_FALSE, 0, 0);
+}
+
+void pcl_mp_write_key_str(pcl_mp_writer_t *writer, const char *key, const char *str) {
+   pcl_mp_write_str(writer, key, strlen(key));
+   pcl_mp_write_str(writer, str, strlen(str));
+}
+
+uint32_t pcl_wrp_count_common(const char *content_type, headers_t *headers, data_t *metadata, partners_t *partner_ids) {
+   return((content_type != NULL) + (headers != NULL) + (metadata != NULL) + (partner_ids != NULL));
+}
+
+void pcl_wrp_encode_common(pcl_mp_writer_t *writer, const char *content_type, headers_t *headers, data_t *metadata, partners_t *partner_ids) {
+   if(content_type != NULL) {
+      pcl_mp_write_key_str(writer, "content_type", content_type);
+   }
+   if(headers != NULL) {
+      pcl_mp_write_str(writer, "headers", 7);
+      pcl_mp_write_array(writer, headers->count);
+      for(size_t index = 0; index < headers->count; index++) {
+         pcl_mp_write_str(writer, headers->headers[index], strlen(headers->headers[index]));
+      }
+   }
+   if(metadata != NULL) {
+      pcl_mp_write_str(writer, "metadata", 8);
+      pcl_mp_write_map(writer, metadata->count);
+      for(size_t index = 0; index < metadata->count; index++) {
+         pcl_mp_write_key_str(writer, metadata->data_items[index].name, metadata->data_items[index].value);
+      }
+   }
+   if(partner_ids != NULL) {
+      pcl_mp_write_str(writer, "partner_ids", 11);
+      pcl_mp_write_array(writer, partner_ids->count);
+      for(size_t index = 0; index < partner_ids->count; index++) {
+         pcl_mp_write_str(writer, partner_ids->partner_ids[index], strlen(partner_ids->partner_ids[index]));
+      }
+   }
+}
+
+void pcl_wrp_encode_spans(pcl_mp_writer_t *writer, const money_trace_spans *spans) {
+   pcl_mp_write_str(writer, "spans", 5);
+   pcl_mp_write_array(writer, spans->count);
+   for(size_t index = 0; index < spans->count; index++) {
+      pcl_mp_write_array(writer, 3);
+      pcl_mp_write_str(writer, spans->spans[index].name, strlen(spans->spans[index].name));
+      pcl_mp_write_int(writer, spans->spans[index].start);
+      pcl_mp_write_int(writer, spans->spans[index].duration);
+   }
+}
+
+ssize_t pcl_wrp_encode(const wrp_msg_t *msg, void *buf, size_t size) {
+   pcl_mp_writer_t writer;
+   pcl_mp_writer_init(&writer, buf, size);
+
+   switch(msg->msg_type) {
+      case WRP_MSG_TYPE__AUTH: {
+         pcl_mp_write_map(&writer, 2);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_str(&writer, "status", 6);
+         pcl_mp_write_int(&writer, msg->u.auth.status);
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_REGISTRATION: {
+         if(msg->u.reg.service_name == NULL || msg->u.reg.url == NULL) {
+            return(-1);
+         }
+         pcl_mp_write_map(&writer, 3);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "service_name", msg->u.reg.service_name);
+         pcl_mp_write_key_str(&writer, "url", msg->u.reg.url);
+         break;
+      }
+      case WRP_MSG_TYPE__SVC_ALIVE: {
+         pcl_mp_write_map(&writer, 1);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         break;
+      }
+      case WRP_MSG_TYPE__REQ: {
+         const struct wrp_req_msg *req = &msg->u.req;
+         if(req->source == NULL || req->dest == NULL || req->transaction_uuid == NULL) {
+            return(-1);
+         }
+         bool spans = req->include_spans && req->spans.count > 0;
+         pcl_mp_write_map(&writer, 5 + pcl_wrp_count_common(req->content_type, req->headers, req->metadata, req->partner_ids) + spans);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", req->source);
+         pcl_mp_write_key_str(&writer, "dest", req->dest);
+         pcl_mp_write_key_str(&writer, "transaction_uuid", req->transaction_uuid);
+         pcl_wrp_encode_common(&writer, req->content_type, req->headers, req->metadata, req->partner_ids);
+         if(spans) {
+            pcl_wrp_encode_spans(&writer, &req->spans);
+         }
+         pcl_mp_write_str(&writer, "payload", 7);
+         pcl_mp_write_bin(&writer, req->payload, req->payload ? req->payload_size : 0);
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         const struct wrp_event_msg *event = &msg->u.event;
+         if(event->source == NULL || event->dest == NULL) {
+            return(-1);
+         }
+         pcl_mp_write_map(&writer, 4 + pcl_wrp_count_common(event->content_type, event->headers, event->metadata, event->partner_ids));
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", event->source);
+         pcl_mp_write_key_str(&writer, "dest", event->dest);
+         pcl_wrp_encode_common(&writer, event->content_type, event->headers, event->metadata, event->partner_ids);
+         pcl_mp_write_str(&writer, "payload", 7);
+         pcl_mp_write_bin(&writer, event->payload, event->payload ? event->payload_size : 0);
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         const struct wrp_crud_msg *crud = &msg->u.crud;
+         if(crud->source == NULL || crud->dest == NULL || crud->transaction_uuid == NULL) {
+            return(-1);
+         }
+         bool spans   = crud->include_spans && crud->spans.count > 0;
+         bool payload = crud->payload != NULL && crud->payload_size > 0;
+         pcl_mp_write_map(&writer, 6 + pcl_wrp_count_common(crud->content_type, crud->headers, crud->metadata, crud->partner_ids) + spans + (crud->path != NULL) + payload);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", crud->source);
+         pcl_mp_write_key_str(&writer, "dest", crud->dest);
+         pcl_mp_write_key_str(&writer, "transaction_uuid", crud->transaction_uuid);
+         pcl_wrp_encode_common(&writer, crud->content_type, crud->headers, crud->metadata, crud->partner_ids);
+         if(spans) {
+            pcl_wrp_encode_spans(&writer, &crud->spans);
+         }
+         pcl_mp_write_str(&writer, "status", 6);
+         pcl_mp_write_int(&writer, crud->status);
+         pcl_mp_write_str(&writer, "rdr", 3);
+         pcl_mp_write_int(&writer, crud->rdr);
+         if(crud->path != NULL) {
+            pcl_mp_write_key_str(&writer, "path", crud->path);
+         }
+         if(payload) {
+            pcl_mp_write_str(&writer, "payload", 7);
+            pcl_mp_write_bin(&writer, crud->payload, crud->payload_size);
+         }
+         break;
+      }
+      case WRP_MSG_TYPE__UNKNOWN:
+      default: {
+         return(-1);
+      }
+   }
+   return((ssize_t)writer.len);
+}
+
+ssize_t pcl_wrp_encode_head(const wrp_msg_t *msg, void *buf, size_t size) {
+   pcl_mp_writer_t writer;
+   pcl_mp_writer_init(&writer, buf, size);
+
+   switch(msg->msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         const struct wrp_req_msg *req = &msg->u.req;
+         if(req->source == NULL || req->dest == NULL) {
+            return(-1);
+         }
+         bool spans = req->include_spans && req->spans.count > 0;
+         pcl_mp_write_map(&writer, 5 + pcl_wrp_count_common(req->content_type, req->headers, req->metadata, req->partner_ids) + spans);
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", req->source);
+         pcl_mp_write_key_str(&writer, "dest", req->dest);
+         pcl_wrp_encode_common(&writer, req->content_type, req->headers, req->metadata, req->partner_ids);
+         if(spans) {
+            pcl_wrp_encode_spans(&writer, &req->spans);
+         }
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         const struct wrp_event_msg *event = &msg->u.event;
+         if(event->source == NULL || event->dest == NULL) {
+            return(-1);
+         }
+         pcl_mp_write_map(&writer, 4 + pcl_wrp_count_common(event->content_type, event->headers, event->metadata, event->partner_ids));
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", event->source);
+         pcl_mp_write_key_str(&writer, "dest", event->dest);
+         pcl_wrp_encode_common(&writer, event->content_type, event->headers, event->metadata, event->partner_ids);
+         break;
+      }
+      case WRP_MSG_TYPE__CREATE:
+      case WRP_MSG_TYPE__RETREIVE:
+      case WRP_MSG_TYPE__UPDATE:
+      case WRP_MSG_TYPE__DELETE: {
+         const struct wrp_crud_msg *crud = &msg->u.crud;
+         if(crud->source == NULL || crud->dest == NULL) {
+            return(-1);
+         }
+         // The payload is always present since its length is not known yet
+         bool spans = crud->include_spans && crud->spans.count > 0;
+         pcl_mp_write_map(&writer, 7 + pcl_wrp_count_common(crud->content_type, crud->headers, crud->metadata, crud->partner_ids) + spans + (crud->path != NULL));
+         pcl_mp_write_str(&writer, "msg_type", 8);
+         pcl_mp_write_int(&writer, msg->msg_type);
+         pcl_mp_write_key_str(&writer, "source", crud->source);
+         pcl_mp_write_key_str(&writer, "dest", crud->dest);
+         pcl_wrp_encode_common(&writer, crud->content_type, crud->headers, crud->metadata, crud->partner_ids);
+         if(spans) {
+            pcl_wrp_encode_spans(&writer, &crud->spans);
+         }
+         pcl_mp_write_str(&writer, "status", 6);
+         pcl_mp_write_int(&writer, crud->status);
+         pcl_mp_write_str(&writer, "rdr", 3);
+         pcl_mp_write_int(&writer, crud->rdr);
+         if(crud->path != NULL) {
+            pcl_mp_write_key_str(&writer, "path", crud->path);
+         }
+         break;
+      }
+      default: {
+         return(-1);
+      }
+   }
+   return((ssize_t)writer.len);
+}
+
+size_t pcl_wrp_encode_tail(enum wrp_msg_type msg_type, const char *uuid, const void *payload, size_t payload_len, void *buf, size_t size) {
+   pcl_mp_writer_t writer;
+   pcl_mp_writer_init(&writer, buf, size);
+
+   if(msg_type != WRP_MSG_TYPE__EVENT) {
+      pcl_mp_write_key_str(&writer, "transaction_uuid", uuid);
+   }
+   pcl_mp_write_str(&writer, "payload", 7);
+   pcl_mp_write_bin(&writer, payload, payload ? payload_len : 0);
+   return(writer.len);
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_MSGPACK__
+#define __PARODUS_CLIENT_LIB_MSGPACK__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "paroduscl.h"
+#include "paroduscl_arena.h"
+
+// Minimal in-place msgpack reader used to access WRP fields without allocating
+typedef struct {
+   const uint8_t *pos;
+   const uint8_t *end;
+} pcl_mp_reader_t;
+
+void pcl_mp_reader_init(pcl_mp_reader_t *reader, const void *buf, size_t len);
+bool pcl_mp_read_map(pcl_mp_reader_t *reader, uint32_t *count);
+bool pcl_mp_read_array(pcl_mp_reader_t *reader, uint32_t *count);
+bool pcl_mp_read_str(pcl_mp_reader_t *reader, const char **str, uint32_t *len); // accepts str or bin
+bool pcl_mp_read_int(pcl_mp_reader_t *reader, int64_t *value);
+bool pcl_mp_skip(pcl_mp_reader_t *reader);
+bool pcl_mp_key_is(const char *key, uint32_t key_len, const char *name);
+
+// Minimal msgpack writer.  When buf is NULL nothing is written and len accumulates the encoded size.
+typedef struct {
+   uint8_t *buf;
+   size_t   size;
+   size_t   len;
+} pcl_mp_writer_t;
+
+void pcl_mp_writer_init(pcl_mp_writer_t *writer, void *buf, size_t size);
+void pcl_mp_write_map(pcl_mp_writer_t *writer, uint32_t count);
+void pcl_mp_write_array(pcl_mp_writer_t *writer, uint32_t count);
+void pcl_mp_write_str(pcl_mp_writer_t *writer, const char *str, size_t len);
+void pcl_mp_write_bin(pcl_mp_writer_t *writer, const void *bin, size_t len);
+void pcl_mp_write_int(pcl_mp_writer_t *writer, int64_t value);
+void pcl_mp_write_bool(pcl_mp_writer_t *writer, bool value);
+void pcl_mp_write_raw(pcl_mp_writer_t *writer, const void *raw, size_t len);
+
+// Encodes msg in the same msgpack layout as wrp_struct_to.  Returns the encoded length, which is larger than size if buf was
+// too small (pass NULL to size the buffer), or -1 if the message type cannot be encoded.
+ssize_t pcl_wrp_encode(const wrp_msg_t *msg, void *buf, size_t size);
+
+// Encodes every field of msg except transaction_uuid and payload, under a map header that counts them, so the message is completed
+// by appending pcl_wrp_encode_tail.  Only requests, events and CRUD messages can be split.  Returns the length like pcl_wrp_encode.
+ssize_t pcl_wrp_encode_head(const wrp_msg_t *msg, void *buf, size_t size);
+// Encodes the transaction_uuid (requests and CRUD messages only) and payload fields following pcl_wrp_encode_head
+size_t  pcl_wrp_encode_tail(enum wrp_msg_type msg_type, const char *uuid, const void *payload, size_t payload_len, void *buf, size_t size);
+
+// Decodes buf like wrp_to_struct, allocating the message and all of its fields from arena so that nothing needs to be freed
+// individually.  Returns false if buf is not a valid WRP msgpack map or the arena is out of memory.
+bool pcl_wrp_decode_arena(const void *buf, size_t len, pcl_arena_t *arena, wrp_msg_t **msg);
+
+// Copies every field of the WRP msgpack map in msg except dest and transaction_uuid to buf (NULL to size it), setting count to the
+// number copied, so the message can be sent again to another dest and transaction.  Returns the copied length or -1 if msg is not
+// a valid msgpack map.
+ssize_t pcl_wrp_strip_addressing(const void *msg, size_t len, void *buf, size_t size, uint32_t *count);
+
+// Header fields read by pcl_wrp_peek, pointing into the buffer
+typedef struct {
+   enum wrp_msg_type msg_type;
+   pcl_str_view_t    source;
+   pcl_str_view_t    dest;
+   pcl_str_view_t    transaction_uuid;
+} pcl_wrp_peek_t;
+
+// Reads msg_type, source, dest and transaction_uuid without looking at the other fields, stopping once all four are found.  Returns
+// false if buf is not a msgpack map with a msg_type.
+bool pcl_wrp_peek(const void *buf, size_t len, pcl_wrp_peek_t *peek);
+// Returns true if buf has a header named name (case insensitive), that is a header starting with name followed by ':'
+bool pcl_wrp_peek_header(const void *buf, size_t len, const char *name);
+
+// Fills a view whose fields point into buf.  Returns false if buf is not a valid WRP msgpack map.
+bool pcl_wrp_view_parse(const void *buf, size_t len, pcl_msg_view_t *view);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "paroduscl_queue.h"
+
+bool pcl_queue_create(pcl_queue_t *queue, size_t depth) {
+   size_t size = 1;
+   while(size < depth) {
+      size <<= 1;
+   }
+   queue->cells = (pcl_queue_cell_t *)malloc(size * sizeof(pcl_queue_cell_t));
+   if(queue->cells == NULL) {
+      return(false);
+   }
+   for(size_t index = 0; index < size; index++) {
+      atomic_init(&queue->cells[index].sequence, index);
+   }
+   queue->mask = size - 1;
+   atomic_init(&queue->enqueue_pos, 0);
+   atomic_init(&queue->dequeue_pos, 0);
+   return(true);
+}
+
+void pcl_queue_destroy(pcl_queue_t *queue) {
+   free(queue->cells);
+   queue->cells = NULL;
+}
+
+bool pcl_queue_push(pcl_queue_t *queue, const pcl_queue_item_t *item) {
+   pcl_queue_cell_t *cell;
+   size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+   // Each cell's sequence tells producers whether the slot is free for this lap of the ring
+   for(;;) {
+      cell = &queue->cells[pos & queue->mask];
+      size_t   seq  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if(diff == 0) {
+         if(atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+         }
+      } else if(diff < 0) {
+         return(false);
+      } else {
+         pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+      }
+   }
+   cell->item = *item;
+   atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+   return(true);
+}
+
+bool pcl_queue_pop(pcl_queue_t *queue, pcl_queue_item_t *item) {
+   pcl_queue_cell_t *cell;
+   size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+   for(;;) {
+      cell = &queue->cells[pos & queue->mask];
+      size_t   seq  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if(diff == 0) {
+         if(atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+         }
+      } else if(diff < 0) {
+         return(false);
+      } else {
+         pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+      }
+   }
+   *item = cell->item;
+   atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+   return(true);
+}
+
+size_t pcl_queue_len(pcl_queue_t *queue) {
+   size_t dequeue_pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+   size_t enqueue_pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+   return((enqueue_pos > dequeue_pos) ? enqueue_pos - dequeue_pos : 0);
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_QUEUE__
+#define __PARODUS_CLIENT_LIB_QUEUE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define PCL_QUEUE_CACHE_LINE (64)
+
+// Encoded outbound message owned by the queue until it is popped
+typedef struct {
+   void *   msg_bytes; // nanomsg buffer (nn_allocmsg)
+   size_t   msg_len;
+   void *   ctx;       // passed to the completion callback
+   int      msg_type;
+   int      lane;      // send lane the message was queued on
+} pcl_queue_item_t;
+
+typedef struct {
+   atomic_size_t    sequence;
+   pcl_queue_item_t item;
+} pcl_queue_cell_t;
+
+// Bounded lock-free multi-producer multi-consumer queue
+typedef struct {
+   pcl_queue_cell_t *cells;
+   size_t            mask;
+   char              pad0[PCL_QUEUE_CACHE_LINE];
+   atomic_size_t     enqueue_pos;
+   char              pad1[PCL_QUEUE_CACHE_LINE];
+   atomic_size_t     dequeue_pos;
+   char              pad2[PCL_QUEUE_CACHE_LINE];
+} pcl_queue_t;
+
+bool   pcl_queue_create(pcl_queue_t *queue, size_t depth); // depth is rounded up to a power of two
+void   pcl_queue_destroy(pcl_queue_t *queue);
+bool   pcl_queue_push(pcl_queue_t *queue, const pcl_queue_item_t *item); // false when full
+bool   pcl_queue_pop(pcl_queue_t *queue, pcl_queue_item_t *item);        // false when empty
+size_t pcl_queue_len(pcl_queue_t *queue);                                // approximate when used concurrently
+
+#endif
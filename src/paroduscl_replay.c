@@ -0,0 +1,173 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "paroduscl.h"
+
+// Replays a capture log written with capture_path through the library's receive path, to benchmark and profile decode and dispatch
+// against recorded traffic.  Every message type gets a handler so nothing is filtered before decode.
+
+#define PCL_REPLAY_URL_CLIENT  "inproc://paroduscl_replay_client"
+#define PCL_REPLAY_URL_PARODUS "inproc://paroduscl_replay_parodus"
+
+static atomic_uint_fast64_t pcl_replay_handled;
+
+static pcl_result_t pcl_replay_handler_request(struct wrp_req_msg *msg);
+static pcl_result_t pcl_replay_handler_event(struct wrp_event_msg *msg);
+static pcl_result_t pcl_replay_handler_crud(struct wrp_crud_msg *msg);
+static pcl_result_t pcl_replay_handler_view(const pcl_msg_view_t *msg);
+static uint64_t     pcl_replay_hist_mean(const pcl_stats_hist_t *hist);
+static void         pcl_replay_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+   double      speed        = 1.0;
+   int         repeat       = 1;
+   int         workers      = 0;
+   bool        view         = false;
+   bool        arena        = false;
+   const char *service_name = NULL;
+   const char *trace_name   = NULL;
+   int         trace_sample = 1;
+   int         opt;
+
+   while((opt = getopt(argc, argv, "s:r:w:n:t:avh")) != -1) {
+      switch(opt) {
+         case 's': { speed   = atof(optarg); break; }
+         case 'r': { repeat  = atoi(optarg); break; }
+         case 'w': { workers = atoi(optarg); break; }
+         case 'n': { service_name = optarg;  break; }
+         case 't': { trace_name   = optarg;  break; }
+         case 'a': { arena   = true;         break; }
+         case 'v': { view    = true;         break; }
+         default: {
+            pcl_replay_usage(argv[0]);
+            return(EXIT_FAILURE);
+         }
+      }
+   }
+   if(optind != argc - 1 || speed < 0 || repeat < 1) {
+      pcl_replay_usage(argv[0]);
+      return(EXIT_FAILURE);
+   }
+   const char *path = argv[optind];
+
+   // Registration is left to the background because no parodus is connected, the AUTH frames in the log authorize the service
+   bool         init_async = true;
+   pcl_params_t params;
+   memset(&params, 0, sizeof(params));
+   params.service_name     = service_name;
+   params.url_client       = PCL_REPLAY_URL_CLIENT;
+   params.url_parodus      = PCL_REPLAY_URL_PARODUS;
+   params.init_async       = &init_async;
+   params.dispatch_workers = &workers;
+   params.decode_arena     = &arena;
+   params.handler_request  = pcl_replay_handler_request;
+   params.handler_event    = pcl_replay_handler_event;
+   params.handler_create   = pcl_replay_handler_crud;
+   params.handler_retrieve = pcl_replay_handler_crud;
+   params.handler_update   = pcl_replay_handler_crud;
+   params.handler_delete   = pcl_replay_handler_crud;
+   params.handler_view     = view ? pcl_replay_handler_view : NULL;
+   params.trace_name       = trace_name;
+   params.trace_sample     = &trace_sample;
+
+   pcl_object_t object = NULL;
+   int          errsv  = 0;
+   pcl_result_t result = pcl_init(&object, NULL, NULL, &errsv, &params);
+   if(result != PCL_RESULT_SUCCESS) {
+      fprintf(stderr, "pcl_init: %s (%s)\n", pcl_result_str(result), strerror(errsv));
+      return(EXIT_FAILURE);
+   }
+
+   pcl_replay_result_t total;
+   memset(&total, 0, sizeof(total));
+   for(int index = 0; index < repeat; index++) {
+      pcl_replay_result_t replay;
+      result = pcl_replay(object, path, speed, &replay, &errsv);
+      if(result != PCL_RESULT_SUCCESS) {
+         fprintf(stderr, "pcl_replay <%s>: %s (%s)\n", path, pcl_result_str(result), strerror(errsv));
+         pcl_term(object, NULL);
+         return(EXIT_FAILURE);
+      }
+      total.frames     += replay.frames;
+      total.bytes      += replay.bytes;
+      total.elapsed_ns += replay.elapsed_ns;
+      if(replay.lag_max_ns > total.lag_max_ns) {
+         total.lag_max_ns = replay.lag_max_ns;
+      }
+   }
+   pcl_stats_t stats;
+   pcl_stats_get(object, &stats);
+   if(trace_name != NULL) { // the trace is unlinked by pcl_term
+      printf("trace      %s, press enter to exit\n", trace_name);
+      getchar();
+   }
+   pcl_term(object, NULL); // waits for the dispatch workers to finish
+
+   double seconds = (total.elapsed_ns > 0) ? total.elapsed_ns / 1e9 : 1e-9;
+   printf("frames     %llu (%llu bytes) in %.3f s\n", (unsigned long long)total.frames, (unsigned long long)total.bytes, seconds);
+   printf("rate       %.0f frames/s, %.2f MB/s\n", total.frames / seconds, total.bytes / seconds / 1e6);
+   printf("handled    %llu, filtered %llu\n", (unsigned long long)atomic_load(&pcl_replay_handled), (unsigned long long)stats.result[PCL_RESULT_ERROR_SOCK_RECV_SVCNAME]);
+   printf("decode     %llu ns mean\n", (unsigned long long)pcl_replay_hist_mean(&stats.decode));
+   printf("dispatch   %llu ns mean\n", (unsigned long long)pcl_replay_hist_mean(&stats.handler));
+   if(speed > 0) {
+      printf("lag max    %.3f ms\n", total.lag_max_ns / 1e6);
+   }
+   return(EXIT_SUCCESS);
+}
+
+pcl_result_t pcl_replay_handler_request(struct wrp_req_msg *msg) {
+   atomic_fetch_add_explicit(&pcl_replay_handled, 1, memory_order_relaxed);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_replay_handler_event(struct wrp_event_msg *msg) {
+   atomic_fetch_add_explicit(&pcl_replay_handled, 1, memory_order_relaxed);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_replay_handler_crud(struct wrp_crud_msg *msg) {
+   atomic_fetch_add_explicit(&pcl_replay_handled, 1, memory_order_relaxed);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t pcl_replay_handler_view(const pcl_msg_view_t *msg) {
+   atomic_fetch_add_explicit(&pcl_replay_handled, 1, memory_order_relaxed);
+   return(PCL_RESULT_SUCCESS);
+}
+
+uint64_t pcl_replay_hist_mean(const pcl_stats_hist_t *hist) {
+   return((hist->count > 0) ? hist->sum_ns / hist->count : 0);
+}
+
+void pcl_replay_usage(const char *name) {
+   fprintf(stderr, "usage: %s [-s speed] [-r repeat] [-w workers] [-n service] [-t trace] [-a] [-v] log\n", name);
+   fprintf(stderr, "  -s speed    scales the recorded timing, 1 for the original (default), 0 for as fast as possible\n");
+   fprintf(stderr, "  -r repeat   times to replay the log\n");
+   fprintf(stderr, "  -w workers  dispatch worker threads, 0 to dispatch on the replay thread (default)\n");
+   fprintf(stderr, "  -n service  service name the recorded messages are addressed to (default iot)\n");
+   fprintf(stderr, "  -t trace    trace every message to this shared memory object, read with paroduscl_trace_dump\n");
+   fprintf(stderr, "  -a          decode into arenas\n");
+   fprintf(stderr, "  -v          dispatch zero-copy views instead of decoded messages\n");
+}
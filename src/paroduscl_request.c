@@ -0,0 +1,326 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "paroduscl.h"
+#include "paroduscl_request.h"
+#include "paroduscl_dispatch.h"
+
+#define PCL_WHEEL_BITS       (6)
+#define PCL_WHEEL_SLOTS      (1 << PCL_WHEEL_BITS)
+#define PCL_WHEEL_MASK       (PCL_WHEEL_SLOTS - 1)
+#define PCL_WHEEL_LEVELS     (4)
+#define PCL_WHEEL_SPAN_MAX   ((1ULL << (PCL_WHEEL_BITS * PCL_WHEEL_LEVELS)) - 1)
+#define PCL_REQUEST_BUCKETS  (64)
+
+typedef struct pcl_request {
+   struct pcl_request * hash_next;
+   struct pcl_request * timer_next;
+   struct pcl_request **timer_pprev;
+   uint32_t               hash;
+   uint64_t               expires;    // absolute tick
+   uint32_t               level;      // wheel level holding the timer
+   pcl_response_handler_t callback;
+   void *                 ctx;
+   size_t                 uuid_len;
+   char                   uuid[];
+} pcl_request_t;
+
+struct pcl_request_table {
+   pthread_mutex_t lock;
+   uint64_t        tick;      // last tick processed by the wheel
+   uint32_t        count;
+   uint32_t        bucket_qty;
+   pcl_request_t **buckets;
+   pcl_request_t * wheel[PCL_WHEEL_LEVELS][PCL_WHEEL_SLOTS];
+   uint32_t        level_count[PCL_WHEEL_LEVELS]; // timers per level, lets expire skip the ticks with nothing to do
+};
+
+static uint64_t pcl_request_now_ms(void);
+static void     pcl_request_timer_insert(pcl_request_table_t *table, pcl_request_t *request);
+static void     pcl_request_timer_remove(pcl_request_table_t *table, pcl_request_t *request);
+static void     pcl_request_hash_remove(pcl_request_table_t *table, pcl_request_t *request);
+static void     pcl_request_hash_grow(pcl_request_table_t *table);
+
+pcl_request_table_t *pcl_request_table_create(void) {
+   pcl_request_table_t *table = (pcl_request_table_t *)calloc(1, sizeof(pcl_request_table_t));
+   if(table == NULL) {
+      return(NULL);
+   }
+   table->bucket_qty = PCL_REQUEST_BUCKETS;
+   table->buckets    = (pcl_request_t **)calloc(table->bucket_qty, sizeof(pcl_request_t *));
+   if(table->buckets == NULL) {
+      free(table);
+      return(NULL);
+   }
+   table->tick = pcl_request_now_ms();
+   pthread_mutex_init(&table->lock, NULL);
+   return(table);
+}
+
+void pcl_request_table_destroy(pcl_request_table_t *table) {
+   if(table == NULL) {
+      return;
+   }
+   for(uint32_t index = 0; index < table->bucket_qty; index++) {
+      pcl_request_t *request = table->buckets[index];
+      while(request != NULL) {
+         pcl_request_t *next = request->hash_next;
+         (*request->callback)(request->ctx, PCL_RESULT_ERROR_SEND_ABORTED, NULL, NULL);
+         free(request);
+         request = next;
+      }
+   }
+   pthread_mutex_destroy(&table->lock);
+   free(table->buckets);
+   free(table);
+}
+
+uint64_t pcl_request_now_ms(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+}
+
+pcl_result_t pcl_request_table_add(pcl_request_table_t *table, const char *uuid, uint32_t deadline_ms, pcl_response_handler_t callback, void *ctx) {
+   size_t   uuid_len = strlen(uuid);
+   uint32_t hash     = pcl_dispatch_hash(uuid, uuid_len);
+
+   pcl_request_t *request = (pcl_request_t *)malloc(sizeof(pcl_request_t) + uuid_len + 1);
+   if(request == NULL) {
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   request->hash     = hash;
+   request->callback = callback;
+   request->ctx      = ctx;
+   request->uuid_len = uuid_len;
+   memcpy(request->uuid, uuid, uuid_len + 1);
+
+   pthread_mutex_lock(&table->lock);
+   for(pcl_request_t *entry = table->buckets[hash & (table->bucket_qty - 1)]; entry != NULL; entry = entry->hash_next) {
+      if(entry->hash == hash && entry->uuid_len == uuid_len && memcmp(entry->uuid, uuid, uuid_len) == 0) {
+         pthread_mutex_unlock(&table->lock);
+         free(request);
+         return(PCL_RESULT_ERROR_PARAMS); // already outstanding
+      }
+   }
+   if(table->count >= table->bucket_qty) {
+      pcl_request_hash_grow(table);
+   }
+   pcl_request_t **bucket = &table->buckets[hash & (table->bucket_qty - 1)];
+   request->hash_next = *bucket;
+   *bucket            = request;
+   table->count++;
+
+   uint64_t now = pcl_request_now_ms();
+   request->expires = ((now > table->tick) ? now : table->tick) + deadline_ms;
+   if(request->expires <= table->tick) { // the current slot has already been processed
+      request->expires = table->tick + 1;
+   }
+   pcl_request_timer_insert(table, request);
+   pthread_mutex_unlock(&table->lock);
+   return(PCL_RESULT_SUCCESS);
+}
+
+bool pcl_request_table_remove(pcl_request_table_t *table, const char *uuid, size_t uuid_len, pcl_response_handler_t *callback, void **ctx) {
+   uint32_t hash = pcl_dispatch_hash(uuid, uuid_len);
+
+   pthread_mutex_lock(&table->lock);
+   if(table->count == 0) {
+      pthread_mutex_unlock(&table->lock);
+      return(false);
+   }
+   for(pcl_request_t *request = table->buckets[hash & (table->bucket_qty - 1)]; request != NULL; request = request->hash_next) {
+      if(request->hash == hash && request->uuid_len == uuid_len && memcmp(request->uuid, uuid, uuid_len) == 0) {
+         pcl_request_hash_remove(table, request);
+         pcl_request_timer_remove(table, request);
+         pthread_mutex_unlock(&table->lock);
+         *callback = request->callback;
+         *ctx      = request->ctx;
+         free(request);
+         return(true);
+      }
+   }
+   pthread_mutex_unlock(&table->lock);
+   return(false);
+}
+
+void pcl_request_table_expire(pcl_request_table_t *table, uint32_t *next_ms) {
+   pcl_request_t *expired = NULL;
+   uint64_t       now     = pcl_request_now_ms();
+
+   pthread_mutex_lock(&table->lock);
+   if(table->count == 0) { // nothing to cascade, jump straight to the current time
+      table->tick = (now > table->tick) ? now : table->tick;
+   }
+   while(table->tick < now) {
+      // While the levels below some level are empty, nothing happens before that level's next cascade, so jump to it rather than
+      // stepping through every millisecond of a stall
+      uint32_t level = 0;
+      while(level < PCL_WHEEL_LEVELS - 1 && table->level_count[level] == 0) {
+         level++;
+      }
+      if(level > 0) {
+         uint64_t cascade = (table->tick | ((1ULL << (PCL_WHEEL_BITS * level)) - 1)) + 1;
+         table->tick      = (cascade - 1 < now) ? cascade - 1 : now;
+         if(table->tick == now) {
+            break;
+         }
+      }
+      table->tick++;
+
+      // Move timers from the higher levels down as the lower level wraps around
+      for(uint32_t level = 1; level < PCL_WHEEL_LEVELS; level++) {
+         if((table->tick & ((1ULL << (PCL_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+         }
+         pcl_request_t *request = table->wheel[level][(table->tick >> (PCL_WHEEL_BITS * level)) & PCL_WHEEL_MASK];
+         while(request != NULL) {
+            pcl_request_t *next = request->timer_next;
+            pcl_request_timer_remove(table, request);
+            pcl_request_timer_insert(table, request);
+            request = next;
+         }
+      }
+      pcl_request_t *request = table->wheel[0][table->tick & PCL_WHEEL_MASK];
+      while(request != NULL) {
+         pcl_request_t *next = request->timer_next;
+         pcl_request_timer_remove(table, request);
+         pcl_request_hash_remove(table, request);
+         request->hash_next = expired;
+         expired = request;
+         request = next;
+      }
+   }
+
+   if(next_ms != NULL) { // time until the next level 0 slot with timers, or the next cascade
+      *next_ms = UINT32_MAX;
+      if(table->count > 0) {
+         uint32_t delta;
+         for(delta = 1; delta < PCL_WHEEL_SLOTS; delta++) {
+            uint64_t tick = table->tick + delta;
+            if(table->wheel[0][tick & PCL_WHEEL_MASK] != NULL || (tick & PCL_WHEEL_MASK) == 0) {
+               break;
+            }
+         }
+         *next_ms = delta;
+      }
+   }
+   pthread_mutex_unlock(&table->lock);
+
+   // Callbacks run without the lock so they can issue new requests
+   while(expired != NULL) {
+      pcl_request_t *next = expired->hash_next;
+      (*expired->callback)(expired->ctx, PCL_RESULT_ERROR_REQUEST_TIMEOUT, NULL, NULL);
+      free(expired);
+      expired = next;
+   }
+}
+
+uint32_t pcl_request_table_count(pcl_request_table_t *table) {
+   pthread_mutex_lock(&table->lock);
+   uint32_t count = table->count;
+   pthread_mutex_unlock(&table->lock);
+   return(count);
+}
+
+bool pcl_request_table_contains(pcl_request_table_t *table, const char *uuid, size_t uuid_len) {
+   uint32_t hash  = pcl_dispatch_hash(uuid, uuid_len);
+   bool     found = false;
+
+   pthread_mutex_lock(&table->lock);
+   for(pcl_request_t *request = table->buckets[hash & (table->bucket_qty - 1)]; request != NULL; request = request->hash_next) {
+      if(request->hash == hash && request->uuid_len == uuid_len && memcmp(request->uuid, uuid, uuid_len) == 0) {
+         found = true;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&table->lock);
+   return(found);
+}
+
+void pcl_request_timer_insert(pcl_request_table_t *table, pcl_request_t *request) {
+   if(request->expires < table->tick) { // only while cascading, the current slot is processed next
+      request->expires = table->tick;
+   }
+   uint64_t delta = request->expires - table->tick;
+   if(delta > PCL_WHEEL_SPAN_MAX) {
+      request->expires = table->tick + PCL_WHEEL_SPAN_MAX;
+      delta            = PCL_WHEEL_SPAN_MAX;
+   }
+   uint32_t level = 0;
+   while(level < PCL_WHEEL_LEVELS - 1 && delta >= (1ULL << (PCL_WHEEL_BITS * (level + 1)))) {
+      level++;
+   }
+   pcl_request_t **slot = &table->wheel[level][(request->expires >> (PCL_WHEEL_BITS * level)) & PCL_WHEEL_MASK];
+   request->level       = level;
+   table->level_count[level]++;
+   request->timer_next  = *slot;
+   request->timer_pprev = slot;
+   if(*slot != NULL) {
+      (*slot)->timer_pprev = &request->timer_next;
+   }
+   *slot = request;
+}
+
+void pcl_request_timer_remove(pcl_request_table_t *table, pcl_request_t *request) {
+   table->level_count[request->level]--;
+   *request->timer_pprev = request->timer_next;
+   if(request->timer_next != NULL) {
+      request->timer_next->timer_pprev = request->timer_pprev;
+   }
+   request->timer_next  = NULL;
+   request->timer_pprev = NULL;
+}
+
+void pcl_request_hash_remove(pcl_request_table_t *table, pcl_request_t *request) {
+   pcl_request_t **entry = &table->buckets[request->hash & (table->bucket_qty - 1)];
+   while(*entry != NULL) {
+      if(*entry == request) {
+         *entry = request->hash_next;
+         table->count--;
+         return;
+      }
+      entry = &(*entry)->hash_next;
+   }
+}
+
+void pcl_request_hash_grow(pcl_request_table_t *table) {
+   uint32_t        bucket_qty = table->bucket_qty * 2;
+   pcl_request_t **buckets    = (pcl_request_t **)calloc(bucket_qty, sizeof(pcl_request_t *));
+   if(buckets == NULL) { // keep the current table, chains just get longer
+      return;
+   }
+   for(uint32_t index = 0; index < table->bucket_qty; index++) {
+      pcl_request_t *request = table->buckets[index];
+      while(request != NULL) {
+         pcl_request_t *next = request->hash_next;
+         request->hash_next = buckets[request->hash & (bucket_qty - 1)];
+         buckets[request->hash & (bucket_qty - 1)] = request;
+         request = next;
+      }
+   }
+   free(table->buckets);
+   table->buckets    = buckets;
+   table->bucket_qty = bucket_qty;
+}
@@ -0,0 +1,38 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_REQUEST__
+#define __PARODUS_CLIENT_LIB_REQUEST__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "paroduscl.h"
+
+// Outstanding requests keyed by transaction uuid, expired by a hierarchical timer wheel with millisecond ticks
+typedef struct pcl_request_table pcl_request_table_t;
+
+pcl_request_table_t *pcl_request_table_create(void);
+void                 pcl_request_table_destroy(pcl_request_table_t *table); // outstanding requests complete with PCL_RESULT_ERROR_SEND_ABORTED
+pcl_result_t         pcl_request_table_add(pcl_request_table_t *table, const char *uuid, uint32_t deadline_ms, pcl_response_handler_t callback, void *ctx);
+bool                 pcl_request_table_remove(pcl_request_table_t *table, const char *uuid, size_t uuid_len, pcl_response_handler_t *callback, void **ctx);
+void                 pcl_request_table_expire(pcl_request_table_t *table, uint32_t *next_ms);
+uint32_t             pcl_request_table_count(pcl_request_table_t *table);
+bool                 pcl_request_table_contains(pcl_request_table_t *table, const char *uuid, size_t uuid_len);
+
+#endif
@@ -0,0 +1,290 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "paroduscl.h"
+#include "paroduscl_route.h"
+
+#define PCL_ROUTE_MSG_TYPE_MAX (WRP_MSG_TYPE__DELETE + 1)
+
+typedef struct {
+   pcl_route_handler_t handler;
+   void *              ctx;
+} pcl_route_entry_t;
+
+// Nodes and entries are only ever added and are published with release stores so readers need no lock
+typedef struct pcl_route_node {
+   _Atomic(struct pcl_route_node *) sibling;
+   _Atomic(struct pcl_route_node *) child;     // literal segments
+   _Atomic(struct pcl_route_node *) wildcard;  // '*' matches one segment
+   _Atomic(pcl_route_entry_t *)     entries[PCL_ROUTE_MSG_TYPE_MAX];      // routes ending at this node
+   _Atomic(pcl_route_entry_t *)     entries_rest[PCL_ROUTE_MSG_TYPE_MAX]; // routes ending in '**' at this node
+   size_t                           segment_len;
+   char                             segment[];
+} pcl_route_node_t;
+
+struct pcl_route_table {
+   pthread_mutex_t   lock;  // serializes writers
+   pcl_route_node_t *root;
+   atomic_bool       empty;
+};
+
+static pcl_route_node_t *pcl_route_node_create(const char *segment, size_t segment_len);
+static void              pcl_route_node_destroy(pcl_route_node_t *node);
+static bool              pcl_route_segment_next(const char **pos, const char *end, const char **segment, size_t *segment_len);
+static bool              pcl_route_match(pcl_route_node_t *node, uint32_t msg_type, const char *pos, const char *end, pcl_route_match_t *match, pcl_route_entry_t **entry);
+
+pcl_route_table_t *pcl_route_table_create(void) {
+   pcl_route_table_t *table = (pcl_route_table_t *)calloc(1, sizeof(pcl_route_table_t));
+   if(table == NULL) {
+      return(NULL);
+   }
+   table->root = pcl_route_node_create("", 0);
+   if(table->root == NULL) {
+      free(table);
+      return(NULL);
+   }
+   pthread_mutex_init(&table->lock, NULL);
+   atomic_init(&table->empty, true);
+   return(table);
+}
+
+void pcl_route_table_destroy(pcl_route_table_t *table) {
+   if(table == NULL) {
+      return;
+   }
+   pcl_route_node_destroy(table->root);
+   pthread_mutex_destroy(&table->lock);
+   free(table);
+}
+
+pcl_route_node_t *pcl_route_node_create(const char *segment, size_t segment_len) {
+   pcl_route_node_t *node = (pcl_route_node_t *)calloc(1, sizeof(pcl_route_node_t) + segment_len + 1);
+   if(node == NULL) {
+      return(NULL);
+   }
+   node->segment_len = segment_len;
+   memcpy(node->segment, segment, segment_len);
+   return(node);
+}
+
+void pcl_route_node_destroy(pcl_route_node_t *node) {
+   while(node != NULL) {
+      pcl_route_node_t *sibling = atomic_load(&node->sibling);
+      pcl_route_node_destroy(atomic_load(&node->child));
+      pcl_route_node_destroy(atomic_load(&node->wildcard));
+      for(uint32_t index = 0; index < PCL_ROUTE_MSG_TYPE_MAX; index++) {
+         free(atomic_load(&node->entries[index]));
+         free(atomic_load(&node->entries_rest[index]));
+      }
+      free(node);
+      node = sibling;
+   }
+}
+
+bool pcl_route_segment_next(const char **pos, const char *end, const char **segment, size_t *segment_len) {
+   // Skip separators so that empty segments ("//" or a trailing "/") are ignored
+   while(*pos < end && **pos == '/') {
+      (*pos)++;
+   }
+   if(*pos >= end) {
+      return(false);
+   }
+   *segment = *pos;
+   while(*pos < end && **pos != '/') {
+      (*pos)++;
+   }
+   *segment_len = *pos - *segment;
+   return(true);
+}
+
+pcl_result_t pcl_route_table_add(pcl_route_table_t *table, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx) {
+   if(table == NULL || pattern == NULL || handler == NULL || msg_type < WRP_MSG_TYPE__REQ || msg_type >= PCL_ROUTE_MSG_TYPE_MAX) {
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   pcl_route_entry_t *entry = (pcl_route_entry_t *)malloc(sizeof(pcl_route_entry_t));
+   if(entry == NULL) {
+      return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+   }
+   entry->handler = handler;
+   entry->ctx     = ctx;
+
+   pthread_mutex_lock(&table->lock);
+
+   pcl_route_node_t *node = table->root;
+   const char *      pos  = pattern;
+   const char *      end  = pattern + strlen(pattern);
+   const char *      segment;
+   size_t            segment_len;
+   bool              rest = false;
+
+   while(pcl_route_segment_next(&pos, end, &segment, &segment_len)) {
+      if(segment_len == 2 && segment[0] == '*' && segment[1] == '*') {
+         if(pcl_route_segment_next(&pos, end, &segment, &segment_len)) { // '**' must be the last segment
+            pthread_mutex_unlock(&table->lock);
+            free(entry);
+            return(PCL_RESULT_ERROR_PARAMS);
+         }
+         rest = true;
+         break;
+      }
+      pcl_route_node_t *next = NULL;
+      if(segment_len == 1 && segment[0] == '*') {
+         next = atomic_load_explicit(&node->wildcard, memory_order_relaxed);
+         if(next == NULL) {
+            next = pcl_route_node_create(segment, segment_len);
+            if(next != NULL) {
+               atomic_store_explicit(&node->wildcard, next, memory_order_release);
+            }
+         }
+      } else {
+         for(next = atomic_load_explicit(&node->child, memory_order_relaxed); next != NULL; next = atomic_load_explicit(&next->sibling, memory_order_relaxed)) {
+            if(next->segment_len == segment_len && memcmp(next->segment, segment, segment_len) == 0) {
+               break;
+            }
+         }
+         if(next == NULL) {
+            next = pcl_route_node_create(segment, segment_len);
+            if(next != NULL) {
+               atomic_store_explicit(&next->sibling, atomic_load_explicit(&node->child, memory_order_relaxed), memory_order_relaxed);
+               atomic_store_explicit(&node->child, next, memory_order_release);
+            }
+         }
+      }
+      if(next == NULL) {
+         pthread_mutex_unlock(&table->lock);
+         free(entry);
+         return(PCL_RESULT_ERROR_OUT_OF_MEMORY);
+      }
+      node = next;
+   }
+
+   _Atomic(pcl_route_entry_t *) *slot = rest ? &node->entries_rest[msg_type] : &node->entries[msg_type];
+   if(atomic_load_explicit(slot, memory_order_relaxed) != NULL) { // entries are never replaced while readers may hold them
+      pthread_mutex_unlock(&table->lock);
+      free(entry);
+      return(PCL_RESULT_ERROR_PARAMS);
+   }
+   atomic_store_explicit(slot, entry, memory_order_release);
+   atomic_store_explicit(&table->empty, false, memory_order_release);
+   pthread_mutex_unlock(&table->lock);
+   return(PCL_RESULT_SUCCESS);
+}
+
+bool pcl_route_table_empty(pcl_route_table_t *table) {
+   return(table == NULL || atomic_load_explicit(&table->empty, memory_order_acquire));
+}
+
+bool pcl_route_match(pcl_route_node_t *node, uint32_t msg_type, const char *pos, const char *end, pcl_route_match_t *match, pcl_route_entry_t **entry) {
+   const char *segment;
+   size_t      segment_len;
+   const char *rest = pos;
+
+   if(!pcl_route_segment_next(&pos, end, &segment, &segment_len)) {
+      *entry = atomic_load_explicit(&node->entries[msg_type], memory_order_acquire);
+      if(*entry == NULL) {
+         *entry = atomic_load_explicit(&node->entries_rest[msg_type], memory_order_acquire);
+         if(*entry != NULL && match->param_count < PCL_ROUTE_PARAMS_MAX) {
+            match->params[match->param_count].str = end;
+            match->params[match->param_count].len = 0;
+            match->param_count++;
+         }
+      }
+      return(*entry != NULL);
+   }
+
+   // Literal segments take priority over '*', which takes priority over '**'
+   for(pcl_route_node_t *child = atomic_load_explicit(&node->child, memory_order_acquire); child != NULL; child = atomic_load_explicit(&child->sibling, memory_order_acquire)) {
+      if(child->segment_len == segment_len && memcmp(child->segment, segment, segment_len) == 0) {
+         if(pcl_route_match(child, msg_type, pos, end, match, entry)) {
+            return(true);
+         }
+         break;
+      }
+   }
+   pcl_route_node_t *wildcard = atomic_load_explicit(&node->wildcard, memory_order_acquire);
+   if(wildcard != NULL && match->param_count < PCL_ROUTE_PARAMS_MAX) {
+      uint32_t param_count = match->param_count;
+      match->params[param_count].str = segment;
+      match->params[param_count].len = segment_len;
+      match->param_count++;
+      if(pcl_route_match(wildcard, msg_type, pos, end, match, entry)) {
+         return(true);
+      }
+      match->param_count = param_count;
+   }
+   *entry = atomic_load_explicit(&node->entries_rest[msg_type], memory_order_acquire);
+   if(*entry != NULL) {
+      while(rest < end && *rest == '/') {
+         rest++;
+      }
+      if(match->param_count < PCL_ROUTE_PARAMS_MAX) {
+         match->params[match->param_count].str = rest;
+         match->params[match->param_count].len = end - rest;
+         match->param_count++;
+      }
+      return(true);
+   }
+   return(false);
+}
+
+bool pcl_route_table_lookup(pcl_route_table_t *table, enum wrp_msg_type msg_type, const char *path, size_t path_len, pcl_route_match_t *match, pcl_route_handler_t *handler, void **ctx) {
+   if(pcl_route_table_empty(table) || msg_type < WRP_MSG_TYPE__REQ || msg_type >= PCL_ROUTE_MSG_TYPE_MAX) {
+      return(false);
+   }
+   bzero(match, sizeof(*match));
+
+   // Split off the fragment and query in the same pass that finds the end of the path
+   const char *end       = path + path_len;
+   const char *path_end  = end;
+   const char *query     = NULL;
+   for(const char *pos = path; pos < end; pos++) {
+      if(*pos == '#') {
+         match->fragment.str = pos + 1;
+         match->fragment.len = end - (pos + 1);
+         end = pos;
+         break;
+      }
+      if(*pos == '?' && query == NULL) {
+         query = pos;
+      }
+   }
+   if(query != NULL) {
+      path_end         = query;
+      match->query.str = query + 1;
+      match->query.len = end - (query + 1);
+   } else {
+      path_end = end;
+   }
+   match->path.str = path;
+   match->path.len = path_end - path;
+
+   pcl_route_entry_t *entry = NULL;
+   if(!pcl_route_match(table->root, msg_type, path, path_end, match, &entry)) {
+      return(false);
+   }
+   *handler = entry->handler;
+   *ctx     = entry->ctx;
+   return(true);
+}
@@ -0,0 +1,37 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_ROUTE__
+#define __PARODUS_CLIENT_LIB_ROUTE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "paroduscl.h"
+
+// Destination path trie.  Routes can be added while messages are being dispatched; lookups take no locks.
+typedef struct pcl_route_table pcl_route_table_t;
+
+pcl_route_table_t *pcl_route_table_create(void);
+void               pcl_route_table_destroy(pcl_route_table_t *table);
+pcl_result_t       pcl_route_table_add(pcl_route_table_t *table, enum wrp_msg_type msg_type, const char *pattern, pcl_route_handler_t handler, void *ctx);
+bool               pcl_route_table_empty(pcl_route_table_t *table);
+// path is the part of dest following the service name, including any query and fragment
+bool               pcl_route_table_lookup(pcl_route_table_t *table, enum wrp_msg_type msg_type, const char *path, size_t path_len, pcl_route_match_t *match, pcl_route_handler_t *handler, void **ctx);
+
+#endif
@@ -0,0 +1,655 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include "paroduscl.h"
+#include "paroduscl_transport.h"
+
+// Single producer single consumer ring in shared memory.  The receive side binds: it creates the ring (memfd) and its data
+// eventfd, and listens on an abstract unix socket named after the url.  The send side connects, passes its space eventfd and
+// receives the ring and the data eventfd.  Each side only signals the other's eventfd when the peer has flagged that it is
+// waiting, so a steady stream of messages costs no system calls.  The consumer starts out waiting and flags it again whenever a
+// read empties the ring, so like NN_RCVFD the data eventfd is readable exactly while there are messages to read.  One producer may
+// be connected at a time; a producer that reconnects continues on the same ring.  Both sides keep the connection open, so a
+// producer sees it hang up when the receiver goes away and moves to the ring of the receiver that replaces it.
+
+#define PCL_SHM_SCHEME      "shm://"
+#define PCL_SHM_SOCK_PREFIX "paroduscl."
+#define PCL_SHM_MAGIC       (0x50434C52)
+#define PCL_SHM_RING_SIZE   (1024 * 1024) // power of two
+#define PCL_SHM_HDR_SIZE    (256)
+#define PCL_SHM_WRAP        (UINT32_MAX)
+#define PCL_SHM_ALIGN(len)  (((len) + 7) & ~(size_t)7)
+#define PCL_SHM_RETRY_MS    (10)
+
+typedef struct {
+   alignas(64) _Atomic uint64_t head;   // written by the producer
+   alignas(64) _Atomic uint64_t tail;   // written by the consumer
+   alignas(64) atomic_bool consumer_waiting;
+   atomic_bool             producer_waiting;
+   uint32_t                magic;
+   uint32_t                size;
+} pcl_shm_hdr_t;
+
+typedef struct {
+   bool            recv;
+   atomic_bool     closed;
+   struct sockaddr_un addr;
+   socklen_t       addr_len;
+   int             listen_fd;
+   int             conn_fd;    // connection to the peer, hangs up when the peer closes or exits
+   pthread_t       thread;
+   bool            thread_valid;
+   int             mem_fd;
+   pcl_shm_hdr_t * hdr;
+   uint8_t *       data;
+   size_t          map_len;
+   uint64_t        mask;
+   uint64_t        tail_seen;  // send side: tail at the last liveness check
+   int             data_efd;   // signalled by the producer when the ring is not empty
+   int             space_efd;  // signalled by the consumer when space is freed
+   pthread_mutex_t lock;       // send side: serialises producers, receive side: guards space_efd across reconnects
+} pcl_shm_t;
+
+static pcl_result_t pcl_shm_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv);
+static void         pcl_shm_shutdown(pcl_sock_t *sock);
+static void         pcl_shm_close(pcl_sock_t *sock);
+static int          pcl_shm_recv(pcl_sock_t *sock, void **msg, int flags);
+static int          pcl_shm_send(pcl_sock_t *sock, const void *buf, size_t len, int flags);
+static int          pcl_shm_produce(pcl_shm_t *shm, int timeout, const void *buf, size_t len, int flags);
+static int          pcl_shm_send_msg(pcl_sock_t *sock, void *msg, size_t len, int flags);
+static void *       pcl_shm_msg_alloc(size_t len);
+static void         pcl_shm_msg_free(void *msg);
+static bool         pcl_shm_map(pcl_shm_t *shm, int mem_fd, bool create);
+static void *       pcl_shm_accept_thread(void *data);
+static bool         pcl_shm_connect(pcl_shm_t *shm);
+static void         pcl_shm_disconnect(pcl_shm_t *shm);
+static bool         pcl_shm_stale(pcl_shm_t *shm);
+static bool         pcl_shm_fds_send(int sock_fd, const int *fds, int fd_qty);
+static int          pcl_shm_fds_recv(int sock_fd, int *fds, int fd_qty);
+static int          pcl_shm_wait(pcl_shm_t *shm, int efd, uint64_t deadline);
+static void         pcl_shm_signal(int efd);
+static void         pcl_shm_drain(int efd);
+static void         pcl_shm_consumer_idle(pcl_shm_t *shm, uint64_t tail);
+static uint64_t     pcl_shm_time_ms(void);
+
+const pcl_transport_t pcl_transport_shm = {
+   .open      = pcl_shm_open,
+   .shutdown  = pcl_shm_shutdown,
+   .close     = pcl_shm_close,
+   .recv      = pcl_shm_recv,
+   .send      = pcl_shm_send,
+   .send_msg  = pcl_shm_send_msg,
+   .msg_alloc = pcl_shm_msg_alloc,
+   .msg_free  = pcl_shm_msg_free,
+};
+
+pcl_result_t pcl_shm_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv) {
+   const char *name     = url + strlen(PCL_SHM_SCHEME);
+   size_t      name_len = strlen(name);
+
+   sock->sock = -1;
+   sock->fd   = -1;
+   sock->priv = NULL;
+
+   pcl_shm_t *shm = (pcl_shm_t *)calloc(1, sizeof(pcl_shm_t));
+   if(shm == NULL) {
+      *errsv = ENOMEM;
+      return(recv ? PCL_RESULT_ERROR_SOCK_RECV_CREATE : PCL_RESULT_ERROR_SOCK_SEND_CREATE);
+   }
+   shm->recv      = recv;
+   shm->listen_fd = -1;
+   shm->conn_fd   = -1;
+   shm->mem_fd    = -1;
+   shm->data_efd  = -1;
+   shm->space_efd = -1;
+   atomic_init(&shm->closed, false);
+   pthread_mutex_init(&shm->lock, NULL);
+   sock->priv = shm;
+
+   // Abstract socket address, the leading nul byte is part of the name
+   if(name_len == 0 || name_len + strlen(PCL_SHM_SOCK_PREFIX) + 1 > sizeof(shm->addr.sun_path)) {
+      *errsv = EINVAL;
+      pcl_shm_close(sock);
+      return(recv ? PCL_RESULT_ERROR_SOCK_RECV_BIND : PCL_RESULT_ERROR_SOCK_SEND_CONNECT);
+   }
+   shm->addr.sun_family = AF_UNIX;
+   memcpy(&shm->addr.sun_path[1], PCL_SHM_SOCK_PREFIX, strlen(PCL_SHM_SOCK_PREFIX));
+   memcpy(&shm->addr.sun_path[1 + strlen(PCL_SHM_SOCK_PREFIX)], name, name_len);
+   shm->addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(PCL_SHM_SOCK_PREFIX) + name_len;
+
+   if(!recv) {
+      shm->space_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if(shm->space_efd < 0) {
+         *errsv = errno;
+         pcl_shm_close(sock);
+         return(PCL_RESULT_ERROR_SOCK_SEND_CREATE);
+      }
+      sock->fd = shm->space_efd;
+      pcl_shm_signal(shm->space_efd); // writable until the ring fills up
+      pcl_shm_connect(shm);           // the receiver may not be listening yet, retried on send
+      return(PCL_RESULT_SUCCESS);
+   }
+
+   shm->data_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   shm->mem_fd   = memfd_create("paroduscl", MFD_CLOEXEC);
+   if(shm->data_efd < 0 || shm->mem_fd < 0) {
+      *errsv = errno;
+      pcl_shm_close(sock);
+      return(PCL_RESULT_ERROR_SOCK_RECV_CREATE);
+   }
+   if(ftruncate(shm->mem_fd, PCL_SHM_HDR_SIZE + PCL_SHM_RING_SIZE) < 0 || !pcl_shm_map(shm, shm->mem_fd, true)) {
+      *errsv = errno;
+      pcl_shm_close(sock);
+      return(PCL_RESULT_ERROR_SOCK_RECV_CREATE);
+   }
+   sock->fd = shm->data_efd;
+
+   shm->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if(shm->listen_fd < 0) {
+      *errsv = errno;
+      pcl_shm_close(sock);
+      return(PCL_RESULT_ERROR_SOCK_RECV_CREATE);
+   }
+   if(bind(shm->listen_fd, (struct sockaddr *)&shm->addr, shm->addr_len) < 0 || listen(shm->listen_fd, 4) < 0) {
+      *errsv = errno;
+      pcl_shm_close(sock);
+      return(PCL_RESULT_ERROR_SOCK_RECV_BIND);
+   }
+   int rc = pthread_create(&shm->thread, NULL, pcl_shm_accept_thread, shm);
+   if(rc != 0) {
+      *errsv = rc;
+      pcl_shm_close(sock);
+      return(PCL_RESULT_ERROR_SOCK_RECV_CREATE);
+   }
+   shm->thread_valid = true;
+   return(PCL_RESULT_SUCCESS);
+}
+
+bool pcl_shm_map(pcl_shm_t *shm, int mem_fd, bool create) {
+   struct stat st;
+   if(fstat(mem_fd, &st) < 0) {
+      return(false);
+   }
+   size_t map_len = (size_t)st.st_size;
+   if(map_len <= PCL_SHM_HDR_SIZE) {
+      errno = EPROTO;
+      return(false);
+   }
+   void *addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+   if(addr == MAP_FAILED) {
+      return(false);
+   }
+   pcl_shm_hdr_t *hdr  = (pcl_shm_hdr_t *)addr;
+   uint32_t       size = (uint32_t)(map_len - PCL_SHM_HDR_SIZE);
+
+   if(create) {
+      atomic_init(&hdr->head, 0);
+      atomic_init(&hdr->tail, 0);
+      atomic_init(&hdr->consumer_waiting, true); // nothing read yet, the first message signals data_efd
+      atomic_init(&hdr->producer_waiting, false);
+      hdr->size  = size;
+      hdr->magic = PCL_SHM_MAGIC;
+   } else if(hdr->magic != PCL_SHM_MAGIC || hdr->size != size || (size & (size - 1)) != 0) {
+      munmap(addr, map_len);
+      errno = EPROTO;
+      return(false);
+   }
+   shm->hdr     = hdr;
+   shm->data    = (uint8_t *)addr + PCL_SHM_HDR_SIZE;
+   shm->map_len = map_len;
+   shm->mask    = size - 1;
+   return(true);
+}
+
+void *pcl_shm_accept_thread(void *data) {
+   pcl_shm_t *shm = (pcl_shm_t *)data;
+
+   while(!atomic_load(&shm->closed)) {
+      int conn_fd = accept4(shm->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if(conn_fd < 0) {
+         if(errno == EINTR || errno == ECONNABORTED) {
+            continue;
+         }
+         break;
+      }
+      int space_efd = -1;
+      int fds[2]    = { shm->mem_fd, shm->data_efd };
+
+      if(pcl_shm_fds_recv(conn_fd, &space_efd, 1) == 1 && pcl_shm_fds_send(conn_fd, fds, 2)) {
+         pthread_mutex_lock(&shm->lock);
+         int space_efd_old = shm->space_efd;
+         int conn_fd_old   = shm->conn_fd;
+         shm->space_efd    = space_efd;
+         shm->conn_fd      = conn_fd;
+         pthread_mutex_unlock(&shm->lock);
+         space_efd = space_efd_old;
+         conn_fd   = conn_fd_old;
+         pcl_shm_signal(shm->space_efd); // the new producer may be waiting on a full ring
+      }
+      if(space_efd >= 0) {
+         close(space_efd);
+      }
+      if(conn_fd >= 0) {
+         close(conn_fd);
+      }
+   }
+   return(NULL);
+}
+
+bool pcl_shm_connect(pcl_shm_t *shm) {
+   int conn_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if(conn_fd < 0) {
+      return(false);
+   }
+   if(connect(conn_fd, (struct sockaddr *)&shm->addr, shm->addr_len) < 0) {
+      close(conn_fd);
+      return(false);
+   }
+   int fds[2] = { -1, -1 };
+   if(!pcl_shm_fds_send(conn_fd, &shm->space_efd, 1) || pcl_shm_fds_recv(conn_fd, fds, 2) != 2) {
+      for(int index = 0; index < 2; index++) {
+         if(fds[index] >= 0) {
+            close(fds[index]);
+         }
+      }
+      close(conn_fd);
+      return(false);
+   }
+
+   if(!pcl_shm_map(shm, fds[0], false)) {
+      close(fds[0]);
+      close(fds[1]);
+      close(conn_fd);
+      return(false);
+   }
+   shm->conn_fd   = conn_fd;
+   shm->mem_fd    = fds[0];
+   shm->data_efd  = fds[1];
+   shm->tail_seen = atomic_load(&shm->hdr->tail);
+   return(true);
+}
+
+void pcl_shm_disconnect(pcl_shm_t *shm) {
+   munmap(shm->hdr, shm->map_len);
+   close(shm->mem_fd);
+   close(shm->data_efd);
+   close(shm->conn_fd);
+   shm->hdr      = NULL;
+   shm->data     = NULL;
+   shm->mem_fd   = -1;
+   shm->data_efd = -1;
+   shm->conn_fd  = -1;
+}
+
+bool pcl_shm_stale(pcl_shm_t *shm) {
+   // A receiver that moved the tail since the last check is alive.  Otherwise ask the connection, which costs a system call only
+   // while the receiver is idle or behind.
+   uint64_t tail = atomic_load_explicit(&shm->hdr->tail, memory_order_relaxed);
+   if(tail != shm->tail_seen) {
+      shm->tail_seen = tail;
+      return(false);
+   }
+   struct pollfd pfd = { .fd = shm->conn_fd, .events = 0 };
+   return(poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR)));
+}
+
+bool pcl_shm_fds_send(int sock_fd, const int *fds, int fd_qty) {
+   char          byte = 0;
+   struct iovec  iov  = { .iov_base = &byte, .iov_len = 1 };
+   union {
+      struct cmsghdr hdr;
+      char           buf[CMSG_SPACE(2 * sizeof(int))];
+   } control;
+   struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = CMSG_SPACE(fd_qty * sizeof(int)) };
+
+   memset(&control, 0, sizeof(control));
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type  = SCM_RIGHTS;
+   cmsg->cmsg_len   = CMSG_LEN(fd_qty * sizeof(int));
+   memcpy(CMSG_DATA(cmsg), fds, fd_qty * sizeof(int));
+
+   return(sendmsg(sock_fd, &msg, MSG_NOSIGNAL) == 1);
+}
+
+int pcl_shm_fds_recv(int sock_fd, int *fds, int fd_qty) {
+   char          byte = 0;
+   struct iovec  iov  = { .iov_base = &byte, .iov_len = 1 };
+   union {
+      struct cmsghdr hdr;
+      char           buf[CMSG_SPACE(2 * sizeof(int))];
+   } control;
+   struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+
+   if(recvmsg(sock_fd, &msg, MSG_CMSG_CLOEXEC) != 1) {
+      return(-1);
+   }
+   int qty = 0;
+   for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+         continue;
+      }
+      int received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for(int index = 0; index < received; index++) {
+         int fd;
+         memcpy(&fd, CMSG_DATA(cmsg) + index * sizeof(int), sizeof(int));
+         if(qty < fd_qty) {
+            fds[qty++] = fd;
+         } else {
+            close(fd);
+         }
+      }
+   }
+   return(qty);
+}
+
+void pcl_shm_shutdown(pcl_sock_t *sock) {
+   pcl_shm_t *shm = (pcl_shm_t *)sock->priv;
+
+   // Blocked calls wake on their own eventfd and see the closed flag
+   atomic_store(&shm->closed, true);
+   pcl_shm_signal(sock->fd);
+   if(shm->listen_fd >= 0) {
+      shutdown(shm->listen_fd, SHUT_RDWR);
+   }
+}
+
+void pcl_shm_close(pcl_sock_t *sock) {
+   pcl_shm_t *shm = (pcl_shm_t *)sock->priv;
+   if(shm == NULL) {
+      return;
+   }
+   atomic_store(&shm->closed, true);
+   if(shm->listen_fd >= 0) {
+      shutdown(shm->listen_fd, SHUT_RDWR);
+   }
+   if(shm->thread_valid) {
+      pthread_join(shm->thread, NULL);
+   }
+   if(shm->listen_fd >= 0) {
+      close(shm->listen_fd);
+   }
+   if(shm->conn_fd >= 0) {
+      close(shm->conn_fd);
+   }
+   if(shm->hdr != NULL) {
+      munmap(shm->hdr, shm->map_len);
+   }
+   if(shm->mem_fd >= 0) {
+      close(shm->mem_fd);
+   }
+   if(shm->data_efd >= 0) {
+      close(shm->data_efd);
+   }
+   if(shm->space_efd >= 0) {
+      close(shm->space_efd);
+   }
+   pthread_mutex_destroy(&shm->lock);
+   free(shm);
+   sock->priv = NULL;
+   sock->fd   = -1;
+}
+
+int pcl_shm_recv(pcl_sock_t *sock, void **msg, int flags) {
+   pcl_shm_t *shm      = (pcl_shm_t *)sock->priv;
+   uint64_t   deadline = (sock->timeout > 0) ? pcl_shm_time_ms() + sock->timeout : 0;
+
+   while(true) {
+      if(atomic_load(&shm->closed)) {
+         errno = EBADF;
+         return(-1);
+      }
+      uint64_t tail = atomic_load_explicit(&shm->hdr->tail, memory_order_relaxed);
+      uint64_t head = atomic_load_explicit(&shm->hdr->head, memory_order_acquire);
+
+      if(head == tail) {
+         // Flag that we are waiting, then check again so a message published in between is not missed
+         pcl_shm_drain(shm->data_efd);
+         atomic_store(&shm->hdr->consumer_waiting, true);
+         if(atomic_load(&shm->hdr->head) != tail) {
+            continue;
+         }
+         if(flags & PCL_SOCK_DONTWAIT) {
+            errno = EAGAIN;
+            return(-1);
+         }
+         if(pcl_shm_wait(shm, shm->data_efd, deadline) < 0) {
+            return(-1);
+         }
+         continue;
+      }
+
+      // The producer shares the ring, validate everything read from it
+      uint64_t avail  = head - tail;
+      uint64_t offset = tail & shm->mask;
+      uint64_t to_end = shm->mask + 1 - offset;
+      if(avail > shm->mask + 1 || (offset & 7) != 0) {
+         errno = EPROTO;
+         return(-1);
+      }
+      uint32_t len;
+      memcpy(&len, &shm->data[offset], sizeof(len));
+      if(len == PCL_SHM_WRAP) {
+         if(avail < to_end) {
+            errno = EPROTO;
+            return(-1);
+         }
+         atomic_store(&shm->hdr->tail, tail + to_end);
+         continue;
+      }
+      size_t rec = PCL_SHM_ALIGN(sizeof(len) + (size_t)len);
+      if(rec > to_end || rec > avail) {
+         errno = EPROTO;
+         return(-1);
+      }
+      void *buf = malloc(len ? len : 1);
+      if(buf == NULL) {
+         errno = ENOMEM;
+         return(-1);
+      }
+      memcpy(buf, &shm->data[offset + sizeof(len)], len);
+      atomic_store(&shm->hdr->tail, tail + rec);
+      if(atomic_load(&shm->hdr->head) == tail + rec) {
+         pcl_shm_consumer_idle(shm, tail + rec);
+      }
+
+      if(atomic_load(&shm->hdr->producer_waiting) && atomic_exchange(&shm->hdr->producer_waiting, false)) {
+         pthread_mutex_lock(&shm->lock);
+         pcl_shm_signal(shm->space_efd);
+         pthread_mutex_unlock(&shm->lock);
+      }
+      *msg = buf;
+      return((int)len);
+   }
+}
+
+int pcl_shm_send(pcl_sock_t *sock, const void *buf, size_t len, int flags) {
+   pcl_shm_t *shm = (pcl_shm_t *)sock->priv;
+
+   // The ring has a single producer, senders on different threads take turns
+   pthread_mutex_lock(&shm->lock);
+   int ret = pcl_shm_produce(shm, sock->timeout, buf, len, flags);
+   pthread_mutex_unlock(&shm->lock);
+   return(ret);
+}
+
+int pcl_shm_produce(pcl_shm_t *shm, int timeout, const void *buf, size_t len, int flags) {
+   uint64_t deadline = (timeout >= 0) ? pcl_shm_time_ms() + timeout : 0;
+
+   while(true) {
+      if(atomic_load(&shm->closed)) {
+         errno = EBADF;
+         return(-1);
+      }
+      if(shm->hdr != NULL && pcl_shm_stale(shm)) {
+         pcl_shm_disconnect(shm); // the receiver has gone, along with anything left unread in its ring
+      }
+      if(shm->hdr == NULL && !pcl_shm_connect(shm)) { // not connected to the receiver yet
+         if(flags & PCL_SOCK_DONTWAIT) {
+            errno = EAGAIN;
+            return(-1);
+         }
+         uint64_t now = pcl_shm_time_ms();
+         if(deadline && now >= deadline) {
+            errno = ETIMEDOUT;
+            return(-1);
+         }
+         struct timespec delay = { .tv_sec = 0, .tv_nsec = PCL_SHM_RETRY_MS * 1000000L };
+         nanosleep(&delay, NULL);
+         continue;
+      }
+
+      uint64_t size = shm->mask + 1;
+      size_t   rec  = PCL_SHM_ALIGN(sizeof(uint32_t) + len);
+      if(rec > size / 2 || len >= PCL_SHM_WRAP) {
+         errno = EMSGSIZE;
+         return(-1);
+      }
+      uint64_t head   = atomic_load_explicit(&shm->hdr->head, memory_order_relaxed);
+      uint64_t tail   = atomic_load_explicit(&shm->hdr->tail, memory_order_acquire);
+      uint64_t offset = head & shm->mask;
+      uint64_t to_end = size - offset;
+      uint64_t need   = rec + ((to_end < rec) ? to_end : 0);
+
+      if(head - tail <= size - need) {
+         if(to_end < rec) { // the record does not fit before the end of the ring, skip to the start
+            uint32_t wrap = PCL_SHM_WRAP;
+            memcpy(&shm->data[offset], &wrap, sizeof(wrap));
+            head  += to_end;
+            offset = 0;
+         }
+         uint32_t len32 = (uint32_t)len;
+         memcpy(&shm->data[offset], &len32, sizeof(len32));
+         memcpy(&shm->data[offset + sizeof(len32)], buf, len);
+         atomic_store(&shm->hdr->head, head + rec);
+
+         if(atomic_load(&shm->hdr->consumer_waiting) && atomic_exchange(&shm->hdr->consumer_waiting, false)) {
+            pcl_shm_signal(shm->data_efd);
+         }
+         return((int)len);
+      }
+
+      // Ring full, flag that we are waiting and check again before sleeping
+      pcl_shm_drain(shm->space_efd);
+      atomic_store(&shm->hdr->producer_waiting, true);
+      if(atomic_load(&shm->hdr->tail) != tail) {
+         continue;
+      }
+      if(flags & PCL_SOCK_DONTWAIT) {
+         errno = EAGAIN;
+         return(-1);
+      }
+      if(pcl_shm_wait(shm, shm->space_efd, deadline) < 0) {
+         return(-1);
+      }
+   }
+}
+
+int pcl_shm_send_msg(pcl_sock_t *sock, void *msg, size_t len, int flags) {
+   int ret = pcl_shm_send(sock, msg, len, flags);
+   if(ret >= 0) {
+      free(msg);
+   }
+   return(ret);
+}
+
+void *pcl_shm_msg_alloc(size_t len) {
+   return(malloc(len ? len : 1));
+}
+
+void pcl_shm_msg_free(void *msg) {
+   free(msg);
+}
+
+// Waits for efd until the deadline (0 waits forever), or on the send side until the receiver hangs up.  Returns -1 with errno set
+// on timeout or shutdown.
+int pcl_shm_wait(pcl_shm_t *shm, int efd, uint64_t deadline) {
+   int timeout = -1;
+   if(deadline) {
+      uint64_t now = pcl_shm_time_ms();
+      if(now >= deadline) {
+         errno = ETIMEDOUT;
+         return(-1);
+      }
+      timeout = (int)(deadline - now);
+   }
+   struct pollfd pfd[2] = { { .fd = efd, .events = POLLIN }, { .fd = shm->conn_fd, .events = 0 } };
+   int rc = poll(pfd, (!shm->recv && shm->conn_fd >= 0) ? 2 : 1, timeout);
+   if(rc < 0 && errno != EINTR) {
+      return(-1);
+   }
+   if(atomic_load(&shm->closed)) {
+      errno = EBADF;
+      return(-1);
+   }
+   if(rc == 0) {
+      errno = ETIMEDOUT;
+      return(-1);
+   }
+   return(0);
+}
+
+void pcl_shm_signal(int efd) {
+   if(efd >= 0) {
+      uint64_t value = 1;
+      if(write(efd, &value, sizeof(value)) < 0) {
+         // counter saturated, the peer is already signalled
+      }
+   }
+}
+
+void pcl_shm_drain(int efd) {
+   uint64_t value;
+   if(read(efd, &value, sizeof(value)) < 0) {
+      // not signalled
+   }
+}
+
+void pcl_shm_consumer_idle(pcl_shm_t *shm, uint64_t tail) {
+   // The ring is empty, clear data_efd and flag that we are waiting.  A message published before the flag was seen did not signal,
+   // so signal it on the producer's behalf unless the producer already took the flag.
+   pcl_shm_drain(shm->data_efd);
+   atomic_store(&shm->hdr->consumer_waiting, true);
+   if(atomic_load(&shm->hdr->head) != tail && atomic_exchange(&shm->hdr->consumer_waiting, false)) {
+      pcl_shm_signal(shm->data_efd);
+   }
+}
+
+uint64_t pcl_shm_time_ms(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
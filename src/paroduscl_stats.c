@@ -0,0 +1,80 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "paroduscl.h"
+#include "paroduscl_stats.h"
+
+static void pcl_stats_read(atomic_uint_fast64_t *live, uint64_t *value, uint32_t qty);
+static void pcl_stats_zero(atomic_uint_fast64_t *live, uint32_t qty);
+
+void pcl_stats_snapshot(pcl_stats_live_t *live, pcl_stats_t *stats) {
+   pcl_stats_read(live->recv_msgs,  stats->recv_msgs,  PCL_BATCH_MSG_TYPE_MAX);
+   pcl_stats_read(live->recv_bytes, stats->recv_bytes, PCL_BATCH_MSG_TYPE_MAX);
+   pcl_stats_read(live->send_msgs,  stats->send_msgs,  PCL_BATCH_MSG_TYPE_MAX);
+   pcl_stats_read(live->send_bytes, stats->send_bytes, PCL_BATCH_MSG_TYPE_MAX);
+   pcl_stats_read(live->result,     stats->result,     PCL_RESULT_INVALID + 1);
+   pcl_stats_read(&live->send_timeout, &stats->send_timeout, 1);
+   pcl_stats_read(live->recv_filtered, stats->recv_filtered, PCL_BATCH_MSG_TYPE_MAX);
+   pcl_stats_read(&live->arena_alloc,  &stats->arena_alloc,  1);
+   pcl_stats_read(&live->reconnects,     &stats->reconnects,     1);
+   pcl_stats_read(&live->replay_held,    &stats->replay_held,    1);
+   pcl_stats_read(&live->replay_dropped, &stats->replay_dropped, 1);
+   pcl_stats_read(live->send_lane_sent,    stats->send_lane_sent,    PCL_SEND_LANE_QTY);
+   pcl_stats_read(live->send_lane_dropped, stats->send_lane_dropped, PCL_SEND_LANE_QTY);
+   pcl_stats_read(&live->idempotency_new,        &stats->idempotency_new,        1);
+   pcl_stats_read(&live->idempotency_replayed,   &stats->idempotency_replayed,   1);
+   pcl_stats_read(&live->idempotency_suppressed, &stats->idempotency_suppressed, 1);
+   pcl_stats_read(&live->idempotency_evicted,    &stats->idempotency_evicted,    1);
+   pcl_stats_read(&live->retrieve_cache_hits,        &stats->retrieve_cache_hits,        1);
+   pcl_stats_read(&live->retrieve_cache_misses,      &stats->retrieve_cache_misses,      1);
+   pcl_stats_read(&live->retrieve_cache_invalidated, &stats->retrieve_cache_invalidated, 1);
+   pcl_stats_read(&live->retrieve_cache_evicted,     &stats->retrieve_cache_evicted,     1);
+   pcl_stats_read(&live->stream_chunks_sent,         &stats->stream_chunks_sent,         1);
+   pcl_stats_read(&live->stream_chunks_recv,         &stats->stream_chunks_recv,         1);
+   pcl_stats_read(&live->stream_chunks_dropped,      &stats->stream_chunks_dropped,      1);
+   pcl_stats_read(&live->shed_expired,  &stats->shed_expired,  1);
+   pcl_stats_read(&live->shed_backlog,  &stats->shed_backlog,  1);
+   pcl_stats_read(&live->shed_rejected, &stats->shed_rejected, 1);
+
+   pcl_stats_hist_live_t *hist_live[] = { &live->decode,  &live->handler,  &live->send,  &live->queue_age };
+   pcl_stats_hist_t *     hist[]      = { &stats->decode, &stats->handler, &stats->send, &stats->queue_age };
+   for(uint32_t index = 0; index < sizeof(hist) / sizeof(hist[0]); index++) {
+      pcl_stats_read(&hist_live[index]->count,  &hist[index]->count,  1);
+      pcl_stats_read(&hist_live[index]->sum_ns, &hist[index]->sum_ns, 1);
+      pcl_stats_read(hist_live[index]->bucket,  hist[index]->bucket,  PCL_STATS_HIST_BUCKETS);
+   }
+}
+
+void pcl_stats_clear(pcl_stats_live_t *live) {
+   // Every member is a counter, so the structure is cleared as one array
+   pcl_stats_zero((atomic_uint_fast64_t *)live, sizeof(*live) / sizeof(atomic_uint_fast64_t));
+}
+
+void pcl_stats_read(atomic_uint_fast64_t *live, uint64_t *value, uint32_t qty) {
+   for(uint32_t index = 0; index < qty; index++) {
+      value[index] = atomic_load_explicit(&live[index], memory_order_relaxed);
+   }
+}
+
+void pcl_stats_zero(atomic_uint_fast64_t *live, uint32_t qty) {
+   for(uint32_t index = 0; index < qty; index++) {
+      atomic_store_explicit(&live[index], 0, memory_order_relaxed);
+   }
+}
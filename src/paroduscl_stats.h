@@ -0,0 +1,101 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_STATS__
+#define __PARODUS_CLIENT_LIB_STATS__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "paroduscl.h"
+
+// Live counters behind pcl_stats_t.  Updated with relaxed atomics from any thread, so a snapshot is not taken atomically.
+typedef struct {
+   atomic_uint_fast64_t count;
+   atomic_uint_fast64_t sum_ns;
+   atomic_uint_fast64_t bucket[PCL_STATS_HIST_BUCKETS];
+} pcl_stats_hist_live_t;
+
+typedef struct {
+   atomic_uint_fast64_t  recv_msgs[PCL_BATCH_MSG_TYPE_MAX];
+   atomic_uint_fast64_t  recv_bytes[PCL_BATCH_MSG_TYPE_MAX];
+   atomic_uint_fast64_t  send_msgs[PCL_BATCH_MSG_TYPE_MAX];
+   atomic_uint_fast64_t  send_bytes[PCL_BATCH_MSG_TYPE_MAX];
+   atomic_uint_fast64_t  result[PCL_RESULT_INVALID + 1];
+   atomic_uint_fast64_t  send_timeout;
+   pcl_stats_hist_live_t decode;
+   pcl_stats_hist_live_t handler;
+   pcl_stats_hist_live_t send;
+   atomic_uint_fast64_t  recv_filtered[PCL_BATCH_MSG_TYPE_MAX];
+   atomic_uint_fast64_t  arena_alloc;
+   atomic_uint_fast64_t  reconnects;
+   atomic_uint_fast64_t  replay_held;
+   atomic_uint_fast64_t  replay_dropped;
+   atomic_uint_fast64_t  send_lane_sent[PCL_SEND_LANE_QTY];
+   atomic_uint_fast64_t  send_lane_dropped[PCL_SEND_LANE_QTY];
+   atomic_uint_fast64_t  idempotency_new;
+   atomic_uint_fast64_t  idempotency_replayed;
+   atomic_uint_fast64_t  idempotency_suppressed;
+   atomic_uint_fast64_t  idempotency_evicted;
+   atomic_uint_fast64_t  retrieve_cache_hits;
+   atomic_uint_fast64_t  retrieve_cache_misses;
+   atomic_uint_fast64_t  retrieve_cache_invalidated;
+   atomic_uint_fast64_t  retrieve_cache_evicted;
+   atomic_uint_fast64_t  stream_chunks_sent;
+   atomic_uint_fast64_t  stream_chunks_recv;
+   atomic_uint_fast64_t  stream_chunks_dropped;
+   atomic_uint_fast64_t  shed_expired;
+   atomic_uint_fast64_t  shed_backlog;
+   atomic_uint_fast64_t  shed_rejected;
+   pcl_stats_hist_live_t queue_age;
+} pcl_stats_live_t;
+
+void pcl_stats_snapshot(pcl_stats_live_t *live, pcl_stats_t *stats);
+void pcl_stats_clear(pcl_stats_live_t *live);
+
+static inline void pcl_stats_add(atomic_uint_fast64_t *counter, uint64_t value) {
+   atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static inline uint32_t pcl_stats_type_index(int msg_type) {
+   return((msg_type >= 0 && msg_type < PCL_BATCH_MSG_TYPE_MAX) ? msg_type : 0);
+}
+
+static inline void pcl_stats_result(pcl_stats_live_t *live, pcl_result_t result) {
+   pcl_stats_add(&live->result[(result < PCL_RESULT_INVALID) ? result : PCL_RESULT_INVALID], 1);
+}
+
+static inline uint64_t pcl_stats_time_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec);
+}
+
+// Records the time elapsed since start (from pcl_stats_time_ns)
+static inline void pcl_stats_hist_record(pcl_stats_hist_live_t *hist, uint64_t start) {
+   uint64_t ns     = pcl_stats_time_ns() - start;
+   uint32_t bucket = (ns > 1) ? (63 - __builtin_clzll(ns)) : 0;
+   if(bucket >= PCL_STATS_HIST_BUCKETS) {
+      bucket = PCL_STATS_HIST_BUCKETS - 1;
+   }
+   pcl_stats_add(&hist->count, 1);
+   pcl_stats_add(&hist->sum_ns, ns);
+   pcl_stats_add(&hist->bucket[bucket], 1);
+}
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "paroduscl_trace.h"
+#include "paroduscl_stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PCL_TRACE_TSC
+#endif
+
+#define PCL_TRACE_RING_SIZE_DEFAULT (4096)
+#define PCL_TRACE_RING_SIZE_MIN     (64)
+#define PCL_TRACE_CALIBRATE_NS      (5000000)
+
+struct pcl_trace {
+   uint64_t         id;       // distinguishes traces in the per thread state, addresses may be reused
+   char *           name;
+   pcl_trace_hdr_t *hdr;
+   size_t           map_len;
+   size_t           ring_len;
+   uint64_t         mask;
+};
+
+typedef struct {
+   uint64_t               id;          // trace the ring belongs to
+   pcl_trace_ring_hdr_t * ring;        // NULL when every ring was claimed
+   uint32_t               countdown;   // messages until the next one is sampled
+   uint64_t               current_id;  // trace the message being dispatched belongs to
+   const pcl_trace_ctx_t *current;
+} pcl_trace_thread_t;
+
+static _Atomic uint64_t              pcl_trace_id = 1;
+static _Thread_local pcl_trace_thread_t pcl_trace_thread;
+
+static pcl_trace_ring_hdr_t *pcl_trace_ring(pcl_trace_t *trace);
+static pcl_trace_ring_hdr_t *pcl_trace_ring_at(pcl_trace_hdr_t *hdr, uint32_t index);
+static pcl_trace_ring_hdr_t *pcl_trace_ring_reclaim(pcl_trace_t *trace, uint32_t tid);
+static uint64_t              pcl_trace_tick_hz(void);
+
+pcl_trace_t *pcl_trace_open(const char *name, uint32_t sample, uint32_t ring_size, int *errsv) {
+   if(ring_size == 0) {
+      ring_size = PCL_TRACE_RING_SIZE_DEFAULT;
+   }
+   uint32_t size = PCL_TRACE_RING_SIZE_MIN;
+   while(size < ring_size && size < (1u << 24)) {
+      size <<= 1;
+   }
+
+   pcl_trace_t *trace = (pcl_trace_t *)calloc(1, sizeof(pcl_trace_t));
+   if(trace == NULL || (trace->name = strdup(name)) == NULL) {
+      *errsv = errno;
+      free(trace);
+      return(NULL);
+   }
+   trace->id       = atomic_fetch_add(&pcl_trace_id, 1);
+   trace->mask     = size - 1;
+   trace->ring_len = sizeof(pcl_trace_ring_hdr_t) + (size_t)size * sizeof(pcl_trace_span_t);
+   trace->map_len  = PCL_TRACE_HDR_SIZE + PCL_TRACE_RING_QTY * trace->ring_len;
+
+   // An object left behind by an earlier process with the same name is replaced, readers still mapping it keep the old one
+   shm_unlink(name);
+   int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+   if(fd < 0 || ftruncate(fd, trace->map_len) < 0) {
+      *errsv = errno;
+      if(fd >= 0) {
+         close(fd);
+         shm_unlink(name);
+      }
+      free(trace->name);
+      free(trace);
+      return(NULL);
+   }
+   void *base = mmap(NULL, trace->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   *errsv = (base == MAP_FAILED) ? errno : 0;
+   close(fd);
+   if(base == MAP_FAILED) {
+      shm_unlink(name);
+      free(trace->name);
+      free(trace);
+      return(NULL);
+   }
+   trace->hdr = (pcl_trace_hdr_t *)base;
+
+   // Pages of the rings are only backed once a thread writes to them
+   struct timespec ts;
+   trace->hdr->ring_qty    = PCL_TRACE_RING_QTY;
+   trace->hdr->ring_size   = size;
+   trace->hdr->tick_hz     = pcl_trace_tick_hz();
+   trace->hdr->tick_base   = pcl_trace_now();
+   clock_gettime(CLOCK_REALTIME, &ts);
+   trace->hdr->realtime_ns = ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+   trace->hdr->pid         = getpid();
+   atomic_init(&trace->hdr->sample, sample);
+   atomic_init(&trace->hdr->ring_used, 0);
+   atomic_init(&trace->hdr->dropped, 0);
+   atomic_thread_fence(memory_order_release);
+   memcpy(trace->hdr->magic, PCL_TRACE_MAGIC, PCL_TRACE_MAGIC_LEN); // readers check it last
+   return(trace);
+}
+
+void pcl_trace_close(pcl_trace_t *trace) {
+   if(trace == NULL) {
+      return;
+   }
+   shm_unlink(trace->name);
+   munmap(trace->hdr, trace->map_len);
+   free(trace->name);
+   free(trace);
+}
+
+void pcl_trace_sample_rate(pcl_trace_t *trace, uint32_t sample) {
+   if(trace != NULL) {
+      atomic_store_explicit(&trace->hdr->sample, sample, memory_order_relaxed);
+   }
+}
+
+bool pcl_trace_sample(pcl_trace_t *trace) {
+   if(trace == NULL) {
+      return(false);
+   }
+   uint32_t sample = atomic_load_explicit(&trace->hdr->sample, memory_order_relaxed);
+   if(sample == 0) {
+      return(false);
+   }
+   // Counting down per thread keeps sampling free of shared writes
+   if(pcl_trace_thread.countdown == 0 || pcl_trace_thread.countdown > sample) {
+      pcl_trace_thread.countdown = sample;
+   }
+   return(--pcl_trace_thread.countdown == 0);
+}
+
+uint64_t pcl_trace_now(void) {
+#ifdef PCL_TRACE_TSC
+   return(__rdtsc());
+#else
+   return(pcl_stats_time_ns());
+#endif
+}
+
+uint64_t pcl_trace_begin(const pcl_trace_ctx_t *ctx) {
+   return(ctx->sampled ? pcl_trace_now() : 0);
+}
+
+uint64_t pcl_trace_span(pcl_trace_t *trace, const pcl_trace_ctx_t *ctx, pcl_trace_stage_t stage, uint64_t start) {
+   if(!ctx->sampled) {
+      return(0);
+   }
+   uint64_t              now  = pcl_trace_now();
+   pcl_trace_ring_hdr_t *ring = pcl_trace_ring(trace);
+   if(ring == NULL) {
+      atomic_fetch_add_explicit(&trace->hdr->dropped, 1, memory_order_relaxed);
+      return(now);
+   }
+   uint64_t          head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+   pcl_trace_span_t *span = &((pcl_trace_span_t *)((uint8_t *)ring + sizeof(pcl_trace_ring_hdr_t)))[head & trace->mask];
+
+   // Readers discard the slot from the moment it is cleared until the new span is published with its sequence number
+   atomic_store_explicit(&span->seq, 0, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+   span->start     = start;
+   span->duration  = now - start;
+   span->uuid_hash = ctx->hash;
+   span->len       = ctx->len;
+   span->stage     = stage;
+   span->msg_type  = ctx->msg_type;
+   span->reserved  = 0;
+   atomic_store_explicit(&span->seq, head + 1, memory_order_release);
+   atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+   return(now);
+}
+
+uint64_t pcl_trace_hash(const char *str, size_t len) {
+   uint64_t hash = 0xcbf29ce484222325ull;
+   for(size_t index = 0; index < len; index++) {
+      hash ^= (uint8_t)str[index];
+      hash *= 0x100000001b3ull;
+   }
+   return(hash);
+}
+
+const pcl_trace_ctx_t *pcl_trace_enter(pcl_trace_t *trace, const pcl_trace_ctx_t *ctx) {
+   const pcl_trace_ctx_t *prev = pcl_trace_current(trace);
+   pcl_trace_thread.current_id = trace->id;
+   pcl_trace_thread.current    = ctx;
+   return(prev);
+}
+
+void pcl_trace_leave(pcl_trace_t *trace, const pcl_trace_ctx_t *prev) {
+   pcl_trace_thread.current_id = (prev != NULL) ? trace->id : 0;
+   pcl_trace_thread.current    = prev;
+}
+
+const pcl_trace_ctx_t *pcl_trace_current(pcl_trace_t *trace) {
+   if(trace == NULL || pcl_trace_thread.current_id != trace->id) {
+      return(NULL);
+   }
+   return(pcl_trace_thread.current);
+}
+
+pcl_trace_ring_hdr_t *pcl_trace_ring(pcl_trace_t *trace) {
+   if(pcl_trace_thread.id == trace->id) {
+      return(pcl_trace_thread.ring);
+   }
+   // A thread that used the trace before, or an exited one whose id was reused, continues on its ring
+   uint32_t tid  = (uint32_t)syscall(SYS_gettid);
+   uint32_t used = atomic_load(&trace->hdr->ring_used);
+   pcl_trace_ring_hdr_t *ring = NULL;
+   for(uint32_t index = 0; index < used && ring == NULL; index++) {
+      if(atomic_load_explicit(&pcl_trace_ring_at(trace->hdr, index)->tid, memory_order_relaxed) == tid) {
+         ring = pcl_trace_ring_at(trace->hdr, index);
+      }
+   }
+   while(ring == NULL && used < trace->hdr->ring_qty) {
+      if(atomic_compare_exchange_weak(&trace->hdr->ring_used, &used, used + 1)) {
+         ring = pcl_trace_ring_at(trace->hdr, used);
+         atomic_store_explicit(&ring->tid, tid, memory_order_relaxed);
+      }
+   }
+   if(ring == NULL) {
+      ring = pcl_trace_ring_reclaim(trace, tid);
+   }
+   pcl_trace_thread.id   = trace->id;
+   pcl_trace_thread.ring = ring;
+   return(ring);
+}
+
+pcl_trace_ring_hdr_t *pcl_trace_ring_reclaim(pcl_trace_t *trace, uint32_t tid) {
+   // Every ring was claimed, take over one whose thread has exited.  Its head carries on so readers keep their place, and thread ids
+   // are only reused once pid_max wraps, so the owner does not come back while the ring is taken over.
+   int                   errsv = errno;
+   pid_t                 pid   = getpid();
+   pcl_trace_ring_hdr_t *ring  = NULL;
+   for(uint32_t index = 0; index < trace->hdr->ring_qty && ring == NULL; index++) {
+      pcl_trace_ring_hdr_t *candidate = pcl_trace_ring_at(trace->hdr, index);
+      uint32_t              owner     = atomic_load_explicit(&candidate->tid, memory_order_relaxed);
+      if(owner != 0 && syscall(SYS_tgkill, pid, owner, 0) < 0 && errno == ESRCH && atomic_compare_exchange_strong(&candidate->tid, &owner, tid)) {
+         ring = candidate;
+      }
+   }
+   errno = errsv; // spans are recorded between a failed call and the caller reading errno
+   return(ring);
+}
+
+pcl_trace_ring_hdr_t *pcl_trace_ring_at(pcl_trace_hdr_t *hdr, uint32_t index) {
+   size_t ring_len = sizeof(pcl_trace_ring_hdr_t) + (size_t)hdr->ring_size * sizeof(pcl_trace_span_t);
+   return((pcl_trace_ring_hdr_t *)((uint8_t *)hdr + PCL_TRACE_HDR_SIZE + index * ring_len));
+}
+
+uint64_t pcl_trace_tick_hz(void) {
+#ifdef PCL_TRACE_TSC
+   // Measured against CLOCK_MONOTONIC, the TSC runs at a constant rate on the processors that have one
+   struct timespec ts       = { 0, PCL_TRACE_CALIBRATE_NS };
+   uint64_t        ns_start = pcl_stats_time_ns();
+   uint64_t        start    = __rdtsc();
+   nanosleep(&ts, NULL);
+   uint64_t ticks = __rdtsc() - start;
+   uint64_t ns    = pcl_stats_time_ns() - ns_start;
+   return((ns > 0) ? (ticks / ns) * 1000000000 + ((ticks % ns) * 1000000000) / ns : 1000000000);
+#else
+   return(1000000000);
+#endif
+}
+
+bool pcl_trace_reader_open(pcl_trace_reader_t *reader, const char *name, bool writable, int *errsv) {
+   struct stat st;
+   memset(reader, 0, sizeof(*reader));
+   int fd = shm_open(name, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0);
+   if(fd < 0 || fstat(fd, &st) < 0) {
+      *errsv = errno;
+      if(fd >= 0) {
+         close(fd);
+      }
+      return(false);
+   }
+   reader->map_len = st.st_size;
+   void *base = (reader->map_len >= PCL_TRACE_HDR_SIZE) ? mmap(NULL, reader->map_len, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0) : MAP_FAILED;
+   *errsv = (base == MAP_FAILED) ? ((reader->map_len >= PCL_TRACE_HDR_SIZE) ? errno : EINVAL) : 0;
+   close(fd);
+   if(base == MAP_FAILED) {
+      return(false);
+   }
+   reader->hdr = (pcl_trace_hdr_t *)base;
+
+   // Checked last: the magic is written once the header is complete
+   pcl_trace_hdr_t *hdr = reader->hdr;
+   if(memcmp(hdr->magic, PCL_TRACE_MAGIC, PCL_TRACE_MAGIC_LEN) != 0 || hdr->ring_qty > PCL_TRACE_RING_QTY || hdr->ring_size == 0 ||
+      (hdr->ring_size & (hdr->ring_size - 1)) != 0 || hdr->tick_hz == 0 ||
+      reader->map_len < PCL_TRACE_HDR_SIZE + hdr->ring_qty * (sizeof(pcl_trace_ring_hdr_t) + (size_t)hdr->ring_size * sizeof(pcl_trace_span_t))) {
+      pcl_trace_reader_close(reader);
+      *errsv = EINVAL;
+      return(false);
+   }
+   atomic_thread_fence(memory_order_acquire);
+   return(true);
+}
+
+void pcl_trace_reader_close(pcl_trace_reader_t *reader) {
+   if(reader->hdr != NULL) {
+      munmap(reader->hdr, reader->map_len);
+      reader->hdr = NULL;
+   }
+}
+
+size_t pcl_trace_reader_next(pcl_trace_reader_t *reader, uint32_t ring, pcl_trace_span_t *spans, size_t max, uint64_t *lost) {
+   uint64_t lost_qty = 0;
+   if(lost != NULL) {
+      *lost = 0;
+   }
+   if(ring >= reader->hdr->ring_qty || max == 0) {
+      return(0);
+   }
+   pcl_trace_ring_hdr_t *   ring_hdr = pcl_trace_ring_at(reader->hdr, ring);
+   const pcl_trace_span_t * slots    = (const pcl_trace_span_t *)((uint8_t *)ring_hdr + sizeof(pcl_trace_ring_hdr_t));
+   uint64_t                 size     = reader->hdr->ring_size;
+   uint64_t                 tail     = reader->tail[ring];
+   uint64_t                 head     = atomic_load_explicit(&ring_hdr->head, memory_order_acquire);
+
+   if(head - tail > size) { // overwritten since the last read
+      lost_qty = head - size - tail;
+      tail     = head - size;
+   }
+   size_t qty  = (head - tail < max) ? (size_t)(head - tail) : max;
+   size_t torn = 0;
+   for(size_t index = 0; index < qty; index++) {
+      // Spans the writer started overwriting before or while they were copied are discarded
+      const pcl_trace_span_t *slot = &slots[(tail + index) & (size - 1)];
+      uint64_t                seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+      memcpy(&spans[index - torn], slot, sizeof(pcl_trace_span_t));
+      atomic_thread_fence(memory_order_acquire);
+      if(seq != tail + index + 1 || atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+         torn++;
+      }
+   }
+   reader->tail[ring] = tail + qty;
+   if(lost != NULL) {
+      *lost = lost_qty + torn;
+   }
+   return(qty - torn);
+}
+
+uint32_t pcl_trace_reader_tid(pcl_trace_reader_t *reader, uint32_t ring) {
+   if(ring >= atomic_load(&reader->hdr->ring_used) || ring >= reader->hdr->ring_qty) {
+      return(0);
+   }
+   return(atomic_load_explicit(&pcl_trace_ring_at(reader->hdr, ring)->tid, memory_order_relaxed));
+}
+
+uint64_t pcl_trace_ticks_ns(const pcl_trace_hdr_t *hdr, uint64_t ticks) {
+   return((ticks / hdr->tick_hz) * 1000000000 + ((ticks % hdr->tick_hz) * 1000000000) / hdr->tick_hz);
+}
@@ -0,0 +1,122 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __PARODUS_CLIENT_LIB_TRACE__
+#define __PARODUS_CLIENT_LIB_TRACE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+
+// Per message span tracing into a shared memory object (shm_open) that other processes can map and read while it is written.
+// The object holds a header followed by PCL_TRACE_RING_QTY rings.  Each thread that records a span claims a ring of its own, so
+// recording takes no lock: the span is written to the slot at head and head is then advanced.  Once every ring is claimed, the rings
+// of threads that have exited are taken over by new ones.  Each span is published by storing its sequence number last; a reader
+// keeps a copied span only when its sequence number is the expected one both before and after the copy.
+#define PCL_TRACE_MAGIC     "PCLTRC02"
+#define PCL_TRACE_MAGIC_LEN (8)
+#define PCL_TRACE_RING_QTY  (64)
+
+typedef enum {
+   PCL_TRACE_RECV    = 0, // transport recv, including the wait for a blocking pcl_recv
+   PCL_TRACE_FILTER  = 1, // receive filter: duplicates, cached responses, backlog shedding and unhandled messages
+   PCL_TRACE_DECODE  = 2, // msgpack to wrp struct, arena or view
+   PCL_TRACE_QUEUE   = 3, // decoded until dispatched, waiting for a dispatch worker or the rest of a batch
+   PCL_TRACE_MATCH   = 4, // outstanding request and service lookup
+   PCL_TRACE_HANDLER = 5,
+   PCL_TRACE_SEND    = 6, // encode and transport send
+   PCL_TRACE_STAGE_QTY
+} pcl_trace_stage_t;
+
+typedef struct {
+   uint64_t start;       // ticks, see pcl_trace_hdr_t
+   uint64_t duration;    // ticks
+   uint64_t uuid_hash;   // pcl_trace_hash of the transaction_uuid, 0 when the message has none
+   uint32_t len;         // frame bytes received, 0 for PCL_TRACE_SEND
+   uint8_t  stage;       // pcl_trace_stage_t
+   uint8_t  msg_type;    // wrp msg type
+   uint16_t reserved;
+   _Atomic uint64_t seq; // index of the span in the ring plus one once it is complete, 0 while it is written
+} pcl_trace_span_t;
+
+typedef struct {
+   char                 magic[PCL_TRACE_MAGIC_LEN];
+   uint32_t             ring_qty;
+   uint32_t             ring_size;    // spans per ring, a power of two
+   uint64_t             tick_hz;      // ticks per second, 1000000000 when ticks are CLOCK_MONOTONIC ns
+   uint64_t             tick_base;    // ticks when the object was created
+   uint64_t             realtime_ns;  // CLOCK_REALTIME at tick_base
+   uint32_t             pid;
+   _Atomic uint32_t     sample;       // 1 in sample messages are traced, 0 pauses tracing.  Readers may change it.
+   _Atomic uint32_t     ring_used;    // rings claimed by threads
+   _Atomic uint64_t     dropped;      // spans not recorded because every ring was claimed by a running thread
+} pcl_trace_hdr_t;
+
+typedef struct {
+   alignas(64) _Atomic uint64_t head; // spans recorded, written by the owning thread only
+   _Atomic uint32_t     tid;          // owning thread, 0 until claimed
+   uint32_t             reserved;
+} pcl_trace_ring_hdr_t;
+
+#define PCL_TRACE_HDR_SIZE      (128)
+#define PCL_TRACE_RING_HDR_SIZE (64)
+
+// Trace state of one received message, carried with it to dispatch
+typedef struct {
+   bool     sampled;
+   uint8_t  msg_type;
+   uint32_t len;
+   uint64_t hash;
+   uint64_t mark;  // ticks when the message was queued for dispatch
+} pcl_trace_ctx_t;
+
+typedef struct pcl_trace pcl_trace_t;
+
+pcl_trace_t *pcl_trace_open(const char *name, uint32_t sample, uint32_t ring_size, int *errsv); // creates or replaces the object
+void         pcl_trace_close(pcl_trace_t *trace); // unlinks the object
+void         pcl_trace_sample_rate(pcl_trace_t *trace, uint32_t sample); // 1 in sample messages, 0 pauses tracing
+// Returns true when the next message handled by the calling thread is to be traced, false when trace is NULL
+bool         pcl_trace_sample(pcl_trace_t *trace);
+uint64_t     pcl_trace_now(void);
+uint64_t     pcl_trace_begin(const pcl_trace_ctx_t *ctx); // pcl_trace_now when ctx is sampled, otherwise 0
+// Records a span of ctx from start until now and returns now.  Does nothing and returns 0 unless ctx is sampled.
+uint64_t     pcl_trace_span(pcl_trace_t *trace, const pcl_trace_ctx_t *ctx, pcl_trace_stage_t stage, uint64_t start);
+// FNV-1a, so readers can look up the spans of a transaction_uuid
+uint64_t     pcl_trace_hash(const char *str, size_t len);
+
+// The message being dispatched by the calling thread, so that the spans of sends made by its handler are attributed to it
+const pcl_trace_ctx_t *pcl_trace_enter(pcl_trace_t *trace, const pcl_trace_ctx_t *ctx); // returns the previous one for pcl_trace_leave
+void                   pcl_trace_leave(pcl_trace_t *trace, const pcl_trace_ctx_t *prev);
+const pcl_trace_ctx_t *pcl_trace_current(pcl_trace_t *trace); // NULL outside of a dispatch
+
+// Trace object mapped for reading
+typedef struct {
+   pcl_trace_hdr_t *hdr;
+   size_t           map_len;
+   uint64_t         tail[PCL_TRACE_RING_QTY]; // next span to read from each ring
+} pcl_trace_reader_t;
+
+bool   pcl_trace_reader_open(pcl_trace_reader_t *reader, const char *name, bool writable, int *errsv); // writable to set the sample rate
+void   pcl_trace_reader_close(pcl_trace_reader_t *reader);
+// Copies up to max spans recorded on ring since the last read.  lost (optional) is set to the spans overwritten before they were read.
+size_t pcl_trace_reader_next(pcl_trace_reader_t *reader, uint32_t ring, pcl_trace_span_t *spans, size_t max, uint64_t *lost);
+uint32_t pcl_trace_reader_tid(pcl_trace_reader_t *reader, uint32_t ring);
+uint64_t pcl_trace_ticks_ns(const pcl_trace_hdr_t *hdr, uint64_t ticks); // converts a duration
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "paroduscl_trace.h"
+
+// Reads the spans traced to a trace_name shared memory object while the process writing it runs.  Spans are printed per thread
+// in the order they were recorded, or summarized per stage.
+
+#define PCL_TRACE_DUMP_BATCH   (256)
+#define PCL_TRACE_DUMP_POLL_MS (100)
+
+typedef struct {
+   uint64_t count;
+   uint64_t sum_ns;
+   uint64_t max_ns;
+} pcl_trace_dump_stage_t;
+
+static const char *pcl_trace_dump_stage_str[PCL_TRACE_STAGE_QTY] = { "recv", "filter", "decode", "queue", "match", "handler", "send" };
+
+static volatile sig_atomic_t pcl_trace_dump_stop;
+
+static uint64_t pcl_trace_dump_read(pcl_trace_reader_t *reader, bool summary, bool match_uuid, uint64_t uuid_hash, pcl_trace_dump_stage_t *stages);
+static void     pcl_trace_dump_signal(int sig);
+static void     pcl_trace_dump_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+   bool        follow  = false;
+   bool        summary = false;
+   const char *uuid    = NULL;
+   long        sample  = -1;
+   int         opt;
+
+   while((opt = getopt(argc, argv, "fu:s:Sh")) != -1) {
+      switch(opt) {
+         case 'f': { follow  = true;                  break; }
+         case 'u': { uuid    = optarg;                break; }
+         case 's': { sample  = strtol(optarg, NULL, 10); break; }
+         case 'S': { summary = true;                  break; }
+         default: {
+            pcl_trace_dump_usage(argv[0]);
+            return(EXIT_FAILURE);
+         }
+      }
+   }
+   if(optind != argc - 1 || sample < -1 || sample > UINT32_MAX) {
+      pcl_trace_dump_usage(argv[0]);
+      return(EXIT_FAILURE);
+   }
+   const char *name = argv[optind];
+
+   pcl_trace_reader_t reader;
+   int                errsv = 0;
+   if(!pcl_trace_reader_open(&reader, name, sample >= 0, &errsv)) {
+      fprintf(stderr, "%s: %s\n", name, strerror(errsv));
+      return(EXIT_FAILURE);
+   }
+   if(sample >= 0) {
+      atomic_store(&reader.hdr->sample, (uint32_t)sample);
+      if(!follow) { // only changing the rate
+         pcl_trace_reader_close(&reader);
+         return(EXIT_SUCCESS);
+      }
+   }
+
+   signal(SIGINT, pcl_trace_dump_signal);
+   signal(SIGTERM, pcl_trace_dump_signal);
+
+   pcl_trace_dump_stage_t stages[PCL_TRACE_STAGE_QTY];
+   memset(stages, 0, sizeof(stages));
+   uint64_t uuid_hash = (uuid != NULL) ? pcl_trace_hash(uuid, strlen(uuid)) : 0;
+   uint64_t lost      = pcl_trace_dump_read(&reader, summary, uuid != NULL, uuid_hash, stages);
+   while(follow && !pcl_trace_dump_stop) {
+      struct timespec ts = { 0, PCL_TRACE_DUMP_POLL_MS * 1000000 };
+      nanosleep(&ts, NULL);
+      lost += pcl_trace_dump_read(&reader, summary, uuid != NULL, uuid_hash, stages);
+   }
+
+   if(summary) {
+      printf("%-8s %10s %12s %12s\n", "stage", "spans", "mean us", "max us");
+      for(uint32_t stage = 0; stage < PCL_TRACE_STAGE_QTY; stage++) {
+         double mean = (stages[stage].count > 0) ? stages[stage].sum_ns / 1e3 / stages[stage].count : 0;
+         printf("%-8s %10llu %12.3f %12.3f\n", pcl_trace_dump_stage_str[stage], (unsigned long long)stages[stage].count, mean, stages[stage].max_ns / 1e3);
+      }
+   }
+   fprintf(stderr, "sample 1 in %u, %u threads, %llu spans overwritten before read, %llu dropped without a ring\n", atomic_load(&reader.hdr->sample),
+           atomic_load(&reader.hdr->ring_used), (unsigned long long)lost, (unsigned long long)atomic_load(&reader.hdr->dropped));
+   pcl_trace_reader_close(&reader);
+   return(EXIT_SUCCESS);
+}
+
+uint64_t pcl_trace_dump_read(pcl_trace_reader_t *reader, bool summary, bool match_uuid, uint64_t uuid_hash, pcl_trace_dump_stage_t *stages) {
+   pcl_trace_span_t spans[PCL_TRACE_DUMP_BATCH];
+   uint64_t         lost_total = 0;
+   uint32_t         ring_qty   = atomic_load(&reader->hdr->ring_used);
+
+   for(uint32_t ring = 0; ring < ring_qty && ring < reader->hdr->ring_qty; ring++) {
+      size_t   qty;
+      uint64_t lost;
+      while((qty = pcl_trace_reader_next(reader, ring, spans, PCL_TRACE_DUMP_BATCH, &lost)) > 0 || lost > 0) {
+         lost_total += lost;
+         for(size_t index = 0; index < qty; index++) {
+            const pcl_trace_span_t *span = &spans[index];
+            if((match_uuid && span->uuid_hash != uuid_hash) || span->stage >= PCL_TRACE_STAGE_QTY) {
+               continue;
+            }
+            uint64_t duration_ns = pcl_trace_ticks_ns(reader->hdr, span->duration);
+            if(summary) {
+               stages[span->stage].count++;
+               stages[span->stage].sum_ns += duration_ns;
+               if(duration_ns > stages[span->stage].max_ns) {
+                  stages[span->stage].max_ns = duration_ns;
+               }
+               continue;
+            }
+            uint64_t time_ns = reader->hdr->realtime_ns + pcl_trace_ticks_ns(reader->hdr, span->start - reader->hdr->tick_base);
+            printf("%llu.%06llu %6u %-7s %2u %016llx %10.3f us %6u\n", (unsigned long long)(time_ns / 1000000000), (unsigned long long)(time_ns % 1000000000) / 1000,
+                   pcl_trace_reader_tid(reader, ring), pcl_trace_dump_stage_str[span->stage], span->msg_type, (unsigned long long)span->uuid_hash,
+                   duration_ns / 1e3, span->len);
+         }
+      }
+   }
+   fflush(stdout);
+   return(lost_total);
+}
+
+void pcl_trace_dump_signal(int sig) {
+   pcl_trace_dump_stop = 1;
+}
+
+void pcl_trace_dump_usage(const char *name) {
+   fprintf(stderr, "usage: %s [-f] [-u uuid] [-s sample] [-S] name\n", name);
+   fprintf(stderr, "  -f          follow, reading new spans until interrupted\n");
+   fprintf(stderr, "  -u uuid     only spans of messages with this transaction_uuid\n");
+   fprintf(stderr, "  -s sample   trace 1 in sample messages from now on, 0 to pause.  Exits unless following.\n");
+   fprintf(stderr, "  -S          per stage span count, mean and max instead of the spans\n");
+}
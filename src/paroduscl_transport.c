@@ -0,0 +1,148 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <nanomsg/nn.h>
+#include <nanomsg/pipeline.h>
+#include "paroduscl.h"
+#include "paroduscl_transport.h"
+
+#define PCL_SHM_SCHEME "shm://"
+
+static pcl_result_t pcl_nn_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv);
+static void         pcl_nn_shutdown(pcl_sock_t *sock);
+static void         pcl_nn_close(pcl_sock_t *sock);
+static int          pcl_nn_recv(pcl_sock_t *sock, void **msg, int flags);
+static int          pcl_nn_send(pcl_sock_t *sock, const void *buf, size_t len, int flags);
+static int          pcl_nn_send_msg(pcl_sock_t *sock, void *msg, size_t len, int flags);
+static void *       pcl_nn_msg_alloc(size_t len);
+static void         pcl_nn_msg_free(void *msg);
+
+const pcl_transport_t pcl_transport_nn = {
+   .open      = pcl_nn_open,
+   .shutdown  = pcl_nn_shutdown,
+   .close     = pcl_nn_close,
+   .recv      = pcl_nn_recv,
+   .send      = pcl_nn_send,
+   .send_msg  = pcl_nn_send_msg,
+   .msg_alloc = pcl_nn_msg_alloc,
+   .msg_free  = pcl_nn_msg_free,
+};
+
+pcl_result_t pcl_sock_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv) {
+   sock->transport = (strncmp(url, PCL_SHM_SCHEME, strlen(PCL_SHM_SCHEME)) == 0) ? &pcl_transport_shm : &pcl_transport_nn;
+   sock->shut      = false;
+
+   pcl_result_t result = sock->transport->open(sock, url, recv, errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      sock->transport = NULL;
+   }
+   return(result);
+}
+
+void pcl_sock_shutdown(pcl_sock_t *sock) {
+   if(sock->transport != NULL && !sock->shut) {
+      sock->shut = true;
+      sock->transport->shutdown(sock);
+   }
+}
+
+void pcl_sock_close(pcl_sock_t *sock) {
+   if(sock->transport != NULL) {
+      sock->transport->close(sock);
+      sock->transport = NULL;
+   }
+}
+
+pcl_result_t pcl_nn_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv) {
+   sock->sock = nn_socket(AF_SP, recv ? NN_PULL : NN_PUSH);
+   if(sock->sock < 0) {
+      *errsv = errno;
+      return(recv ? PCL_RESULT_ERROR_SOCK_RECV_CREATE : PCL_RESULT_ERROR_SOCK_SEND_CREATE);
+   }
+   if(recv) {
+      if(sock->timeout > 0 && nn_setsockopt(sock->sock, NN_SOL_SOCKET, NN_RCVTIMEO, &sock->timeout, sizeof(sock->timeout)) < 0) {
+         *errsv = errno;
+         pcl_nn_close(sock);
+         return(PCL_RESULT_ERROR_SOCK_RECV_SETOPT);
+      }
+      if(nn_bind(sock->sock, url) < 0) {
+         *errsv = errno;
+         pcl_nn_close(sock);
+         return(PCL_RESULT_ERROR_SOCK_RECV_BIND);
+      }
+   } else {
+      if(nn_setsockopt(sock->sock, NN_SOL_SOCKET, NN_SNDTIMEO, &sock->timeout, sizeof(sock->timeout)) < 0) {
+         *errsv = errno;
+         pcl_nn_close(sock);
+         return(PCL_RESULT_ERROR_SOCK_SEND_SETOPT);
+      }
+      if(nn_connect(sock->sock, url) < 0) {
+         *errsv = errno;
+         pcl_nn_close(sock);
+         return(PCL_RESULT_ERROR_SOCK_SEND_CONNECT);
+      }
+   }
+   size_t optvallen = sizeof(sock->fd);
+   if(nn_getsockopt(sock->sock, NN_SOL_SOCKET, recv ? NN_RCVFD : NN_SNDFD, &sock->fd, &optvallen) < 0 || optvallen != sizeof(sock->fd)) {
+      *errsv = errno;
+      pcl_nn_close(sock);
+      return(recv ? PCL_RESULT_ERROR_SOCK_RECV_GETOPT : PCL_RESULT_ERROR_SOCK_SEND_GETOPT);
+   }
+   return(PCL_RESULT_SUCCESS);
+}
+
+void pcl_nn_shutdown(pcl_sock_t *sock) {
+   // Messages nn_send has already queued get up to the socket timeout to reach the peer before nn_close drops them.  nn_close
+   // wakes blocked calls and waits for them to return.
+   int linger = (sock->timeout > 0) ? sock->timeout : 0;
+   nn_setsockopt(sock->sock, NN_SOL_SOCKET, NN_LINGER, &linger, sizeof(linger));
+   nn_close(sock->sock);
+}
+
+void pcl_nn_close(pcl_sock_t *sock) {
+   if(sock->sock >= 0 && !sock->shut) {
+      nn_shutdown(sock->sock, 0);
+      nn_close(sock->sock);
+   }
+   sock->sock = -1;
+   sock->fd   = -1;
+}
+
+int pcl_nn_recv(pcl_sock_t *sock, void **msg, int flags) {
+   return(nn_recv(sock->sock, msg, NN_MSG, (flags & PCL_SOCK_DONTWAIT) ? NN_DONTWAIT : 0));
+}
+
+int pcl_nn_send(pcl_sock_t *sock, const void *buf, size_t len, int flags) {
+   return(nn_send(sock->sock, buf, len, (flags & PCL_SOCK_DONTWAIT) ? NN_DONTWAIT : 0));
+}
+
+int pcl_nn_send_msg(pcl_sock_t *sock, void *msg, size_t len, int flags) {
+   return(nn_send(sock->sock, &msg, NN_MSG, (flags & PCL_SOCK_DONTWAIT) ? NN_DONTWAIT : 0));
+}
+
+void *pcl_nn_msg_alloc(size_t len) {
+   return(nn_allocmsg(len, 0));
+}
+
+void pcl_nn_msg_free(void *msg) {
+   nn_freemsg(msg);
+}
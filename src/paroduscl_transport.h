@@ -0,0 +1,61 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_TRANSPORT__
+#define __PARODUS_CLIENT_LIB_TRANSPORT__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "paroduscl.h"
+
+#define PCL_SOCK_DONTWAIT (1)
+
+typedef struct pcl_transport pcl_transport_t;
+
+typedef struct {
+   const pcl_transport_t *transport;
+   int                    sock;     // nanomsg socket
+   int                    fd;       // readable when a message can be received (receive side) or sent (send side)
+   int                    timeout;  // in milliseconds
+   bool                   shut;     // woken by pcl_sock_shutdown
+   void *                 priv;     // transport state
+} pcl_sock_t;
+
+// Message buffers returned by recv and passed to send_msg are allocated with the transport's msg_alloc.  recv and send return the
+// message length, or -1 with errno set to EAGAIN (PCL_SOCK_DONTWAIT and not ready), ETIMEDOUT or the transport's error.
+struct pcl_transport {
+   pcl_result_t (*open)(pcl_sock_t *sock, const char *url, bool recv, int *errsv);  // the receive side binds, the send side connects
+   void         (*shutdown)(pcl_sock_t *sock);                                     // wakes calls blocked on the socket
+   void         (*close)(pcl_sock_t *sock);
+   int          (*recv)(pcl_sock_t *sock, void **msg, int flags);
+   int          (*send)(pcl_sock_t *sock, const void *buf, size_t len, int flags);  // copies buf
+   int          (*send_msg)(pcl_sock_t *sock, void *msg, size_t len, int flags);    // takes ownership of msg on success
+   void *       (*msg_alloc)(size_t len);
+   void         (*msg_free)(void *msg);
+};
+
+extern const pcl_transport_t pcl_transport_nn;
+extern const pcl_transport_t pcl_transport_shm;
+
+// Opens sock with the transport selected by the url scheme (shm:// or any nanomsg url)
+pcl_result_t pcl_sock_open(pcl_sock_t *sock, const char *url, bool recv, int *errsv);
+void         pcl_sock_shutdown(pcl_sock_t *sock);
+void         pcl_sock_close(pcl_sock_t *sock);
+
+#endif
@@ -60,6 +60,12 @@ const char *pcl_result_str(pcl_result_t result) {
       case PCL_RESULT_ERROR_SOCK_SEND_AUTH:    return("ERROR_SOCK_SEND_AUTH");
       case PCL_RESULT_ERROR_REGISTER:          return("ERROR_REGISTER");
       case PCL_RESULT_ERROR_INTERNAL:          return("ERROR_INTERNAL");
+      case PCL_RESULT_ERROR_SEND_QUEUE_FULL:   return("ERROR_SEND_QUEUE_FULL");
+      case PCL_RESULT_ERROR_SEND_ABORTED:      return("ERROR_SEND_ABORTED");
+      case PCL_RESULT_ERROR_REQUEST_TIMEOUT:   return("ERROR_REQUEST_TIMEOUT");
+      case PCL_RESULT_ERROR_SERVICE_LIMIT:     return("ERROR_SERVICE_LIMIT");
+      case PCL_RESULT_ERROR_CLOSED:            return("ERROR_CLOSED");
+      case PCL_RESULT_ERROR_SHED:              return("ERROR_SHED");
       case PCL_RESULT_INVALID:                 return("INVALID");
    }
    return(pcl_invalid_return(result));
@@ -0,0 +1,494 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "paroduscl.h"
+#include "standin.h"
+#include "loopback.h"
+
+// Benchmarks the library against the loopback stand-in.  Run without options it does a short pass over every section, as part of
+// make check; -c raises the message count for stable numbers.
+//
+// rtt: the stand-in sends requests to the client, which answers each from its handler.  Reports messages per second, round trip
+// latency percentiles and heap allocations per message made on the client's receive thread (receive, decode, dispatch and the
+// response's send) for each transport and payload size.
+//
+// batch: the stand-in sends bursts of events that the client drains with pcl_recv, one message per call, or pcl_recv_batch.
+// Reports the drain rate and allocations per message on the receiving thread.
+//
+// send: the client sends events to the stand-in with pcl_send, encoded by wrp_struct_to and copied by the socket (the default)
+// or with send_zero_copy.  Reports the latency percentiles of the pcl_send calls and allocations per send on the sending thread.
+//
+// decode: bursts of events drained with pcl_recv_batch and decoded by wrp_to_struct (the default), into pooled arenas
+// (decode_arena) or passed as views (handler_view).  Reports the drain rate, allocations per message on the receiving thread and
+// the arena_alloc counter, which stops growing once the arena pool is warm.
+
+#define BENCH_COUNT_DEFAULT  (2000)
+#define BENCH_WINDOW_DEFAULT (16)
+#define BENCH_BURST          (512)  // fits in the socket buffers, so a burst is sent before it is drained
+#define BENCH_BURST_BYTES    (512 * 1024) // and in half of the shm ring
+#define BENCH_BURST_SETTLE_US (20000)
+
+typedef struct {
+   uint32_t    count;
+   uint32_t    window;
+   const char *transport; // NULL for every transport
+} bench_config_t;
+
+typedef struct {
+   const char *name;
+   bool      (*run)(const bench_config_t *config);
+} bench_section_t;
+
+typedef struct {
+   char       url_parodus[LOOPBACK_URL_LEN_MAX];
+   char       url_client[LOOPBACK_URL_LEN_MAX];
+   standin_t *standin;
+} bench_peer_t;
+
+static bool         bench_rtt(const bench_config_t *config);
+static bool         bench_batch(const bench_config_t *config);
+static bool         bench_send(const bench_config_t *config);
+static bool         bench_decode(const bench_config_t *config);
+static bool         bench_drain(bench_peer_t *peer, uint32_t count, uint32_t payload_size, bool batch, uint64_t *elapsed_ns, uint64_t *allocs);
+static bool         bench_open(bench_peer_t *peer, const char *transport, const char *tag, pcl_params_t *params);
+static void         bench_close(bench_peer_t *peer);
+static pcl_result_t bench_handler_event(struct wrp_event_msg *msg);
+static pcl_result_t bench_handler_view(const pcl_msg_view_t *msg);
+static int          bench_cmp_u64(const void *a, const void *b);
+static bool bench_transport_skip(const bench_config_t *config, const char *transport);
+static void bench_count_thread(void);
+static void bench_usage(const char *name);
+
+static const bench_section_t bench_sections[] = {
+   { "rtt",   bench_rtt   },
+   { "batch", bench_batch },
+   { "send",  bench_send  },
+   { "decode", bench_decode },
+};
+
+static const char *   bench_transports[]    = { "tcp", "ipc", "inproc", "shm" };
+static const uint32_t bench_payload_sizes[] = { 16, 256, 4096, 65536 };
+
+// Allocation counting.  Heap allocations are counted on threads that called bench_count_thread, by wrapping the allocator.
+static _Thread_local bool   bench_counted;
+static atomic_uint_fast64_t bench_allocs;
+static atomic_uint_fast64_t bench_events;
+
+#ifdef __GLIBC__
+#define BENCH_ALLOCS_COUNTED (true)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+   if(bench_counted) {
+      atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+   }
+   return(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size) {
+   if(bench_counted) {
+      atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+   }
+   return(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size) {
+   if(bench_counted) {
+      atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+   }
+   return(__libc_realloc(ptr, size));
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+   if(bench_counted) {
+      atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+   }
+   void *ptr = __libc_memalign(alignment, size);
+   if(ptr == NULL) {
+      return(ENOMEM);
+   }
+   *memptr = ptr;
+   return(0);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+   if(bench_counted) {
+      atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+   }
+   return(__libc_memalign(alignment, size));
+}
+#else
+#define BENCH_ALLOCS_COUNTED (false)
+#endif
+
+int main(int argc, char *argv[]) {
+   bench_config_t config;
+   const char *   section = NULL;
+   int            opt;
+
+   config.count     = BENCH_COUNT_DEFAULT;
+   config.window    = BENCH_WINDOW_DEFAULT;
+   config.transport = NULL;
+
+   while((opt = getopt(argc, argv, "c:w:t:s:h")) != -1) {
+      switch(opt) {
+         case 'c': { config.count     = atoi(optarg); break; }
+         case 'w': { config.window    = atoi(optarg); break; }
+         case 't': { config.transport = optarg;       break; }
+         case 's': { section          = optarg;       break; }
+         default: {
+            bench_usage(argv[0]);
+            return(EXIT_FAILURE);
+         }
+      }
+   }
+   if(optind != argc || config.count == 0) {
+      bench_usage(argv[0]);
+      return(EXIT_FAILURE);
+   }
+   if(!BENCH_ALLOCS_COUNTED) {
+      printf("bench: allocations are only counted with glibc\n");
+   }
+
+   bool ok = true;
+   for(size_t index = 0; index < sizeof(bench_sections) / sizeof(bench_sections[0]); index++) {
+      if(section == NULL || strcmp(section, bench_sections[index].name) == 0) {
+         ok = bench_sections[index].run(&config) && ok;
+      }
+   }
+   return(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+bool bench_rtt(const bench_config_t *config) {
+   bool ok = true;
+
+   printf("%-8s %-7s %8s %10s %10s %10s %10s %11s\n", "rtt", "url", "payload", "msgs/s", "p50 us", "p99 us", "p999 us", "allocs/msg");
+   for(size_t transport = 0; transport < sizeof(bench_transports) / sizeof(bench_transports[0]); transport++) {
+      if(bench_transport_skip(config, bench_transports[transport])) {
+         continue;
+      }
+      bench_peer_t peer;
+      pcl_params_t params;
+      memset(&params, 0, sizeof(params));
+      loopback_echo_params(&params);
+      if(!bench_open(&peer, bench_transports[transport], "rtt", &params)) {
+         ok = false;
+         continue;
+      }
+      loopback_run_start(loopback_object, bench_count_thread);
+
+      for(size_t size = 0; ok && size < sizeof(bench_payload_sizes) / sizeof(bench_payload_sizes[0]); size++) {
+         standin_load_t load;
+         memset(&load, 0, sizeof(load));
+         load.msg_type     = WRP_MSG_TYPE__REQ;
+         load.count        = config->count;
+         load.payload_size = bench_payload_sizes[size];
+         load.window       = config->window;
+         load.answered     = true;
+
+         standin_load_result_t result;
+         uint64_t allocs = atomic_load(&bench_allocs);
+         if(!standin_load(peer.standin, LOOPBACK_SERVICE, &load, &result)) {
+            printf("rtt: %s payload %u answered %u of %u\n", bench_transports[transport], load.payload_size, result.answered, load.count);
+            ok = false;
+            break;
+         }
+         allocs = atomic_load(&bench_allocs) - allocs;
+         printf("%-8s %-7s %8u %10.0f %10.1f %10.1f %10.1f %11.2f\n", "", bench_transports[transport], load.payload_size,
+                result.answered / (result.elapsed_ns / 1e9), result.rtt_p50_ns / 1e3, result.rtt_p99_ns / 1e3,
+                result.rtt_p999_ns / 1e3, (double)allocs / result.answered);
+      }
+
+      loopback_run_stop();
+      bench_close(&peer);
+   }
+   return(ok);
+}
+
+bool bench_batch(const bench_config_t *config) {
+   bool ok = true;
+
+   printf("%-8s %-7s %8s %10s %11s\n", "batch", "url", "recv", "msgs/s", "allocs/msg");
+   for(size_t transport = 0; transport < sizeof(bench_transports) / sizeof(bench_transports[0]); transport++) {
+      if(bench_transport_skip(config, bench_transports[transport])) {
+         continue;
+      }
+      bench_peer_t peer;
+      pcl_params_t params;
+      memset(&params, 0, sizeof(params));
+      params.handler_event = bench_handler_event;
+      if(!bench_open(&peer, bench_transports[transport], "batch", &params)) {
+         ok = false;
+         continue;
+      }
+
+      for(uint32_t batch = 0; ok && batch < 2; batch++) {
+         uint64_t elapsed_ns = 0;
+         uint64_t allocs     = 0;
+         ok = bench_drain(&peer, config->count, 64, batch, &elapsed_ns, &allocs);
+         if(ok) {
+            printf("%-8s %-7s %8s %10.0f %11.2f\n", "", bench_transports[transport], batch ? "batch" : "single",
+                   config->count / (elapsed_ns / 1e9), (double)allocs / config->count);
+         }
+      }
+      bench_close(&peer);
+   }
+   return(ok);
+}
+
+bool bench_send(const bench_config_t *config) {
+   bool      ok         = true;
+   uint64_t *latency_ns = (uint64_t *)malloc(config->count * sizeof(uint64_t));
+   uint8_t   payload[4096];
+   memset(payload, 0xa5, sizeof(payload));
+   if(latency_ns == NULL) {
+      return(false);
+   }
+
+   printf("%-8s %-7s %8s %-9s %10s %10s %10s %11s\n", "send", "url", "payload", "encode", "p50 us", "p99 us", "p999 us", "allocs/msg");
+   for(size_t transport = 0; transport < sizeof(bench_transports) / sizeof(bench_transports[0]); transport++) {
+      if(bench_transport_skip(config, bench_transports[transport])) {
+         continue;
+      }
+      for(uint32_t zero_copy = 0; ok && zero_copy < 2; zero_copy++) {
+         bench_peer_t peer;
+         bool         send_zero_copy = zero_copy;
+         pcl_params_t params;
+         memset(&params, 0, sizeof(params));
+         params.send_zero_copy = &send_zero_copy;
+         if(!bench_open(&peer, bench_transports[transport], "send", &params)) {
+            ok = false;
+            break;
+         }
+
+         const uint32_t sizes[] = { 64, sizeof(payload) };
+         for(size_t size = 0; ok && size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+            wrp_msg_t msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_type             = WRP_MSG_TYPE__EVENT;
+            msg.u.event.source       = LOOPBACK_SERVICE;
+            msg.u.event.dest         = "event:bench";
+            msg.u.event.content_type = "application/octet-stream";
+            msg.u.event.payload      = payload;
+            msg.u.event.payload_size = sizes[size];
+
+            uint64_t received = standin_received(peer.standin, WRP_MSG_TYPE__EVENT);
+            uint64_t allocs   = 0;
+            for(uint32_t index = 0; ok && index < config->count; index++) {
+               int errsv = 0;
+               bench_counted    = true;
+               uint64_t count   = atomic_load(&bench_allocs);
+               uint64_t start   = standin_time_ns();
+               ok               = (pcl_send(loopback_object, &msg, &errsv) == PCL_RESULT_SUCCESS);
+               latency_ns[index] = standin_time_ns() - start;
+               allocs          += atomic_load(&bench_allocs) - count;
+               bench_counted    = false;
+            }
+            for(int wait = 0; ok && wait < 1000 && standin_received(peer.standin, WRP_MSG_TYPE__EVENT) < received + config->count; wait++) {
+               usleep(1000);
+            }
+            if(!ok || standin_received(peer.standin, WRP_MSG_TYPE__EVENT) != received + config->count) {
+               printf("send: %s received %u of %u\n", bench_transports[transport], (uint32_t)(standin_received(peer.standin, WRP_MSG_TYPE__EVENT) - received), config->count);
+               ok = false;
+               break;
+            }
+            qsort(latency_ns, config->count, sizeof(uint64_t), bench_cmp_u64);
+            printf("%-8s %-7s %8u %-9s %10.1f %10.1f %10.1f %11.2f\n", "", bench_transports[transport], sizes[size],
+                   zero_copy ? "zero-copy" : "copy", latency_ns[(uint64_t)config->count * 50 / 100] / 1e3,
+                   latency_ns[(uint64_t)config->count * 99 / 100] / 1e3, latency_ns[(uint64_t)config->count * 999 / 1000] / 1e3,
+                   (double)allocs / config->count);
+         }
+         bench_close(&peer);
+      }
+   }
+   free(latency_ns);
+   return(ok);
+}
+
+bool bench_decode(const bench_config_t *config) {
+   bool ok = true;
+
+   printf("%-8s %-7s %8s %-7s %10s %11s %11s\n", "decode", "url", "payload", "mode", "msgs/s", "allocs/msg", "arena_alloc");
+   for(size_t transport = 0; transport < sizeof(bench_transports) / sizeof(bench_transports[0]); transport++) {
+      if(bench_transport_skip(config, bench_transports[transport])) {
+         continue;
+      }
+      const char *modes[] = { "struct", "arena", "view" };
+      for(uint32_t mode = 0; ok && mode < sizeof(modes) / sizeof(modes[0]); mode++) {
+         bench_peer_t peer;
+         bool         decode_arena = (mode == 1);
+         pcl_params_t params;
+         memset(&params, 0, sizeof(params));
+         params.handler_event = bench_handler_event;
+         params.handler_view  = (mode == 2) ? bench_handler_view : NULL;
+         params.decode_arena  = &decode_arena;
+         if(!bench_open(&peer, bench_transports[transport], "decode", &params)) {
+            ok = false;
+            break;
+         }
+         const uint32_t sizes[] = { 64, 4096 };
+         for(size_t size = 0; ok && size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+            uint64_t elapsed_ns = 0;
+            uint64_t allocs     = 0;
+            ok = bench_drain(&peer, config->count, sizes[size], true, &elapsed_ns, &allocs);
+            pcl_stats_t stats;
+            pcl_stats_get(loopback_object, &stats);
+            if(ok) {
+               printf("%-8s %-7s %8u %-7s %10.0f %11.2f %11llu\n", "", bench_transports[transport], sizes[size], modes[mode],
+                      config->count / (elapsed_ns / 1e9), (double)allocs / config->count, (unsigned long long)stats.arena_alloc);
+            }
+         }
+         bench_close(&peer);
+      }
+   }
+   return(ok);
+}
+
+bool bench_drain(bench_peer_t *peer, uint32_t count, uint32_t payload_size, bool batch, uint64_t *elapsed_ns, uint64_t *allocs) {
+   uint32_t burst   = BENCH_BURST_BYTES / (payload_size + 256);
+   uint32_t drained = 0;
+   if(burst > BENCH_BURST) {
+      burst = BENCH_BURST;
+   }
+   while(drained < count) {
+      standin_load_t load;
+      memset(&load, 0, sizeof(load));
+      load.msg_type     = WRP_MSG_TYPE__EVENT;
+      load.count        = (count - drained < burst) ? count - drained : burst;
+      load.payload_size = payload_size;
+
+      standin_load_result_t result;
+      atomic_store(&bench_events, 0);
+      if(!standin_load(peer->standin, LOOPBACK_SERVICE, &load, &result)) {
+         return(false);
+      }
+      usleep(BENCH_BURST_SETTLE_US);
+
+      // Only the draining is timed and counted
+      bench_counted         = true;
+      uint64_t allocs_start = atomic_load(&bench_allocs);
+      uint64_t start        = standin_time_ns();
+      uint64_t timeout      = start + 5000000000ull;
+      while(atomic_load(&bench_events) < load.count && standin_time_ns() < timeout) {
+         int errsv = 0;
+         if(batch) {
+            pcl_batch_result_t batch_result;
+            pcl_recv_batch(loopback_object, 64, 0, &batch_result, &errsv);
+         } else {
+            pcl_recv(loopback_object, &errsv);
+         }
+      }
+      *elapsed_ns  += standin_time_ns() - start;
+      *allocs      += atomic_load(&bench_allocs) - allocs_start;
+      bench_counted = false;
+      if(atomic_load(&bench_events) < load.count) {
+         printf("drain: %s drained %u of %u\n", peer->url_client, (uint32_t)atomic_load(&bench_events), load.count);
+         return(false);
+      }
+      drained += load.count;
+   }
+   return(true);
+}
+
+bool bench_open(bench_peer_t *peer, const char *transport, const char *tag, pcl_params_t *params) {
+   loopback_urls(transport, tag, peer->url_parodus, peer->url_client);
+
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus = peer->url_parodus;
+   peer->standin = standin_start(&standin_params);
+   if(peer->standin == NULL) {
+      return(false);
+   }
+
+   params->service_name = LOOPBACK_SERVICE;
+   params->url_parodus  = peer->url_parodus;
+   params->url_client   = peer->url_client;
+   int errsv = 0;
+   if(pcl_init(&loopback_object, NULL, NULL, &errsv, params) != PCL_RESULT_SUCCESS) {
+      standin_stop(peer->standin);
+      return(false);
+   }
+   // AUTH is handled by pcl_recv, so wait for the registration and take the AUTH from the socket here
+   if(!standin_wait_registered(peer->standin, LOOPBACK_SERVICE, 1, 2000)) {
+      bench_close(peer);
+      return(false);
+   }
+   for(int attempt = 0; attempt < 100 && !pcl_service_authorized(loopback_object, LOOPBACK_SERVICE, NULL); attempt++) {
+      pcl_batch_result_t batch;
+      pcl_recv_batch(loopback_object, 64, 0, &batch, &errsv);
+      usleep(1000);
+   }
+   if(!pcl_service_authorized(loopback_object, LOOPBACK_SERVICE, NULL)) {
+      bench_close(peer);
+      return(false);
+   }
+   return(true);
+}
+
+void bench_close(bench_peer_t *peer) {
+   int errsv = 0;
+   pcl_term(loopback_object, &errsv);
+   loopback_object = NULL;
+   standin_stop(peer->standin);
+   loopback_urls_cleanup(peer->url_parodus, peer->url_client);
+}
+
+pcl_result_t bench_handler_event(struct wrp_event_msg *msg) {
+   atomic_fetch_add(&bench_events, 1);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t bench_handler_view(const pcl_msg_view_t *msg) {
+   atomic_fetch_add(&bench_events, 1);
+   return(PCL_RESULT_SUCCESS);
+}
+
+int bench_cmp_u64(const void *a, const void *b) {
+   uint64_t lhs = *(const uint64_t *)a;
+   uint64_t rhs = *(const uint64_t *)b;
+   return((lhs > rhs) - (lhs < rhs));
+}
+
+bool bench_transport_skip(const bench_config_t *config, const char *transport) {
+   return(config->transport != NULL && strcmp(config->transport, transport) != 0);
+}
+
+void bench_count_thread(void) {
+   bench_counted = true;
+}
+
+void bench_usage(const char *name) {
+   fprintf(stderr, "usage: %s [-c count] [-w window] [-t transport] [-s section]\n", name);
+   fprintf(stderr, "  -c count      messages per measurement (default %u)\n", BENCH_COUNT_DEFAULT);
+   fprintf(stderr, "  -w window     requests outstanding at most (default %u)\n", BENCH_WINDOW_DEFAULT);
+   fprintf(stderr, "  -t transport  tcp, ipc, inproc or shm (default all)\n");
+   fprintf(stderr, "  -s section    rtt, batch, send or decode (default all)\n");
+}
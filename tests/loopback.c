@@ -0,0 +1,188 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "paroduscl.h"
+#include "loopback.h"
+
+int                  loopback_failures;
+pcl_object_t         loopback_object;
+atomic_uint_fast64_t loopback_handled;
+atomic_uint_fast64_t loopback_alive;
+
+static pthread_t   loopback_thread;
+static bool        loopback_thread_valid;
+static atomic_bool loopback_stop;
+static void      (*loopback_thread_init)(void);
+
+static pcl_result_t loopback_handler_request(struct wrp_req_msg *msg);
+static pcl_result_t loopback_handler_event(struct wrp_event_msg *msg);
+static pcl_result_t loopback_handler_create(struct wrp_crud_msg *msg);
+static pcl_result_t loopback_handler_retrieve(struct wrp_crud_msg *msg);
+static pcl_result_t loopback_handler_update(struct wrp_crud_msg *msg);
+static pcl_result_t loopback_handler_delete(struct wrp_crud_msg *msg);
+static pcl_result_t loopback_handler_crud(enum wrp_msg_type msg_type, struct wrp_crud_msg *msg);
+static pcl_result_t loopback_handler_alive(void);
+static void *       loopback_run_thread(void *data);
+
+bool loopback_urls(const char *transport, const char *tag, char *url_parodus, char *url_client) {
+   int pid = (int)getpid();
+   if(strcmp(transport, "tcp") == 0) {
+      // Ports derived from the pid and tag so tests running in parallel do not collide
+      unsigned int port = 20000 + ((pid * 16 + (unsigned int)(strlen(tag) * 7 + tag[0])) % 20000) * 2;
+      snprintf(url_parodus, LOOPBACK_URL_LEN_MAX, "tcp://127.0.0.1:%u", port);
+      snprintf(url_client, LOOPBACK_URL_LEN_MAX, "tcp://127.0.0.1:%u", port + 1);
+   } else if(strcmp(transport, "ipc") == 0) {
+      snprintf(url_parodus, LOOPBACK_URL_LEN_MAX, "ipc:///tmp/paroduscl-%d-%s-parodus", pid, tag);
+      snprintf(url_client, LOOPBACK_URL_LEN_MAX, "ipc:///tmp/paroduscl-%d-%s-client", pid, tag);
+   } else if(strcmp(transport, "inproc") == 0 || strcmp(transport, "shm") == 0) {
+      snprintf(url_parodus, LOOPBACK_URL_LEN_MAX, "%s://paroduscl-%d-%s-parodus", transport, pid, tag);
+      snprintf(url_client, LOOPBACK_URL_LEN_MAX, "%s://paroduscl-%d-%s-client", transport, pid, tag);
+   } else {
+      return(false);
+   }
+   return(true);
+}
+
+void loopback_urls_cleanup(const char *url_parodus, const char *url_client) {
+   const char *urls[] = { url_parodus, url_client };
+   for(int index = 0; index < 2; index++) {
+      if(strncmp(urls[index], "ipc://", 6) == 0) {
+         unlink(urls[index] + 6);
+      }
+   }
+}
+
+void loopback_echo_params(pcl_params_t *params) {
+   params->handler_request  = loopback_handler_request;
+   params->handler_event    = loopback_handler_event;
+   params->handler_create   = loopback_handler_create;
+   params->handler_retrieve = loopback_handler_retrieve;
+   params->handler_update   = loopback_handler_update;
+   params->handler_delete   = loopback_handler_delete;
+   params->handler_alive    = loopback_handler_alive;
+}
+
+bool loopback_run_start(pcl_object_t object, void (*thread_init)(void)) {
+   atomic_store(&loopback_stop, false);
+   loopback_thread_init  = thread_init;
+   loopback_thread_valid = (pthread_create(&loopback_thread, NULL, loopback_run_thread, object) == 0);
+   return(loopback_thread_valid);
+}
+
+void loopback_run_stop(void) {
+   if(loopback_thread_valid) {
+      atomic_store(&loopback_stop, true);
+      pthread_join(loopback_thread, NULL);
+      loopback_thread_valid = false;
+   }
+}
+
+bool loopback_wait_authorized(pcl_object_t object, uint32_t timeout_ms) {
+   for(uint32_t waited = 0; waited < timeout_ms; waited += 5) {
+      if(pcl_service_authorized(object, LOOPBACK_SERVICE, NULL)) {
+         return(true);
+      }
+      usleep(5000);
+   }
+   return(pcl_service_authorized(object, LOOPBACK_SERVICE, NULL));
+}
+
+void *loopback_run_thread(void *data) {
+   pcl_object_t object = (pcl_object_t)data;
+   if(loopback_thread_init != NULL) {
+      loopback_thread_init();
+   }
+   while(!atomic_load(&loopback_stop)) {
+      int errsv = 0;
+      pcl_result_t result = pcl_run_once(object, 20, &errsv);
+      if(result == PCL_RESULT_ERROR_CLOSED || result == PCL_RESULT_ERROR_INTERNAL) {
+         break;
+      }
+   }
+   return(NULL);
+}
+
+pcl_result_t loopback_handler_request(struct wrp_req_msg *msg) {
+   wrp_msg_t rsp;
+   memset(&rsp, 0, sizeof(rsp));
+   rsp.msg_type                 = WRP_MSG_TYPE__REQ;
+   rsp.u.req.source             = msg->dest;
+   rsp.u.req.dest               = msg->source;
+   rsp.u.req.transaction_uuid   = msg->transaction_uuid;
+   rsp.u.req.content_type       = msg->content_type;
+   rsp.u.req.payload            = msg->payload;
+   rsp.u.req.payload_size       = msg->payload_size;
+   atomic_fetch_add(&loopback_handled, 1);
+   return(pcl_send(loopback_object, &rsp, NULL));
+}
+
+pcl_result_t loopback_handler_event(struct wrp_event_msg *msg) {
+   wrp_msg_t rsp;
+   memset(&rsp, 0, sizeof(rsp));
+   rsp.msg_type             = WRP_MSG_TYPE__EVENT;
+   rsp.u.event.source       = msg->dest;
+   rsp.u.event.dest         = msg->source;
+   rsp.u.event.payload      = msg->payload;
+   rsp.u.event.payload_size = msg->payload_size;
+   atomic_fetch_add(&loopback_handled, 1);
+   return(pcl_send(loopback_object, &rsp, NULL));
+}
+
+pcl_result_t loopback_handler_create(struct wrp_crud_msg *msg) {
+   return(loopback_handler_crud(WRP_MSG_TYPE__CREATE, msg));
+}
+
+pcl_result_t loopback_handler_retrieve(struct wrp_crud_msg *msg) {
+   return(loopback_handler_crud(WRP_MSG_TYPE__RETREIVE, msg));
+}
+
+pcl_result_t loopback_handler_update(struct wrp_crud_msg *msg) {
+   return(loopback_handler_crud(WRP_MSG_TYPE__UPDATE, msg));
+}
+
+pcl_result_t loopback_handler_delete(struct wrp_crud_msg *msg) {
+   return(loopback_handler_crud(WRP_MSG_TYPE__DELETE, msg));
+}
+
+pcl_result_t loopback_handler_crud(enum wrp_msg_type msg_type, struct wrp_crud_msg *msg) {
+   wrp_msg_t rsp;
+   memset(&rsp, 0, sizeof(rsp));
+   rsp.msg_type                = msg_type;
+   rsp.u.crud.source           = msg->dest;
+   rsp.u.crud.dest             = msg->source;
+   rsp.u.crud.transaction_uuid = msg->transaction_uuid;
+   rsp.u.crud.path             = msg->path;
+   rsp.u.crud.status           = 200;
+   rsp.u.crud.payload          = msg->payload;
+   rsp.u.crud.payload_size     = msg->payload_size;
+   atomic_fetch_add(&loopback_handled, 1);
+   return(pcl_send(loopback_object, &rsp, NULL));
+}
+
+pcl_result_t loopback_handler_alive(void) {
+   atomic_fetch_add(&loopback_alive, 1);
+   return(PCL_RESULT_SUCCESS);
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_LOOPBACK__
+#define __PARODUS_CLIENT_LIB_LOOPBACK__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "paroduscl.h"
+
+// Client side of the tests and benchmarks run against the stand-in: per process urls, echo handlers and a thread running the
+// object's event loop.
+
+#define LOOPBACK_URL_LEN_MAX (128)
+#define LOOPBACK_SERVICE     "loopback"
+
+#define CHECK(cond) do { \
+   if(!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      loopback_failures++; \
+   } \
+} while(0)
+
+extern int                  loopback_failures;
+extern pcl_object_t         loopback_object;  // answered through by the echo handlers
+extern atomic_uint_fast64_t loopback_handled; // messages seen by the echo handlers
+extern atomic_uint_fast64_t loopback_alive;   // SVC_ALIVE messages received
+
+// Fills url_parodus and url_client with addresses unique to this process and tag for transport ("tcp", "ipc", "inproc" or "shm")
+bool loopback_urls(const char *transport, const char *tag, char *url_parodus, char *url_client);
+void loopback_urls_cleanup(const char *url_parodus, const char *url_client);
+// Sets handlers answering requests and crud messages with the same transaction_uuid and source and dest swapped, and sending
+// events back to their source
+void loopback_echo_params(pcl_params_t *params);
+// Runs pcl_run_once on a thread until loopback_run_stop.  thread_init (optional) is called first on the thread.
+bool loopback_run_start(pcl_object_t object, void (*thread_init)(void));
+void loopback_run_stop(void);
+// Waits up to timeout_ms for LOOPBACK_SERVICE to be authorized
+bool loopback_wait_authorized(pcl_object_t object, uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,580 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "paroduscl.h"
+#include "paroduscl_msgpack.h"
+#include "paroduscl_transport.h"
+#include "standin.h"
+
+#define STANDIN_CLIENT_QTY_MAX   (8)
+#define STANDIN_SERVICE_QTY_MAX  (PCL_SERVICE_QTY_MAX)
+#define STANDIN_URL_LEN_MAX      (256)
+#define STANDIN_NAME_LEN_MAX     (64)
+#define STANDIN_TIMEOUT_SEND_MS  (2000)
+#define STANDIN_TIMEOUT_DEFAULT  (5000)
+#define STANDIN_AUTH_DEFAULT     (200)
+#define STANDIN_KEY_PREFIX       "standin-"
+#define STANDIN_DEST_PREFIX      "mac:112233445566/"
+
+typedef struct {
+   char             url[STANDIN_URL_LEN_MAX];
+   pcl_sock_t       sock;
+   pthread_rwlock_t lock; // sends share it, reopening the socket takes it exclusively
+} standin_client_t;
+
+typedef struct {
+   char     name[STANDIN_NAME_LEN_MAX];
+   uint32_t client;
+   uint32_t registrations;
+} standin_service_t;
+
+struct standin {
+   standin_params_t  params;
+   pcl_sock_t        recv;
+   pthread_t         recv_thread;
+   pthread_t         alive_thread;
+   bool              alive_thread_valid;
+   pthread_mutex_t   lock;
+   pthread_cond_t    cond;
+   bool              stop;
+   standin_client_t  clients[STANDIN_CLIENT_QTY_MAX];
+   uint32_t          client_qty;
+   standin_service_t services[STANDIN_SERVICE_QTY_MAX];
+   uint32_t          service_qty;
+   uint64_t          received[PCL_BATCH_MSG_TYPE_MAX];
+   // Load in progress, guarded by lock
+   uint64_t *        sent_ns;
+   uint64_t *        rtt_ns;
+   uint32_t          load_count;
+   uint32_t          answered;
+   uint64_t          answered_ns;
+};
+
+static void *             standin_recv_thread(void *data);
+static void *             standin_alive_thread(void *data);
+static void               standin_register(standin_t *standin, const void *buf, size_t len);
+static void               standin_answer(standin_t *standin, const pcl_wrp_peek_t *peek);
+static bool               standin_key(pcl_str_view_t str, uint32_t *seq);
+static standin_client_t * standin_client_find(standin_t *standin, const char *service_name);
+static bool               standin_client_send(standin_client_t *client, const void *buf, size_t len);
+static bool               standin_encode_send(standin_client_t *client, const wrp_msg_t *msg);
+static void               standin_deadline(struct timespec *deadline, uint32_t timeout_ms);
+static int                standin_cmp_u64(const void *a, const void *b);
+
+standin_t *standin_start(const standin_params_t *params) {
+   standin_t *standin = (standin_t *)calloc(1, sizeof(standin_t));
+   if(standin == NULL) {
+      return(NULL);
+   }
+   if(params != NULL) {
+      standin->params = *params;
+   }
+   if(standin->params.url_parodus == NULL) {
+      standin->params.url_parodus = PCL_URL_PARODUS_DEFAULT;
+   }
+   if(standin->params.auth_status == 0) {
+      standin->params.auth_status = STANDIN_AUTH_DEFAULT;
+   }
+   pthread_mutex_init(&standin->lock, NULL);
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&standin->cond, &attr);
+   pthread_condattr_destroy(&attr);
+
+   int errsv = 0;
+   standin->recv.timeout = 0; // blocks until standin_stop shuts the socket down
+   pcl_result_t result = pcl_sock_open(&standin->recv, standin->params.url_parodus, true, &errsv);
+   if(result != PCL_RESULT_SUCCESS) {
+      printf("standin: unable to bind <%s> <%s> errno <%d>\n", standin->params.url_parodus, pcl_result_str(result), errsv);
+      pthread_cond_destroy(&standin->cond);
+      pthread_mutex_destroy(&standin->lock);
+      free(standin);
+      return(NULL);
+   }
+   if(pthread_create(&standin->recv_thread, NULL, standin_recv_thread, standin) != 0) {
+      pcl_sock_close(&standin->recv);
+      pthread_cond_destroy(&standin->cond);
+      pthread_mutex_destroy(&standin->lock);
+      free(standin);
+      return(NULL);
+   }
+   if(standin->params.alive_period_ms > 0) {
+      standin->alive_thread_valid = (pthread_create(&standin->alive_thread, NULL, standin_alive_thread, standin) == 0);
+   }
+   return(standin);
+}
+
+void standin_stop(standin_t *standin) {
+   if(standin == NULL) {
+      return;
+   }
+   pthread_mutex_lock(&standin->lock);
+   standin->stop = true;
+   pthread_cond_broadcast(&standin->cond);
+   pthread_mutex_unlock(&standin->lock);
+
+   if(standin->alive_thread_valid) {
+      pthread_join(standin->alive_thread, NULL);
+   }
+   pcl_sock_shutdown(&standin->recv);
+   pthread_join(standin->recv_thread, NULL);
+   pcl_sock_close(&standin->recv);
+
+   for(uint32_t index = 0; index < standin->client_qty; index++) {
+      standin_client_t *client = &standin->clients[index];
+      pcl_sock_shutdown(&client->sock);
+      pcl_sock_close(&client->sock);
+      pthread_rwlock_destroy(&client->lock);
+   }
+   free(standin->sent_ns);
+   free(standin->rtt_ns);
+   pthread_cond_destroy(&standin->cond);
+   pthread_mutex_destroy(&standin->lock);
+   free(standin);
+}
+
+uint32_t standin_registrations(standin_t *standin, const char *service_name) {
+   uint32_t registrations = 0;
+   pthread_mutex_lock(&standin->lock);
+   for(uint32_t index = 0; index < standin->service_qty; index++) {
+      if(strcmp(standin->services[index].name, service_name) == 0) {
+         registrations = standin->services[index].registrations;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&standin->lock);
+   return(registrations);
+}
+
+bool standin_wait_registered(standin_t *standin, const char *service_name, uint32_t count, uint32_t timeout_ms) {
+   struct timespec deadline;
+   standin_deadline(&deadline, timeout_ms);
+
+   while(standin_registrations(standin, service_name) < count) {
+      pthread_mutex_lock(&standin->lock);
+      int rc = standin->stop ? ETIMEDOUT : pthread_cond_timedwait(&standin->cond, &standin->lock, &deadline);
+      pthread_mutex_unlock(&standin->lock);
+      if(rc == ETIMEDOUT) {
+         return(standin_registrations(standin, service_name) >= count);
+      }
+   }
+   return(true);
+}
+
+uint64_t standin_received(standin_t *standin, enum wrp_msg_type msg_type) {
+   pthread_mutex_lock(&standin->lock);
+   uint64_t received = ((uint32_t)msg_type < PCL_BATCH_MSG_TYPE_MAX) ? standin->received[msg_type] : 0;
+   pthread_mutex_unlock(&standin->lock);
+   return(received);
+}
+
+bool standin_send(standin_t *standin, const char *service_name, const wrp_msg_t *msg) {
+   standin_client_t *client = standin_client_find(standin, service_name);
+   if(client == NULL) {
+      return(false);
+   }
+   return(standin_encode_send(client, msg));
+}
+
+bool standin_load(standin_t *standin, const char *service_name, const standin_load_t *load, standin_load_result_t *result) {
+   memset(result, 0, sizeof(*result));
+
+   standin_client_t *client = standin_client_find(standin, service_name);
+   if(client == NULL || load->count == 0) {
+      return(false);
+   }
+   uint32_t timeout_ms = load->timeout_ms ? load->timeout_ms : STANDIN_TIMEOUT_DEFAULT;
+   char     dest[STANDIN_URL_LEN_MAX];
+   char     key[32];
+   snprintf(dest, sizeof(dest), STANDIN_DEST_PREFIX "%s/standin", service_name);
+
+   uint8_t *payload = (uint8_t *)malloc(load->payload_size ? load->payload_size : 1);
+   uint64_t *sent_ns = (uint64_t *)calloc(load->count, sizeof(uint64_t));
+   uint64_t *rtt_ns  = (uint64_t *)calloc(load->count, sizeof(uint64_t));
+   if(payload == NULL || sent_ns == NULL || rtt_ns == NULL) {
+      free(payload);
+      free(sent_ns);
+      free(rtt_ns);
+      return(false);
+   }
+   for(uint32_t index = 0; index < load->payload_size; index++) {
+      payload[index] = (uint8_t)index;
+   }
+
+   wrp_msg_t msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_type = load->msg_type;
+   switch(load->msg_type) {
+      case WRP_MSG_TYPE__REQ: {
+         msg.u.req.source           = "standin";
+         msg.u.req.dest             = dest;
+         msg.u.req.transaction_uuid = key;
+         msg.u.req.payload          = payload;
+         msg.u.req.payload_size     = load->payload_size;
+         break;
+      }
+      case WRP_MSG_TYPE__EVENT: {
+         msg.u.event.source       = key;
+         msg.u.event.dest         = dest;
+         msg.u.event.payload      = payload;
+         msg.u.event.payload_size = load->payload_size;
+         break;
+      }
+      default: {
+         msg.u.crud.source           = "standin";
+         msg.u.crud.dest             = dest;
+         msg.u.crud.path             = dest;
+         msg.u.crud.transaction_uuid = key;
+         msg.u.crud.payload          = payload;
+         msg.u.crud.payload_size     = load->payload_size;
+         break;
+      }
+   }
+   snprintf(key, sizeof(key), STANDIN_KEY_PREFIX "%u", load->count);
+   ssize_t buf_size = pcl_wrp_encode(&msg, NULL, 0); // the longest key, every message fits
+   void *  buf      = (buf_size > 0) ? malloc(buf_size) : NULL;
+
+   pthread_mutex_lock(&standin->lock);
+   free(standin->sent_ns);
+   free(standin->rtt_ns);
+   standin->sent_ns     = sent_ns;
+   standin->rtt_ns      = rtt_ns;
+   standin->load_count  = load->count;
+   standin->answered    = 0;
+   standin->answered_ns = 0;
+   pthread_mutex_unlock(&standin->lock);
+
+   bool     ok    = (buf != NULL);
+   uint64_t start = standin_time_ns();
+   for(uint32_t seq = 0; ok && seq < load->count; seq++) {
+      if(load->window > 0) {
+         struct timespec deadline;
+         standin_deadline(&deadline, timeout_ms);
+         pthread_mutex_lock(&standin->lock);
+         while(ok && !standin->stop && seq - standin->answered >= load->window) {
+            ok = (pthread_cond_timedwait(&standin->cond, &standin->lock, &deadline) != ETIMEDOUT);
+         }
+         pthread_mutex_unlock(&standin->lock);
+         if(!ok) {
+            break;
+         }
+      }
+      snprintf(key, sizeof(key), STANDIN_KEY_PREFIX "%u", seq);
+      ssize_t len = pcl_wrp_encode(&msg, buf, buf_size);
+
+      pthread_mutex_lock(&standin->lock);
+      sent_ns[seq] = standin_time_ns();
+      pthread_mutex_unlock(&standin->lock);
+      if(len <= 0 || len > buf_size || !standin_client_send(client, buf, len)) {
+         ok = false;
+         break;
+      }
+      result->sent++;
+   }
+   uint64_t end = standin_time_ns();
+
+   if(ok && load->answered) {
+      struct timespec deadline;
+      standin_deadline(&deadline, timeout_ms);
+      pthread_mutex_lock(&standin->lock);
+      while(ok && !standin->stop && standin->answered < load->count) {
+         ok = (pthread_cond_timedwait(&standin->cond, &standin->lock, &deadline) != ETIMEDOUT);
+      }
+      ok = ok && standin->answered == load->count;
+      pthread_mutex_unlock(&standin->lock);
+   }
+
+   pthread_mutex_lock(&standin->lock);
+   standin->load_count = 0; // later answers are ignored
+   result->answered    = standin->answered;
+   if(load->answered && standin->answered_ns > end) {
+      end = standin->answered_ns;
+   }
+   uint32_t qty = 0;
+   for(uint32_t seq = 0; seq < load->count; seq++) {
+      if(rtt_ns[seq] != 0) {
+         rtt_ns[qty++] = rtt_ns[seq];
+      }
+   }
+   pthread_mutex_unlock(&standin->lock);
+
+   result->elapsed_ns = end - start;
+   if(qty > 0) {
+      qsort(rtt_ns, qty, sizeof(uint64_t), standin_cmp_u64);
+      result->rtt_p50_ns  = rtt_ns[(uint64_t)qty * 50 / 100];
+      result->rtt_p99_ns  = rtt_ns[(uint64_t)qty * 99 / 100];
+      result->rtt_p999_ns = rtt_ns[(uint64_t)qty * 999 / 1000];
+      result->rtt_max_ns  = rtt_ns[qty - 1];
+   }
+   free(buf);
+   free(payload);
+   return(ok);
+}
+
+uint64_t standin_time_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+void *standin_recv_thread(void *data) {
+   standin_t *standin = (standin_t *)data;
+   if(standin->params.thread_init != NULL) {
+      standin->params.thread_init();
+   }
+
+   while(true) {
+      void *buf = NULL;
+      int   len = standin->recv.transport->recv(&standin->recv, &buf, 0);
+      if(len < 0) {
+         if(errno == ETIMEDOUT || errno == EAGAIN || errno == EINTR) {
+            continue;
+         }
+         break; // shut down
+      }
+      pcl_wrp_peek_t peek;
+      if(!pcl_wrp_peek(buf, len, &peek)) {
+         printf("standin: invalid message len <%d>\n", len);
+      } else if(peek.msg_type == WRP_MSG_TYPE__SVC_REGISTRATION) {
+         standin_register(standin, buf, len);
+      } else {
+         standin_answer(standin, &peek);
+         pcl_msg_view_t view;
+         if(standin->params.handler != NULL && pcl_wrp_view_parse(buf, len, &view)) {
+            standin->params.handler(standin->params.handler_ctx, &view);
+         }
+      }
+      standin->recv.transport->msg_free(buf);
+   }
+   return(NULL);
+}
+
+void *standin_alive_thread(void *data) {
+   standin_t *standin = (standin_t *)data;
+   if(standin->params.thread_init != NULL) {
+      standin->params.thread_init();
+   }
+   wrp_msg_t alive;
+   memset(&alive, 0, sizeof(alive));
+   alive.msg_type = WRP_MSG_TYPE__SVC_ALIVE;
+
+   pthread_mutex_lock(&standin->lock);
+   while(!standin->stop) {
+      struct timespec deadline;
+      standin_deadline(&deadline, standin->params.alive_period_ms);
+      while(!standin->stop && pthread_cond_timedwait(&standin->cond, &standin->lock, &deadline) != ETIMEDOUT);
+      if(standin->stop) {
+         break;
+      }
+      uint32_t client_qty = standin->client_qty;
+      pthread_mutex_unlock(&standin->lock);
+      for(uint32_t index = 0; index < client_qty; index++) {
+         standin_encode_send(&standin->clients[index], &alive);
+      }
+      pthread_mutex_lock(&standin->lock);
+   }
+   pthread_mutex_unlock(&standin->lock);
+   return(NULL);
+}
+
+void standin_register(standin_t *standin, const void *buf, size_t len) {
+   wrp_msg_t *reg = NULL;
+   if(wrp_to_struct(buf, len, WRP_BYTES, &reg) < 0 || reg == NULL) {
+      printf("standin: invalid registration\n");
+      return;
+   }
+   const char *name = reg->u.reg.service_name;
+   const char *url  = reg->u.reg.url;
+   if(name == NULL || url == NULL || strlen(name) >= STANDIN_NAME_LEN_MAX || strlen(url) >= STANDIN_URL_LEN_MAX) {
+      printf("standin: invalid registration\n");
+      wrp_free_struct(reg);
+      return;
+   }
+
+   pthread_mutex_lock(&standin->lock);
+   uint32_t client_index;
+   for(client_index = 0; client_index < standin->client_qty; client_index++) {
+      if(strcmp(standin->clients[client_index].url, url) == 0) {
+         break;
+      }
+   }
+   uint32_t service_index;
+   for(service_index = 0; service_index < standin->service_qty; service_index++) {
+      if(strcmp(standin->services[service_index].name, name) == 0) {
+         break;
+      }
+   }
+   if(client_index == STANDIN_CLIENT_QTY_MAX || (service_index == standin->service_qty && service_index == STANDIN_SERVICE_QTY_MAX)) {
+      pthread_mutex_unlock(&standin->lock);
+      printf("standin: too many clients or services\n");
+      wrp_free_struct(reg);
+      return;
+   }
+   standin_client_t *client = &standin->clients[client_index];
+   bool              reopen = (service_index < standin->service_qty && standin->services[service_index].client == client_index);
+   int               errsv  = 0;
+   pcl_result_t      result = PCL_RESULT_SUCCESS;
+   if(client_index == standin->client_qty) {
+      snprintf(client->url, sizeof(client->url), "%s", url);
+      pthread_rwlock_init(&client->lock, NULL);
+      client->sock.timeout = STANDIN_TIMEOUT_SEND_MS;
+      result = pcl_sock_open(&client->sock, url, false, &errsv);
+      if(result == PCL_RESULT_SUCCESS) {
+         standin->client_qty++;
+      } else {
+         pthread_rwlock_destroy(&client->lock);
+      }
+   } else if(reopen) {
+      // The service registered again, so its client may have restarted with a new receive socket
+      pthread_rwlock_wrlock(&client->lock);
+      pcl_sock_shutdown(&client->sock);
+      pcl_sock_close(&client->sock);
+      client->sock.timeout = STANDIN_TIMEOUT_SEND_MS;
+      result = pcl_sock_open(&client->sock, url, false, &errsv);
+      pthread_rwlock_unlock(&client->lock);
+   }
+   if(result != PCL_RESULT_SUCCESS) {
+      pthread_mutex_unlock(&standin->lock);
+      printf("standin: unable to connect <%s> <%s> errno <%d>\n", url, pcl_result_str(result), errsv);
+      wrp_free_struct(reg);
+      return;
+   }
+   if(service_index == standin->service_qty) {
+      snprintf(standin->services[service_index].name, STANDIN_NAME_LEN_MAX, "%s", name);
+      standin->service_qty++;
+   }
+   standin->services[service_index].client = client_index;
+   pthread_mutex_unlock(&standin->lock);
+
+   wrp_msg_t auth;
+   memset(&auth, 0, sizeof(auth));
+   auth.msg_type         = WRP_MSG_TYPE__AUTH;
+   auth.u.auth.status    = standin->params.auth_status;
+   bool sent             = standin_encode_send(client, &auth);
+
+   // Counted once the AUTH is on its way so waiters can send to the client straight away
+   pthread_mutex_lock(&standin->lock);
+   if(sent) {
+      standin->services[service_index].registrations++;
+   }
+   standin->received[WRP_MSG_TYPE__SVC_REGISTRATION]++;
+   pthread_cond_broadcast(&standin->cond);
+   pthread_mutex_unlock(&standin->lock);
+   wrp_free_struct(reg);
+}
+
+void standin_answer(standin_t *standin, const pcl_wrp_peek_t *peek) {
+   uint32_t seq;
+   bool     key = standin_key(peek->transaction_uuid, &seq) || (peek->msg_type == WRP_MSG_TYPE__EVENT && standin_key(peek->dest, &seq));
+
+   pthread_mutex_lock(&standin->lock);
+   if((uint32_t)peek->msg_type < PCL_BATCH_MSG_TYPE_MAX) {
+      standin->received[peek->msg_type]++;
+   }
+   if(key && seq < standin->load_count && standin->sent_ns[seq] != 0 && standin->rtt_ns[seq] == 0) {
+      uint64_t now = standin_time_ns();
+      standin->rtt_ns[seq]  = (now > standin->sent_ns[seq]) ? now - standin->sent_ns[seq] : 1;
+      standin->answered_ns = now;
+      standin->answered++;
+      pthread_cond_broadcast(&standin->cond);
+   }
+   pthread_mutex_unlock(&standin->lock);
+}
+
+bool standin_key(pcl_str_view_t str, uint32_t *seq) {
+   size_t prefix_len = strlen(STANDIN_KEY_PREFIX);
+   if(str.str == NULL || str.len <= prefix_len || str.len > prefix_len + 10 || memcmp(str.str, STANDIN_KEY_PREFIX, prefix_len) != 0) {
+      return(false);
+   }
+   uint64_t value = 0;
+   for(uint32_t pos = prefix_len; pos < str.len; pos++) {
+      if(str.str[pos] < '0' || str.str[pos] > '9') {
+         return(false);
+      }
+      value = value * 10 + (str.str[pos] - '0');
+   }
+   if(value > UINT32_MAX) {
+      return(false);
+   }
+   *seq = (uint32_t)value;
+   return(true);
+}
+
+standin_client_t *standin_client_find(standin_t *standin, const char *service_name) {
+   standin_client_t *client = NULL;
+   pthread_mutex_lock(&standin->lock);
+   for(uint32_t index = 0; index < standin->service_qty; index++) {
+      if(strcmp(standin->services[index].name, service_name) == 0) {
+         client = &standin->clients[standin->services[index].client];
+         break;
+      }
+   }
+   pthread_mutex_unlock(&standin->lock);
+   return(client);
+}
+
+bool standin_client_send(standin_client_t *client, const void *buf, size_t len) {
+   pthread_rwlock_rdlock(&client->lock);
+   int rc = client->sock.transport->send(&client->sock, buf, len, 0);
+   pthread_rwlock_unlock(&client->lock);
+   return(rc == (int)len);
+}
+
+bool standin_encode_send(standin_client_t *client, const wrp_msg_t *msg) {
+   uint8_t stack[256];
+   ssize_t len = pcl_wrp_encode(msg, NULL, 0);
+   if(len <= 0) {
+      return(false);
+   }
+   uint8_t *buf = ((size_t)len <= sizeof(stack)) ? stack : (uint8_t *)malloc(len);
+   if(buf == NULL) {
+      return(false);
+   }
+   pcl_wrp_encode(msg, buf, len);
+   bool sent = standin_client_send(client, buf, len);
+   if(buf != stack) {
+      free(buf);
+   }
+   return(sent);
+}
+
+void standin_deadline(struct timespec *deadline, uint32_t timeout_ms) {
+   clock_gettime(CLOCK_MONOTONIC, deadline);
+   deadline->tv_sec  += timeout_ms / 1000;
+   deadline->tv_nsec += (timeout_ms % 1000) * 1000000;
+   if(deadline->tv_nsec >= 1000000000) {
+      deadline->tv_sec++;
+      deadline->tv_nsec -= 1000000000;
+   }
+}
+
+int standin_cmp_u64(const void *a, const void *b) {
+   uint64_t lhs = *(const uint64_t *)a;
+   uint64_t rhs = *(const uint64_t *)b;
+   return((lhs > rhs) - (lhs < rhs));
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PARODUS_CLIENT_LIB_STANDIN__
+#define __PARODUS_CLIENT_LIB_STANDIN__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "paroduscl.h"
+
+// Loopback stand-in for the parodus daemon.  It binds a PULL socket on url_parodus, answers each SVC_REGISTRATION by connecting
+// a PUSH socket to the registered url and sending an AUTH, sends SVC_ALIVE to every registered client periodically and generates
+// REQ, EVENT and CRUD traffic whose responses it times.  Sockets are opened through the library's transport layer, so any url the
+// client accepts (tcp://, ipc://, inproc:// or shm://) works.
+
+typedef struct standin standin_t;
+
+// Called on the stand-in's receive thread for every message other than a registration
+typedef void (*standin_handler_t)(void *ctx, const pcl_msg_view_t *msg);
+
+typedef struct {
+   const char *      url_parodus;     // NULL to use default value
+   int               auth_status;     // status of the AUTH answering each registration.  0 to use default value (200)
+   uint32_t          alive_period_ms; // SVC_ALIVE sent to every registered client this often.  0 for none
+   standin_handler_t handler;         // NULL for none
+   void *            handler_ctx;
+   void            (*thread_init)(void); // called first on every thread the stand-in starts.  NULL for none
+} standin_params_t;
+
+typedef struct {
+   enum wrp_msg_type msg_type;     // REQ, EVENT or a CRUD type
+   uint32_t          count;        // messages sent
+   uint32_t          payload_size;
+   uint32_t          window;       // messages sent and not yet answered at most.  0 for no limit
+   bool              answered;     // wait for every message to be answered
+   uint32_t          timeout_ms;   // longest wait for an answer.  0 to use default value (5000)
+} standin_load_t;
+
+typedef struct {
+   uint32_t sent;
+   uint32_t answered;
+   uint64_t elapsed_ns;  // from the first send to the last answer (or the last send when answers are not awaited)
+   uint64_t rtt_p50_ns;
+   uint64_t rtt_p99_ns;
+   uint64_t rtt_p999_ns;
+   uint64_t rtt_max_ns;
+} standin_load_result_t;
+
+standin_t *standin_start(const standin_params_t *params);
+void       standin_stop(standin_t *standin);
+// Returns the number of times service_name registered
+uint32_t   standin_registrations(standin_t *standin, const char *service_name);
+bool       standin_wait_registered(standin_t *standin, const char *service_name, uint32_t count, uint32_t timeout_ms);
+// Returns the number of messages of msg_type received from clients
+uint64_t   standin_received(standin_t *standin, enum wrp_msg_type msg_type);
+// Sends msg to the client registered for service_name
+bool       standin_send(standin_t *standin, const char *service_name, const wrp_msg_t *msg);
+// Sends load->count messages of load->msg_type to service_name.  The transaction_uuid of requests and CRUD messages and the
+// source of events are "standin-<n>"; an answer is a message from the client carrying the same uuid, or an event whose dest is
+// that source.  Returns false when service_name is not registered, a send fails or an awaited answer does not arrive in time.
+bool       standin_load(standin_t *standin, const char *service_name, const standin_load_t *load, standin_load_result_t *result);
+uint64_t   standin_time_ns(void);
+
+#endif
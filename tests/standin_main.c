@@ -0,0 +1,150 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "paroduscl.h"
+#include "standin.h"
+
+// Runs the loopback parodus stand-in on its own, so a client under development can be pointed at it and so tests can kill and
+// restart it.  With -n it generates traffic for the service once it registers and prints the results.
+
+static volatile sig_atomic_t standin_main_stop;
+
+static void standin_main_signal(int signum);
+static bool standin_main_msg_type(const char *name, enum wrp_msg_type *msg_type);
+static void standin_main_usage(const char *name);
+
+int main(int argc, char *argv[]) {
+   standin_params_t params;
+   standin_load_t   load;
+   const char *     service_name = NULL;
+   int              opt;
+
+   memset(&params, 0, sizeof(params));
+   memset(&load, 0, sizeof(load));
+   load.msg_type     = WRP_MSG_TYPE__REQ;
+   load.count        = 1000;
+   load.payload_size = 64;
+   load.window       = 16;
+
+   while((opt = getopt(argc, argv, "p:s:a:n:t:c:z:w:h")) != -1) {
+      switch(opt) {
+         case 'p': { params.url_parodus     = optarg;       break; }
+         case 's': { params.auth_status     = atoi(optarg); break; }
+         case 'a': { params.alive_period_ms = atoi(optarg); break; }
+         case 'n': { service_name           = optarg;       break; }
+         case 'c': { load.count             = atoi(optarg); break; }
+         case 'z': { load.payload_size      = atoi(optarg); break; }
+         case 'w': { load.window            = atoi(optarg); break; }
+         case 't': {
+            if(!standin_main_msg_type(optarg, &load.msg_type)) {
+               standin_main_usage(argv[0]);
+               return(EXIT_FAILURE);
+            }
+            break;
+         }
+         default: {
+            standin_main_usage(argv[0]);
+            return(EXIT_FAILURE);
+         }
+      }
+   }
+   if(optind != argc) {
+      standin_main_usage(argv[0]);
+      return(EXIT_FAILURE);
+   }
+   load.answered = (load.msg_type != WRP_MSG_TYPE__EVENT);
+
+   struct sigaction action;
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = standin_main_signal;
+   sigaction(SIGINT, &action, NULL);
+   sigaction(SIGTERM, &action, NULL);
+
+   standin_t *standin = standin_start(&params);
+   if(standin == NULL) {
+      return(EXIT_FAILURE);
+   }
+   printf("standin: listening on <%s>\n", params.url_parodus ? params.url_parodus : PCL_URL_PARODUS_DEFAULT);
+   fflush(stdout);
+
+   int ret = EXIT_SUCCESS;
+   if(service_name != NULL) {
+      while(!standin_main_stop && !standin_wait_registered(standin, service_name, 1, 100));
+      if(!standin_main_stop) {
+         standin_load_result_t result;
+         if(!standin_load(standin, service_name, &load, &result)) {
+            ret = EXIT_FAILURE;
+         }
+         double seconds = result.elapsed_ns / 1e9;
+         printf("standin: sent %u answered %u in %.3f s, %.0f msgs/s, rtt p50 %.1f us p99 %.1f us p999 %.1f us\n", result.sent,
+                result.answered, seconds, seconds > 0 ? (load.answered ? result.answered : result.sent) / seconds : 0.0,
+                result.rtt_p50_ns / 1e3, result.rtt_p99_ns / 1e3, result.rtt_p999_ns / 1e3);
+      }
+   } else {
+      while(!standin_main_stop) {
+         pause();
+      }
+   }
+   standin_stop(standin);
+   return(ret);
+}
+
+void standin_main_signal(int signum) {
+   standin_main_stop = 1;
+}
+
+bool standin_main_msg_type(const char *name, enum wrp_msg_type *msg_type) {
+   const struct {
+      const char *      name;
+      enum wrp_msg_type msg_type;
+   } types[] = {
+      { "req",      WRP_MSG_TYPE__REQ      },
+      { "event",    WRP_MSG_TYPE__EVENT    },
+      { "create",   WRP_MSG_TYPE__CREATE   },
+      { "retrieve", WRP_MSG_TYPE__RETREIVE },
+      { "update",   WRP_MSG_TYPE__UPDATE   },
+      { "delete",   WRP_MSG_TYPE__DELETE   },
+   };
+   for(size_t index = 0; index < sizeof(types) / sizeof(types[0]); index++) {
+      if(strcmp(name, types[index].name) == 0) {
+         *msg_type = types[index].msg_type;
+         return(true);
+      }
+   }
+   return(false);
+}
+
+void standin_main_usage(const char *name) {
+   fprintf(stderr, "usage: %s [-p url] [-s status] [-a alive_ms] [-n service [-t type] [-c count] [-z size] [-w window]]\n", name);
+   fprintf(stderr, "  -p url       url to bind for registrations and client messages (default %s)\n", PCL_URL_PARODUS_DEFAULT);
+   fprintf(stderr, "  -s status    status of the AUTH answering each registration (default 200)\n");
+   fprintf(stderr, "  -a alive_ms  send SVC_ALIVE to every registered client this often, 0 for none (default)\n");
+   fprintf(stderr, "  -n service   send traffic to this service once it registers, then exit\n");
+   fprintf(stderr, "  -t type      req (default), event, create, retrieve, update or delete\n");
+   fprintf(stderr, "  -c count     messages to send (default 1000)\n");
+   fprintf(stderr, "  -z size      payload bytes per message (default 64)\n");
+   fprintf(stderr, "  -w window    messages outstanding at most, 0 for no limit (default 16)\n");
+}
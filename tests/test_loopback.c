@@ -0,0 +1,240 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include "paroduscl.h"
+#include "paroduscl_transport.h"
+#include "paroduscl_trace.h"
+#include "standin.h"
+#include "loopback.h"
+
+// Registers a client with the stand-in over each transport, then checks that AUTH and SVC_ALIVE arrive, that generated requests,
+// events and crud messages are answered and that messages the client sends reach the stand-in.  Also checks that the shared memory
+// transport's receive fd is readable exactly while messages are waiting, and that short-lived threads keep finding trace rings.
+
+#define TEST_LOAD_COUNT    (200)
+#define TEST_TRACE_THREADS (3 * PCL_TRACE_RING_QTY)
+#define TEST_TRACE_WAVE    (8)
+
+static void test_loopback(const char *transport);
+static void test_shm_fd(void);
+static bool test_readable(int fd);
+static void test_trace_threads(void);
+static void *test_trace_thread(void *arg);
+
+int main(int argc, char *argv[]) {
+   const char *transports[] = { "tcp", "ipc", "inproc", "shm" };
+
+   for(size_t index = 0; index < sizeof(transports) / sizeof(transports[0]); index++) {
+      test_loopback(transports[index]);
+   }
+   test_shm_fd();
+   test_trace_threads();
+   printf("test_loopback: %s\n", loopback_failures ? "FAIL" : "PASS");
+   return(loopback_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+void test_loopback(const char *transport) {
+   char url_parodus[LOOPBACK_URL_LEN_MAX];
+   char url_client[LOOPBACK_URL_LEN_MAX];
+   CHECK(loopback_urls(transport, "loopback", url_parodus, url_client));
+   printf("test_loopback: %s\n", transport);
+
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus     = url_parodus;
+   standin_params.alive_period_ms = 20;
+   standin_t *standin = standin_start(&standin_params);
+   CHECK(standin != NULL);
+   if(standin == NULL) {
+      return;
+   }
+
+   int          timeout_ms = 2000;
+   pcl_params_t params;
+   memset(&params, 0, sizeof(params));
+   params.service_name    = LOOPBACK_SERVICE;
+   params.url_parodus     = url_parodus;
+   params.url_client      = url_client;
+   params.timeout_recv_ms = &timeout_ms;
+   params.timeout_send_ms = &timeout_ms;
+   loopback_echo_params(&params);
+
+   int          errsv  = 0;
+   pcl_result_t result = pcl_init(&loopback_object, NULL, NULL, &errsv, &params);
+   CHECK(result == PCL_RESULT_SUCCESS);
+   if(result != PCL_RESULT_SUCCESS) {
+      standin_stop(standin);
+      return;
+   }
+   CHECK(loopback_run_start(loopback_object, NULL));
+   CHECK(standin_wait_registered(standin, LOOPBACK_SERVICE, 1, 2000));
+   CHECK(loopback_wait_authorized(loopback_object, 2000));
+
+   const enum wrp_msg_type types[] = { WRP_MSG_TYPE__REQ, WRP_MSG_TYPE__EVENT, WRP_MSG_TYPE__CREATE, WRP_MSG_TYPE__RETREIVE,
+                                       WRP_MSG_TYPE__UPDATE, WRP_MSG_TYPE__DELETE };
+   for(size_t index = 0; index < sizeof(types) / sizeof(types[0]); index++) {
+      standin_load_t load;
+      memset(&load, 0, sizeof(load));
+      load.msg_type     = types[index];
+      load.count        = TEST_LOAD_COUNT;
+      load.payload_size = 100;
+      load.window       = 8;
+      load.answered     = true;
+
+      standin_load_result_t load_result;
+      CHECK(standin_load(standin, LOOPBACK_SERVICE, &load, &load_result));
+      CHECK(load_result.sent == TEST_LOAD_COUNT);
+      CHECK(load_result.answered == TEST_LOAD_COUNT);
+      CHECK(load_result.rtt_p50_ns > 0 && load_result.rtt_p50_ns <= load_result.rtt_p999_ns);
+   }
+   CHECK(atomic_load(&loopback_handled) >= 6 * TEST_LOAD_COUNT);
+
+   // An event sent by the client on its own
+   wrp_msg_t event;
+   memset(&event, 0, sizeof(event));
+   event.msg_type         = WRP_MSG_TYPE__EVENT;
+   event.u.event.source   = LOOPBACK_SERVICE;
+   event.u.event.dest     = "event:device-status";
+   uint64_t events        = standin_received(standin, WRP_MSG_TYPE__EVENT);
+   CHECK(pcl_send(loopback_object, &event, &errsv) == PCL_RESULT_SUCCESS);
+   for(int wait = 0; wait < 200 && standin_received(standin, WRP_MSG_TYPE__EVENT) == events; wait++) {
+      usleep(5000);
+   }
+   CHECK(standin_received(standin, WRP_MSG_TYPE__EVENT) == events + 1);
+
+   for(int wait = 0; wait < 200 && atomic_load(&loopback_alive) == 0; wait++) {
+      usleep(5000);
+   }
+   CHECK(atomic_load(&loopback_alive) > 0);
+
+   loopback_run_stop();
+   CHECK(pcl_term(loopback_object, &errsv) == PCL_RESULT_SUCCESS);
+   loopback_object = NULL;
+   atomic_store(&loopback_handled, 0);
+   atomic_store(&loopback_alive, 0);
+   standin_stop(standin);
+   loopback_urls_cleanup(url_parodus, url_client);
+}
+
+void test_shm_fd(void) {
+   char url_recv[LOOPBACK_URL_LEN_MAX];
+   char url_send[LOOPBACK_URL_LEN_MAX];
+   CHECK(loopback_urls("shm", "fd", url_recv, url_send));
+   printf("test_loopback: shm fd\n");
+
+   int        errsv = 0;
+   pcl_sock_t recv;
+   pcl_sock_t send;
+   memset(&recv, 0, sizeof(recv));
+   memset(&send, 0, sizeof(send));
+   recv.timeout = 1000;
+   send.timeout = 1000;
+   CHECK(pcl_sock_open(&recv, url_recv, true, &errsv) == PCL_RESULT_SUCCESS);
+   CHECK(pcl_sock_open(&send, url_recv, false, &errsv) == PCL_RESULT_SUCCESS);
+   CHECK(!test_readable(recv.fd));
+
+   // The first message signals without anything having been read first
+   const char msg[] = "level";
+   CHECK(send.transport->send(&send, msg, sizeof(msg), 0) == (int)sizeof(msg));
+   CHECK(test_readable(recv.fd));
+   CHECK(send.transport->send(&send, msg, sizeof(msg), 0) == (int)sizeof(msg));
+
+   // Still readable while a message is left, cleared by the read that empties the ring
+   void *buf = NULL;
+   CHECK(recv.transport->recv(&recv, &buf, PCL_SOCK_DONTWAIT) == (int)sizeof(msg));
+   recv.transport->msg_free(buf);
+   CHECK(test_readable(recv.fd));
+   CHECK(recv.transport->recv(&recv, &buf, PCL_SOCK_DONTWAIT) == (int)sizeof(msg));
+   recv.transport->msg_free(buf);
+   CHECK(!test_readable(recv.fd));
+
+   CHECK(send.transport->send(&send, msg, sizeof(msg), 0) == (int)sizeof(msg));
+   CHECK(test_readable(recv.fd));
+   CHECK(recv.transport->recv(&recv, &buf, PCL_SOCK_DONTWAIT) == (int)sizeof(msg));
+   recv.transport->msg_free(buf);
+   CHECK(!test_readable(recv.fd));
+   CHECK(recv.transport->recv(&recv, &buf, PCL_SOCK_DONTWAIT) < 0 && errno == EAGAIN);
+
+   pcl_sock_close(&send);
+   pcl_sock_close(&recv);
+}
+
+bool test_readable(int fd) {
+   struct pollfd pfd = { .fd = fd, .events = POLLIN };
+   return(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN));
+}
+
+void test_trace_threads(void) {
+   char name[64];
+   int  errsv = 0;
+   snprintf(name, sizeof(name), "/paroduscl-%d-trace", (int)getpid());
+   printf("test_loopback: trace threads\n");
+   pcl_trace_t *trace = pcl_trace_open(name, 1, 0, &errsv);
+   CHECK(trace != NULL);
+   if(trace == NULL) {
+      return;
+   }
+
+   // Threads exiting in waves leave their rings to the next ones, so none of their spans are dropped
+   for(int started = 0; started < TEST_TRACE_THREADS; started += TEST_TRACE_WAVE) {
+      pthread_t threads[TEST_TRACE_WAVE];
+      for(int index = 0; index < TEST_TRACE_WAVE; index++) {
+         CHECK(pthread_create(&threads[index], NULL, test_trace_thread, trace) == 0);
+      }
+      for(int index = 0; index < TEST_TRACE_WAVE; index++) {
+         pthread_join(threads[index], NULL);
+      }
+   }
+
+   pcl_trace_reader_t reader;
+   bool               opened = pcl_trace_reader_open(&reader, name, false, &errsv);
+   CHECK(opened);
+   if(!opened) {
+      pcl_trace_close(trace);
+      return;
+   }
+   uint64_t spans = 0;
+   for(uint32_t ring = 0; ring < atomic_load(&reader.hdr->ring_used); ring++) {
+      pcl_trace_span_t span[64];
+      size_t           count;
+      while((count = pcl_trace_reader_next(&reader, ring, span, sizeof(span) / sizeof(span[0]), NULL)) > 0) {
+         spans += count;
+      }
+   }
+   CHECK(atomic_load(&reader.hdr->ring_used) <= PCL_TRACE_RING_QTY);
+   CHECK(atomic_load(&reader.hdr->dropped) == 0);
+   CHECK(spans == TEST_TRACE_THREADS);
+   pcl_trace_reader_close(&reader);
+   pcl_trace_close(trace);
+}
+
+void *test_trace_thread(void *arg) {
+   pcl_trace_ctx_t ctx = { .sampled = true, .msg_type = WRP_MSG_TYPE__EVENT };
+   pcl_trace_span((pcl_trace_t *)arg, &ctx, PCL_TRACE_HANDLER, pcl_trace_begin(&ctx));
+   return(NULL);
+}
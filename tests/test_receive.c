@@ -0,0 +1,381 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <semaphore.h>
+#include "paroduscl.h"
+#include "standin.h"
+#include "loopback.h"
+
+// Checks the receive path features that keep messages from reaching the handlers, driving them with messages sent by the stand-in
+// and counting what the echo handlers see.
+
+#define RECEIVE_DEST_PREFIX "mac:112233445566/" LOOPBACK_SERVICE "/"
+#define RECEIVE_SOURCE      "dns:standin/receive"
+#define RECEIVE_SHED_MS     (1000) // UPDATE deadline, long enough that only a message held back on purpose expires
+
+typedef struct {
+   standin_t *standin;
+   char       url_parodus[LOOPBACK_URL_LEN_MAX];
+   char       url_client[LOOPBACK_URL_LEN_MAX];
+} receive_peer_t;
+
+static atomic_uint             receive_chunks;
+static atomic_uint             receive_blocked;  // CREATE handlers waiting on receive_release
+static sem_t                   receive_release;
+static pcl_msg_handler_crud_t receive_handler_create_echo;
+
+static void test_retrieve_cache(void);
+static void test_stream_idempotency(void);
+static void test_shed_idempotency(void);
+static bool receive_open(receive_peer_t *peer, const char *tag, pcl_params_t *params);
+static void receive_close(receive_peer_t *peer);
+static bool receive_crud(receive_peer_t *peer, enum wrp_msg_type msg_type, const char *path, const char *uuid);
+static bool receive_wait(receive_peer_t *peer, enum wrp_msg_type msg_type, uint64_t count);
+static bool receive_req(receive_peer_t *peer, const char *path, const char *uuid, const char *chunk_header);
+static pcl_result_t receive_handler_stream(const pcl_stream_chunk_t *chunk, wrp_msg_t *msg, const pcl_msg_view_t *view);
+static pcl_result_t receive_handler_request_stream(struct wrp_req_msg *msg);
+static ssize_t      receive_reader(void *ctx, void *buf, size_t size);
+static pcl_result_t receive_handler_create_blocking(struct wrp_crud_msg *msg);
+
+int main(int argc, char *argv[]) {
+   test_retrieve_cache();
+   test_stream_idempotency();
+   test_shed_idempotency();
+   printf("test_receive: %s\n", loopback_failures ? "FAIL" : "PASS");
+   return(loopback_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+void test_retrieve_cache(void) {
+   receive_peer_t peer;
+   int            ttl_ms = 10000;
+   pcl_params_t   params;
+   memset(&params, 0, sizeof(params));
+   params.retrieve_cache_ttl_ms = &ttl_ms;
+   loopback_echo_params(&params);
+   printf("test_receive: retrieve cache\n");
+   if(!receive_open(&peer, "cache", &params)) {
+      return;
+   }
+
+   // Cache the responses for a path, the path above it and a sibling sharing its name as a prefix
+   const char *paths[] = { "config/wifi", "config", "configx" };
+   uint64_t    answers = 0;
+   for(size_t index = 0; index < sizeof(paths) / sizeof(paths[0]); index++) {
+      char uuid[32];
+      snprintf(uuid, sizeof(uuid), "cache-miss-%zu", index);
+      CHECK(receive_crud(&peer, WRP_MSG_TYPE__RETREIVE, paths[index], uuid));
+      CHECK(receive_wait(&peer, WRP_MSG_TYPE__RETREIVE, ++answers));
+   }
+   CHECK(atomic_load(&loopback_handled) == 3);
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__RETREIVE, "config/wifi/", "cache-hit"));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__RETREIVE, ++answers));
+   CHECK(atomic_load(&loopback_handled) == 3);
+
+   // A REQ to a cached path reaches its handler but leaves the cached response in place
+   CHECK(receive_req(&peer, "config/wifi", "cache-req", NULL));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__REQ, 1));
+   CHECK(atomic_load(&loopback_handled) == 4);
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__RETREIVE, "config/wifi", "cache-hit-req"));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__RETREIVE, ++answers));
+   CHECK(atomic_load(&loopback_handled) == 4);
+
+   // An UPDATE of config drops config and config/wifi but not configx
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__UPDATE, "config", "cache-update"));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__UPDATE, 1));
+   pcl_stats_t stats;
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.retrieve_cache_invalidated == 2);
+   CHECK(stats.retrieve_cache_hits == 2);
+
+   uint64_t handled = atomic_load(&loopback_handled);
+   for(size_t index = 0; index < sizeof(paths) / sizeof(paths[0]); index++) {
+      char uuid[32];
+      snprintf(uuid, sizeof(uuid), "cache-after-%zu", index);
+      CHECK(receive_crud(&peer, WRP_MSG_TYPE__RETREIVE, paths[index], uuid));
+      CHECK(receive_wait(&peer, WRP_MSG_TYPE__RETREIVE, ++answers));
+   }
+   CHECK(atomic_load(&loopback_handled) == handled + 2);
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.retrieve_cache_hits == 3);
+
+   // A DELETE below config/wifi drops the path above it again
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__DELETE, "config/wifi/ssid", "cache-delete"));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__DELETE, 1));
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.retrieve_cache_invalidated == 4);
+
+   receive_close(&peer);
+}
+
+void test_stream_idempotency(void) {
+   receive_peer_t peer;
+   int            window_ms  = 10000;
+   int            chunk_size = 16;
+   pcl_params_t   params;
+   memset(&params, 0, sizeof(params));
+   loopback_echo_params(&params);
+   params.idempotency_window_ms = &window_ms;
+   params.stream_chunk_size     = &chunk_size;
+   params.handler_stream        = receive_handler_stream;
+   params.handler_request       = receive_handler_request_stream;
+   printf("test_receive: stream idempotency\n");
+   if(!receive_open(&peer, "stream", &params)) {
+      return;
+   }
+
+   // The chunks of a received stream share its transaction_uuid without being taken as retries
+   char header[64];
+   for(int seq = 0; seq < 3; seq++) {
+      snprintf(header, sizeof(header), "%s: %08x %d %d", PCL_STREAM_HEADER, 1, seq, seq == 2);
+      CHECK(receive_req(&peer, "stream", "stream-in", header));
+   }
+   for(int wait = 0; wait < 400 && atomic_load(&receive_chunks) < 3; wait++) {
+      usleep(5000);
+   }
+   CHECK(atomic_load(&receive_chunks) == 3);
+   pcl_stats_t stats;
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.idempotency_suppressed == 0);
+   CHECK(stats.stream_chunks_recv == 3);
+
+   // A request answered with a stream: the first chunk must not be kept as the response to retries
+   uint64_t chunks_sent = stats.stream_chunks_sent;
+   CHECK(receive_req(&peer, "stream", "stream-out", NULL));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__REQ, 3));
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.stream_chunks_sent == chunks_sent + 3);
+   CHECK(receive_req(&peer, "stream", "stream-out", NULL));
+   for(int wait = 0; wait < 400; wait++) {
+      pcl_stats_get(loopback_object, &stats);
+      if(stats.idempotency_suppressed + stats.idempotency_replayed > 0) {
+         break;
+      }
+      usleep(5000);
+   }
+   CHECK(stats.idempotency_suppressed == 1);
+   CHECK(stats.idempotency_replayed == 0);
+   CHECK(atomic_load(&loopback_handled) == 1);
+
+   receive_close(&peer);
+}
+
+void test_shed_idempotency(void) {
+   receive_peer_t peer;
+   int            window_ms                           = 10000;
+   int            workers                             = 1;
+   int            deadline_ms[PCL_BATCH_MSG_TYPE_MAX] = { 0 };
+   bool           reject                              = true;
+   pcl_params_t   params;
+   memset(&params, 0, sizeof(params));
+   loopback_echo_params(&params);
+   deadline_ms[WRP_MSG_TYPE__UPDATE] = RECEIVE_SHED_MS;
+   receive_handler_create_echo       = params.handler_create;
+   params.handler_create             = receive_handler_create_blocking;
+   params.idempotency_window_ms      = &window_ms;
+   params.dispatch_workers           = &workers;
+   params.shed_deadline_ms           = deadline_ms;
+   params.shed_reject                = &reject;
+   printf("test_receive: shed idempotency\n");
+   if(!receive_open(&peer, "shed", &params)) {
+      return;
+   }
+
+   // A CREATE, which has no deadline, holds the only worker until the UPDATE queued behind it has expired.  The UPDATE is
+   // answered with 503, so its retry must be handled.
+   sem_init(&receive_release, 0, 0);
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__CREATE, "slow", "shed-slow"));
+   for(int wait = 0; wait < 400 && atomic_load(&receive_blocked) == 0; wait++) {
+      usleep(5000);
+   }
+   CHECK(atomic_load(&receive_blocked) == 1);
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__UPDATE, "config", "shed-retry"));
+   for(int wait = 0; wait < 400 && pcl_recv_backlog(loopback_object) == 0; wait++) {
+      usleep(5000);
+   }
+   CHECK(pcl_recv_backlog(loopback_object) == 1);
+   usleep((RECEIVE_SHED_MS + 100) * 1000); // only ages the queued UPDATE further
+   sem_post(&receive_release);
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__CREATE, 1));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__UPDATE, 1));
+   pcl_stats_t stats;
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.shed_expired == 1);
+   CHECK(stats.shed_rejected == 1);
+   CHECK(atomic_load(&loopback_handled) == 1);
+
+   CHECK(receive_crud(&peer, WRP_MSG_TYPE__UPDATE, "config", "shed-retry"));
+   CHECK(receive_wait(&peer, WRP_MSG_TYPE__UPDATE, 2));
+   CHECK(atomic_load(&loopback_handled) == 2);
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.idempotency_suppressed == 0);
+   CHECK(stats.shed_expired == 1);
+
+   // Messages for another service never reach a handler, so their retries are not suppressed either
+   wrp_msg_t msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_type                = WRP_MSG_TYPE__UPDATE;
+   msg.u.crud.source           = RECEIVE_SOURCE;
+   msg.u.crud.dest             = "mac:112233445566/other/config";
+   msg.u.crud.transaction_uuid = "shed-other";
+   for(int send = 0; send < 2; send++) {
+      CHECK(standin_send(peer.standin, LOOPBACK_SERVICE, &msg));
+   }
+   for(int wait = 0; wait < 400; wait++) {
+      pcl_stats_get(loopback_object, &stats);
+      if(stats.result[PCL_RESULT_ERROR_SOCK_RECV_SVCNAME] >= 2) {
+         break;
+      }
+      usleep(5000);
+   }
+   CHECK(stats.result[PCL_RESULT_ERROR_SOCK_RECV_SVCNAME] == 2);
+   CHECK(stats.idempotency_suppressed == 0);
+
+   receive_close(&peer);
+   sem_destroy(&receive_release);
+}
+
+bool receive_open(receive_peer_t *peer, const char *tag, pcl_params_t *params) {
+   memset(peer, 0, sizeof(*peer));
+   CHECK(loopback_urls("ipc", tag, peer->url_parodus, peer->url_client));
+
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus = peer->url_parodus;
+   peer->standin = standin_start(&standin_params);
+   CHECK(peer->standin != NULL);
+   if(peer->standin == NULL) {
+      return(false);
+   }
+
+   int timeout_ms = 2000;
+   params->service_name    = LOOPBACK_SERVICE;
+   params->url_parodus     = peer->url_parodus;
+   params->url_client      = peer->url_client;
+   params->timeout_recv_ms = &timeout_ms;
+   params->timeout_send_ms = &timeout_ms;
+
+   int          errsv  = 0;
+   pcl_result_t result = pcl_init(&loopback_object, NULL, NULL, &errsv, params);
+   CHECK(result == PCL_RESULT_SUCCESS);
+   if(result != PCL_RESULT_SUCCESS) {
+      standin_stop(peer->standin);
+      return(false);
+   }
+   CHECK(loopback_run_start(loopback_object, NULL));
+   CHECK(standin_wait_registered(peer->standin, LOOPBACK_SERVICE, 1, 2000));
+   CHECK(loopback_wait_authorized(loopback_object, 2000));
+   atomic_store(&loopback_handled, 0);
+   return(true);
+}
+
+void receive_close(receive_peer_t *peer) {
+   loopback_run_stop();
+   CHECK(pcl_term(loopback_object, NULL) == PCL_RESULT_SUCCESS);
+   loopback_object = NULL;
+   atomic_store(&loopback_handled, 0);
+   atomic_store(&loopback_alive, 0);
+   standin_stop(peer->standin);
+   loopback_urls_cleanup(peer->url_parodus, peer->url_client);
+}
+
+bool receive_crud(receive_peer_t *peer, enum wrp_msg_type msg_type, const char *path, const char *uuid) {
+   char dest[LOOPBACK_URL_LEN_MAX];
+   snprintf(dest, sizeof(dest), RECEIVE_DEST_PREFIX "%s", path);
+
+   wrp_msg_t msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_type                = msg_type;
+   msg.u.crud.source           = RECEIVE_SOURCE;
+   msg.u.crud.dest             = dest;
+   msg.u.crud.transaction_uuid = (char *)uuid;
+   msg.u.crud.path             = (char *)path;
+   return(standin_send(peer->standin, LOOPBACK_SERVICE, &msg));
+}
+
+bool receive_wait(receive_peer_t *peer, enum wrp_msg_type msg_type, uint64_t count) {
+   for(int wait = 0; wait < 400 && standin_received(peer->standin, msg_type) < count; wait++) {
+      usleep(5000);
+   }
+   return(standin_received(peer->standin, msg_type) == count);
+}
+
+bool receive_req(receive_peer_t *peer, const char *path, const char *uuid, const char *chunk_header) {
+   char dest[LOOPBACK_URL_LEN_MAX];
+   snprintf(dest, sizeof(dest), RECEIVE_DEST_PREFIX "%s", path);
+
+   char       payload[] = "0123456789abcdef";
+   char       buf[sizeof(headers_t) + sizeof(char *)];
+   headers_t *headers   = (headers_t *)buf;
+   headers->count      = 1;
+   headers->headers[0] = (char *)chunk_header;
+
+   wrp_msg_t msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_type               = WRP_MSG_TYPE__REQ;
+   msg.u.req.source           = RECEIVE_SOURCE;
+   msg.u.req.dest             = dest;
+   msg.u.req.transaction_uuid = (char *)uuid;
+   msg.u.req.headers          = (chunk_header != NULL) ? headers : NULL;
+   msg.u.req.payload          = payload;
+   msg.u.req.payload_size     = sizeof(payload) - 1;
+   return(standin_send(peer->standin, LOOPBACK_SERVICE, &msg));
+}
+
+pcl_result_t receive_handler_stream(const pcl_stream_chunk_t *chunk, wrp_msg_t *msg, const pcl_msg_view_t *view) {
+   atomic_fetch_add(&receive_chunks, 1);
+   return(PCL_RESULT_SUCCESS);
+}
+
+pcl_result_t receive_handler_request_stream(struct wrp_req_msg *msg) {
+   // Answers with three chunks
+   wrp_msg_t rsp;
+   memset(&rsp, 0, sizeof(rsp));
+   rsp.msg_type               = WRP_MSG_TYPE__REQ;
+   rsp.u.req.source           = msg->dest;
+   rsp.u.req.dest             = msg->source;
+   rsp.u.req.transaction_uuid = msg->transaction_uuid;
+   size_t remaining           = 40;
+   atomic_fetch_add(&loopback_handled, 1);
+   return(pcl_send_stream(loopback_object, &rsp, receive_reader, &remaining, NULL));
+}
+
+ssize_t receive_reader(void *ctx, void *buf, size_t size) {
+   size_t *remaining = (size_t *)ctx;
+   size_t  len       = (size < *remaining) ? size : *remaining;
+   memset(buf, 'c', len);
+   *remaining -= len;
+   return((ssize_t)len);
+}
+
+pcl_result_t receive_handler_create_blocking(struct wrp_crud_msg *msg) {
+   // Bounded so a failing test still ends
+   struct timespec deadline;
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += 10;
+   atomic_fetch_add(&receive_blocked, 1);
+   sem_timedwait(&receive_release, &deadline);
+   return((*receive_handler_create_echo)(msg));
+}
@@ -0,0 +1,249 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "paroduscl.h"
+#include "standin.h"
+#include "loopback.h"
+
+// Starts the paroduscl_standin program, lets a client register with it in the background, kills it and starts a stand-in again
+// on the same url.  Checks that the client notices the loss, holds what it sends meanwhile, registers again and then delivers the
+// held messages and answers traffic as before.  Also checks that a client started before the stand-in registers once it appears.
+
+#define RESTART_STANDIN    "./paroduscl_standin" // make check runs the tests from the build directory
+#define RESTART_ALIVE_MS   (20)
+#define RESTART_TIMEOUT_MS (200)                 // alive_timeout_ms, ten missed SVC_ALIVE messages
+#define RESTART_HELD       (5)
+
+extern char **environ;
+
+static atomic_uint restart_ready;
+
+static void  test_restart(const char *standin_path, const char *transport);
+static void  test_init_async(void);
+static pid_t restart_spawn(const char *standin_path, const char *url_parodus);
+static void  restart_handler_ready(int auth_status, uint32_t time_to_authorized_ms);
+
+int main(int argc, char *argv[]) {
+   const char *standin_path = (argc > 1) ? argv[1] : RESTART_STANDIN;
+   const char *transports[] = { "tcp", "ipc", "shm" };
+
+   for(size_t index = 0; index < sizeof(transports) / sizeof(transports[0]); index++) {
+      test_restart(standin_path, transports[index]);
+   }
+   test_init_async();
+   printf("test_restart: %s\n", loopback_failures ? "FAIL" : "PASS");
+   return(loopback_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+void test_restart(const char *standin_path, const char *transport) {
+   char url_parodus[LOOPBACK_URL_LEN_MAX];
+   char url_client[LOOPBACK_URL_LEN_MAX];
+   CHECK(loopback_urls(transport, "restart", url_parodus, url_client));
+   printf("test_restart: %s\n", transport);
+
+   pid_t pid = restart_spawn(standin_path, url_parodus);
+   CHECK(pid > 0);
+   if(pid <= 0) {
+      return;
+   }
+
+   // The stand-in may not be listening yet, so registration is left to the background
+   bool         init_async    = true;
+   int          timeout_ms    = 2000;
+   int          alive_timeout = RESTART_TIMEOUT_MS;
+   int          replay_depth  = 2 * RESTART_HELD;
+   pcl_params_t params;
+   memset(&params, 0, sizeof(params));
+   params.service_name     = LOOPBACK_SERVICE;
+   params.url_parodus      = url_parodus;
+   params.url_client       = url_client;
+   params.timeout_recv_ms  = &timeout_ms;
+   params.timeout_send_ms  = &timeout_ms;
+   params.init_async       = &init_async;
+   params.alive_timeout_ms = &alive_timeout;
+   params.replay_depth     = &replay_depth;
+   loopback_echo_params(&params);
+
+   int          errsv  = 0;
+   pcl_result_t result = pcl_init(&loopback_object, NULL, NULL, &errsv, &params);
+   CHECK(result == PCL_RESULT_SUCCESS);
+   if(result != PCL_RESULT_SUCCESS) {
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      return;
+   }
+   CHECK(loopback_run_start(loopback_object, NULL));
+   CHECK(loopback_wait_authorized(loopback_object, 5000));
+   for(int wait = 0; wait < 200 && atomic_load(&loopback_alive) == 0; wait++) {
+      usleep(5000);
+   }
+   CHECK(atomic_load(&loopback_alive) > 0);
+
+   // Without SVC_ALIVE the client takes parodus as lost within alive_timeout_ms
+   CHECK(kill(pid, SIGKILL) == 0);
+   CHECK(waitpid(pid, NULL, 0) == pid);
+   for(int wait = 0; wait < 400 && pcl_service_authorized(loopback_object, LOOPBACK_SERVICE, NULL); wait++) {
+      usleep(5000);
+   }
+   CHECK(!pcl_service_authorized(loopback_object, LOOPBACK_SERVICE, NULL));
+   pcl_stats_t stats;
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.reconnects >= 1);
+
+   // Held until parodus is back
+   wrp_msg_t event;
+   memset(&event, 0, sizeof(event));
+   event.msg_type       = WRP_MSG_TYPE__EVENT;
+   event.u.event.source = LOOPBACK_SERVICE;
+   event.u.event.dest   = "event:restart";
+   for(int index = 0; index < RESTART_HELD; index++) {
+      CHECK(pcl_send(loopback_object, &event, &errsv) == PCL_RESULT_SUCCESS);
+   }
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.replay_held == RESTART_HELD);
+
+   if(strcmp(transport, "ipc") == 0) {
+      unlink(&url_parodus[strlen("ipc://")]); // left behind by the killed stand-in
+   }
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus     = url_parodus;
+   standin_params.alive_period_ms = RESTART_ALIVE_MS;
+   standin_t *standin = standin_start(&standin_params);
+   CHECK(standin != NULL);
+   if(standin != NULL) {
+      CHECK(standin_wait_registered(standin, LOOPBACK_SERVICE, 1, 5000));
+      CHECK(loopback_wait_authorized(loopback_object, 5000));
+      for(int wait = 0; wait < 400 && standin_received(standin, WRP_MSG_TYPE__EVENT) < RESTART_HELD; wait++) {
+         usleep(5000);
+      }
+      CHECK(standin_received(standin, WRP_MSG_TYPE__EVENT) == RESTART_HELD);
+
+      standin_load_t load;
+      memset(&load, 0, sizeof(load));
+      load.msg_type     = WRP_MSG_TYPE__REQ;
+      load.count        = 100;
+      load.payload_size = 64;
+      load.window       = 8;
+      load.answered     = true;
+      standin_load_result_t load_result;
+      CHECK(standin_load(standin, LOOPBACK_SERVICE, &load, &load_result));
+      CHECK(load_result.answered == load.count);
+   }
+   pcl_stats_get(loopback_object, &stats);
+   CHECK(stats.replay_dropped == 0);
+   printf("test_restart: %llu reconnects, %llu held\n", (unsigned long long)stats.reconnects, (unsigned long long)stats.replay_held);
+
+   loopback_run_stop();
+   CHECK(pcl_term(loopback_object, &errsv) == PCL_RESULT_SUCCESS);
+   loopback_object = NULL;
+   atomic_store(&loopback_handled, 0);
+   atomic_store(&loopback_alive, 0);
+   if(standin != NULL) {
+      standin_stop(standin);
+   }
+   loopback_urls_cleanup(url_parodus, url_client);
+}
+
+void test_init_async(void) {
+   char url_parodus[LOOPBACK_URL_LEN_MAX];
+   char url_client[LOOPBACK_URL_LEN_MAX];
+   CHECK(loopback_urls("ipc", "async", url_parodus, url_client));
+   printf("test_restart: init_async\n");
+
+   // Nothing is listening on url_parodus yet
+   bool         init_async = true;
+   int          timeout_ms = 2000;
+   pcl_params_t params;
+   memset(&params, 0, sizeof(params));
+   params.service_name    = LOOPBACK_SERVICE;
+   params.url_parodus     = url_parodus;
+   params.url_client      = url_client;
+   params.timeout_recv_ms = &timeout_ms;
+   params.timeout_send_ms = &timeout_ms;
+   params.init_async      = &init_async;
+   params.handler_ready   = restart_handler_ready;
+   loopback_echo_params(&params);
+
+   int          errsv    = 0;
+   uint64_t     begin_ns = standin_time_ns();
+   pcl_result_t result   = pcl_init(&loopback_object, NULL, NULL, &errsv, &params);
+   CHECK(result == PCL_RESULT_SUCCESS);
+   if(result != PCL_RESULT_SUCCESS) {
+      return;
+   }
+   CHECK(standin_time_ns() - begin_ns < (uint64_t)timeout_ms * 1000000);
+   CHECK(!pcl_service_authorized(loopback_object, LOOPBACK_SERVICE, NULL));
+   CHECK(loopback_run_start(loopback_object, NULL));
+   usleep(100000); // a few registration retries fail first
+
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus = url_parodus;
+   standin_t *standin = standin_start(&standin_params);
+   CHECK(standin != NULL);
+   if(standin != NULL) {
+      CHECK(standin_wait_registered(standin, LOOPBACK_SERVICE, 1, 5000));
+      CHECK(loopback_wait_authorized(loopback_object, 5000));
+      for(int wait = 0; wait < 200 && atomic_load(&restart_ready) == 0; wait++) {
+         usleep(5000);
+      }
+      CHECK(atomic_load(&restart_ready) == 1);
+      pcl_stats_t stats;
+      pcl_stats_get(loopback_object, &stats);
+      CHECK(stats.time_to_authorized_us >= 100000);
+   }
+
+   loopback_run_stop();
+   CHECK(pcl_term(loopback_object, &errsv) == PCL_RESULT_SUCCESS);
+   loopback_object = NULL;
+   atomic_store(&loopback_handled, 0);
+   atomic_store(&loopback_alive, 0);
+   if(standin != NULL) {
+      standin_stop(standin);
+   }
+   loopback_urls_cleanup(url_parodus, url_client);
+}
+
+void restart_handler_ready(int auth_status, uint32_t time_to_authorized_ms) {
+   if(auth_status == 200) {
+      atomic_fetch_add(&restart_ready, 1);
+   }
+}
+
+pid_t restart_spawn(const char *standin_path, const char *url_parodus) {
+   char  alive[16];
+   snprintf(alive, sizeof(alive), "%d", RESTART_ALIVE_MS);
+   char *argv[] = { (char *)standin_path, "-p", (char *)url_parodus, "-a", alive, NULL };
+   pid_t pid;
+   if(posix_spawn(&pid, standin_path, NULL, NULL, argv, environ) != 0) {
+      printf("test_restart: cannot start %s\n", standin_path);
+      return(-1);
+   }
+   return(pid);
+}
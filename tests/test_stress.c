@@ -0,0 +1,262 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "paroduscl.h"
+#include "standin.h"
+#include "loopback.h"
+
+// Sends from 1, 2, 4 and 8 threads at once while another thread is blocked in pcl_recv, reporting how the send rate scales, then
+// calls pcl_term while pcl_run, streaming senders and dispatch workers are all busy and checks that every call returns.
+
+#define STRESS_SENDS        (40000)  // events sent per thread count, split between the threads
+#define STRESS_THREADS_MAX  (8)
+#define STRESS_REQUESTS     (2000)   // requests queued on the dispatch workers before pcl_term
+#define STRESS_STREAMS      (2)
+#define STRESS_TIMEOUT_MS   (30000)  // socket timeouts, long enough that only pcl_term ends a blocked call
+
+typedef struct {
+   uint32_t          count;
+   pthread_barrier_t *start;
+   pcl_result_t      result;
+} stress_sender_t;
+
+static atomic_uint  stress_recv_returns;
+static pcl_result_t stress_recv_result;
+static pcl_result_t stress_run_result;
+
+static void   stress_scaling(standin_t *standin);
+static void   stress_term(standin_t *standin);
+static void * stress_send_thread(void *data);
+static void * stress_recv_thread(void *data);
+static void * stress_run_thread(void *data);
+static void * stress_stream_thread(void *data);
+static ssize_t stress_reader(void *ctx, void *buf, size_t size);
+static bool   stress_wait_received(standin_t *standin, enum wrp_msg_type msg_type, uint64_t count);
+
+int main(int argc, char *argv[]) {
+   const char *transport = (argc > 1) ? argv[1] : "ipc";
+   char url_parodus[LOOPBACK_URL_LEN_MAX];
+   char url_client[LOOPBACK_URL_LEN_MAX];
+   CHECK(loopback_urls(transport, "stress", url_parodus, url_client));
+   printf("test_stress: %s\n", transport);
+
+   standin_params_t standin_params;
+   memset(&standin_params, 0, sizeof(standin_params));
+   standin_params.url_parodus = url_parodus;
+   standin_t *standin = standin_start(&standin_params);
+   CHECK(standin != NULL);
+   if(standin == NULL) {
+      return(EXIT_FAILURE);
+   }
+
+   int          timeout_ms  = STRESS_TIMEOUT_MS;
+   int          workers     = 4;
+   int          chunk_size  = 1024;
+   pcl_params_t params;
+   memset(&params, 0, sizeof(params));
+   params.service_name      = LOOPBACK_SERVICE;
+   params.url_parodus       = url_parodus;
+   params.url_client        = url_client;
+   params.timeout_recv_ms   = &timeout_ms;
+   params.timeout_send_ms   = &timeout_ms;
+   params.dispatch_workers  = &workers;
+   params.stream_chunk_size = &chunk_size;
+   loopback_echo_params(&params);
+
+   int          errsv  = 0;
+   pcl_result_t result = pcl_init(&loopback_object, NULL, NULL, &errsv, &params);
+   CHECK(result == PCL_RESULT_SUCCESS);
+   if(result == PCL_RESULT_SUCCESS) {
+      // The AUTH is read by the event loop, which is stopped again so that the sends below race a blocked pcl_recv instead
+      CHECK(loopback_run_start(loopback_object, NULL));
+      CHECK(standin_wait_registered(standin, LOOPBACK_SERVICE, 1, 2000));
+      CHECK(loopback_wait_authorized(loopback_object, 2000));
+      loopback_run_stop();
+
+      stress_scaling(standin);
+      stress_term(standin);
+      loopback_object = NULL;
+   }
+   standin_stop(standin);
+   loopback_urls_cleanup(url_parodus, url_client);
+   printf("test_stress: %s\n", loopback_failures ? "FAIL" : "PASS");
+   return(loopback_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+void stress_scaling(standin_t *standin) {
+   pthread_t receiver;
+   CHECK(pthread_create(&receiver, NULL, stress_recv_thread, NULL) == 0);
+   usleep(20000); // let it block
+
+   // Run up to STRESS_THREADS_MAX even on fewer cpus, oversubscribing must not collapse the rate either
+   printf("test_stress: %ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+   double rate_single = 0;
+   for(uint32_t threads = 1; threads <= STRESS_THREADS_MAX; threads *= 2) {
+      pthread_barrier_t start;
+      pthread_barrier_init(&start, NULL, threads + 1);
+      stress_sender_t senders[STRESS_THREADS_MAX];
+      pthread_t       ids[STRESS_THREADS_MAX];
+      for(uint32_t index = 0; index < threads; index++) {
+         senders[index].count  = STRESS_SENDS / threads;
+         senders[index].start  = &start;
+         senders[index].result = PCL_RESULT_SUCCESS;
+         CHECK(pthread_create(&ids[index], NULL, stress_send_thread, &senders[index]) == 0);
+      }
+      uint64_t received = standin_received(standin, WRP_MSG_TYPE__EVENT);
+      pthread_barrier_wait(&start);
+      uint64_t begin_ns = standin_time_ns();
+      for(uint32_t index = 0; index < threads; index++) {
+         pthread_join(ids[index], NULL);
+         CHECK(senders[index].result == PCL_RESULT_SUCCESS);
+      }
+      uint64_t elapsed_ns = standin_time_ns() - begin_ns;
+      pthread_barrier_destroy(&start);
+
+      uint64_t sent = (uint64_t)(STRESS_SENDS / threads) * threads;
+      double   rate = sent / ((elapsed_ns > 0) ? elapsed_ns / 1e9 : 1e-9);
+      if(threads == 1) {
+         rate_single = rate;
+      }
+      printf("test_stress: %u sender%s %10.0f msgs/s  x%.2f\n", threads, (threads == 1) ? " " : "s", rate, rate / rate_single);
+      CHECK(stress_wait_received(standin, WRP_MSG_TYPE__EVENT, received + sent));
+      // Senders share the socket, so the rate need not grow, but it must not collapse under contention.  Loose enough for a
+      // single loaded cpu, where the scheduler alone moves the rate by a factor of two.
+      CHECK(rate >= rate_single / 4);
+   }
+   // None of the sends waited for the blocked receiver
+   CHECK(atomic_load(&stress_recv_returns) == 0);
+
+   wrp_msg_t event;
+   memset(&event, 0, sizeof(event));
+   event.msg_type       = WRP_MSG_TYPE__EVENT;
+   event.u.event.source = "standin-wake";
+   event.u.event.dest   = "mac:112233445566/" LOOPBACK_SERVICE;
+   uint64_t echoes = standin_received(standin, WRP_MSG_TYPE__EVENT);
+   CHECK(standin_send(standin, LOOPBACK_SERVICE, &event));
+   pthread_join(receiver, NULL);
+   CHECK(atomic_load(&stress_recv_returns) == 1);
+   CHECK(stress_recv_result == PCL_RESULT_SUCCESS);
+   // A dispatch worker echoes the event, wait for it so that only requests are handled from here on
+   CHECK(stress_wait_received(standin, WRP_MSG_TYPE__EVENT, echoes + 1));
+}
+
+void stress_term(standin_t *standin) {
+   // Each thread makes a single call that lasts until pcl_term, so none of them can call in after the object is freed
+   pthread_t runner;
+   pthread_t streams[STRESS_STREAMS];
+   pcl_result_t stream_results[STRESS_STREAMS];
+   CHECK(pthread_create(&runner, NULL, stress_run_thread, NULL) == 0);
+   for(uint32_t index = 0; index < STRESS_STREAMS; index++) {
+      CHECK(pthread_create(&streams[index], NULL, stress_stream_thread, &stream_results[index]) == 0);
+   }
+
+   uint64_t handled_before = atomic_load(&loopback_handled);
+   uint64_t answers        = standin_received(standin, WRP_MSG_TYPE__REQ);
+   standin_load_t load;
+   memset(&load, 0, sizeof(load));
+   load.msg_type     = WRP_MSG_TYPE__REQ;
+   load.count        = STRESS_REQUESTS;
+   load.payload_size = 100;
+   standin_load_result_t load_result;
+   CHECK(standin_load(standin, LOOPBACK_SERVICE, &load, &load_result));
+   for(int wait = 0; wait < 1000 && atomic_load(&loopback_handled) == handled_before; wait++) {
+      usleep(1000);
+   }
+
+   int      errsv    = 0;
+   uint64_t begin_ns = standin_time_ns();
+   CHECK(pcl_term(loopback_object, &errsv) == PCL_RESULT_SUCCESS);
+   uint64_t elapsed_ns = standin_time_ns() - begin_ns;
+   printf("test_stress: pcl_term %.1f ms with %llu of %u requests handled\n", elapsed_ns / 1e6,
+          (unsigned long long)(atomic_load(&loopback_handled) - handled_before), STRESS_REQUESTS);
+   // Blocked calls were woken rather than left to time out
+   CHECK(elapsed_ns < (uint64_t)STRESS_TIMEOUT_MS * 1000000);
+
+   pthread_join(runner, NULL);
+   CHECK(stress_run_result == PCL_RESULT_ERROR_CLOSED);
+   for(uint32_t index = 0; index < STRESS_STREAMS; index++) {
+      pthread_join(streams[index], NULL);
+      CHECK(stream_results[index] != PCL_RESULT_SUCCESS);
+   }
+   // Handlers the workers had started sent their responses before the send side closed
+   uint64_t handled = atomic_load(&loopback_handled) - handled_before;
+   CHECK(stress_wait_received(standin, WRP_MSG_TYPE__REQ, answers + handled));
+}
+
+void *stress_send_thread(void *data) {
+   stress_sender_t *sender = (stress_sender_t *)data;
+   char             payload[64];
+   memset(payload, 's', sizeof(payload));
+
+   wrp_msg_t event;
+   memset(&event, 0, sizeof(event));
+   event.msg_type             = WRP_MSG_TYPE__EVENT;
+   event.u.event.source       = LOOPBACK_SERVICE;
+   event.u.event.dest         = "event:stress";
+   event.u.event.payload      = payload;
+   event.u.event.payload_size = sizeof(payload);
+
+   pthread_barrier_wait(sender->start);
+   for(uint32_t index = 0; index < sender->count && sender->result == PCL_RESULT_SUCCESS; index++) {
+      sender->result = pcl_send(loopback_object, &event, NULL);
+   }
+   return(NULL);
+}
+
+void *stress_recv_thread(void *data) {
+   stress_recv_result = pcl_recv(loopback_object, NULL);
+   atomic_fetch_add(&stress_recv_returns, 1);
+   return(NULL);
+}
+
+void *stress_run_thread(void *data) {
+   stress_run_result = pcl_run(loopback_object, NULL);
+   return(NULL);
+}
+
+void *stress_stream_thread(void *data) {
+   wrp_msg_t event;
+   memset(&event, 0, sizeof(event));
+   event.msg_type       = WRP_MSG_TYPE__EVENT;
+   event.u.event.source = LOOPBACK_SERVICE;
+   event.u.event.dest   = "event:stress-stream";
+   *(pcl_result_t *)data = pcl_send_stream(loopback_object, &event, stress_reader, NULL, NULL);
+   return(NULL);
+}
+
+ssize_t stress_reader(void *ctx, void *buf, size_t size) {
+   // Never ends, so the stream is only stopped by pcl_term
+   memset(buf, 'r', size);
+   return((ssize_t)size);
+}
+
+bool stress_wait_received(standin_t *standin, enum wrp_msg_type msg_type, uint64_t count) {
+   for(int wait = 0; wait < 4000 && standin_received(standin, msg_type) < count; wait++) {
+      usleep(5000);
+   }
+   return(standin_received(standin, msg_type) >= count);
+}